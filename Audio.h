@@ -1,12 +1,13 @@
-
-
-
 #ifndef SCRATCH_FOP_AUDIO_H
 #define SCRATCH_FOP_AUDIO_H
 #include <SDL2/SDL_mixer.h>
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include "structs.h"
+#include "mixer.h"
+#include "synth.h"
+#include "asset_store.h"
 
 inline bool audio_init()
 {
@@ -26,188 +27,162 @@ inline bool audio_init()
         return false;
     }
 
-    Mix_AllocateChannels(32);
-    std::cout << "[Audio] SDL_mixer initialized OK\n";
+    if (!Mix_QuerySpec(&g_audioFreq, &g_audioFormat, &g_audioChannels))
+        std::cerr << "[Audio] Mix_QuerySpec failed: " << Mix_GetError() << "\n";
+
+    synth_init();
+    mixer_init();
+    std::cout << "[Audio] SDL_mixer initialized OK ("
+              << g_audioFreq << " Hz, " << g_audioChannels << " ch)\n";
     return true;
 }
 
 inline void audio_quit()
 {
+    mixer_quit();
     Mix_CloseAudio();
     Mix_Quit();
 }
 
+inline void audio_set_pcm_info(SoundClip& clip)
+{
+    clip.frames       = clip.pcm ? (Uint32)(clip.pcm->size() / PCM_CHANNELS) : 0;
+    clip.durationSecs = (float)clip.frames / (float)g_audioFreq;
+}
+
+// Reads the file but leaves decoding to the first play (asset_store.h).
 inline bool audio_load(SoundClip& clip)
 {
     if (clip.filePath.empty()) return false;
-    if (clip.chunk) {
-        Mix_FreeChunk(clip.chunk);
-        clip.chunk = nullptr;
-    }
 
-    clip.chunk = Mix_LoadWAV(clip.filePath.c_str());
-    if (!clip.chunk) {
-        std::cerr << "[Audio] Cannot load '" << clip.filePath
-                  << "': " << Mix_GetError() << "\n";
+    AssetBytes bytes = asset_read_file(clip.filePath);
+    if (!bytes) {
+        std::cerr << "[Audio] Cannot load '" << clip.filePath << "'\n";
         return false;
     }
 
-    clip.durationSecs = (float)clip.chunk->alen / (44100.0f * 2.0f * 2.0f);
+    clip.source = std::move(bytes);
+    clip.pcm.reset();
+    clip.peaks.clear();
+    clip.undoStack.clear();
+    clip.redoStack.clear();
+    clip.undoBytes = 0;
+    audio_set_pcm_info(clip);
     return true;
 }
 
-inline void audio_play(SoundClip& clip)
+inline bool audio_channel_active(int channel, Uint32 gen)
 {
-    if (!clip.chunk) {
-        std::cerr << "[Audio] No chunk loaded for '" << clip.name << "'\n";
-        return;
-    }
-
-    if (clip.isPlaying && clip.channel >= 0)
-        Mix_HaltChannel(clip.channel);
-
-    clip.channel   = Mix_PlayChannel(-1, clip.chunk, 0);
-    clip.isPlaying = (clip.channel >= 0);
-
-    if (clip.channel < 0)
-        std::cerr << "[Audio] Mix_PlayChannel failed: " << Mix_GetError() << "\n";
+    return mixer_voice_active(channel, gen);
 }
 
-inline void audio_stop(SoundClip& clip)
+inline bool audio_handle_active(const SoundHandle& h)
 {
-    if (clip.channel >= 0)
-        Mix_HaltChannel(clip.channel);
-    clip.isPlaying = false;
-    clip.channel   = -1;
+    return mixer_voice_active(h.channel, h.gen);
 }
 
-inline void audio_update(SoundsPanel& panel)
+inline void audio_gains(const SoundClip& clip, float& gainL, float& gainR)
 {
-    for (auto& s : panel.sounds) {
-        if (s.isPlaying && s.channel >= 0) {
-            if (!Mix_Playing(s.channel)) {
-                s.isPlaying = false;
-                s.channel   = -1;
-            }
-        }
-    }
+    float vol = std::max(0.0f, std::min(100.0f, clip.volume)) / 100.0f;
+    float pan = std::max(-100.0f, std::min(100.0f, clip.pan)) / 100.0f;
+    gainL = vol * (pan > 0.0f ? 1.0f - pan : 1.0f);
+    gainR = vol * (pan < 0.0f ? 1.0f + pan : 1.0f);
 }
 
-inline void audio_free_all(SoundsPanel& panel)
+inline SoundHandle audio_start(SoundClip& clip, int priority = MIXER_PRIO_NORMAL)
 {
-    for (auto& s : panel.sounds) {
-        if (s.chunk) {
-            Mix_FreeChunk(s.chunk);
-            s.chunk   = nullptr;
-            s.channel = -1;
-        }
+    SoundHandle h;
+    if (!asset_sound_materialize(clip)) return h;
+
+    float gl, gr;
+    audio_gains(clip, gl, gr);
+    h = mixer_play(clip.pcm, gl, gr, clip.pitch, priority);
+    if (h.channel < 0) {
+        std::cerr << "[Audio] No voice available for '" << clip.name << "'\n";
+        return h;
     }
-}
 
-#endif
-
-
-#ifndef SCRATCH_FOP_AUDIO_H
-#define SCRATCH_FOP_AUDIO_H
-#include <SDL2/SDL_mixer.h>
-#include <string>
-#include <iostream>
-#include "structs.h"
+    clip.channel    = h.channel;
+    clip.channelGen = h.gen;
+    clip.startFrame = audio_clock_frames();
+    clip.isPlaying  = true;
+    return h;
+}
 
-inline bool audio_init()
+inline void audio_play(SoundClip& clip, int priority = MIXER_PRIO_HIGH)
 {
-    if (SDL_Init(SDL_INIT_AUDIO) < 0) {
-        std::cerr << "[Audio] SDL_Init AUDIO failed: " << SDL_GetError() << "\n";
-        return false;
+    if (!asset_sound_materialize(clip)) {
+        std::cerr << "[Audio] No audio loaded for '" << clip.name << "'\n";
+        return;
     }
 
-    int flags = MIX_INIT_MP3 | MIX_INIT_OGG | MIX_INIT_FLAC;
-    int initted = Mix_Init(flags);
-    if ((initted & flags) != flags)
-        std::cerr << "[Audio] Mix_Init warning: " << Mix_GetError() << "\n";
-
+    if (clip.isPlaying)
+        mixer_stop({clip.channel, clip.channelGen});
 
-    if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0) {
-        std::cerr << "[Audio] Mix_OpenAudio failed: " << Mix_GetError() << "\n";
-        return false;
-    }
-
-    Mix_AllocateChannels(32);
-    std::cout << "[Audio] SDL_mixer initialized OK\n";
-    return true;
+    audio_start(clip, priority);
 }
 
-inline void audio_quit()
+inline void audio_stop(SoundClip& clip)
 {
-    Mix_CloseAudio();
-    Mix_Quit();
+    if (clip.isPlaying)
+        mixer_stop({clip.channel, clip.channelGen});
+    clip.isPlaying = false;
+    clip.channel   = -1;
 }
 
-inline bool audio_load(SoundClip& clip)
+inline void audio_apply_params(const SoundClip& clip)
 {
-    if (clip.filePath.empty()) return false;
-    if (clip.chunk) {
-        Mix_FreeChunk(clip.chunk);
-        clip.chunk = nullptr;
-    }
-
-    clip.chunk = Mix_LoadWAV(clip.filePath.c_str());
-    if (!clip.chunk) {
-        std::cerr << "[Audio] Cannot load '" << clip.filePath
-                  << "': " << Mix_GetError() << "\n";
-        return false;
-    }
-
-    clip.durationSecs = (float)clip.chunk->alen / (44100.0f * 2.0f * 2.0f);
-    return true;
+    if (!clip.isPlaying) return;
+    float gl, gr;
+    audio_gains(clip, gl, gr);
+    mixer_set_params({clip.channel, clip.channelGen}, gl, gr, clip.pitch);
 }
 
-inline void audio_play(SoundClip& clip)
+inline void audio_stop_all(SoundsPanel& panel)
 {
-    if (!clip.chunk) {
-        std::cerr << "[Audio] No chunk loaded for '" << clip.name << "'\n";
-        return;
+    mixer_stop_all();
+    synth_stop_all();
+    for (auto& s : panel.sounds) {
+        s.isPlaying = false;
+        s.channel   = -1;
     }
+}
 
-    if (clip.isPlaying && clip.channel >= 0)
-        Mix_HaltChannel(clip.channel);
-
-    clip.channel   = Mix_PlayChannel(-1, clip.chunk, 0);
-    clip.isPlaying = (clip.channel >= 0);
-
-    if (clip.channel < 0)
-        std::cerr << "[Audio] Mix_PlayChannel failed: " << Mix_GetError() << "\n";
+inline int audio_loudness()
+{
+    return g_audioLoudness.load(std::memory_order_relaxed);
 }
 
-inline void audio_stop(SoundClip& clip)
+inline float audio_play_position(const SoundClip& clip)
 {
-    if (clip.channel >= 0)
-        Mix_HaltChannel(clip.channel);
-    clip.isPlaying = false;
-    clip.channel   = -1;
+    if (!clip.isPlaying || clip.frames == 0) return 0.0f;
+    Uint64 played = audio_clock_frames() - clip.startFrame;
+    float pos = (float)played * clip.pitch / (float)clip.frames;
+    return pos > 1.0f ? 1.0f : pos;
 }
 
 inline void audio_update(SoundsPanel& panel)
 {
+    mixer_update();
     for (auto& s : panel.sounds) {
-        if (s.isPlaying && s.channel >= 0) {
-            if (!Mix_Playing(s.channel)) {
-                s.isPlaying = false;
-                s.channel   = -1;
-            }
+        if (s.isPlaying && !audio_channel_active(s.channel, s.channelGen)) {
+            s.isPlaying = false;
+            s.channel   = -1;
         }
     }
 }
 
 inline void audio_free_all(SoundsPanel& panel)
 {
+    audio_stop_all(panel);
     for (auto& s : panel.sounds) {
-        if (s.chunk) {
-            Mix_FreeChunk(s.chunk);
-            s.chunk   = nullptr;
-            s.channel = -1;
-        }
+        s.pcm.reset();
+        s.source.reset();
+        s.peaks.clear();
+        s.undoStack.clear();
+        s.redoStack.clear();
+        s.undoBytes = 0;
     }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -5,14 +5,17 @@
 #include <SDL2/SDL.h>
 #include "structs.h"
 #include "globals.h"
+#include "texture_manager.h"
 
 static SDL_Texture* g_penTrailTex = nullptr;
 
 inline void pen_trail_init(SDL_Renderer* r) {
-    g_penTrailTex = SDL_CreateTexture(r,
+    tex_destroy(g_penTrailTex);
+    g_penTrailTex = tex_create(r, TEX_PEN,
         SDL_PIXELFORMAT_ARGB8888,
         SDL_TEXTUREACCESS_TARGET,
         STAGE_WIDTH, STAGE_HEIGHT);
+    if (!g_penTrailTex) return;
     SDL_SetTextureBlendMode(g_penTrailTex, SDL_BLENDMODE_BLEND);
     SDL_SetRenderTarget(r, g_penTrailTex);
     SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
@@ -20,6 +23,11 @@ inline void pen_trail_init(SDL_Renderer* r) {
     SDL_SetRenderTarget(r, nullptr);
 }
 
+inline void pen_trail_quit() {
+    tex_destroy(g_penTrailTex);
+    g_penTrailTex = nullptr;
+}
+
 inline void pen_trail_clear(SDL_Renderer* r) {
     if (!g_penTrailTex) return;
     SDL_SetRenderTarget(r, g_penTrailTex);
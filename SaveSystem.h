@@ -5,13 +5,860 @@
 #include <fstream>
 #include <vector>
 #include <string>
-#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <SDL2/SDL.h>
+#include "structs.h"
+#include "utils.h"
+#include "tab_bar.h"
+#include "Audio.h"
+#include "sound_editor.h"
+#include "asset_store.h"
+#include "texture_manager.h"
 
-struct BlockData {
-    int type;
-    std::string opcode;
-    std::string value;
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary project layout (all offsets from file start, native byte order):
+//   SaveHeader | SaveBlockRec[] | SaveInputRec[] | SaveVarRec[]
+//   | SaveCostumeRec[] | SaveSoundRec[] | SaveAssetRec[] | blob | string table
+// Blocks are written script by script in pre-order, so every link (next,
+// C-block bodies, embedded reporters) is a forward index delta from the
+// owning record (0 means none) and loading is one pass over the records.
+// Strings are referenced by byte offset into the table, where each entry is
+// a Uint32 length followed by the bytes, padded to 4. Costumes and sounds
+// name their data by content hash (see asset_store.h); each distinct asset
+// has one SaveAssetRec and is stored once in the blob, as ARGB8888 pixels
+// or interleaved stereo S16 PCM.
+
+static const char   SAVE_MAGIC[4] = {'S', 'F', 'O', 'P'};
+static const Uint32 SAVE_VERSION  = 4;
+static const Uint32 SAVE_BOM      = 0x01020304;
+static const Uint32 SAVE_NONE     = 0xFFFFFFFFu;
+
+enum SaveBlockFlags {
+    SAVE_BLOCK_EMBEDDED = 1
+};
+
+struct SaveHeader {
+    char   magic[4];
+    Uint32 bom;
+    Uint32 version;
+    Uint32 headerSize;
+    Uint32 blockCount;
+    Uint32 blockOffset;
+    Uint32 inputCount;
+    Uint32 inputOffset;
+    Uint32 varCount;
+    Uint32 varOffset;
+    Uint32 costumeCount;
+    Uint32 costumeOffset;
+    Uint32 soundCount;
+    Uint32 soundOffset;
+    Uint32 assetCount;
+    Uint32 assetOffset;
+    Uint32 blobBytes;
+    Uint32 blobOffset;
+    Uint32 stringBytes;
+    Uint32 stringOffset;
+    Uint32 spriteName;
+    Sint32 currentCostume;
+    Uint32 epoch;
 };
 
+struct SaveBlockRec {
+    Sint32 id;
+    Sint32 x;
+    Sint32 y;
+    Uint32 text;
+    Uint16 type;
+    Uint16 inputCount;
+    Uint32 firstInput;
+    Uint32 next;
+    Uint32 innerFirst;
+    Uint32 elseFirst;
+    Uint32 flags;
+};
+
+struct SaveInputRec {
+    Uint32 value;
+    Uint32 slotType;
+    Uint32 embedded;
+};
+
+struct SaveVarRec {
+    Uint32 name;
+    float  value;
+    Uint32 show;
+};
+
+// Hashes are split into halves so records stay 4-byte aligned.
+struct SaveCostumeRec {
+    Uint32 name;
+    Sint32 w;
+    Sint32 h;
+    Uint32 hashLo;
+    Uint32 hashHi;
+};
+
+struct SaveSoundRec {
+    Uint32 name;
+    Uint32 path;
+    float  volume;
+    float  pitch;
+    float  pan;
+    Uint32 frames;
+    Uint32 hashLo;
+    Uint32 hashHi;
+};
+
+struct SaveAssetRec {
+    Uint32 hashLo;
+    Uint32 hashHi;
+    Uint32 offset;
+    Uint32 bytes;
+};
+
+inline Uint64 save_hash(Uint32 lo, Uint32 hi) { return (Uint64)hi << 32 | lo; }
+
+static_assert(sizeof(SaveHeader)     == 92, "SaveHeader layout");
+static_assert(sizeof(SaveBlockRec)   == 40, "SaveBlockRec layout");
+static_assert(sizeof(SaveInputRec)   == 12, "SaveInputRec layout");
+static_assert(sizeof(SaveVarRec)     == 12, "SaveVarRec layout");
+static_assert(sizeof(SaveCostumeRec) == 20, "SaveCostumeRec layout");
+static_assert(sizeof(SaveSoundRec)   == 32, "SaveSoundRec layout");
+static_assert(sizeof(SaveAssetRec)   == 16, "SaveAssetRec layout");
+
+struct SaveStringTable {
+    std::vector<Uint8> bytes;
+    std::unordered_map<std::string, Uint32> offsets;
+
+    Uint32 intern(const std::string& s) {
+        auto it = offsets.find(s);
+        if (it != offsets.end()) return it->second;
+        Uint32 off = (Uint32)bytes.size();
+        Uint32 len = (Uint32)s.size();
+        bytes.resize(off + 4 + ((len + 3) & ~3u), 0);
+        std::memcpy(bytes.data() + off, &len, 4);
+        std::memcpy(bytes.data() + off + 4, s.data(), len);
+        offsets.emplace(s, off);
+        return off;
+    }
+};
+
+struct MappedFile {
+    const Uint8* data = nullptr;
+    size_t       size = 0;
+#ifdef _WIN32
+    HANDLE file    = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int    fd      = -1;
+#endif
+};
+
+inline bool map_file(const std::string& path, MappedFile& mf)
+{
+#ifdef _WIN32
+    mf.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mf.file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(mf.file, &sz) || sz.QuadPart == 0) {
+        CloseHandle(mf.file); mf.file = INVALID_HANDLE_VALUE;
+        return false;
+    }
+    mf.size    = (size_t)sz.QuadPart;
+    mf.mapping = CreateFileMappingA(mf.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mf.mapping)
+        mf.data = (const Uint8*)MapViewOfFile(mf.mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!mf.data) {
+        if (mf.mapping) CloseHandle(mf.mapping);
+        CloseHandle(mf.file);
+        mf = MappedFile{};
+        return false;
+    }
+    return true;
+#else
+    mf.fd = open(path.c_str(), O_RDONLY);
+    if (mf.fd < 0) return false;
+    struct stat st;
+    if (fstat(mf.fd, &st) != 0 || st.st_size == 0) {
+        close(mf.fd); mf.fd = -1;
+        return false;
+    }
+    mf.size = (size_t)st.st_size;
+    void* p = mmap(nullptr, mf.size, PROT_READ, MAP_PRIVATE, mf.fd, 0);
+    if (p == MAP_FAILED) {
+        close(mf.fd);
+        mf = MappedFile{};
+        return false;
+    }
+    mf.data = (const Uint8*)p;
+    return true;
+#endif
+}
+
+inline void unmap_file(MappedFile& mf)
+{
+#ifdef _WIN32
+    if (mf.data)    UnmapViewOfFile(mf.data);
+    if (mf.mapping) CloseHandle(mf.mapping);
+    if (mf.file != INVALID_HANDLE_VALUE) CloseHandle(mf.file);
+#else
+    if (mf.data) munmap((void*)mf.data, mf.size);
+    if (mf.fd >= 0) close(mf.fd);
+#endif
+    mf = MappedFile{};
+}
+
+// Everything a save needs, detached from the live workspace: block graph
+// records and strings are copied, costume pixels and sound PCM are shared
+// immutable buffers. Safe to hand to another thread once built.
+struct SaveSnapshot {
+    SaveStringTable             strings;
+    std::vector<SaveBlockRec>   blocks;
+    std::vector<SaveInputRec>   inputs;
+    std::vector<SaveVarRec>     vars;
+    std::vector<SaveCostumeRec> costumes;
+    std::vector<std::shared_ptr<const std::vector<Uint32>>> costumePixels;
+    std::vector<SaveSoundRec>   sounds;
+    std::vector<PcmBuffer>      soundPcm;
+    // Encoded sources; decoded by the writer when the asset is cold.
+    std::vector<AssetBytes>     costumeSource;
+    std::vector<AssetBytes>     soundSource;
+    Uint32 spriteName     = 0;
+    Sint32 currentCostume = 0;
+    Uint32 epoch          = 0;
+};
+
+static Uint32 save_emit_chain(SaveSnapshot& s, const Block* head);
+
+// Writes b, then its embedded reporters and C-block bodies right after it,
+// patching the forward deltas once the children's indices are known.
+static Uint32 save_emit_block(SaveSnapshot& s, const Block* b, Uint32 flags)
+{
+    Uint32 idx = (Uint32)s.blocks.size();
+    SaveBlockRec rec;
+    rec.id         = b->id;
+    rec.x          = b->x;
+    rec.y          = b->y;
+    rec.text       = s.strings.intern(b->text);
+    rec.type       = (Uint16)b->type;
+    rec.inputCount = (Uint16)b->inputs.size();
+    rec.firstInput = (Uint32)s.inputs.size();
+    rec.next       = 0;
+    rec.innerFirst = 0;
+    rec.elseFirst  = 0;
+    rec.flags      = flags;
+    s.blocks.push_back(rec);
+
+    for (const auto& inp : b->inputs)
+        s.inputs.push_back({s.strings.intern(inp.value), (Uint32)inp.slotType, 0});
+
+    for (size_t k = 0; k < b->inputs.size(); k++) {
+        if (!b->inputs[k].embeddedBlock) continue;
+        Uint32 e = save_emit_block(s, b->inputs[k].embeddedBlock, SAVE_BLOCK_EMBEDDED);
+        s.inputs[rec.firstInput + k].embedded = e - idx;
+    }
+    if (b->innerFirst) s.blocks[idx].innerFirst = save_emit_chain(s, b->innerFirst) - idx;
+    if (b->elseFirst)  s.blocks[idx].elseFirst  = save_emit_chain(s, b->elseFirst)  - idx;
+    return idx;
+}
+
+static Uint32 save_emit_chain(SaveSnapshot& s, const Block* head)
+{
+    Uint32 first = (Uint32)s.blocks.size();
+    Uint32 prev  = SAVE_NONE;
+    for (const Block* b = head; b; b = b->next) {
+        Uint32 idx = save_emit_block(s, b, 0);
+        if (prev != SAVE_NONE) s.blocks[prev].next = idx - prev;
+        prev = idx;
+    }
+    return first;
+}
+
+// Reads a texture back through a render target, as the costume editor does.
+static bool save_read_texture(SDL_Renderer* r, SDL_Texture* tex, int w, int h,
+                              std::vector<Uint32>& out)
+{
+    if (!r || !tex || w <= 0 || h <= 0) return false;
+    SDL_Texture* target = tex_create(r, TEX_SCRATCH, SDL_PIXELFORMAT_ARGB8888,
+                                     SDL_TEXTUREACCESS_TARGET, w, h);
+    if (!target) return false;
+
+    SDL_BlendMode mode = SDL_BLENDMODE_BLEND;
+    SDL_GetTextureBlendMode(tex, &mode);
+    SDL_Texture* prevTarget = SDL_GetRenderTarget(r);
+    SDL_SetRenderTarget(r, target);
+    SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+    SDL_RenderClear(r);
+    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_NONE);
+    SDL_RenderCopy(r, tex, nullptr, nullptr);
+    SDL_SetTextureBlendMode(tex, mode);
+
+    out.resize((size_t)w * h);
+    bool ok = SDL_RenderReadPixels(r, nullptr, SDL_PIXELFORMAT_ARGB8888,
+                                   out.data(), w * 4) == 0;
+    SDL_SetRenderTarget(r, prevTarget);
+    tex_destroy(target);
+    return ok;
+}
+
+// Costume pixels are cached on the costume until its texture is replaced,
+// so only new or edited costumes pay for a GPU readback.
+inline void save_cache_costume_pixels(SDL_Renderer* r, Costume& c)
+{
+    if (!c.texture || (c.pixels && c.pixelsTex == c.texture)) return;
+    int tw = c.w, th = c.h;
+    SDL_QueryTexture(c.texture, nullptr, nullptr, &tw, &th);
+    auto px = std::make_shared<std::vector<Uint32>>();
+    if (!save_read_texture(r, c.texture, tw, th, *px)) return;
+    c.w         = tw;
+    c.h         = th;
+    c.pixels    = px;
+    c.pixelsTex = c.texture;
+}
+
+inline void save_snapshot(SaveSnapshot& s,
+                          const std::vector<Block*>& wsBlocks,
+                          const VariablesPanel& vars,
+                          Sprite& sprite,
+                          const SoundsPanel& sounds,
+                          SDL_Renderer* r)
+{
+    s.blocks.reserve(wsBlocks.size());
+    s.inputs.reserve(wsBlocks.size() * 2);
+
+    std::unordered_set<const Block*> bodies;
+    for (const Block* b : wsBlocks) {
+        if (!b) continue;
+        if (b->innerFirst) bodies.insert(b->innerFirst);
+        if (b->elseFirst)  bodies.insert(b->elseFirst);
+    }
+    for (const Block* b : wsBlocks) {
+        if (!b || b->prev || bodies.count(b)) continue;
+        save_emit_chain(s, b);
+    }
+    size_t statements = 0;
+    for (const auto& rec : s.blocks)
+        if (!(rec.flags & SAVE_BLOCK_EMBEDDED)) statements++;
+    if (statements != wsBlocks.size())
+        std::cerr << "[Save] " << wsBlocks.size() - std::min(statements, wsBlocks.size())
+                  << " detached block(s) not reachable from a script were skipped\n";
+
+    for (const auto& v : vars.variables)
+        s.vars.push_back({s.strings.intern(v.name), v.value, v.showOnStage ? 1u : 0u});
+
+    for (auto& c : sprite.costumes) {
+        save_cache_costume_pixels(r, c);
+        bool has = c.pixels && c.pixels->size() == (size_t)c.w * c.h;
+        Uint64 hash = has && c.pixelsTex == c.texture && !c.source ? c.hash : 0;
+        s.costumes.push_back({s.strings.intern(c.name), c.w, c.h, (Uint32)hash, (Uint32)(hash >> 32)});
+        s.costumePixels.push_back(has ? c.pixels : nullptr);
+        s.costumeSource.push_back(c.source);
+    }
+
+    for (const auto& clip : sounds.sounds) {
+        bool has = clip.pcm && !clip.pcm->empty();
+        s.sounds.push_back({s.strings.intern(clip.name), s.strings.intern(clip.filePath),
+                            clip.volume, clip.pitch, clip.pan,
+                            has ? (Uint32)(clip.pcm->size() / PCM_CHANNELS) : clip.source ? clip.frames : 0,
+                            0, 0});
+        s.soundPcm.push_back(has ? clip.pcm : nullptr);
+        s.soundSource.push_back(clip.source);
+    }
+
+    s.spriteName     = s.strings.intern(sprite.name);
+    s.currentCostume = sprite.currentCostume;
+}
+
+inline bool save_sync_file(FILE* f)
+{
+    if (fflush(f) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// Replaces path with tmp in one step, so readers see the old file or the
+// new one and never a partial write.
+inline bool save_replace_file(const std::string& tmp, const std::string& path)
+{
+#ifdef _WIN32
+    return MoveFileExA(tmp.c_str(), path.c_str(),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (rename(tmp.c_str(), path.c_str()) != 0) return false;
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    return true;
+#endif
+}
+
+// Streams the snapshot to path+".tmp", fsyncs it and renames it over path.
+// Touches no UI state, so it may run on a worker thread.
+inline bool save_write_snapshot(const SaveSnapshot& s, const std::string& path)
+{
+    std::vector<SaveCostumeRec> costumes = s.costumes;
+    std::vector<SaveSoundRec>   sounds   = s.sounds;
+    std::vector<std::shared_ptr<const std::vector<Uint32>>> costumePixels = s.costumePixels;
+    std::vector<PcmBuffer> soundPcm = s.soundPcm;
+
+    // Cold assets are decoded here rather than on the UI thread.
+    for (size_t i = 0; i < costumes.size(); i++) {
+        if (costumePixels[i] || !s.costumeSource[i]) continue;
+        AssetDecoded d;
+        d.source = s.costumeSource[i];
+        asset_decode(d);
+        if (!d.pixels) continue;
+        costumePixels[i]   = d.pixels;
+        costumes[i].w      = d.w;
+        costumes[i].h      = d.h;
+        costumes[i].hashLo = (Uint32)d.hash;
+        costumes[i].hashHi = (Uint32)(d.hash >> 32);
+    }
+    for (size_t i = 0; i < sounds.size(); i++) {
+        if (soundPcm[i] || !s.soundSource[i]) continue;
+        AssetDecoded d;
+        d.source = s.soundSource[i];
+        d.sound  = true;
+        asset_decode(d);
+        if (!d.pcm || d.pcm->empty()) continue;
+        soundPcm[i]      = d.pcm;
+        sounds[i].frames = (Uint32)(d.pcm->size() / PCM_CHANNELS);
+    }
+
+    // One blob entry per distinct content hash. Costumes edited since they
+    // were last interned get hashed here, off the UI thread.
+    std::vector<SaveAssetRec> assets;
+    std::vector<const std::vector<Uint32>*> assetPixels;
+    std::vector<const std::vector<float>*>  assetPcm;
+    std::unordered_map<Uint64, size_t> byHash;
+    Uint32 blobBytes = 0;
+    auto add = [&](Uint64 hash, const std::vector<Uint32>* px, const std::vector<float>* pcm,
+                   Uint32 bytes) {
+        for (;;) {
+            auto it = byHash.find(hash);
+            if (it == byHash.end()) break;
+            size_t k = it->second;
+            if (px && assetPixels[k] && assetPixels[k]->size() == px->size() &&
+                std::memcmp(assetPixels[k]->data(), px->data(), px->size() * 4) == 0)
+                return hash;
+            if (pcm && assetPcm[k] && assetPcm[k]->size() == pcm->size() &&
+                std::memcmp(assetPcm[k]->data(), pcm->data(), pcm->size() * 4) == 0)
+                return hash;
+            hash = hash * ASSET_P1 + 1;
+        }
+        byHash[hash] = assets.size();
+        assets.push_back({(Uint32)hash, (Uint32)(hash >> 32), blobBytes, bytes});
+        assetPixels.push_back(px);
+        assetPcm.push_back(pcm);
+        blobBytes += (bytes + 3) & ~3u;
+        return hash;
+    };
+    for (size_t i = 0; i < costumes.size(); i++) {
+        const auto& px = costumePixels[i];
+        if (!px) continue;
+        SaveCostumeRec& c = costumes[i];
+        Uint64 hash = save_hash(c.hashLo, c.hashHi);
+        if (!hash) hash = asset_image_hash(px->data(), c.w, c.h);
+        hash = add(hash, px.get(), nullptr, (Uint32)(px->size() * sizeof(Uint32)));
+        c.hashLo = (Uint32)hash;
+        c.hashHi = (Uint32)(hash >> 32);
+    }
+    for (size_t i = 0; i < sounds.size(); i++) {
+        const auto& pcm = soundPcm[i];
+        if (!pcm) continue;
+        SaveSoundRec& rec = sounds[i];
+        Uint64 hash = add(asset_pcm_hash(*pcm), nullptr, pcm.get(),
+                          (Uint32)(rec.frames * 2 * sizeof(Sint16)));
+        rec.hashLo = (Uint32)hash;
+        rec.hashHi = (Uint32)(hash >> 32);
+    }
+
+    SaveHeader h;
+    std::memcpy(h.magic, SAVE_MAGIC, 4);
+    h.bom            = SAVE_BOM;
+    h.version        = SAVE_VERSION;
+    h.headerSize     = sizeof(SaveHeader);
+    h.blockCount     = (Uint32)s.blocks.size();
+    h.blockOffset    = h.headerSize;
+    h.inputCount     = (Uint32)s.inputs.size();
+    h.inputOffset    = h.blockOffset + h.blockCount * (Uint32)sizeof(SaveBlockRec);
+    h.varCount       = (Uint32)s.vars.size();
+    h.varOffset      = h.inputOffset + h.inputCount * (Uint32)sizeof(SaveInputRec);
+    h.costumeCount   = (Uint32)costumes.size();
+    h.costumeOffset  = h.varOffset + h.varCount * (Uint32)sizeof(SaveVarRec);
+    h.soundCount     = (Uint32)sounds.size();
+    h.soundOffset    = h.costumeOffset + h.costumeCount * (Uint32)sizeof(SaveCostumeRec);
+    h.assetCount     = (Uint32)assets.size();
+    h.assetOffset    = h.soundOffset + h.soundCount * (Uint32)sizeof(SaveSoundRec);
+    h.blobBytes      = blobBytes;
+    h.blobOffset     = h.assetOffset + h.assetCount * (Uint32)sizeof(SaveAssetRec);
+    h.stringBytes    = (Uint32)s.strings.bytes.size();
+    h.stringOffset   = h.blobOffset + h.blobBytes;
+    h.spriteName     = s.spriteName;
+    h.currentCostume = s.currentCostume;
+    h.epoch          = s.epoch;
+
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        std::cerr << "[Save] Cannot open '" << tmp << "' for writing\n";
+        return false;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    auto put = [&](const void* data, size_t bytes) {
+        if (ok && bytes) ok = fwrite(data, 1, bytes, f) == bytes;
+    };
+    put(s.blocks.data(), s.blocks.size() * sizeof(SaveBlockRec));
+    put(s.inputs.data(), s.inputs.size() * sizeof(SaveInputRec));
+    put(s.vars.data(),   s.vars.size()   * sizeof(SaveVarRec));
+    put(costumes.data(), costumes.size() * sizeof(SaveCostumeRec));
+    put(sounds.data(),   sounds.size()   * sizeof(SaveSoundRec));
+    put(assets.data(),   assets.size()   * sizeof(SaveAssetRec));
+
+    std::vector<Sint16> pcm(MIXER_BUS_FRAMES * 2);
+    for (size_t k = 0; k < assets.size(); k++) {
+        if (assetPixels[k]) {
+            put(assetPixels[k]->data(), assets[k].bytes);
+            continue;
+        }
+        const std::vector<float>& buf = *assetPcm[k];
+        size_t n = buf.size() & ~(size_t)1;
+        for (size_t i = 0; i < n; i += pcm.size()) {
+            size_t c = std::min(pcm.size(), n - i);
+            mixer_float_to_s16(buf.data() + i, pcm.data(), (int)c);
+            put(pcm.data(), c * sizeof(Sint16));
+        }
+        static const Uint8 pad[4] = {0, 0, 0, 0};
+        put(pad, (4 - (n * sizeof(Sint16)) % 4) % 4);
+    }
+    put(s.strings.bytes.data(), s.strings.bytes.size());
+
+    ok = ok && save_sync_file(f);
+    ok = fclose(f) == 0 && ok;
+    if (ok) ok = save_replace_file(tmp, path);
+    if (!ok) {
+        std::cerr << "[Save] Writing '" << path << "' failed\n";
+        remove(tmp.c_str());
+    }
+    return ok;
+}
+
+inline bool save_project_binary(const std::string& path,
+                                const std::vector<Block*>& wsBlocks,
+                                const VariablesPanel& vars,
+                                Sprite& sprite,
+                                const SoundsPanel& sounds,
+                                SDL_Renderer* r)
+{
+    SaveSnapshot s;
+    save_snapshot(s, wsBlocks, vars, sprite, sounds, r);
+    return save_write_snapshot(s, path);
+}
+
+inline bool save_section_ok(const SaveHeader& h, size_t fileSize,
+                            Uint32 offset, Uint32 count, size_t recSize)
+{
+    return offset >= h.headerSize && offset <= fileSize &&
+           (size_t)count <= (fileSize - offset) / recSize;
+}
+
+inline bool save_string_at(const Uint8* table, Uint32 tableBytes, Uint32 off,
+                           std::string& out)
+{
+    if ((size_t)off + 4 > tableBytes) return false;
+    Uint32 len;
+    std::memcpy(&len, table + off, 4);
+    if ((size_t)len > (size_t)tableBytes - off - 4) return false;
+    out.assign((const char*)table + off + 4, len);
+    return true;
+}
+
+inline bool save_blob_ok(Uint32 blobBytes, Uint32 off, size_t bytes)
+{
+    return off != SAVE_NONE && off <= blobBytes && bytes <= (size_t)(blobBytes - off);
+}
+
+inline bool is_binary_project(const std::string& path)
+{
+    std::ifstream f(path, std::ios::binary);
+    char magic[4] = {};
+    return f.read(magic, 4) && std::memcmp(magic, SAVE_MAGIC, 4) == 0;
+}
+
+// Resolves a forward delta from record i, claiming the target so a corrupt
+// file cannot give one block two owners.
+static Block* save_link(std::vector<Block*>& loaded, std::vector<Uint8>& owned,
+                        const SaveBlockRec* recs, Uint32 i, Uint32 delta, bool embedded)
+{
+    if (delta == 0 || delta >= loaded.size() - i) return nullptr;
+    Uint32 j = i + delta;
+    if (owned[j] || ((recs[j].flags & SAVE_BLOCK_EMBEDDED) != 0) != embedded) return nullptr;
+    owned[j] = 1;
+    return loaded[j];
+}
+
+// Loads a binary project already in memory (4-byte aligned); `source` is
+// only used in log messages. Every offset and count is checked against `size`.
+inline bool load_project_memory(const Uint8* data, size_t size, const std::string& source,
+                                std::vector<Block*>& wsBlocks,
+                                VariablesPanel& vars,
+                                Sprite& sprite,
+                                SoundsPanel& sounds,
+                                SDL_Renderer* r,
+                                int& nextId,
+                                Uint32* epoch = nullptr)
+{
+    SaveHeader h;
+    bool ok = size >= sizeof(SaveHeader);
+    if (ok) {
+        std::memcpy(&h, data, sizeof(h));
+        ok = std::memcmp(h.magic, SAVE_MAGIC, 4) == 0 && h.bom == SAVE_BOM &&
+             h.headerSize >= sizeof(SaveHeader);
+    }
+    if (ok && h.version != SAVE_VERSION) {
+        std::cerr << "[Save] Unsupported project version " << h.version << "\n";
+        ok = false;
+    }
+    ok = ok &&
+         save_section_ok(h, size, h.blockOffset,   h.blockCount,   sizeof(SaveBlockRec)) &&
+         save_section_ok(h, size, h.inputOffset,   h.inputCount,   sizeof(SaveInputRec)) &&
+         save_section_ok(h, size, h.varOffset,     h.varCount,     sizeof(SaveVarRec)) &&
+         save_section_ok(h, size, h.costumeOffset, h.costumeCount, sizeof(SaveCostumeRec)) &&
+         save_section_ok(h, size, h.soundOffset,   h.soundCount,   sizeof(SaveSoundRec)) &&
+         save_section_ok(h, size, h.assetOffset,   h.assetCount,   sizeof(SaveAssetRec)) &&
+         save_section_ok(h, size, h.blobOffset,    h.blobBytes,    1) &&
+         save_section_ok(h, size, h.stringOffset,  h.stringBytes,  1) &&
+         ((h.blockOffset | h.inputOffset | h.varOffset | h.costumeOffset |
+           h.soundOffset | h.assetOffset | h.blobOffset) & 3) == 0;
+    if (!ok) {
+        std::cerr << "[Save] '" << source << "' is not a valid project file\n";
+        return false;
+    }
+
+    const SaveBlockRec*   recs  = (const SaveBlockRec*)(data + h.blockOffset);
+    const SaveInputRec*   inps  = (const SaveInputRec*)(data + h.inputOffset);
+    const SaveVarRec*     vrs   = (const SaveVarRec*)(data + h.varOffset);
+    const SaveCostumeRec* costs = (const SaveCostumeRec*)(data + h.costumeOffset);
+    const SaveSoundRec*   snds  = (const SaveSoundRec*)(data + h.soundOffset);
+    const SaveAssetRec*   asts  = (const SaveAssetRec*)(data + h.assetOffset);
+    const Uint8*          blob  = data + h.blobOffset;
+    const Uint8*          strs  = data + h.stringOffset;
+
+    std::unordered_map<Uint64, const SaveAssetRec*> assetByHash;
+    for (Uint32 i = 0; i < h.assetCount; i++)
+        if (save_blob_ok(h.blobBytes, asts[i].offset, asts[i].bytes))
+            assetByHash.emplace(save_hash(asts[i].hashLo, asts[i].hashHi), &asts[i]);
+    auto asset = [&](Uint32 lo, Uint32 hi, size_t bytes) -> const Uint8* {
+        auto it = assetByHash.find(save_hash(lo, hi));
+        if (it == assetByHash.end() || it->second->bytes != bytes) return nullptr;
+        return blob + it->second->offset;
+    };
+
+    for (auto* b : wsBlocks) block_free_reporters(b);
+    wsBlocks.clear();
+
+    std::vector<Block*> loaded(h.blockCount, nullptr);
+    std::vector<Uint8>  owned(h.blockCount, 0);
+    for (auto& b : loaded) b = block_alloc();
+
+    wsBlocks.reserve(h.blockCount);
+    for (Uint32 i = 0; i < h.blockCount; i++) {
+        const SaveBlockRec& rec = recs[i];
+        Block* b = loaded[i];
+        if (!save_string_at(strs, h.stringBytes, rec.text, b->text)) b->text.clear();
+        b->id          = rec.id;
+        if (rec.id >= nextId && rec.id < INT_MAX) nextId = rec.id + 1;
+        b->type        = rec.type <= BLOCK_MUSIC ? (BlockType)rec.type : BLOCK_EXTENSION;
+        b->x           = rec.x;
+        b->y           = rec.y;
+        b->h           = BLOCK_H;
+        b->isDragging  = false;
+        b->dragOffsetX = 0;
+        b->dragOffsetY = 0;
+        init_block_inputs(b);
+
+        for (Uint32 k = 0; k < rec.inputCount && k < b->inputs.size(); k++) {
+            Uint32 ii = rec.firstInput + k;
+            if (ii >= h.inputCount) break;
+            BlockInput& inp = b->inputs[k];
+            save_string_at(strs, h.stringBytes, inps[ii].value, inp.value);
+            inp.slotType      = inps[ii].slotType == SLOT_BOOLEAN ? SLOT_BOOLEAN : SLOT_NUMERIC;
+            inp.embeddedBlock = save_link(loaded, owned, recs, i, inps[ii].embedded, true);
+        }
+
+        // Reporters never own statements; linking them would leave the
+        // statement pointing at a reporter that may be freed below.
+        if (rec.flags & SAVE_BLOCK_EMBEDDED) continue;
+        if ((b->next = save_link(loaded, owned, recs, i, rec.next, false)))
+            b->next->prev = b;
+        b->innerFirst = save_link(loaded, owned, recs, i, rec.innerFirst, false);
+        b->elseFirst  = save_link(loaded, owned, recs, i, rec.elseFirst,  false);
+        b->innerLast  = b->innerFirst;
+        wsBlocks.push_back(b);
+    }
+
+    // Embedded reporters nobody claimed would otherwise leak.
+    for (Uint32 i = 0; i < h.blockCount; i++)
+        if ((recs[i].flags & SAVE_BLOCK_EMBEDDED) && !owned[i]) block_free_reporters(loaded[i]);
+
+    for (Block* b : wsBlocks)
+        while (b->innerLast && b->innerLast->next) b->innerLast = b->innerLast->next;
+
+    std::string name;
+    for (Uint32 i = 0; i < h.varCount; i++) {
+        if (!save_string_at(strs, h.stringBytes, vrs[i].name, name)) continue;
+        bool found = false;
+        for (auto& v : vars.variables) {
+            if (v.name == name) {
+                v.value       = vrs[i].value;
+                v.showOnStage = vrs[i].show != 0;
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            vars.variables.push_back({name, vrs[i].value, vrs[i].show != 0});
+    }
+
+    if (h.costumeCount) {
+        // The old costumes are released only afterwards, so images shared
+        // with them (reloading the open project) keep their textures.
+        std::vector<Costume> loadedCostumes;
+        for (Uint32 i = 0; i < h.costumeCount; i++) {
+            const SaveCostumeRec& rec = costs[i];
+            Costume c;
+            save_string_at(strs, h.stringBytes, rec.name, c.name);
+            c.w = rec.w;
+            c.h = rec.h;
+            const Uint8* px = rec.w > 0 && rec.h > 0 && rec.w <= 16384 && rec.h <= 16384
+                ? asset(rec.hashLo, rec.hashHi, (size_t)rec.w * rec.h * sizeof(Uint32)) : nullptr;
+            if (r && px)
+                asset_costume_load(r, c, (const Uint32*)px, rec.w, rec.h,
+                                   save_hash(rec.hashLo, rec.hashHi));
+            loadedCostumes.push_back(c);
+        }
+        asset_release_costumes(sprite);
+        sprite.costumes = std::move(loadedCostumes);
+        sprite.currentCostume = 0;
+        if (h.currentCostume >= 0 && h.currentCostume < (Sint32)sprite.costumes.size())
+            sprite.currentCostume = h.currentCostume;
+        sprite.texture = sprite.costumes[sprite.currentCostume].texture;
+    }
+    save_string_at(strs, h.stringBytes, h.spriteName, sprite.name);
+
+    if (h.soundCount) {
+        audio_free_all(sounds);
+        sounds.sounds.clear();
+        sounds.selectedIndex = -1;
+        std::unordered_map<Uint64, PcmBuffer> pcmByHash;
+        for (Uint32 i = 0; i < h.soundCount; i++) {
+            const SaveSoundRec& rec = snds[i];
+            SoundClip sc;
+            save_string_at(strs, h.stringBytes, rec.name, sc.name);
+            save_string_at(strs, h.stringBytes, rec.path, sc.filePath);
+            sc.volume    = rec.volume;
+            sc.pitch     = rec.pitch;
+            sc.pan       = rec.pan;
+            sc.channel   = -1;
+            sc.isPlaying = false;
+            const Uint8* data = rec.frames
+                ? asset(rec.hashLo, rec.hashHi, (size_t)rec.frames * 2 * sizeof(Sint16)) : nullptr;
+            if (data) {
+                // Sounds sharing a hash share one buffer; decode it once.
+                auto& done = pcmByHash[save_hash(rec.hashLo, rec.hashHi)];
+                if (!done) {
+                    auto pcm = std::make_shared<std::vector<float>>((size_t)rec.frames * 2);
+                    mixer_s16_to_float((const Sint16*)data, pcm->data(), (int)pcm->size());
+                    done = pcm;
+                    asset_pcm_intern(done);
+                }
+                sc.pcm = done;
+            }
+            audio_set_pcm_info(sc);
+            se_build_peaks(sc);
+            sounds.sounds.push_back(std::move(sc));
+        }
+    }
+
+    if (epoch) *epoch = h.epoch;
+    return true;
+}
+
+inline bool load_project_binary(const std::string& path,
+                                std::vector<Block*>& wsBlocks,
+                                VariablesPanel& vars,
+                                Sprite& sprite,
+                                SoundsPanel& sounds,
+                                SDL_Renderer* r,
+                                int& nextId,
+                                Uint32* epoch = nullptr)
+{
+    MappedFile mf;
+    if (!map_file(path, mf)) {
+        std::cerr << "[Save] Cannot map '" << path << "'\n";
+        return false;
+    }
+    bool ok = load_project_memory(mf.data, mf.size, path, wsBlocks, vars, sprite, sounds,
+                                  r, nextId, epoch);
+    unmap_file(mf);
+    return ok;
+}
+
+// Binary is the native format; a ".txt" path writes the legacy text export,
+// which only carries the scripts and variables.
+inline bool project_save(const std::string& path,
+                         const std::vector<Block*>& wsBlocks,
+                         const VariablesPanel& vars,
+                         Sprite& sprite,
+                         const SoundsPanel& sounds,
+                         SDL_Renderer* r)
+{
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".txt") == 0)
+        return save_project(path, wsBlocks, vars);
+    return save_project_binary(path, wsBlocks, vars, sprite, sounds, r);
+}
+
+inline bool project_load(const std::string& path,
+                         std::vector<Block*>& wsBlocks,
+                         VariablesPanel& vars,
+                         Sprite& sprite,
+                         SoundsPanel& sounds,
+                         SDL_Renderer* r,
+                         int& nextId,
+                         Uint32* epoch = nullptr)
+{
+    if (epoch) *epoch = 0;
+    if (is_binary_project(path))
+        return load_project_binary(path, wsBlocks, vars, sprite, sounds, r, nextId, epoch);
+    return load_project(path, wsBlocks, vars, nextId);
+}
 
-#endif
\ No newline at end of file
+#endif
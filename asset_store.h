@@ -0,0 +1,638 @@
+#ifndef SCRATCH_FOP_ASSET_STORE_H
+#define SCRATCH_FOP_ASSET_STORE_H
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include "structs.h"
+#include "mixer.h"
+#include "texture_manager.h"
+
+// Content-addressed store for costume images and sound PCM, keyed by the
+// xxHash64 of the decoded bytes. Costumes with identical pixels share one
+// texture and one pixel buffer, refcounted by the costumes holding them
+// (Costume::hash); identical PCM collapses onto one shared buffer. A
+// costume whose hash is 0 owns its texture outright.
+//
+// Costumes and sounds read from an encoded file keep those bytes as their
+// `source` and are decoded only when first used; see "Lazy decode" below.
+
+// ── xxHash64 ─────────────────────────────────────────────────
+
+static const Uint64 ASSET_P1 = 0x9E3779B185EBCA87ull;
+static const Uint64 ASSET_P2 = 0xC2B2AE3D27D4EB4Full;
+static const Uint64 ASSET_P3 = 0x165667B19E3779F9ull;
+static const Uint64 ASSET_P4 = 0x85EBCA77C2B2AE63ull;
+static const Uint64 ASSET_P5 = 0x27D4EB2F165667C5ull;
+
+static inline Uint64 asset_rotl(Uint64 x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline Uint64 asset_read64(const Uint8* p)
+{
+    Uint64 v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+static inline Uint32 asset_read32(const Uint8* p)
+{
+    Uint32 v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+static inline Uint64 asset_round(Uint64 acc, Uint64 in)
+{
+    acc += in * ASSET_P2;
+    return asset_rotl(acc, 31) * ASSET_P1;
+}
+
+static inline Uint64 asset_merge(Uint64 h, Uint64 v)
+{
+    h ^= asset_round(0, v);
+    return h * ASSET_P1 + ASSET_P4;
+}
+
+inline Uint64 asset_hash(const void* data, size_t bytes, Uint64 seed = 0)
+{
+    const Uint8* p   = (const Uint8*)data;
+    const Uint8* end = p + bytes;
+    Uint64 h;
+    if (bytes >= 32) {
+        Uint64 v1 = seed + ASSET_P1 + ASSET_P2, v2 = seed + ASSET_P2;
+        Uint64 v3 = seed, v4 = seed - ASSET_P1;
+        for (; end - p >= 32; p += 32) {
+            v1 = asset_round(v1, asset_read64(p));
+            v2 = asset_round(v2, asset_read64(p + 8));
+            v3 = asset_round(v3, asset_read64(p + 16));
+            v4 = asset_round(v4, asset_read64(p + 24));
+        }
+        h = asset_rotl(v1, 1) + asset_rotl(v2, 7) + asset_rotl(v3, 12) + asset_rotl(v4, 18);
+        h = asset_merge(h, v1);
+        h = asset_merge(h, v2);
+        h = asset_merge(h, v3);
+        h = asset_merge(h, v4);
+    } else {
+        h = seed + ASSET_P5;
+    }
+    h += (Uint64)bytes;
+    for (; end - p >= 8; p += 8)
+        h = asset_rotl(h ^ asset_round(0, asset_read64(p)), 27) * ASSET_P1 + ASSET_P4;
+    if (end - p >= 4) {
+        h = asset_rotl(h ^ (Uint64)asset_read32(p) * ASSET_P1, 23) * ASSET_P2 + ASSET_P3;
+        p += 4;
+    }
+    for (; p < end; p++)
+        h = asset_rotl(h ^ *p * ASSET_P5, 11) * ASSET_P1;
+    h ^= h >> 33;
+    h *= ASSET_P2;
+    h ^= h >> 29;
+    h *= ASSET_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// 0 means "not in the store", so no asset ever hashes to it.
+inline Uint64 asset_image_hash(const Uint32* px, int w, int h)
+{
+    Uint64 v = asset_hash(px, (size_t)w * h * sizeof(Uint32), (Uint64)(Uint32)w << 32 | (Uint32)h);
+    return v ? v : 1;
+}
+
+inline Uint64 asset_pcm_hash(const std::vector<float>& pcm)
+{
+    Uint64 v = asset_hash(pcm.data(), pcm.size() * sizeof(float));
+    return v ? v : 1;
+}
+
+// ── Store ────────────────────────────────────────────────────
+
+struct AssetImage {
+    std::shared_ptr<const std::vector<Uint32>> pixels;
+    SDL_Texture* texture = nullptr;
+    int          w = 0, h = 0;
+    int          refs = 0;
+};
+
+static std::unordered_map<Uint64, AssetImage> g_assetImages;
+static std::unordered_map<Uint64, std::weak_ptr<const std::vector<float>>> g_assetSounds;
+
+inline void asset_costume_release(Costume& c)
+{
+    if (c.hash) {
+        auto it = g_assetImages.find(c.hash);
+        if (it != g_assetImages.end() && --it->second.refs <= 0) {
+            tex_destroy(it->second.texture);
+            g_assetImages.erase(it);
+        }
+    } else if (c.texture) {
+        tex_destroy(c.texture);
+    }
+    c.texture   = nullptr;
+    c.pixelsTex = nullptr;
+    c.pixels.reset();
+    c.hash = 0;
+}
+
+inline void asset_release_costumes(Sprite& sprite)
+{
+    for (auto& c : sprite.costumes) asset_costume_release(c);
+    sprite.texture = nullptr;
+}
+
+static void asset_costume_attach(Costume& c, Uint64 hash, AssetImage& a)
+{
+    if (c.hash != hash) {
+        a.refs++;
+        asset_costume_release(c);
+        c.hash = hash;
+    }
+    c.texture   = a.texture;
+    c.pixels    = a.pixels;
+    c.pixelsTex = a.texture;
+    c.w         = a.w;
+    c.h         = a.h;
+}
+
+// The stored image under hash, if it really holds these pixels. A mismatch
+// (a collision, or a damaged file's hash) is reported through `clash`.
+static AssetImage* asset_image_lookup(Uint64 hash, const Uint32* px, int w, int h, bool& clash)
+{
+    clash = false;
+    auto it = g_assetImages.find(hash);
+    if (it == g_assetImages.end()) return nullptr;
+    AssetImage& a = it->second;
+    if (a.w == w && a.h == h &&
+        (a.pixels->data() == px ||
+         std::memcmp(a.pixels->data(), px, (size_t)w * h * sizeof(Uint32)) == 0))
+        return &a;
+    clash = true;
+    return nullptr;
+}
+
+static SDL_Texture* asset_upload(SDL_Renderer* r, const std::vector<Uint32>& px, int w, int h)
+{
+    SDL_Texture* tex = tex_create(r, TEX_COSTUME, SDL_PIXELFORMAT_ARGB8888,
+                                  SDL_TEXTUREACCESS_STATIC, w, h);
+    if (!tex) return nullptr;
+    SDL_UpdateTexture(tex, nullptr, px.data(), w * 4);
+    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+    return tex;
+}
+
+// Stored images keep their pixels when their texture is evicted.
+static bool asset_image_upload(SDL_Renderer* r, AssetImage& a)
+{
+    if (a.texture) return true;
+    if (!r) return false;
+    a.texture = asset_upload(r, *a.pixels, a.w, a.h);
+    if (a.texture) g_texReuploads++;
+    return a.texture != nullptr;
+}
+
+// Points c at the image with these ARGB8888 pixels, uploading it only if
+// the store does not already have it. Takes ownership of the buffer.
+inline bool asset_costume_set(SDL_Renderer* r, Costume& c,
+                              std::shared_ptr<const std::vector<Uint32>> px, int w, int h,
+                              Uint64 hash = 0)
+{
+    if (!px || w <= 0 || h <= 0 || px->size() != (size_t)w * h) return false;
+    if (!hash) hash = asset_image_hash(px->data(), w, h);
+    bool clash;
+    if (AssetImage* a = asset_image_lookup(hash, px->data(), w, h, clash)) {
+        if (!asset_image_upload(r, *a)) return false;
+        asset_costume_attach(c, hash, *a);
+        return true;
+    }
+
+    SDL_Texture* tex = asset_upload(r, *px, w, h);
+    if (!tex) return false;
+    if (clash) {
+        std::cerr << "[Assets] Hash clash on " << std::hex << hash << std::dec
+                  << ", keeping a private copy\n";
+        asset_costume_release(c);
+        c.texture   = tex;
+        c.pixels    = px;
+        c.pixelsTex = tex;
+        c.w         = w;
+        c.h         = h;
+        return true;
+    }
+    AssetImage& a = g_assetImages[hash];
+    a.pixels  = std::move(px);
+    a.texture = tex;
+    a.w       = w;
+    a.h       = h;
+    asset_costume_attach(c, hash, a);
+    return true;
+}
+
+// Same, for pixels the caller still owns (a mapped file, a surface); they
+// are only copied when the image is new.
+inline bool asset_costume_load(SDL_Renderer* r, Costume& c, const Uint32* px, int w, int h,
+                               Uint64 hash = 0)
+{
+    if (!px || w <= 0 || h <= 0) return false;
+    if (!hash) hash = asset_image_hash(px, w, h);
+    bool clash;
+    if (AssetImage* a = asset_image_lookup(hash, px, w, h, clash)) {
+        if (!asset_image_upload(r, *a)) return false;
+        asset_costume_attach(c, hash, *a);
+        return true;
+    }
+    auto copy = std::make_shared<std::vector<Uint32>>(px, px + (size_t)w * h);
+    return asset_costume_set(r, c, std::move(copy), w, h, clash ? 0 : hash);
+}
+
+inline bool asset_surface_pixels(SDL_Surface* s, std::vector<Uint32>& px, int& w, int& h)
+{
+    SDL_Surface* argb = SDL_ConvertSurfaceFormat(s, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (!argb) return false;
+    w = argb->w;
+    h = argb->h;
+    px.resize((size_t)w * h);
+    for (int y = 0; y < h; y++)
+        std::memcpy(px.data() + (size_t)y * w,
+                    (const Uint8*)argb->pixels + (size_t)y * argb->pitch, (size_t)w * 4);
+    SDL_FreeSurface(argb);
+    return true;
+}
+
+inline bool asset_costume_from_surface(SDL_Renderer* r, Costume& c, SDL_Surface* s)
+{
+    auto px = std::make_shared<std::vector<Uint32>>();
+    int w, h;
+    if (!asset_surface_pixels(s, *px, w, h)) return false;
+    return asset_costume_set(r, c, std::move(px), w, h);
+}
+
+// Swaps pcm for the stored buffer with the same samples, or records it as
+// the buffer for its hash.
+inline void asset_pcm_intern(PcmBuffer& pcm, Uint64 hash = 0)
+{
+    if (!pcm) return;
+    if (!hash) hash = asset_pcm_hash(*pcm);
+    auto& slot = g_assetSounds[hash];
+    PcmBuffer have = slot.lock();
+    if (have && have != pcm && have->size() == pcm->size() &&
+        std::memcmp(have->data(), pcm->data(), pcm->size() * sizeof(float)) == 0) {
+        pcm = have;
+        return;
+    }
+    if (!have) slot = pcm;
+
+    // Drop entries whose last user is gone so the map tracks live sounds.
+    if (g_assetSounds.size() > 64) {
+        for (auto it = g_assetSounds.begin(); it != g_assetSounds.end(); )
+            it = it->second.expired() ? g_assetSounds.erase(it) : std::next(it);
+    }
+}
+
+// ── Lazy decode ──────────────────────────────────────────────
+// A costume or sound with a source but no texture/PCM is cold. It is decoded
+// on first use (the stage, the editors, `switch costume`, `next costume`,
+// `play sound`), or earlier when a use is predicted: a worker decodes
+// prefetched sources and asset_pump() hands the results over on the main
+// thread, which owns the renderer. Decoded forms that still have their
+// source are dropped again, least recently used first, once they add up to
+// more than ASSET_DECODED_BUDGET. Edited assets lose their source and stay.
+
+static const size_t ASSET_DECODED_BUDGET = (size_t)96 << 20;
+
+inline AssetBytes asset_read_file(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return nullptr;
+    std::streamoff size = in.tellg();
+    if (size <= 0) return nullptr;
+    auto bytes = std::make_shared<std::vector<Uint8>>((size_t)size);
+    in.seekg(0);
+    if (!in.read((char*)bytes->data(), size)) return nullptr;
+    return bytes;
+}
+
+// Both decoders are safe to call off the main thread.
+inline bool asset_decode_image(const std::vector<Uint8>& bytes, std::vector<Uint32>& px,
+                               int& w, int& h)
+{
+    SDL_RWops* rw = SDL_RWFromConstMem(bytes.data(), (int)bytes.size());
+    if (!rw) return false;
+    SDL_Surface* s = IMG_Load_RW(rw, 1);
+    if (!s) return false;
+    bool ok = asset_surface_pixels(s, px, w, h);
+    SDL_FreeSurface(s);
+    return ok && w > 0 && h > 0;
+}
+
+inline PcmBuffer asset_decode_sound(const std::vector<Uint8>& bytes)
+{
+    SDL_RWops* rw = SDL_RWFromConstMem(bytes.data(), (int)bytes.size());
+    if (!rw) return nullptr;
+    Mix_Chunk* chunk = Mix_LoadWAV_RW(rw, 1);
+    if (!chunk) return nullptr;
+    PcmBuffer pcm = mixer_pcm_from_device(chunk->abuf, chunk->alen);
+    Mix_FreeChunk(chunk);
+    return pcm;
+}
+
+struct AssetDecoded {
+    AssetBytes source;
+    bool       sound = false;
+    std::shared_ptr<const std::vector<Uint32>> pixels;
+    int        w = 0, h = 0;
+    PcmBuffer  pcm;
+    Uint64     hash = 0;
+};
+
+inline void asset_decode(AssetDecoded& d)
+{
+    if (!d.source) return;
+    if (d.sound) {
+        d.pcm = asset_decode_sound(*d.source);
+        if (d.pcm) d.hash = asset_pcm_hash(*d.pcm);
+        return;
+    }
+    auto px = std::make_shared<std::vector<Uint32>>();
+    if (!asset_decode_image(*d.source, *px, d.w, d.h)) return;
+    d.hash   = asset_image_hash(px->data(), d.w, d.h);
+    d.pixels = std::move(px);
+}
+
+// Entries are keyed by the source buffer's address; each holds a reference
+// to its source, so the address cannot be reused while the entry exists.
+static std::mutex                 g_assetLock;
+static std::condition_variable    g_assetWake;
+static std::condition_variable    g_assetDone;
+static std::deque<AssetDecoded>   g_assetQueue;
+static std::unordered_set<const void*>               g_assetBusy;
+static std::unordered_map<const void*, AssetDecoded> g_assetReady;
+static std::thread g_assetWorker;
+static bool        g_assetQuit = false;
+static Uint32      g_assetTick = 0;
+static Uint32      g_assetTrimTick = 0;
+
+static void asset_worker()
+{
+    std::unique_lock<std::mutex> lock(g_assetLock);
+    for (;;) {
+        g_assetWake.wait(lock, [] { return g_assetQuit || !g_assetQueue.empty(); });
+        if (g_assetQuit) return;
+        AssetDecoded d = std::move(g_assetQueue.front());
+        g_assetQueue.pop_front();
+        lock.unlock();
+        asset_decode(d);
+        lock.lock();
+        const void* key = d.source.get();
+        g_assetBusy.erase(key);
+        g_assetReady[key] = std::move(d);
+        g_assetDone.notify_all();
+    }
+}
+
+inline void asset_prefetch(const AssetBytes& src, bool sound)
+{
+    if (!src) return;
+    std::lock_guard<std::mutex> lock(g_assetLock);
+    const void* key = src.get();
+    if (g_assetQuit || g_assetBusy.count(key) || g_assetReady.count(key)) return;
+    AssetDecoded d;
+    d.source = src;
+    d.sound  = sound;
+    g_assetQueue.push_back(std::move(d));
+    g_assetBusy.insert(key);
+    if (!g_assetWorker.joinable()) g_assetWorker = std::thread(asset_worker);
+    g_assetWake.notify_one();
+}
+
+// The decoded form of src: the worker's result if it has one, waiting for
+// it if it is mid-decode, otherwise decoded right here.
+static AssetDecoded asset_take(const AssetBytes& src, bool sound)
+{
+    const void* key = src.get();
+    {
+        std::unique_lock<std::mutex> lock(g_assetLock);
+        for (auto it = g_assetQueue.begin(); it != g_assetQueue.end(); ++it) {
+            if (it->source.get() != key) continue;
+            g_assetQueue.erase(it);
+            g_assetBusy.erase(key);
+            break;
+        }
+        g_assetDone.wait(lock, [key] { return !g_assetBusy.count(key); });
+        auto it = g_assetReady.find(key);
+        if (it != g_assetReady.end()) {
+            AssetDecoded d = std::move(it->second);
+            g_assetReady.erase(it);
+            return d;
+        }
+    }
+    AssetDecoded d;
+    d.source = src;
+    d.sound  = sound;
+    asset_decode(d);
+    return d;
+}
+
+static bool asset_costume_adopt(SDL_Renderer* r, Costume& c, const AssetDecoded& d)
+{
+    if (!d.pixels) {
+        std::cerr << "[Assets] Cannot decode costume '" << c.name << "'\n";
+        c.source.reset();
+        return false;
+    }
+    return asset_costume_set(r, c, d.pixels, d.w, d.h, d.hash);
+}
+
+static bool asset_sound_adopt(SoundClip& clip, const AssetDecoded& d)
+{
+    if (!d.pcm) {
+        std::cerr << "[Assets] Cannot decode sound '" << clip.name << "'\n";
+        clip.source.reset();
+        return false;
+    }
+    clip.pcm = d.pcm;
+    asset_pcm_intern(clip.pcm, d.hash);
+    clip.peaks.clear();
+    clip.frames       = (Uint32)(clip.pcm->size() / 2);
+    clip.durationSecs = (float)clip.frames / (float)g_audioFreq;
+    return true;
+}
+
+// Makes sure c has a texture: re-uploaded from its pixels if only the
+// texture was evicted, decoded from its source if it is cold.
+inline bool asset_costume_materialize(SDL_Renderer* r, Costume& c)
+{
+    c.lastUse = ++g_assetTick;
+    if (c.texture || !r) return c.texture != nullptr;
+    if (c.pixels && c.hash) {
+        auto it = g_assetImages.find(c.hash);
+        if (it != g_assetImages.end() && asset_image_upload(r, it->second)) {
+            c.texture = c.pixelsTex = it->second.texture;
+            return true;
+        }
+    } else if (c.pixels) {
+        c.texture = c.pixelsTex = asset_upload(r, *c.pixels, c.w, c.h);
+        if (c.texture) g_texReuploads++;
+        return c.texture != nullptr;
+    }
+    if (!c.source) return false;
+    return asset_costume_adopt(r, c, asset_take(c.source, false));
+}
+
+inline bool asset_sound_materialize(SoundClip& clip)
+{
+    clip.lastUse = ++g_assetTick;
+    if (clip.pcm || !clip.source) return clip.pcm != nullptr;
+    return asset_sound_adopt(clip, asset_take(clip.source, true));
+}
+
+inline void asset_costume_prefetch(const Costume& c)
+{
+    if (!c.texture && !c.pixels) asset_prefetch(c.source, false);
+}
+
+inline void asset_sound_prefetch(const SoundClip& clip)
+{
+    if (!clip.pcm) asset_prefetch(clip.source, true);
+}
+
+static void asset_trim(Sprite& sprite, SoundsPanel& sounds, int keep)
+{
+    struct Cold { Uint32 lastUse; Costume* costume; SoundClip* clip; size_t bytes; };
+    std::vector<Cold> drop;
+    std::unordered_set<Uint64> counted;
+    size_t total = 0;
+    for (int i = 0; i < (int)sprite.costumes.size(); i++) {
+        Costume& c = sprite.costumes[i];
+        if (!c.texture && !c.pixels) continue;
+        // The CPU copy of the pixels, plus the texture if it is resident.
+        size_t bytes = (size_t)c.w * c.h * (c.texture ? 8 : 4);
+        if (!c.hash || counted.insert(c.hash).second) total += bytes;
+        if (c.source && i != sprite.currentCostume && i != keep)
+            drop.push_back({c.lastUse, &c, nullptr, bytes});
+    }
+    for (auto& clip : sounds.sounds) {
+        if (!clip.pcm) continue;
+        size_t bytes = clip.pcm->size() * sizeof(float);
+        total += bytes;
+        if (clip.source && !clip.isPlaying)
+            drop.push_back({clip.lastUse, nullptr, &clip, bytes});
+    }
+    if (total <= ASSET_DECODED_BUDGET) return;
+
+    std::sort(drop.begin(), drop.end(),
+              [](const Cold& a, const Cold& b) { return a.lastUse < b.lastUse; });
+    for (const Cold& d : drop) {
+        if (total <= ASSET_DECODED_BUDGET) break;
+        if (d.costume) {
+            asset_costume_release(*d.costume);
+        } else {
+            d.clip->pcm.reset();
+            d.clip->peaks.clear();
+        }
+        total -= std::min(total, d.bytes);
+    }
+}
+
+// Drops costume textures, coldest first, until the texture total is back
+// under g_texBudget. Only textures whose pixels are kept can go, and never
+// the one on stage or the predicted next one (nor images they share).
+static void asset_texture_trim(Sprite& sprite, int keep)
+{
+    std::unordered_set<const SDL_Texture*> pinned;
+    if (sprite.texture) pinned.insert(sprite.texture);
+    for (int i : {sprite.currentCostume, keep})
+        if (i >= 0 && i < (int)sprite.costumes.size() && sprite.costumes[i].texture)
+            pinned.insert(sprite.costumes[i].texture);
+
+    std::vector<Costume*> cold;
+    for (auto& c : sprite.costumes)
+        if (c.texture && c.pixels && c.pixelsTex == c.texture && !pinned.count(c.texture))
+            cold.push_back(&c);
+    std::sort(cold.begin(), cold.end(),
+              [](const Costume* a, const Costume* b) { return a->lastUse < b->lastUse; });
+
+    for (Costume* c : cold) {
+        if (!tex_over_budget()) break;
+        SDL_Texture* tex = c->texture;
+        if (!tex) continue;
+        if (c->hash) {
+            auto it = g_assetImages.find(c->hash);
+            if (it != g_assetImages.end() && it->second.texture == tex)
+                it->second.texture = nullptr;
+        }
+        for (auto& o : sprite.costumes)
+            if (o.texture == tex) o.texture = o.pixelsTex = nullptr;
+        tex_destroy(tex);
+        g_texEvictions++;
+    }
+}
+
+// Once per frame on the main thread: adopts what the worker decoded,
+// prefetches the costume a `next costume` would show, and trims decoded
+// forms back under budget when anything was decoded since the last trim,
+// and textures whenever they are over theirs.
+inline void asset_pump(SDL_Renderer* r, Sprite& sprite, SoundsPanel& sounds)
+{
+    std::unordered_map<const void*, AssetDecoded> ready;
+    {
+        std::lock_guard<std::mutex> lock(g_assetLock);
+        ready.swap(g_assetReady);
+    }
+    if (!ready.empty()) {
+        for (auto& c : sprite.costumes) {
+            if (c.texture || !c.source) continue;
+            auto it = ready.find(c.source.get());
+            if (it == ready.end()) continue;
+            c.lastUse = ++g_assetTick;
+            asset_costume_adopt(r, c, it->second);
+        }
+        for (auto& clip : sounds.sounds) {
+            if (clip.pcm || !clip.source) continue;
+            auto it = ready.find(clip.source.get());
+            if (it == ready.end()) continue;
+            clip.lastUse = ++g_assetTick;
+            asset_sound_adopt(clip, it->second);
+        }
+    }
+
+    int keep = -1;
+    if (!sprite.costumes.empty()) {
+        keep = (sprite.currentCostume + 1) % (int)sprite.costumes.size();
+        asset_costume_prefetch(sprite.costumes[keep]);
+    }
+    if (g_assetTrimTick != g_assetTick) {
+        g_assetTrimTick = g_assetTick;
+        asset_trim(sprite, sounds, keep);
+    }
+    if (tex_over_budget()) asset_texture_trim(sprite, keep);
+}
+
+inline void asset_store_quit()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_assetLock);
+        g_assetQuit = true;
+        g_assetQueue.clear();
+        g_assetBusy.clear();
+    }
+    g_assetWake.notify_all();
+    g_assetDone.notify_all();
+    if (g_assetWorker.joinable()) g_assetWorker.join();
+    g_assetReady.clear();
+    for (auto& kv : g_assetImages) tex_destroy(kv.second.texture);
+    g_assetImages.clear();
+    g_assetSounds.clear();
+}
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef SCRATCH_FOP_AUTOSAVE_H
+#define SCRATCH_FOP_AUTOSAVE_H
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/stat.h>
+#include <SDL2/SDL.h>
+#include "structs.h"
+#include "SaveSystem.h"
+
+static const Uint32 AUTOSAVE_INTERVAL_MS = 30000;
+static const char*  AUTOSAVE_SUFFIX      = ".autosave";
+
+// The UI thread builds a SaveSnapshot (record copies plus shared pixel/PCM
+// buffers) and hands it over; the worker does the serialization, fsync and
+// rename. A newer snapshot replaces one the worker has not picked up yet.
+//
+// The autosave only exists to recover from a session that did not end
+// cleanly: it is removed once the project is saved and on a normal exit,
+// and at startup it is offered, not loaded, and only if it is newer than
+// the project file.
+static std::thread             g_autosaveThread;
+static std::mutex              g_autosaveMutex;
+static std::condition_variable g_autosaveCv;
+static std::condition_variable g_autosaveIdle;
+static std::shared_ptr<const SaveSnapshot> g_autosavePending;
+static std::string             g_autosavePath;
+static bool                    g_autosaveQuit   = false;
+static bool                    g_autosaveActive = false;
+static bool                    g_autosaveBusy   = false;
+static Uint32                  g_autosaveLast   = 0;
+static Uint64                  g_autosaveDigest = 0;
+
+static Uint64 autosave_hash(Uint64 h, const void* data, size_t bytes)
+{
+    const Uint8* p = (const Uint8*)data;
+    for (size_t i = 0; i < bytes; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Content digest of a snapshot, used to skip autosaves when nothing changed.
+// Asset buffers are immutable, so their identity stands in for their bytes;
+// an encoded source outlives its decoded forms, so it is preferred.
+static Uint64 autosave_digest(const SaveSnapshot& s)
+{
+    Uint64 h = 14695981039346656037ull;
+    h = autosave_hash(h, s.blocks.data(),   s.blocks.size()   * sizeof(SaveBlockRec));
+    h = autosave_hash(h, s.inputs.data(),   s.inputs.size()   * sizeof(SaveInputRec));
+    h = autosave_hash(h, s.vars.data(),     s.vars.size()     * sizeof(SaveVarRec));
+    h = autosave_hash(h, s.costumes.data(), s.costumes.size() * sizeof(SaveCostumeRec));
+    h = autosave_hash(h, s.sounds.data(),   s.sounds.size()   * sizeof(SaveSoundRec));
+    h = autosave_hash(h, s.strings.bytes.data(), s.strings.bytes.size());
+    for (size_t i = 0; i < s.costumePixels.size(); i++) {
+        const void* id = s.costumeSource[i] ? (const void*)s.costumeSource[i].get()
+                                            : (const void*)s.costumePixels[i].get();
+        h = autosave_hash(h, &id, sizeof(id));
+    }
+    for (size_t i = 0; i < s.soundPcm.size(); i++) {
+        const void* id = s.soundSource[i] ? (const void*)s.soundSource[i].get()
+                                          : (const void*)s.soundPcm[i].get();
+        h = autosave_hash(h, &id, sizeof(id));
+    }
+    h = autosave_hash(h, &s.spriteName, sizeof(s.spriteName));
+    h = autosave_hash(h, &s.currentCostume, sizeof(s.currentCostume));
+    return h;
+}
+
+static void autosave_worker()
+{
+    std::unique_lock<std::mutex> lock(g_autosaveMutex);
+    for (;;) {
+        g_autosaveCv.wait(lock, [] { return g_autosaveQuit || g_autosavePending; });
+        if (!g_autosavePending) return;
+        std::shared_ptr<const SaveSnapshot> snap = std::move(g_autosavePending);
+        std::string path = g_autosavePath;
+        g_autosaveBusy = true;
+        lock.unlock();
+
+        Uint32 t0 = SDL_GetTicks();
+        if (save_write_snapshot(*snap, path))
+            std::cerr << "[Autosave] Wrote '" << path << "' in "
+                      << SDL_GetTicks() - t0 << " ms\n";
+        lock.lock();
+        g_autosaveBusy = false;
+        g_autosaveIdle.notify_all();
+    }
+}
+
+inline std::string autosave_path(const std::string& projectPath)
+{
+    return projectPath + AUTOSAVE_SUFFIX;
+}
+
+inline void autosave_init(const std::string& projectPath)
+{
+    if (g_autosaveActive) return;
+    g_autosavePath   = autosave_path(projectPath);
+    g_autosaveQuit   = false;
+    g_autosaveLast   = SDL_GetTicks();
+    g_autosaveThread = std::thread(autosave_worker);
+    g_autosaveActive = true;
+}
+
+// Snapshots the project now and queues it for the worker, unless it is
+// identical to the last one queued.
+inline void autosave_now(const std::vector<Block*>& wsBlocks,
+                         const VariablesPanel& vars,
+                         Sprite& sprite,
+                         const SoundsPanel& sounds,
+                         SDL_Renderer* r)
+{
+    if (!g_autosaveActive) return;
+    g_autosaveLast = SDL_GetTicks();
+
+    auto snap = std::make_shared<SaveSnapshot>();
+    save_snapshot(*snap, wsBlocks, vars, sprite, sounds, r);
+    Uint64 digest = autosave_digest(*snap);
+    if (digest == g_autosaveDigest) return;
+    g_autosaveDigest = digest;
+
+    {
+        std::lock_guard<std::mutex> lock(g_autosaveMutex);
+        g_autosavePending = std::move(snap);
+    }
+    g_autosaveCv.notify_one();
+}
+
+inline void autosave_tick(const std::vector<Block*>& wsBlocks,
+                          const VariablesPanel& vars,
+                          Sprite& sprite,
+                          const SoundsPanel& sounds,
+                          SDL_Renderer* r)
+{
+    if (!g_autosaveActive || SDL_GetTicks() - g_autosaveLast < AUTOSAVE_INTERVAL_MS) return;
+    autosave_now(wsBlocks, vars, sprite, sounds, r);
+}
+
+// Drops a queued snapshot, waits for a write in progress and removes the
+// autosave file.
+inline void autosave_discard()
+{
+    if (!g_autosaveActive) return;
+    {
+        std::unique_lock<std::mutex> lock(g_autosaveMutex);
+        g_autosavePending.reset();
+        g_autosaveIdle.wait(lock, [] { return !g_autosaveBusy; });
+    }
+    std::remove(g_autosavePath.c_str());
+}
+
+// The project as it is now matches its file; the next autosave is only
+// written once it differs.
+inline void autosave_mark_clean(const std::vector<Block*>& wsBlocks,
+                                const VariablesPanel& vars,
+                                Sprite& sprite,
+                                const SoundsPanel& sounds,
+                                SDL_Renderer* r)
+{
+    if (!g_autosaveActive) return;
+    SaveSnapshot snap;
+    save_snapshot(snap, wsBlocks, vars, sprite, sounds, r);
+    g_autosaveDigest = autosave_digest(snap);
+    g_autosaveLast   = SDL_GetTicks();
+}
+
+// After a successful save: the autosave is not needed any more.
+inline void autosave_saved(const std::vector<Block*>& wsBlocks,
+                           const VariablesPanel& vars,
+                           Sprite& sprite,
+                           const SoundsPanel& sounds,
+                           SDL_Renderer* r)
+{
+    if (!g_autosaveActive) return;
+    autosave_mark_clean(wsBlocks, vars, sprite, sounds, r);
+    autosave_discard();
+}
+
+// Follows the open project to projectPath after a save or load elsewhere.
+// The old project's autosave is removed; writes now go next to the new one.
+inline void autosave_retarget(const std::string& projectPath)
+{
+    std::string path = autosave_path(projectPath);
+    if (path == g_autosavePath) return;
+    autosave_discard();
+    std::lock_guard<std::mutex> lock(g_autosaveMutex);
+    g_autosavePath = path;
+}
+
+// True if projectPath has an autosave written after the project file was.
+inline bool autosave_is_newer(const std::string& projectPath)
+{
+    struct stat a, p;
+    if (stat(autosave_path(projectPath).c_str(), &a) != 0) return false;
+    if (stat(projectPath.c_str(), &p) != 0) return true;
+    return a.st_mtime > p.st_mtime;
+}
+
+// Offers an autosave newer than the project and loads it if the user
+// agrees. One the user turns down is removed; a stale one is left alone.
+inline bool autosave_offer_restore(SDL_Window* window, const std::string& projectPath,
+                                   std::vector<Block*>& wsBlocks, VariablesPanel& vars,
+                                   Sprite& sprite, SoundsPanel& sounds,
+                                   SDL_Renderer* r, int& nextId)
+{
+    std::string path = autosave_path(projectPath);
+    if (!is_binary_project(path) || !autosave_is_newer(projectPath)) return false;
+
+    const SDL_MessageBoxButtonData buttons[] = {
+        { SDL_MESSAGEBOX_BUTTON_ESCAPEKEY_DEFAULT, 0, "Discard" },
+        { SDL_MESSAGEBOX_BUTTON_RETURNKEY_DEFAULT, 1, "Restore" },
+    };
+    std::string text = "The last session ended without saving. Restore the autosaved "
+                       "work, newer than '" + projectPath + "'?";
+    SDL_MessageBoxData box = { SDL_MESSAGEBOX_WARNING, window, "Unsaved work found",
+                               text.c_str(), 2, buttons, nullptr };
+    int choice = -1;
+    if (SDL_ShowMessageBox(&box, &choice) != 0) {
+        std::cerr << "[Autosave] Could not ask about '" << path << "': " << SDL_GetError() << "\n";
+        return false;
+    }
+    if (choice != 1) {
+        std::remove(path.c_str());
+        return false;
+    }
+    if (!project_load(path, wsBlocks, vars, sprite, sounds, r, nextId)) return false;
+    std::cerr << "[Autosave] Restored previous session from '" << path << "'\n";
+    return true;
+}
+
+// Finishes any queued write before returning.
+inline void autosave_quit()
+{
+    if (!g_autosaveActive) return;
+    {
+        std::lock_guard<std::mutex> lock(g_autosaveMutex);
+        g_autosaveQuit = true;
+    }
+    g_autosaveCv.notify_one();
+    g_autosaveThread.join();
+    g_autosaveActive = false;
+}
+
+#endif
@@ -0,0 +1,483 @@
+#ifndef SCRATCH_FOP_BENCH_H
+#define SCRATCH_FOP_BENCH_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_set>
+#include <SDL2/SDL.h>
+#include "structs.h"
+#include "utils.h"
+#include "tab_bar.h"
+#include "SaveSystem.h"
+
+// Synthetic projects for timing and fuzzing the project loaders.
+//
+//   Scratch_fop --bench [scripts stackLen depth vars stringLen]
+//   Scratch_fop --fuzz-load [iterations [seed]]
+//
+// Both run before the window opens and exit. Building with
+// -DSCRATCH_LIBFUZZER -fsanitize=fuzzer drops main() and exposes
+// LLVMFuzzerTestOneInput instead, which feeds every input to whichever
+// loader its first bytes select.
+
+struct BenchShape {
+    int    scripts   = 200;  // top-level stacks
+    int    stackLen  = 40;   // plain blocks under each hat
+    int    depth     = 12;   // C-blocks nested inside each other per stack
+    int    vars      = 500;
+    int    stringLen = 256;  // input values and variable names
+    Uint32 seed      = 1;
+};
+
+inline Uint32 bench_rand(Uint32& s)
+{
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+// Mostly text, with everything escape_str() has to handle mixed in,
+// including literal escape sequences that must not be decoded on load.
+inline std::string bench_string(Uint32& rng, int len)
+{
+    static const char* pieces[] = {
+        "a", "b", "x", "7", " ", "|", "\n", "\r", "\\", "\\pipe", "\\n", "pipe", "\xC3\xA9"
+    };
+    std::string s;
+    while ((int)s.size() < len)
+        s += pieces[bench_rand(rng) % (sizeof(pieces) / sizeof(pieces[0]))];
+    return s;
+}
+
+static Block* bench_block(std::vector<Block*>* ws, int& nextId, BlockType type,
+                          const char* text, int x, int y)
+{
+    Block* b = block_alloc();
+    b->id          = nextId++;
+    b->type        = type;
+    b->text        = text;
+    b->x           = x;
+    b->y           = y;
+    b->w           = BLOCK_W;
+    b->h           = BLOCK_H;
+    b->isDragging  = false;
+    b->dragOffsetX = 0;
+    b->dragOffsetY = 0;
+    b->next        = nullptr;
+    b->prev        = nullptr;
+    init_block_inputs(b);
+    if (ws) ws->push_back(b);
+    return b;
+}
+
+static Block* bench_statement(std::vector<Block*>& ws, int& nextId, Uint32& rng,
+                              const BenchShape& shape, int x, int y)
+{
+    switch (bench_rand(rng) % 4) {
+    case 0: {
+        Block* b = bench_block(&ws, nextId, BLOCK_LOOKS, "say ()", x, y);
+        b->inputs[0].value = bench_string(rng, shape.stringLen);
+        if (bench_rand(rng) % 8 == 0) {
+            Block* r = bench_block(nullptr, nextId, BLOCK_OPERATORS, "join () ()", x, y);
+            r->inputs[0].value = bench_string(rng, shape.stringLen / 4);
+            r->inputs[1].value = bench_string(rng, shape.stringLen / 4);
+            b->inputs[0].embeddedBlock = r;
+        }
+        return b;
+    }
+    case 1: {
+        Block* b = bench_block(&ws, nextId, BLOCK_MOTION, "move () steps", x, y);
+        b->inputs[0].value = std::to_string(bench_rand(rng) % 100);
+        return b;
+    }
+    case 2: {
+        Block* b = bench_block(&ws, nextId, BLOCK_MOTION, "turn () degrees", x, y);
+        b->inputs[0].value = std::to_string(bench_rand(rng) % 360);
+        return b;
+    }
+    default: {
+        Block* b = bench_block(&ws, nextId, BLOCK_LOOKS, "think () for () secs", x, y);
+        b->inputs[0].value = bench_string(rng, shape.stringLen / 2);
+        return b;
+    }
+    }
+}
+
+// Blocks go into ws in the same pre-order the editor keeps: each C-block,
+// then its body, then its else branch.
+static Block* bench_nest(std::vector<Block*>& ws, int& nextId, Uint32& rng,
+                         const BenchShape& shape, int level, int x, int y)
+{
+    if (level >= shape.depth) return bench_statement(ws, nextId, rng, shape, x, y);
+
+    static const char* cTexts[] = { "repeat ()", "forever", "if <> then", "if <> then else" };
+    const char* text = cTexts[bench_rand(rng) % 4];
+    Block* c = bench_block(&ws, nextId, BLOCK_CONTROL, text, x, y);
+    if (!c->inputs.empty() && c->inputs[0].slotType == SLOT_NUMERIC)
+        c->inputs[0].value = std::to_string(bench_rand(rng) % 20 + 1);
+
+    c->innerFirst = bench_nest(ws, nextId, rng, shape, level + 1, x + 16, y + BLOCK_H);
+    c->innerLast  = c->innerFirst;
+    if (c->hasElse) {
+        c->elseFirst = bench_statement(ws, nextId, rng, shape, x + 16, y + 2 * BLOCK_H);
+        Block* more  = bench_statement(ws, nextId, rng, shape, x + 16, y + 3 * BLOCK_H);
+        c->elseFirst->next = more;
+        more->prev         = c->elseFirst;
+    }
+    return c;
+}
+
+inline void bench_generate(const BenchShape& shape, std::vector<Block*>& ws,
+                           VariablesPanel& vars, int& nextId)
+{
+    Uint32 rng = shape.seed ? shape.seed : 1;
+
+    for (int s = 0; s < shape.scripts; s++) {
+        int x = 40 + (s % 20) * 300;
+        int y = 40 + (s / 20) * 400;
+        Block* tail = bench_block(&ws, nextId, BLOCK_EVENT, "when green flag clicked", x, y);
+        if (shape.depth > 0) {
+            Block* c = bench_nest(ws, nextId, rng, shape, 0, x, y + BLOCK_H);
+            tail->next = c;
+            c->prev    = tail;
+            tail       = c;
+        }
+        for (int i = 0; i < shape.stackLen; i++) {
+            Block* b = bench_statement(ws, nextId, rng, shape, x, y + (i + 2) * BLOCK_H);
+            tail->next = b;
+            b->prev    = tail;
+            tail       = b;
+        }
+    }
+
+    // Whole numbers only: the text format writes values at default precision.
+    for (int i = 0; i < shape.vars; i++) {
+        std::string name = "v" + std::to_string(i) + ":" + bench_string(rng, shape.stringLen / 8);
+        float value = (float)(int)(bench_rand(rng) % 100000) - 50000.0f;
+        vars.variables.push_back({ name, value, (i % 3) == 0 });
+    }
+}
+
+inline void bench_free(std::vector<Block*>& ws)
+{
+    for (Block* b : ws) block_free_reporters(b);
+    ws.clear();
+}
+
+// True when every stack is a finite chain with consistent prev/next links
+// and no block has two owners. Loaders must guarantee this for any input.
+inline bool bench_check(const std::vector<Block*>& ws)
+{
+    std::unordered_set<const Block*> all(ws.begin(), ws.end());
+    std::unordered_set<const Block*> owned;
+    if (all.size() != ws.size()) return false;
+
+    for (const Block* b : ws) {
+        if (b->next && (!all.count(b->next) || b->next->prev != b ||
+                        !owned.insert(b->next).second))
+            return false;
+        if (b->prev && b->prev->next != b) return false;
+        for (const Block* head : { b->innerFirst, b->elseFirst })
+            if (head && (!all.count(head) || head->prev || !owned.insert(head).second))
+                return false;
+        for (const auto& inp : b->inputs)
+            if (inp.embeddedBlock && (all.count(inp.embeddedBlock) ||
+                                      !owned.insert(inp.embeddedBlock).second))
+                return false;
+    }
+
+    size_t chained = 0;
+    for (const Block* b : ws) {
+        if (b->prev) continue;
+        for (const Block* c = b; c; c = c->next)
+            if (++chained > ws.size()) return false;
+    }
+    return chained == ws.size();
+}
+
+// Compares what a loader produced against the generated project. The text
+// format keeps only stacks and input values, so bodies and reporters are
+// compared for the binary format only.
+static bool bench_same(const std::vector<Block*>& a, const std::vector<Block*>& b,
+                       const VariablesPanel& va, const VariablesPanel& vb, bool full)
+{
+    auto id_of = [](const Block* x) { return x ? x->id : -1; };
+    if (a.size() != b.size() || va.variables.size() != vb.variables.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        const Block* x = a[i];
+        const Block* y = b[i];
+        if (x->id != y->id || x->type != y->type || x->text != y->text ||
+            x->x != y->x || x->y != y->y || x->inputs.size() != y->inputs.size() ||
+            id_of(x->next) != id_of(y->next) || id_of(x->prev) != id_of(y->prev))
+            return false;
+        for (size_t k = 0; k < x->inputs.size(); k++)
+            if (x->inputs[k].value != y->inputs[k].value) return false;
+        if (!full) continue;
+        if (id_of(x->innerFirst) != id_of(y->innerFirst) ||
+            id_of(x->elseFirst) != id_of(y->elseFirst))
+            return false;
+        for (size_t k = 0; k < x->inputs.size(); k++)
+            if (id_of(x->inputs[k].embeddedBlock) != id_of(y->inputs[k].embeddedBlock))
+                return false;
+    }
+    for (size_t i = 0; i < va.variables.size(); i++) {
+        const Variable& x = va.variables[i];
+        const Variable& y = vb.variables[i];
+        if (x.name != y.name || x.value != y.value || x.showOnStage != y.showOnStage)
+            return false;
+    }
+    return true;
+}
+
+inline double bench_ms(Uint64 t0)
+{
+    return (double)(SDL_GetPerformanceCounter() - t0) * 1000.0 /
+           (double)SDL_GetPerformanceFrequency();
+}
+
+inline long bench_file_size(const std::string& path)
+{
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    return f ? (long)f.tellg() : 0;
+}
+
+// Best of `rounds` for each of save and load, for both formats.
+inline bool bench_run(const BenchShape& shape, int rounds = 5)
+{
+    std::vector<Block*> ws;
+    VariablesPanel vars{};
+    int nextId = 1;
+    bench_generate(shape, ws, vars, nextId);
+
+    Sprite sprite;
+    SoundsPanel sounds{};
+    bool allOk = true;
+    const char* paths[2] = { "bench_project.txt", "bench_project.scratch" };
+
+    std::cerr << "[Bench] " << ws.size() << " blocks, " << vars.variables.size()
+              << " variables (" << shape.scripts << " stacks of " << shape.stackLen
+              << ", depth " << shape.depth << ", strings " << shape.stringLen << ")\n";
+
+    for (int fmt = 0; fmt < 2; fmt++) {
+        const std::string path = paths[fmt];
+        double saveMs = 1e30, loadMs = 1e30;
+        bool same = false;
+        for (int i = 0; i < rounds; i++) {
+            Uint64 t0 = SDL_GetPerformanceCounter();
+            bool ok = project_save(path, ws, vars, sprite, sounds, nullptr);
+            double ms = bench_ms(t0);
+            if (!ok) {
+                std::cerr << "[Bench] Cannot write '" << path << "'\n";
+                allOk = false;
+                break;
+            }
+            if (ms < saveMs) saveMs = ms;
+
+            std::vector<Block*> loaded;
+            VariablesPanel loadedVars{};
+            int loadedNext = 1;
+            t0 = SDL_GetPerformanceCounter();
+            ok = project_load(path, loaded, loadedVars, sprite, sounds, nullptr, loadedNext);
+            ms = bench_ms(t0);
+            if (ms < loadMs) loadMs = ms;
+            same = ok && bench_check(loaded) &&
+                   bench_same(ws, loaded, vars, loadedVars, fmt == 1) &&
+                   (fmt == 0 || loadedNext == nextId);
+            bench_free(loaded);
+            if (!same) break;
+        }
+        if (saveMs > 1e29) continue;
+
+        double mb = bench_file_size(path) / (1024.0 * 1024.0);
+        std::cerr << "[Bench] " << (fmt ? "binary" : "text  ") << ": "
+                  << mb << " MB, save " << saveMs << " ms (" << mb * 1000.0 / saveMs
+                  << " MB/s), load " << loadMs << " ms (" << mb * 1000.0 / loadMs
+                  << " MB/s, " << (long)(ws.size() * 1000.0 / loadMs) << " blocks/s)"
+                  << (same ? "" : "  ROUND TRIP MISMATCH") << "\n";
+        allOk = allOk && same;
+        std::remove(path.c_str());
+    }
+
+    bench_free(ws);
+    return allOk;
+}
+
+// One fuzz input: binary if it starts with the save magic, text otherwise.
+// Returns false if the loader produced a workspace that breaks bench_check().
+inline bool bench_fuzz_one(const Uint8* data, size_t size)
+{
+    std::vector<Block*> ws;
+    VariablesPanel vars{};
+    Sprite sprite;
+    SoundsPanel sounds{};
+    int nextId = 1;
+
+    if (size >= 4 && std::memcmp(data, SAVE_MAGIC, 4) == 0) {
+        // Records are read in place, so give them the alignment a mapping has.
+        std::vector<Uint32> aligned((size + 3) / 4);
+        std::memcpy(aligned.data(), data, size);
+        load_project_memory((const Uint8*)aligned.data(), size, "<fuzz>",
+                            ws, vars, sprite, sounds, nullptr, nextId);
+    } else {
+        std::istringstream in(std::string((const char*)data, size));
+        load_project_stream(in, ws, vars, nextId);
+    }
+
+    bool ok = bench_check(ws);
+    bench_free(ws);
+    asset_release_costumes(sprite);
+    audio_free_all(sounds);
+    return ok;
+}
+
+static void bench_mutate(std::vector<Uint8>& d, Uint32& rng)
+{
+    static const Uint8 bytes[] = { 0, 0xFF, 0x7F, 0x80, '|', '\n', '\\', '-', '9', '#' };
+    static const Uint32 words[] = { 0, 1, 2, 0x7FFFFFFFu, 0x80000000u, 0xFFFFFFFFu, 0xFFFFu };
+
+    int n = 1 + bench_rand(rng) % 4;
+    for (int i = 0; i < n && !d.empty(); i++) {
+        size_t at = bench_rand(rng) % d.size();
+        switch (bench_rand(rng) % 7) {
+        case 0: d[at] ^= (Uint8)(1u << (bench_rand(rng) % 8)); break;
+        case 1: d[at] = bytes[bench_rand(rng) % sizeof(bytes)]; break;
+        case 2:
+            if (d.size() >= 4) {
+                at -= at % 4;
+                if (at + 4 > d.size()) at = d.size() - 4;
+                Uint32 w = words[bench_rand(rng) % (sizeof(words) / sizeof(words[0]))];
+                std::memcpy(&d[at], &w, 4);
+            }
+            break;
+        case 3: d.resize(at); break;
+        case 4: {
+            size_t len = std::min<size_t>(bench_rand(rng) % 64 + 1, d.size() - at);
+            d.erase(d.begin() + at, d.begin() + at + len);
+            break;
+        }
+        case 5: {
+            size_t from = bench_rand(rng) % d.size();
+            size_t len  = std::min<size_t>(bench_rand(rng) % 64 + 1, d.size() - from);
+            std::vector<Uint8> chunk(d.begin() + from, d.begin() + from + len);
+            d.insert(d.begin() + at, chunk.begin(), chunk.end());
+            break;
+        }
+        default: {
+            // Text only: duplicate a whole line elsewhere, which produces
+            // repeated ids and conflicting prev links.
+            size_t s = at;
+            while (s > 0 && d[s - 1] != '\n') s--;
+            size_t e = at;
+            while (e < d.size() && d[e] != '\n') e++;
+            std::vector<Uint8> line(d.begin() + s, d.begin() + e);
+            line.push_back('\n');
+            size_t to = bench_rand(rng) % (d.size() + 1);
+            d.insert(d.begin() + to, line.begin(), line.end());
+            break;
+        }
+        }
+    }
+}
+
+inline bool bench_read_file(const std::string& path, std::vector<Uint8>& out)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return false;
+    out.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Mutates small generated projects in both formats. Inputs that break an
+// invariant are written to fuzz-fail-N.bin for replay.
+inline bool bench_fuzz_loader(int iterations, Uint32 seed)
+{
+    BenchShape shape;
+    shape.scripts   = 3;
+    shape.stackLen  = 5;
+    shape.depth     = 3;
+    shape.vars      = 4;
+    shape.stringLen = 12;
+    shape.seed      = seed ? seed : 1;
+
+    std::vector<Block*> ws;
+    VariablesPanel vars{};
+    Sprite sprite;
+    SoundsPanel sounds{};
+    int nextId = 1;
+    bench_generate(shape, ws, vars, nextId);
+
+    std::vector<std::vector<Uint8>> corpus(2);
+    const char* paths[2] = { "fuzz_seed.txt", "fuzz_seed.scratch" };
+    for (int i = 0; i < 2; i++) {
+        if (!project_save(paths[i], ws, vars, sprite, sounds, nullptr) ||
+            !bench_read_file(paths[i], corpus[i])) {
+            std::cerr << "[Fuzz] Cannot write seed '" << paths[i] << "'\n";
+            bench_free(ws);
+            return false;
+        }
+        std::remove(paths[i]);
+    }
+    bench_free(ws);
+
+    // Rejected inputs log from inside the loaders; keep the run readable.
+    std::streambuf* logBuf = std::cerr.rdbuf(nullptr);
+    Uint32 rng = shape.seed;
+    int failures = 0;
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    for (int i = 0; i < iterations; i++) {
+        std::vector<Uint8> input = corpus[bench_rand(rng) % 2];
+        bench_mutate(input, rng);
+        if (bench_fuzz_one(input.data(), input.size())) continue;
+
+        failures++;
+        std::string name = "fuzz-fail-" + std::to_string(i) + ".bin";
+        std::ofstream(name, std::ios::binary).write((const char*)input.data(), input.size());
+    }
+    std::cerr.rdbuf(logBuf);
+    std::cerr.clear();
+
+    std::cerr << "[Fuzz] " << iterations << " inputs in " << (long)bench_ms(t0)
+              << " ms, " << failures << " failures\n";
+    return failures == 0;
+}
+
+// Handles --bench and --fuzz-load. Returns the exit code, or -1 when the
+// arguments are not one of these modes and the editor should start.
+inline int bench_command(int argc, char* argv[])
+{
+    if (argc < 2) return -1;
+    auto arg = [&](int i, long def) { return i < argc ? std::strtol(argv[i], nullptr, 10) : def; };
+
+    if (std::strcmp(argv[1], "--bench") == 0) {
+        BenchShape shape;
+        shape.scripts   = (int)arg(2, shape.scripts);
+        shape.stackLen  = (int)arg(3, shape.stackLen);
+        shape.depth     = (int)arg(4, shape.depth);
+        shape.vars      = (int)arg(5, shape.vars);
+        shape.stringLen = (int)arg(6, shape.stringLen);
+        return bench_run(shape) ? 0 : 1;
+    }
+    if (std::strcmp(argv[1], "--fuzz-load") == 0)
+        return bench_fuzz_loader((int)arg(2, 100000), (Uint32)arg(3, 1)) ? 0 : 1;
+    return -1;
+}
+
+#ifdef SCRATCH_LIBFUZZER
+extern "C" int LLVMFuzzerTestOneInput(const Uint8* data, size_t size)
+{
+    static bool quiet = (std::cerr.rdbuf(nullptr), true);
+    (void)quiet;
+    if (!bench_fuzz_one(data, size)) std::abort();
+    return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef SCRATCH_FOP_BLOCK_POOL_H
+#define SCRATCH_FOP_BLOCK_POOL_H
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include <cstdlib>
+#include <SDL2/SDL.h>
+#include "structs.h"
+
+// Every Block lives in a BlockPool. Slots are handed out from fixed-size
+// chunks, so neighbouring blocks share cache lines, a Block* stays valid
+// until its slot is freed, and a block never moves. Freed slots go on a
+// free list and are reused before the pool grows.
+//
+// Blocks refer to each other by BlockRef. A handle packs the slot (low 23
+// bits), a bit for the palette pool and the slot's 8-bit generation, which
+// is bumped whenever the slot is freed, so a handle kept past a delete no
+// longer matches. Generations start at 1 so no live handle is 0.
+//
+// Eight bits wrap after 255 reuses of a slot, and an old handle would match
+// again. A slot whose generation wraps is retired instead of going back on
+// the free list, so a handle never matches a later block through the free
+// list; only a clear hands such slots out again.
+//
+// block_pool_clear() drops every block at once without touching them: the
+// next allocations start again from slot 0, and each slot that was handed
+// out before gets its generation bumped as it is reused. Until then the
+// slot is past `used` and no handle to it is valid. The workspace and the
+// palette use separate pools so a new project can be cleared that way.
+
+static const Uint32 BLOCK_POOL_CHUNK  = 256;
+static const Uint32 BLOCK_REF_SLOTS   = 0x007FFFFFu;
+static const Uint32 BLOCK_REF_PALETTE = 0x00800000u;
+static const int    BLOCK_REF_GEN_SHIFT = 24;
+
+struct BlockPool {
+    std::vector<std::unique_ptr<Block[]>> chunks;
+    std::vector<Uint32> freeList;
+    std::vector<Uint8>  alive;
+    std::vector<Uint8>  gen;
+    Uint32 used = 0;   // slots handed out since the last clear
+    Uint32 reached = 0; // slots ever handed out
+    Uint32 live = 0;
+    Uint32 tag  = 0;   // BLOCK_REF_PALETTE for the palette pool
+
+    explicit BlockPool(Uint32 t = 0) : tag(t) {}
+};
+
+static BlockPool g_blockPool;
+static BlockPool g_palettePool(BLOCK_REF_PALETTE);
+
+inline Block* block_at(BlockPool& pool, Uint32 slot)
+{
+    return &pool.chunks[slot / BLOCK_POOL_CHUNK][slot % BLOCK_POOL_CHUNK];
+}
+
+inline BlockPool& block_ref_pool(BlockRef r)
+{
+    return (r.bits & BLOCK_REF_PALETTE) ? g_palettePool : g_blockPool;
+}
+
+inline Uint32 block_ref_slot(BlockRef r)
+{
+    return r.bits & BLOCK_REF_SLOTS;
+}
+
+// True while the block the handle was taken from has not been freed.
+inline bool block_ref_valid(BlockRef r)
+{
+    if (!r.bits) return false;
+    BlockPool& pool = block_ref_pool(r);
+    Uint32 slot = block_ref_slot(r);
+    return slot < pool.used && pool.alive[slot] && pool.gen[slot] == (r.bits >> BLOCK_REF_GEN_SHIFT);
+}
+
+inline Block* BlockRef::get() const
+{
+    if (!bits) return nullptr;
+#ifndef NDEBUG
+    if (!block_ref_valid(*this)) {
+        std::cerr << "[Blocks] Stale handle to slot " << block_ref_slot(*this) << "\n";
+        return nullptr;
+    }
+#endif
+    return block_at(block_ref_pool(*this), block_ref_slot(*this));
+}
+
+inline bool block_owned(BlockPool& pool, const Block* b)
+{
+    if (!b || (b->self.bits & BLOCK_REF_PALETTE) != pool.tag) return false;
+    Uint32 slot = block_ref_slot(b->self);
+    return slot < pool.used && block_at(pool, slot) == b && pool.alive[slot];
+}
+
+inline void block_set_self(BlockPool& pool, Block* b, Uint32 slot)
+{
+    b->self.bits = slot | pool.tag | ((Uint32)pool.gen[slot] << BLOCK_REF_GEN_SHIFT);
+}
+
+// Returns false when the generation wrapped.
+inline bool block_bump_gen(BlockPool& pool, Uint32 slot)
+{
+    if (++pool.gen[slot] != 0) return true;
+    pool.gen[slot] = 1;
+    return false;
+}
+
+// Returns a value-initialised block, as `new Block()` would.
+inline Block* block_alloc(BlockPool& pool = g_blockPool)
+{
+    Uint32 slot;
+    if (!pool.freeList.empty()) {
+        slot = pool.freeList.back();
+        pool.freeList.pop_back();
+    } else {
+        slot = pool.used++;
+        if (slot > BLOCK_REF_SLOTS) {
+            std::cerr << "[Blocks] Block pool is full\n";
+            std::abort();
+        }
+        if (slot / BLOCK_POOL_CHUNK >= pool.chunks.size())
+            pool.chunks.emplace_back(new Block[BLOCK_POOL_CHUNK]);
+        if (slot >= pool.alive.size()) {
+            pool.alive.resize(pool.chunks.size() * BLOCK_POOL_CHUNK);
+            pool.gen.resize(pool.chunks.size() * BLOCK_POOL_CHUNK, 1);
+        }
+        if (slot < pool.reached) block_bump_gen(pool, slot);
+        else pool.reached = slot + 1;
+    }
+    Block* b = block_at(pool, slot);
+    *b = Block{};
+    block_set_self(pool, b, slot);
+    pool.alive[slot] = 1;
+    pool.live++;
+    return b;
+}
+
+inline Block* block_copy(const Block& src, BlockPool& pool = g_blockPool)
+{
+    Block* b = block_alloc(pool);
+    BlockRef self = b->self;
+    *b = src;
+    b->self = self;
+    return b;
+}
+
+
+// Frees one slot. Its text and inputs are released now, not on reuse.
+inline void block_free(Block* b, BlockPool& pool = g_blockPool)
+{
+    if (!b) return;
+    if (!block_owned(pool, b)) {
+        std::cerr << "[Blocks] Freeing block " << b->id << " that is not live in this pool\n";
+        return;
+    }
+    Uint32 slot = block_ref_slot(b->self);
+    *b = Block{};
+    bool reuse = block_bump_gen(pool, slot);
+    block_set_self(pool, b, slot);
+    pool.alive[slot] = 0;
+    if (reuse) pool.freeList.push_back(slot);
+    pool.live--;
+}
+
+// Frees a block together with the reporters embedded in its inputs.
+inline void block_free_reporters(Block* b, BlockPool& pool = g_blockPool)
+{
+    if (!b) return;
+    for (auto& inp : b->inputs)
+        if (inp.embeddedBlock) block_free_reporters(inp.embeddedBlock, pool);
+    block_free(b, pool);
+}
+
+static void block_collect(Block* b, std::vector<Block*>& out)
+{
+    out.push_back(b);
+    for (auto& inp : b->inputs)
+        if (inp.embeddedBlock) block_collect(inp.embeddedBlock, out);
+    for (Block* c = b->innerFirst; c; c = c->next) block_collect(c, out);
+    for (Block* c = b->elseFirst;  c; c = c->next) block_collect(c, out);
+}
+
+// Deletes a block that is already unlinked from its stack, along with its
+// reporters and the bodies of a C-block, and drops them all from `blocks`.
+inline void block_delete(Block* b, std::vector<Block*>& blocks, BlockPool& pool = g_blockPool)
+{
+    std::vector<Block*> doomed;
+    block_collect(b, doomed);
+    std::unordered_set<Block*> gone(doomed.begin(), doomed.end());
+    blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                [&](Block* x) { return gone.count(x) != 0; }),
+                 blocks.end());
+    for (Block* d : doomed) block_free(d, pool);
+}
+
+inline void block_pool_clear(BlockPool& pool = g_blockPool)
+{
+    pool.freeList.clear();
+    pool.used = 0;
+    pool.live = 0;
+}
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef SCRATCH_FOP_CAMERA_H
+#define SCRATCH_FOP_CAMERA_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include "structs.h"
+#include "render.h"
+#include "spatial.h"
+
+// The code area is a window onto an unbounded plane. Blocks keep their
+// positions in plane coordinates; the camera says which plane point is at
+// the workspace's top-left corner and how many screen pixels one unit
+// takes. A reset camera maps the plane onto the screen one to one, so
+// projects saved before the camera existed open where they were.
+//
+// Drawing goes through SDL_RenderSetScale() and g_blockView's offset, and
+// only the stacks the spatial grid finds in view are drawn. Zoomed out
+// past CAMERA_BARS_ZOOM, blocks are drawn as plain colored bars.
+
+static const float CAMERA_ZOOM_MIN  = 0.2f;
+static const float CAMERA_ZOOM_MAX  = 2.0f;
+static const float CAMERA_BARS_ZOOM = 0.5f;
+
+struct Camera {
+    float x = 0, y = 0;
+    float zoom = 1.0f;
+};
+
+inline void camera_reset(Camera& cam, const Workspace& ws)
+{
+    cam.x = (float)ws.x;
+    cam.y = (float)ws.y;
+    cam.zoom = 1.0f;
+}
+
+inline void camera_to_world(const Camera& cam, const Workspace& ws,
+                            int sx, int sy, int& wx, int& wy)
+{
+    wx = (int)std::floor(cam.x + (sx - ws.x) / cam.zoom);
+    wy = (int)std::floor(cam.y + (sy - ws.y) / cam.zoom);
+}
+
+inline void camera_to_screen(const Camera& cam, const Workspace& ws,
+                             int wx, int wy, int& sx, int& sy)
+{
+    sx = ws.x + (int)std::lround((wx - cam.x) * cam.zoom);
+    sy = ws.y + (int)std::lround((wy - cam.y) * cam.zoom);
+}
+
+// A copy of a mouse event with its position on the plane, for the block
+// handlers in input.h.
+inline SDL_Event camera_event(const Camera& cam, const Workspace& ws, const SDL_Event& e)
+{
+    SDL_Event we = e;
+    if (e.type == SDL_MOUSEMOTION)
+        camera_to_world(cam, ws, e.motion.x, e.motion.y, we.motion.x, we.motion.y);
+    else if (e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_MOUSEBUTTONUP)
+        camera_to_world(cam, ws, e.button.x, e.button.y, we.button.x, we.button.y);
+    return we;
+}
+
+inline void camera_pan(Camera& cam, int dxScreen, int dyScreen)
+{
+    cam.x -= dxScreen / cam.zoom;
+    cam.y -= dyScreen / cam.zoom;
+}
+
+// Zooms by `factor`, keeping the plane point under (sx, sy) where it is.
+inline void camera_zoom_at(Camera& cam, const Workspace& ws, int sx, int sy, float factor)
+{
+    float px = cam.x + (sx - ws.x) / cam.zoom;
+    float py = cam.y + (sy - ws.y) / cam.zoom;
+    cam.zoom = std::clamp(cam.zoom * factor, CAMERA_ZOOM_MIN, CAMERA_ZOOM_MAX);
+    cam.x = px - (sx - ws.x) / cam.zoom;
+    cam.y = py - (sy - ws.y) / cam.zoom;
+}
+
+inline void camera_center_on(Camera& cam, const Workspace& ws, int wx, int wy)
+{
+    cam.x = wx - ws.w / 2 / cam.zoom;
+    cam.y = wy - ws.h / 2 / cam.zoom;
+}
+
+// Sets up the renderer so blocks drawn at their plane positions land in
+// the workspace. With clip off they may be drawn outside it too, as a
+// block dragged in from the palette is.
+inline void camera_begin(SDL_Renderer* r, const Camera& cam, const Workspace& ws, bool clip)
+{
+    SDL_RenderSetScale(r, cam.zoom, cam.zoom);
+    g_blockView.dx   = (int)std::lround(ws.x / cam.zoom - cam.x);
+    g_blockView.dy   = (int)std::lround(ws.y / cam.zoom - cam.y);
+    g_blockView.bars = cam.zoom < CAMERA_BARS_ZOOM;
+    if (clip) {
+        SDL_Rect rc = {(int)std::floor(ws.x / cam.zoom), (int)std::floor(ws.y / cam.zoom),
+                       (int)std::ceil(ws.w / cam.zoom), (int)std::ceil(ws.h / cam.zoom)};
+        SDL_RenderSetClipRect(r, &rc);
+    }
+}
+
+inline void camera_end(SDL_Renderer* r)
+{
+    SDL_RenderSetClipRect(r, nullptr);
+    SDL_RenderSetScale(r, 1.0f, 1.0f);
+    g_blockView = BlockView{};
+}
+
+// The part of the plane the workspace shows.
+inline Workspace camera_view(const Camera& cam, const Workspace& ws)
+{
+    int x0, y0, x1, y1;
+    camera_to_world(cam, ws, ws.x, ws.y, x0, y0);
+    camera_to_world(cam, ws, ws.x + ws.w, ws.y + ws.h, x1, y1);
+    return {x0, y0, x1 - x0, y1 - y0};
+}
+
+// Statement blocks whose stack area overlaps the view, in workspace order.
+inline void camera_visible_blocks(const Camera& cam, const Workspace& ws,
+                                  std::vector<Block*>& out)
+{
+    Workspace v = camera_view(cam, ws);
+    spatial_blocks_in(v.x, v.y, v.x + v.w, v.y + v.h, out);
+}
+
+static void camera_collect_stack(Block* b, std::unordered_set<Block*>& out)
+{
+    for (; b; b = b->next) {
+        out.insert(b);
+        camera_collect_stack(b->innerFirst, out);
+        camera_collect_stack(b->elseFirst, out);
+    }
+}
+
+static void camera_draw_stack(SDL_Renderer* r, TTF_Font* font, Block* b)
+{
+    for (; b; b = b->next) {
+        draw_block(r, font, b);
+        camera_draw_stack(r, font, b->innerFirst);
+        camera_draw_stack(r, font, b->elseFirst);
+    }
+}
+
+// Draws the code area's blocks that are in view, then the stack being
+// dragged, which may hang over the palette and is not clipped. A C-block
+// draws its bodies over itself, so blocks inside a C-block in view are
+// drawn through it and skipped when the grid returns them on their own.
+inline void camera_draw_blocks(SDL_Renderer* r, TTF_Font* font, const Camera& cam,
+                               const Workspace& ws, Block* dragged)
+{
+    static std::vector<Block*> visible;
+    std::unordered_set<Block*> carried, nested;
+    camera_collect_stack(dragged, carried);
+    camera_visible_blocks(cam, ws, visible);
+    for (Block* b : visible) {
+        if (!b->isCShaped) continue;
+        for (Block* c = b->innerFirst; c; c = c->next) nested.insert(c);
+        for (Block* c = b->elseFirst;  c; c = c->next) nested.insert(c);
+    }
+
+    camera_begin(r, cam, ws, true);
+    for (Block* b : visible) {
+        if (carried.count(b) || nested.count(b)) continue;
+        draw_block(r, font, b);
+        camera_draw_stack(r, font, b->innerFirst);
+        camera_draw_stack(r, font, b->elseFirst);
+    }
+    camera_end(r);
+
+    if (!dragged) return;
+    camera_begin(r, cam, ws, false);
+    camera_draw_stack(r, font, dragged);
+    camera_end(r);
+}
+
+// Dots on the plane every 24 units, left out when they would crowd.
+inline void camera_draw_grid(SDL_Renderer* r, const Camera& cam, const Workspace& ws)
+{
+    SDL_SetRenderDrawColor(r, 255, 255, 255, 255);
+    SDL_Rect rc = {ws.x, ws.y, ws.w, ws.h};
+    SDL_RenderFillRect(r, &rc);
+    float step = 24.0f * cam.zoom;
+    if (step >= 8.0f) {
+        SDL_SetRenderDrawColor(r, 215, 215, 215, 255);
+        float gx = std::ceil((cam.x - 12.0f) / 24.0f) * 24.0f + 12.0f;
+        float gy = std::ceil((cam.y - 12.0f) / 24.0f) * 24.0f + 12.0f;
+        float sx0 = ws.x + (gx - cam.x) * cam.zoom;
+        float sy0 = ws.y + (gy - cam.y) * cam.zoom;
+        for (float x = sx0; x < ws.x + ws.w; x += step)
+            for (float y = sy0; y < ws.y + ws.h; y += step)
+                SDL_RenderDrawPoint(r, (int)x, (int)y);
+    }
+    SDL_SetRenderDrawColor(r, 200, 200, 200, 255);
+    SDL_RenderDrawRect(r, &rc);
+}
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef SCRATCH_FOP_CLEANUP_H
+#define SCRATCH_FOP_CLEANUP_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include "structs.h"
+#include "utils.h"
+#include "render.h"
+#include "undo.h"
+
+// "Clean up blocks": every top-level stack is packed, without overlaps,
+// into a strip as wide as the view (wider if there is a lot to fit) whose
+// top-left is the view's. Stacks are measured with their bodies and placed
+// tallest first by a bottom-left skyline packer: the skyline is the top
+// edge of what is placed so far, as segments, and a stack goes where its
+// top would be lowest, leftmost on ties. That is O(stacks x segments), and
+// the segments stay few because the strip is only about as wide as the
+// square root of the total area.
+//
+// The move is one undo command. The stacks then glide from where they
+// were over CLEANUP_MS; any click or key press ends the glide first.
+
+static const int    CLEANUP_GAP = 24;
+static const Uint32 CLEANUP_MS  = 300;
+
+struct SkylineSeg {
+    int x, y, w;
+};
+
+struct CleanupMove {
+    BlockRef top;
+    int fromX, fromY, toX, toY;
+};
+
+struct Cleanup {
+    std::vector<CleanupMove> moves;
+    Uint32 start = 0;
+};
+
+static Cleanup g_cleanup;
+
+// Where a box w wide can sit with its left edge at segment i, or -1 if it
+// would stick out past binW.
+static int skyline_fit(const std::vector<SkylineSeg>& sky, size_t i, int w, int binW)
+{
+    if (sky[i].x + w > binW) return -1;
+    int y = 0;
+    for (size_t j = i; j < sky.size() && sky[j].x < sky[i].x + w; j++)
+        y = std::max(y, sky[j].y);
+    return y;
+}
+
+static void skyline_add(std::vector<SkylineSeg>& sky, size_t i, int w, int top)
+{
+    int x = sky[i].x, end = x + w;
+    size_t j = i;
+    while (j < sky.size() && sky[j].x + sky[j].w <= end) j++;
+    if (j < sky.size() && sky[j].x < end) {
+        sky[j].w -= end - sky[j].x;
+        sky[j].x  = end;
+    }
+    sky.erase(sky.begin() + i, sky.begin() + j);
+    sky.insert(sky.begin() + i, SkylineSeg{x, top, w});
+    size_t k = 0;
+    for (size_t m = 1; m < sky.size(); m++) {
+        if (sky[m].y == sky[k].y) sky[k].w += sky[m].w;
+        else                      sky[++k] = sky[m];
+    }
+    sky.resize(k + 1);
+}
+
+// Packs boxes of the given sizes into a strip binW wide. Returns their
+// top-left corners, relative to the strip's.
+static std::vector<SDL_Point> skyline_pack(const std::vector<SDL_Point>& sizes, int binW)
+{
+    std::vector<SDL_Point> at(sizes.size(), SDL_Point{0, 0});
+    std::vector<SkylineSeg> sky = {{0, 0, binW}};
+    for (size_t n = 0; n < sizes.size(); n++) {
+        int w = std::min(sizes[n].x, binW);
+        size_t best = 0;
+        int bestY = -1;
+        for (size_t i = 0; i < sky.size(); i++) {
+            int y = skyline_fit(sky, i, w, binW);
+            if (y >= 0 && (bestY < 0 || y < bestY)) { best = i; bestY = y; }
+        }
+        at[n] = {sky[best].x, bestY};
+        skyline_add(sky, best, w, bestY + sizes[n].y);
+    }
+    return at;
+}
+
+static void cleanup_extent(Block* b, SDL_Rect& box)
+{
+    for (; b; b = b->next) {
+        int x1 = std::max(box.x + box.w, b->x + b->w);
+        int y1 = std::max(box.y + box.h, b->y + block_total_height(b));
+        box.x = std::min(box.x, b->x);
+        box.y = std::min(box.y, b->y);
+        box.w = x1 - box.x;
+        box.h = y1 - box.y;
+        cleanup_extent(b->innerFirst, box);
+        cleanup_extent(b->elseFirst, box);
+    }
+}
+
+// Moves a stack, bodies included, by (dx, dy).
+static void cleanup_shift(Block* b, int dx, int dy)
+{
+    for (; b; b = b->next) {
+        b->x += dx;
+        b->y += dy;
+        cleanup_shift(b->innerFirst, dx, dy);
+        cleanup_shift(b->elseFirst, dx, dy);
+    }
+}
+
+static void cleanup_place(const std::vector<CleanupMove>& moves, float t)
+{
+    for (const CleanupMove& m : moves) {
+        if (!block_ref_valid(m.top)) continue;
+        Block* top = m.top;
+        if (top->buried) continue;
+        int x = m.fromX + (int)std::lround((m.toX - m.fromX) * t);
+        int y = m.fromY + (int)std::lround((m.toY - m.fromY) * t);
+        cleanup_shift(top, x - top->x, y - top->y);
+    }
+    layout_moved();
+}
+
+// Moves the glide on to `now`; call once a frame.
+inline void cleanup_step(Uint32 now)
+{
+    if (g_cleanup.moves.empty()) return;
+    float t = std::min(1.0f, (float)(now - g_cleanup.start) / CLEANUP_MS);
+    float ease = 1.0f - (1.0f - t) * (1.0f - t) * (1.0f - t);
+    cleanup_place(g_cleanup.moves, ease);
+    if (t >= 1.0f) g_cleanup.moves.clear();
+}
+
+inline void cleanup_finish()
+{
+    if (g_cleanup.moves.empty()) return;
+    cleanup_place(g_cleanup.moves, 1.0f);
+    g_cleanup.moves.clear();
+}
+
+// Arranges the stacks in `blocks` from the top-left of `view`. Returns how
+// many stacks moved.
+int cleanup_blocks(std::vector<Block*>& blocks, const Workspace& view)
+{
+    cleanup_finish();
+    layout_workspace(blocks);
+
+    std::unordered_set<Block*> bodies;
+    for (Block* b : blocks) {
+        for (Block* c = b->innerFirst; c; c = c->next) bodies.insert(c);
+        for (Block* c = b->elseFirst;  c; c = c->next) bodies.insert(c);
+    }
+    struct Stack { Block* top; SDL_Rect box; };
+    std::vector<Stack> stacks;
+    for (Block* b : blocks) {
+        if (b->prev || bodies.count(b)) continue;
+        SDL_Rect box = {b->x, b->y, 0, 0};
+        cleanup_extent(b, box);
+        stacks.push_back({b, box});
+    }
+    if (stacks.empty()) return 0;
+    std::stable_sort(stacks.begin(), stacks.end(), [](const Stack& a, const Stack& b) {
+        if (a.box.h != b.box.h) return a.box.h > b.box.h;
+        return a.box.y != b.box.y ? a.box.y < b.box.y : a.box.x < b.box.x;
+    });
+
+    std::vector<SDL_Point> sizes;
+    double area = 0;
+    int widest = 0;
+    for (const Stack& s : stacks) {
+        sizes.push_back({s.box.w + CLEANUP_GAP, s.box.h + CLEANUP_GAP});
+        area  += (double)sizes.back().x * sizes.back().y;
+        widest = std::max(widest, sizes.back().x);
+    }
+    double aspect = (double)std::max(1, view.w) / std::max(1, view.h);
+    int binW = std::max({widest, view.w - CLEANUP_GAP, (int)std::ceil(std::sqrt(area * aspect))});
+    std::vector<SDL_Point> at = skyline_pack(sizes, binW);
+
+    std::vector<CleanupMove> moves;
+    for (size_t i = 0; i < stacks.size(); i++) {
+        Block* top = stacks[i].top;
+        int toX = view.x + CLEANUP_GAP + at[i].x + (top->x - stacks[i].box.x);
+        int toY = view.y + CLEANUP_GAP + at[i].y + (top->y - stacks[i].box.y);
+        if (toX != top->x || toY != top->y)
+            moves.push_back({top, top->x, top->y, toX, toY});
+    }
+    if (moves.empty()) return 0;
+
+    undo_begin(blocks, UNDO_DRAG);
+    undo_touch_all(blocks);
+    cleanup_place(moves, 1.0f);
+    undo_commit();
+    cleanup_place(moves, 0.0f);
+    g_cleanup.moves = std::move(moves);
+    g_cleanup.start = SDL_GetTicks();
+    return (int)g_cleanup.moves.size();
+}
+
+// The code area's right-click menu, with its one entry.
+inline SDL_Rect cleanup_menu_rect(int mx, int my)
+{
+    return {mx, my, 140, 26};
+}
+
+void draw_cleanup_menu(SDL_Renderer* r, TTF_Font* font, const SDL_Rect& rc)
+{
+    SDL_SetRenderDrawColor(r, 255, 255, 255, 255);
+    SDL_RenderFillRect(r, &rc);
+    SDL_SetRenderDrawColor(r, 180, 180, 190, 255);
+    SDL_RenderDrawRect(r, &rc);
+    draw_text(r, font, "Clean up blocks", rc.x + 10, rc.y + 5, COLOR_TEXT_DARK);
+}
+
+#endif
@@ -11,7 +11,10 @@
 #include <SDL2/SDL.h>
 #include "structs.h"
 #include "globals.h"
+#include "block_pool.h"
+#include "packed_script.h"
 #include "OperatorManager.h"
+#include "Audio.h"
 
 
 #ifndef M_PI
@@ -33,71 +36,68 @@ static Sprite* g_currentSprite = nullptr;
 static SDL_Renderer* g_renderer = nullptr;
 static Stage*   g_stage         = nullptr;
 
-static float eval_embedded_numeric(Block* b);
-static bool  eval_embedded_boolean(Block* b);
+static float eval_number(const PackedScript& p, Uint32 n);
+static bool  eval_bool(const PackedScript& p, Uint32 n);
 static std::string float_to_str(float v);
 
-static float get_input_val(Block* b, int idx, float fallback = 0.0f) {
-    if (idx < (int)b->inputs.size()) {
-        if (b->inputs[idx].embeddedBlock) {
-            return eval_embedded_numeric(b->inputs[idx].embeddedBlock);
-        }
-        try { return std::stof(b->inputs[idx].value); }
-        catch (...) {}
+static float get_input_val(const PackedScript& p, Uint32 n, int idx, float fallback = 0.0f) {
+    if (idx < p.argCount[n]) {
+        Uint32 a = p.firstArg[n] + idx;
+        if (p.argKind[a] == ARG_EXPR)   return eval_number(p, p.argExpr[a]);
+        if (p.argKind[a] == ARG_NUMBER) return p.argNum[a];
     }
     return fallback;
 }
 
-static bool get_input_bool(Block* b, int idx) {
-    if (idx < (int)b->inputs.size()) {
-        if (b->inputs[idx].embeddedBlock) {
-            return eval_embedded_boolean(b->inputs[idx].embeddedBlock);
-        }
-        float val = 0;
-        try { val = std::stof(b->inputs[idx].value); } catch (...) {}
-        return val != 0.0f;
+static bool get_input_bool(const PackedScript& p, Uint32 n, int idx) {
+    if (idx < p.argCount[n]) {
+        Uint32 a = p.firstArg[n] + idx;
+        if (p.argKind[a] == ARG_EXPR) return eval_bool(p, p.argExpr[a]);
+        return p.argKind[a] == ARG_NUMBER && p.argNum[a] != 0.0f;
     }
     return false;
 }
 
-static float eval_embedded_numeric(Block* b) {
-    if (!b) return 0.0f;
-    const std::string& txt = b->text;
-    float a = get_input_val(b, 0, 0.0f);
-    float c = get_input_val(b, 1, 0.0f);
-
-    if (txt.find("() + ()") != std::string::npos) return a + c;
-    if (txt.find("() - ()") != std::string::npos) return a - c;
-    if (txt.find("() * ()") != std::string::npos) return a * c;
-    if (txt.find("() / ()") != std::string::npos) return (c != 0) ? a / c : 0;
-    if (txt.find("() mod ()") != std::string::npos) return (c != 0) ? std::fmod(a, c) : 0;
-    if (txt.find("round ()") != std::string::npos) return std::round(a);
-    if (txt.find("abs of ()") != std::string::npos) return std::abs(a);
-    if (txt.find("sqrt of ()") != std::string::npos) return (a >= 0) ? std::sqrt(a) : 0;
-    if (txt.find("floor of ()") != std::string::npos) return std::floor(a);
-    if (txt.find("ceiling of ()") != std::string::npos) return std::ceil(a);
-    if (txt.find("sin of ()") != std::string::npos) return (float)std::sin(a * M_PI / 180.0);
-    if (txt.find("cos of ()") != std::string::npos) return (float)std::cos(a * M_PI / 180.0);
-    if (txt.find("tan of ()") != std::string::npos) return (float)std::tan(a * M_PI / 180.0);
-    if (txt.find("pick random") != std::string::npos) {
+static float eval_number(const PackedScript& p, Uint32 n) {
+    float a = get_input_val(p, n, 0, 0.0f);
+    float c = get_input_val(p, n, 1, 0.0f);
+
+    switch (p.op[n]) {
+    case OP_NUM_ADD:   return a + c;
+    case OP_NUM_SUB:   return a - c;
+    case OP_NUM_MUL:   return a * c;
+    case OP_NUM_DIV:   return (c != 0) ? a / c : 0;
+    case OP_NUM_MOD:   return (c != 0) ? std::fmod(a, c) : 0;
+    case OP_NUM_ROUND: return std::round(a);
+    case OP_NUM_ABS:   return std::abs(a);
+    case OP_NUM_SQRT:  return (a >= 0) ? std::sqrt(a) : 0;
+    case OP_NUM_FLOOR: return std::floor(a);
+    case OP_NUM_CEIL:  return std::ceil(a);
+    case OP_NUM_SIN:   return (float)std::sin(a * M_PI / 180.0);
+    case OP_NUM_COS:   return (float)std::cos(a * M_PI / 180.0);
+    case OP_NUM_TAN:   return (float)std::tan(a * M_PI / 180.0);
+    case OP_NUM_RANDOM: {
         int lo = (int)a, hi = (int)c;
         if (hi < lo) std::swap(lo, hi);
         return (float)(lo + rand() % (hi - lo + 1));
     }
-    if (txt == "timer" || txt.find("timer") != std::string::npos)
+    case OP_NUM_TIMER:
         return (float)(SDL_GetTicks() - g_timerStart) / 1000.0f;
-    if (txt == "mouse x") {
+    case OP_NUM_LOUDNESS:
+        return (float)audio_loudness();
+    case OP_NUM_MOUSE_X: {
         int mx2, my2; SDL_GetMouseState(&mx2, &my2);
         return (float)(mx2 - (STAGE_X + STAGE_WIDTH / 2));
     }
-    if (txt == "mouse y") {
+    case OP_NUM_MOUSE_Y: {
         int mx2, my2; SDL_GetMouseState(&mx2, &my2);
         return (float)((STAGE_Y + STAGE_HEIGHT / 2) - my2);
     }
-    if (txt == "answer") {
-        try { return std::stof(g_answer); } catch (...) { return 0.0f; }
+    case OP_NUM_ANSWER: {
+        float v;
+        return parse_literal(g_answer, v) ? v : 0.0f;
     }
-    if (txt.find("distance to mouse") != std::string::npos) {
+    case OP_NUM_MOUSE_DIST: {
         if (!g_currentSprite) return 0.0f;
         int mx2, my2; SDL_GetMouseState(&mx2, &my2);
         float scx = STAGE_X + g_currentSprite->x + g_currentSprite->w * g_currentSprite->scale / 2.0f;
@@ -105,29 +105,28 @@ static float eval_embedded_numeric(Block* b) {
         float dx2 = (float)(mx2 - scx), dy2 = (float)(my2 - scy);
         return std::sqrt(dx2*dx2 + dy2*dy2);
     }
-    if (txt.find("() < ()") != std::string::npos) return (a < c) ? 1.0f : 0.0f;
-    if (txt.find("() > ()") != std::string::npos) return (a > c) ? 1.0f : 0.0f;
-    if (txt.find("() = ()") != std::string::npos) return (a == c) ? 1.0f : 0.0f;
-    if (txt.find("<> and <>") != std::string::npos) return (get_input_bool(b,0) && get_input_bool(b,1)) ? 1.0f : 0.0f;
-    if (txt.find("<> or <>") != std::string::npos)  return (get_input_bool(b,0) || get_input_bool(b,1)) ? 1.0f : 0.0f;
-    if (txt.find("not <>") != std::string::npos)    return (!get_input_bool(b,0)) ? 1.0f : 0.0f;
-    return 0.0f;
+    case OP_NUM_LT:  return (a < c) ? 1.0f : 0.0f;
+    case OP_NUM_GT:  return (a > c) ? 1.0f : 0.0f;
+    case OP_NUM_EQ:  return (a == c) ? 1.0f : 0.0f;
+    case OP_NUM_AND: return (get_input_bool(p,n,0) && get_input_bool(p,n,1)) ? 1.0f : 0.0f;
+    case OP_NUM_OR:  return (get_input_bool(p,n,0) || get_input_bool(p,n,1)) ? 1.0f : 0.0f;
+    case OP_NUM_NOT: return (!get_input_bool(p,n,0)) ? 1.0f : 0.0f;
+    default:         return 0.0f;
+    }
 }
 
-static bool eval_embedded_boolean(Block* b) {
-    if (!b) return false;
-    const std::string& txt = b->text;
-    float a = get_input_val(b, 0, 0.0f);
-    float c = get_input_val(b, 1, 0.0f);
-
-    if (txt.find("() < ()") != std::string::npos) return a < c;
-    if (txt.find("() > ()") != std::string::npos) return a > c;
-    if (txt.find("() = ()") != std::string::npos) return a == c;
-    if (txt.find("<> and <>") != std::string::npos) return get_input_bool(b,0) && get_input_bool(b,1);
-    if (txt.find("<> or <>") != std::string::npos)  return get_input_bool(b,0) || get_input_bool(b,1);
-    if (txt.find("not <>") != std::string::npos)    return !get_input_bool(b,0);
-
-    if (txt.find("touching mouse-pointer") != std::string::npos) {
+static bool eval_bool(const PackedScript& p, Uint32 n) {
+    float a = get_input_val(p, n, 0, 0.0f);
+    float c = get_input_val(p, n, 1, 0.0f);
+
+    switch (p.boolOp[n]) {
+    case OP_BOOL_LT:  return a < c;
+    case OP_BOOL_GT:  return a > c;
+    case OP_BOOL_EQ:  return a == c;
+    case OP_BOOL_AND: return get_input_bool(p,n,0) && get_input_bool(p,n,1);
+    case OP_BOOL_OR:  return get_input_bool(p,n,0) || get_input_bool(p,n,1);
+    case OP_BOOL_NOT: return !get_input_bool(p,n,0);
+    case OP_BOOL_TOUCH_MOUSE: {
         if (!g_currentSprite) return false;
         int mx2, my2; SDL_GetMouseState(&mx2, &my2);
         float sx = g_currentSprite->x + STAGE_X;
@@ -136,60 +135,48 @@ static bool eval_embedded_boolean(Block* b) {
         float sh = g_currentSprite->h * g_currentSprite->scale;
         return mx2 >= sx && mx2 <= sx + sw && my2 >= sy && my2 <= sy + sh;
     }
-    if (txt.find("touching edge") != std::string::npos) {
+    case OP_BOOL_TOUCH_EDGE: {
         if (!g_currentSprite) return false;
         float maxX = (float)(STAGE_WIDTH  - (int)(g_currentSprite->w * g_currentSprite->scale));
         float maxY = (float)(STAGE_HEIGHT - (int)(g_currentSprite->h * g_currentSprite->scale));
         return g_currentSprite->x <= 0 || g_currentSprite->x >= maxX
             || g_currentSprite->y <= 0 || g_currentSprite->y >= maxY;
     }
-    if (txt.find("mouse down") != std::string::npos ||
-        (txt.find("down") != std::string::npos && txt.find("mouse") != std::string::npos)) {
+    case OP_BOOL_MOUSE_DOWN: {
         int mx2, my2;
         Uint32 mb = SDL_GetMouseState(&mx2, &my2);
         return (mb & SDL_BUTTON(1)) != 0;
     }
-    if (txt.find("key") != std::string::npos &&
-        txt.find("pressed") != std::string::npos) {
-        const Uint8* keys = SDL_GetKeyboardState(nullptr);
-        if (txt.find("space")  != std::string::npos) return keys[SDL_SCANCODE_SPACE]  != 0;
-        if (txt.find("right")  != std::string::npos) return keys[SDL_SCANCODE_RIGHT]  != 0;
-        if (txt.find("left")   != std::string::npos) return keys[SDL_SCANCODE_LEFT]   != 0;
-        if (txt.find("up")     != std::string::npos) return keys[SDL_SCANCODE_UP]     != 0;
-        if (txt.find("down")   != std::string::npos) return keys[SDL_SCANCODE_DOWN]   != 0;
-        if (txt.find("enter")  != std::string::npos) return keys[SDL_SCANCODE_RETURN] != 0;
-        if (txt.find("escape") != std::string::npos) return keys[SDL_SCANCODE_ESCAPE] != 0;
-        for (char ch = 'a'; ch <= 'z'; ch++) {
-            std::string letter(1, ch);
-            if (txt.find(letter) != std::string::npos) {
-                SDL_Scancode sc = SDL_GetScancodeFromKey(SDLK_a + (ch - 'a'));
-                return keys[sc] != 0;
-            }
-        }
-        for (char ch = '0'; ch <= '9'; ch++) {
-            std::string digit(1, ch);
-            if (txt.find(digit) != std::string::npos) {
-                SDL_Scancode sc = SDL_GetScancodeFromKey(SDLK_0 + (ch - '0'));
-                return keys[sc] != 0;
-            }
-        }
-        return false;
+    case OP_BOOL_KEY:
+        return p.imm[n] >= 0 && SDL_GetKeyboardState(nullptr)[p.imm[n]] != 0;
+    default:
+        return eval_number(p, n) != 0.0f;
     }
-
-    return eval_embedded_numeric(b) != 0.0f;
 }
 
-static std::string get_input_str(Block* b, int idx,
+static std::string get_input_str(const PackedScript& p, Uint32 n, int idx,
                                   const std::string& fallback = "") {
-    if (idx < (int)b->inputs.size()) {
-        if (b->inputs[idx].embeddedBlock) {
-            return float_to_str(eval_embedded_numeric(b->inputs[idx].embeddedBlock));
-        }
-        return b->inputs[idx].value;
+    if (idx < p.argCount[n]) {
+        Uint32 a = p.firstArg[n] + idx;
+        if (p.argKind[a] == ARG_EXPR)
+            return float_to_str(eval_number(p, p.argExpr[a]));
+        return p.argText[a];
     }
     return fallback;
 }
 
+// Reads one input of a block outside a running script, e.g. a hat block.
+static float block_input_val(Block* b, int idx, float fallback) {
+    if (idx >= (int)b->inputs.size()) return fallback;
+    if (!b->inputs[idx].embeddedBlock) {
+        float v;
+        return parse_literal(b->inputs[idx].value, v) ? v : fallback;
+    }
+    PackedScript p;
+    Uint32 n = script_pack_node(p, b, true);
+    return get_input_val(p, n, idx, fallback);
+}
+
 static float parse_float(const std::string& txt,
                            const std::string& after, float fallback = 0.0f) {
     size_t pos = txt.find(after);
@@ -217,6 +204,36 @@ static std::string float_to_str(float v) {
     return s;
 }
 
+static SoundClip* find_sound(const std::string& sname) {
+    if (!g_soundsPanel) return nullptr;
+    for (auto& sc : g_soundsPanel->sounds) {
+        if (sname.empty()
+            || sc.name.find(sname) != std::string::npos
+            || sname.find(sc.name) != std::string::npos)
+            return &sc;
+    }
+    return nullptr;
+}
+
+// Starts decoding whatever the block about to run will show or play, so it
+// is ready by the time the block executes. Only literal inputs are read;
+// evaluating a reporter early could have side effects.
+static void prefetch_assets(const PackedScript& p, Uint32 n, Sprite* sprite) {
+    if (n == PACK_NONE || p.argCount[n] == 0) return;
+    Uint32 a = p.firstArg[n];
+    if (p.argKind[a] == ARG_EXPR) return;
+    if (p.op[n] == OP_SWITCH_COSTUME) {
+        int idx = (int)get_input_val(p, n, 0, 0);
+        if (idx >= 1) idx--;
+        if (idx >= 0 && idx < (int)sprite->costumes.size())
+            asset_costume_prefetch(sprite->costumes[idx]);
+    }
+    else if (p.op[n] == OP_PLAY_SOUND || p.op[n] == OP_PLAY_SOUND_WAIT) {
+        if (SoundClip* sc = find_sound(p.argText[a]))
+            asset_sound_prefetch(*sc);
+    }
+}
+
 static void clamp_sprite(Sprite* s) {
     float maxX = (float)(STAGE_WIDTH  - (int)(s->w * s->scale));
     float maxY = (float)(STAGE_HEIGHT - (int)(s->h * s->scale));
@@ -227,27 +244,47 @@ static void clamp_sprite(Sprite* s) {
 }
 
 struct LoopFrame {
-    Block*  loopBlock;
-    Block*  current;
+    Uint32  loopBlock;
+    Uint32  current;
     int     remaining;
     bool    inElse;
 };
 
+static bool script_block_live(BlockRef r) {
+    return block_ref_valid(r) && ((r.bits & BLOCK_REF_PALETTE) || !r->buried);
+}
+
 struct ScriptRunner {
     bool   running   = false;
     bool   paused    = false;
-    Block* current   = nullptr;
+    PackedScript prog;
+    BlockRef root;
+    bool   stale     = false;
+    Uint32 current   = PACK_NONE;
     Uint32 waitUntil = 0;
     bool   waiting   = false;
     bool   saySilent = false;
+    SoundHandle waitSound;
+    bool   waitingSound = false;
+    Uint64 musicCursor  = 0;
+    Uint32 synthOwner   = 0;
+    Uint64 waitFrame    = 0;
+    bool   waitingFrame = false;
     std::vector<LoopFrame> loopStack;
     std::vector<Variable>* vars = nullptr;
 
     Sprite* askSprite = nullptr;
 
     void start(Block* first, std::vector<Variable>* varList = nullptr) {
-        running = true; paused = false; current = first;
+        if (running) synth_release_owner(synthOwner);
+        synthOwner = synth_new_owner();
+        running = true; paused = false;
+        root = first; stale = false;
+        script_pack(prog, first);
+        current = script_node(prog, first);
         waitUntil = 0; waiting = false; saySilent = false;
+        waitingSound = false; waitingFrame = false;
+        musicCursor = 0;
         loopStack.clear();
         vars = varList;
         g_hasOperatorResult  = false;
@@ -257,10 +294,13 @@ struct ScriptRunner {
     }
 
     void stop() {
-        running = false; paused = false; current = nullptr;
+        running = false; paused = false; current = PACK_NONE;
+        root = nullptr; stale = false;
         waiting = false; saySilent = false;
+        waitingSound = false; waitingFrame = false;
         loopStack.clear();
         g_askPending = false;
+        synth_release_owner(synthOwner);
     }
 
     void togglePause() {
@@ -268,6 +308,40 @@ struct ScriptRunner {
         paused = !paused;
     }
 
+    // The blocks were edited; the program is rebuilt before the next step.
+    void invalidate() {
+        if (running) stale = true;
+    }
+
+    // Packs the script again and moves the position and loop frames over to
+    // the new nodes. Blocks the runner is inside of that were dragged out of
+    // the script are packed as extra chains so it carries on where it was,
+    // as it would have following the blocks themselves. If one of them was
+    // deleted the script stops.
+    void repack() {
+        stale = false;
+        std::vector<BlockRef> at;
+        at.push_back(current != PACK_NONE ? prog.source[current] : BlockRef());
+        for (auto& f : loopStack) {
+            at.push_back(prog.source[f.loopBlock]);
+            at.push_back(f.current != PACK_NONE ? prog.source[f.current] : BlockRef());
+        }
+        for (BlockRef b : at)
+            if (b.bits && !script_block_live(b)) { stop(); return; }
+        if (!script_block_live(root)) { stop(); return; }
+
+        script_pack(prog, root);
+        for (BlockRef b : at)
+            if (b.bits && !prog.nodeOf.count(b.get())) script_pack_chain(prog, b);
+
+        size_t k = 0;
+        current = script_node(prog, at[k++]);
+        for (auto& f : loopStack) {
+            f.loopBlock = script_node(prog, at[k++]);
+            f.current   = script_node(prog, at[k++]);
+        }
+    }
+
     void syncVarsBack() {
         if (!vars) return;
         for (auto& v : *vars) {
@@ -278,11 +352,24 @@ struct ScriptRunner {
 
     void update(Sprite* sprite) {
         if (!running || paused || !sprite) return;
+        if (stale) {
+            repack();
+            if (!running) return;
+        }
         askSprite = sprite;
         g_currentSprite = sprite;
 
         if (g_askPending) return;
 
+        if (waitingSound) {
+            if (audio_handle_active(waitSound)) return;
+            waitingSound = false;
+        }
+        if (waitingFrame) {
+            if (g_mixerOpen && synth_schedule_floor() + g_audioBlockFrames < waitFrame) return;
+            waitingFrame = false;
+        }
+
         Uint32 now = SDL_GetTicks();
         if (waiting) {
             if (now < waitUntil) return;
@@ -291,7 +378,7 @@ struct ScriptRunner {
                 sprite->sayText = ""; sprite->sayTimer = 0; saySilent = false;
             }
         }
-        if (!current) {
+        if (current == PACK_NONE) {
             if (!loopStack.empty()) {
                 advance_loop(sprite);
                 return;
@@ -300,557 +387,546 @@ struct ScriptRunner {
         }
         bool jumped = execute_block(current, sprite, now);
         if (!jumped) advance(current, sprite);
+        prefetch_assets(prog, current, sprite);
         syncVarsBack();
     }
 
-    bool eval_condition(Block* b) {
-        if (b->inputs.empty()) return false;
-        if (b->inputs[0].embeddedBlock) {
-            return eval_embedded_boolean(b->inputs[0].embeddedBlock);
+    // Places the next musical event back to back with the previous one so
+    // sequences stay sample-accurate regardless of frame timing. The script
+    // resumes a block early so the following event is queued in time.
+    Uint64 schedule_music(float beats) {
+        Uint64 floor = synth_schedule_floor();
+        if (musicCursor < floor) musicCursor = floor;
+        Uint64 start = musicCursor;
+        musicCursor += synth_beats_to_frames(beats);
+        if (g_mixerOpen) {
+            waitFrame    = musicCursor;
+            waitingFrame = true;
+        } else {
+            waitUntil = SDL_GetTicks() + (Uint32)(beats * 60000.0f / g_musicTempo);
+            waiting   = true;
         }
-        const std::string& val = b->inputs[0].value;
-        float fval = 0;
-        try { fval = std::stof(val); } catch (...) {}
-        return fval != 0.0f;
+        return start;
     }
 
-    bool execute_block(Block* b, Sprite* sprite, Uint32 now) {
-        const std::string& txt = b->text;
-
-        if (b->type == BLOCK_EVENT) return false;
+    bool enter(Uint32 n, Uint32 body, int count, bool inElse) {
+        loopStack.push_back({n, body, count, inElse});
+        current = body;
+        return true;
+    }
 
-        if (b->type == BLOCK_MOTION) {
-            if (txt.find("move") != std::string::npos &&
-                txt.find("steps") != std::string::npos) {
-                float steps = get_input_val(b, 0, 10);
-                double rad = (sprite->direction - 90.0) * M_PI / 180.0;
-                sprite->x += (float)(steps * std::cos(rad));
-                sprite->y += (float)(steps * std::sin(rad));
-                clamp_sprite(sprite);
-            }
-            else if (txt.find("turn right") != std::string::npos ||
-                     (txt.find("turn") != std::string::npos &&
-                      txt.find("left") == std::string::npos)) {
-                float deg = get_input_val(b, 0, 15);
-                sprite->direction += deg;
-            }
-            else if (txt.find("turn left") != std::string::npos) {
-                float deg = get_input_val(b, 0, 15);
-                sprite->direction -= deg;
-            }
-            else if (txt.find("go to x:") != std::string::npos) {
-                float gx = get_input_val(b, 0, 0);
-                float gy = get_input_val(b, 1, 0);
-                sprite->x = STAGE_WIDTH  / 2.0f + gx - sprite->w * sprite->scale / 2.0f;
-                sprite->y = STAGE_HEIGHT / 2.0f - gy - sprite->h * sprite->scale / 2.0f;
-                clamp_sprite(sprite);
-            }
-            else if (txt.find("go to random") != std::string::npos) {
-                sprite->x = (float)(rand() % (STAGE_WIDTH  - (int)(sprite->w * sprite->scale)));
-                sprite->y = (float)(rand() % (STAGE_HEIGHT - (int)(sprite->h * sprite->scale)));
-            }
-            else if (txt.find("go to mouse") != std::string::npos) {
-                int mx, my;
-                SDL_GetMouseState(&mx, &my);
-                sprite->x = (float)(mx - STAGE_X) - sprite->w * sprite->scale / 2.0f;
-                sprite->y = (float)(my - STAGE_Y) - sprite->h * sprite->scale / 2.0f;
-                clamp_sprite(sprite);
-            }
-            else if (txt.find("glide") != std::string::npos &&
-                     txt.find("secs") != std::string::npos) {
-                float secs = get_input_val(b, 0, 1);
-                float gx   = get_input_val(b, 1, 0);
-                float gy   = get_input_val(b, 2, 0);
-                sprite->x = STAGE_WIDTH  / 2.0f + gx - sprite->w * sprite->scale / 2.0f;
-                sprite->y = STAGE_HEIGHT / 2.0f - gy - sprite->h * sprite->scale / 2.0f;
-                clamp_sprite(sprite);
-                waitUntil = SDL_GetTicks() + (Uint32)(secs * 1000);
-                waiting = true;
-            }
-            else if (txt.find("point in direction") != std::string::npos) {
-                sprite->direction = get_input_val(b, 0, 90);
-            }
-            else if (txt.find("point towards mouse") != std::string::npos) {
-                int mx, my;
-                SDL_GetMouseState(&mx, &my);
-                float sx = STAGE_X + sprite->x + sprite->w * sprite->scale / 2.0f;
-                float sy = STAGE_Y + sprite->y + sprite->h * sprite->scale / 2.0f;
-                float dx = (float)(mx - sx), dy = (float)(my - sy);
-                sprite->direction = (float)(std::atan2(dy, dx) * 180.0 / M_PI) + 90.0f;
-            }
-            else if (txt.find("change x by") != std::string::npos) {
-                sprite->x += get_input_val(b, 0, 10);
-                clamp_sprite(sprite);
-            }
-            else if (txt.find("change y by") != std::string::npos) {
-                sprite->y -= get_input_val(b, 0, 10);
-                clamp_sprite(sprite);
-            }
-            else if (txt.find("set x to") != std::string::npos) {
-                float val = get_input_val(b, 0, 0);
-                sprite->x = STAGE_WIDTH / 2.0f + val - sprite->w * sprite->scale / 2.0f;
-                clamp_sprite(sprite);
-            }
-            else if (txt.find("set y to") != std::string::npos) {
-                float val = get_input_val(b, 0, 0);
-                sprite->y = STAGE_HEIGHT / 2.0f - val - sprite->h * sprite->scale / 2.0f;
-                clamp_sprite(sprite);
-            }
-            else if (txt.find("if on edge") != std::string::npos) {
-                float maxX = (float)(STAGE_WIDTH  - (int)(sprite->w * sprite->scale));
-                float maxY = (float)(STAGE_HEIGHT - (int)(sprite->h * sprite->scale));
-                if (sprite->x <= 0 || sprite->x >= maxX)
-                    sprite->direction = 180.0f - sprite->direction;
-                if (sprite->y <= 0 || sprite->y >= maxY)
-                    sprite->direction = -sprite->direction;
-                clamp_sprite(sprite);
-            }
+    bool execute_block(Uint32 n, Sprite* sprite, Uint32 /*now*/) {
+        const PackedScript& p = prog;
+        Uint8 op = p.op[n];
+
+        if (op >= OP_CALC_ADD && op <= OP_CALC_NONE)
+            return execute_operator(n, op, sprite);
+
+        switch (op) {
+        case OP_MOVE: {
+            float steps = get_input_val(p, n, 0, 10);
+            double rad = (sprite->direction - 90.0) * M_PI / 180.0;
+            sprite->x += (float)(steps * std::cos(rad));
+            sprite->y += (float)(steps * std::sin(rad));
+            clamp_sprite(sprite);
+            break;
         }
-
-        else if (b->type == BLOCK_LOOKS) {
-            if (txt.find("say") != std::string::npos ||
-                txt.find("think") != std::string::npos) {
-                if (txt.find("for") != std::string::npos && b->inputs.size() >= 2) {
-                    sprite->sayText  = get_input_str(b, 0, "Hello!");
-                    float secs = get_input_val(b, 1, 2);
-                    sprite->sayTimer = (int)(secs * 60);
-                    waitUntil = SDL_GetTicks() + (Uint32)(secs * 1000);
-                    waiting = true; saySilent = true;
-                } else if (!b->inputs.empty()) {
-                    sprite->sayText  = get_input_str(b, 0, "Hello!");
-                    sprite->sayTimer = 999999;
-                } else {
-                    sprite->sayText  = "Hello!";
-                    sprite->sayTimer = 999999;
-                }
-            }
-            else if (txt == "show")        { sprite->visible = true; }
-            else if (txt == "hide")        { sprite->visible = false; }
-            else if (txt.find("set size to") != std::string::npos) {
-                float val = get_input_val(b, 0, 100);
-                sprite->scale = val / 100.0f;
-                if (sprite->scale < 0.05f) sprite->scale = 0.05f;
-            }
-            else if (txt.find("change size by") != std::string::npos) {
-                float val = get_input_val(b, 0, 10);
-                sprite->scale += val / 100.0f;
-                if (sprite->scale < 0.05f) sprite->scale = 0.05f;
-            }
-            else if (txt.find("next costume") != std::string::npos) {
-                if (!sprite->costumes.empty()) {
-                    sprite->currentCostume =
-                        (sprite->currentCostume + 1) % (int)sprite->costumes.size();
-                    if (sprite->costumes[sprite->currentCostume].texture)
-                        sprite->texture = sprite->costumes[sprite->currentCostume].texture;
-                }
-            }
-            else if (txt.find("switch costume to") != std::string::npos) {
-                int idx = (int)get_input_val(b, 0, 0);
-                if (idx >= 1) idx--;
-                if (idx >= 0 && idx < (int)sprite->costumes.size()) {
-                    sprite->currentCostume = idx;
-                    if (sprite->costumes[idx].texture)
-                        sprite->texture = sprite->costumes[idx].texture;
-                }
-            }
-            else if (txt.find("switch backdrop to") != std::string::npos) {
-                int idx = (int)get_input_val(b, 0, 1);
-                if (g_stage) {
-                    SDL_Color bgColors[] = {
-                        {255,255,255,255},
-                        {173,216,230,255},
-                        {255,228,196,255},
-                        {144,238,144,255}
-                    };
-                    int ci = ((idx-1) % 4 + 4) % 4;
-                    g_stage->color = bgColors[ci];
-                }
-            }
-            else if (txt.find("next backdrop") != std::string::npos) {
-                if (g_stage) {
-                    static int bgIdx = 0;
-                    bgIdx = (bgIdx + 1) % 4;
-                    SDL_Color bgColors[] = {
-                        {255,255,255,255},{173,216,230,255},
-                        {255,228,196,255},{144,238,144,255}
-                    };
-                    g_stage->color = bgColors[bgIdx];
-                }
-            }
+        case OP_TURN_RIGHT:
+            sprite->direction += get_input_val(p, n, 0, 15);
+            break;
+        case OP_TURN_LEFT:
+            sprite->direction -= get_input_val(p, n, 0, 15);
+            break;
+        case OP_GOTO_XY: {
+            float gx = get_input_val(p, n, 0, 0);
+            float gy = get_input_val(p, n, 1, 0);
+            sprite->x = STAGE_WIDTH  / 2.0f + gx - sprite->w * sprite->scale / 2.0f;
+            sprite->y = STAGE_HEIGHT / 2.0f - gy - sprite->h * sprite->scale / 2.0f;
+            clamp_sprite(sprite);
+            break;
+        }
+        case OP_GOTO_RANDOM:
+            sprite->x = (float)(rand() % (STAGE_WIDTH  - (int)(sprite->w * sprite->scale)));
+            sprite->y = (float)(rand() % (STAGE_HEIGHT - (int)(sprite->h * sprite->scale)));
+            break;
+        case OP_GOTO_MOUSE: {
+            int mx, my;
+            SDL_GetMouseState(&mx, &my);
+            sprite->x = (float)(mx - STAGE_X) - sprite->w * sprite->scale / 2.0f;
+            sprite->y = (float)(my - STAGE_Y) - sprite->h * sprite->scale / 2.0f;
+            clamp_sprite(sprite);
+            break;
+        }
+        case OP_GLIDE: {
+            float secs = get_input_val(p, n, 0, 1);
+            float gx   = get_input_val(p, n, 1, 0);
+            float gy   = get_input_val(p, n, 2, 0);
+            sprite->x = STAGE_WIDTH  / 2.0f + gx - sprite->w * sprite->scale / 2.0f;
+            sprite->y = STAGE_HEIGHT / 2.0f - gy - sprite->h * sprite->scale / 2.0f;
+            clamp_sprite(sprite);
+            waitUntil = SDL_GetTicks() + (Uint32)(secs * 1000);
+            waiting = true;
+            break;
+        }
+        case OP_POINT_DIR:
+            sprite->direction = get_input_val(p, n, 0, 90);
+            break;
+        case OP_POINT_MOUSE: {
+            int mx, my;
+            SDL_GetMouseState(&mx, &my);
+            float sx = STAGE_X + sprite->x + sprite->w * sprite->scale / 2.0f;
+            float sy = STAGE_Y + sprite->y + sprite->h * sprite->scale / 2.0f;
+            float dx = (float)(mx - sx), dy = (float)(my - sy);
+            sprite->direction = (float)(std::atan2(dy, dx) * 180.0 / M_PI) + 90.0f;
+            break;
+        }
+        case OP_CHANGE_X:
+            sprite->x += get_input_val(p, n, 0, 10);
+            clamp_sprite(sprite);
+            break;
+        case OP_CHANGE_Y:
+            sprite->y -= get_input_val(p, n, 0, 10);
+            clamp_sprite(sprite);
+            break;
+        case OP_SET_X: {
+            float val = get_input_val(p, n, 0, 0);
+            sprite->x = STAGE_WIDTH / 2.0f + val - sprite->w * sprite->scale / 2.0f;
+            clamp_sprite(sprite);
+            break;
+        }
+        case OP_SET_Y: {
+            float val = get_input_val(p, n, 0, 0);
+            sprite->y = STAGE_HEIGHT / 2.0f - val - sprite->h * sprite->scale / 2.0f;
+            clamp_sprite(sprite);
+            break;
+        }
+        case OP_BOUNCE: {
+            float maxX = (float)(STAGE_WIDTH  - (int)(sprite->w * sprite->scale));
+            float maxY = (float)(STAGE_HEIGHT - (int)(sprite->h * sprite->scale));
+            if (sprite->x <= 0 || sprite->x >= maxX)
+                sprite->direction = 180.0f - sprite->direction;
+            if (sprite->y <= 0 || sprite->y >= maxY)
+                sprite->direction = -sprite->direction;
+            clamp_sprite(sprite);
+            break;
         }
 
-        else if (b->type == BLOCK_EXTENSION) {
-            if (txt.find("pen down") != std::string::npos) {
-                sprite->penDown  = true;
-                sprite->lastPenX = sprite->x;
-                sprite->lastPenY = sprite->y;
-            }
-            else if (txt.find("pen up") != std::string::npos) {
-                sprite->penDown  = false;
-                sprite->lastPenX = -9999;
-                sprite->lastPenY = -9999;
-            }
-            else if (txt.find("erase all") != std::string::npos) {
-                if (g_renderer) pen_trail_clear(g_renderer);
-            }
-            else if (txt.find("stamp") != std::string::npos) {
-                if (g_renderer) pen_stamp(g_renderer, sprite);
-            }
-            else if (txt.find("set pen color") != std::string::npos) {
-                int idx = (int)get_input_val(b, 0, 0);
-                SDL_Color colors[] = {
-                    {0,0,0,255},{220,50,50,255},{50,180,50,255},
-                    {50,50,220,255},{230,170,30,255},{150,60,200,255}
+        case OP_SAY_FOR: {
+            sprite->sayText  = get_input_str(p, n, 0, "Hello!");
+            float secs = get_input_val(p, n, 1, 2);
+            sprite->sayTimer = (int)(secs * 60);
+            waitUntil = SDL_GetTicks() + (Uint32)(secs * 1000);
+            waiting = true; saySilent = true;
+            break;
+        }
+        case OP_SAY:
+            sprite->sayText  = get_input_str(p, n, 0, "Hello!");
+            sprite->sayTimer = 999999;
+            break;
+        case OP_SAY_HELLO:
+            sprite->sayText  = "Hello!";
+            sprite->sayTimer = 999999;
+            break;
+        case OP_SHOW: sprite->visible = true;  break;
+        case OP_HIDE: sprite->visible = false; break;
+        case OP_SET_SIZE:
+            sprite->scale = get_input_val(p, n, 0, 100) / 100.0f;
+            if (sprite->scale < 0.05f) sprite->scale = 0.05f;
+            break;
+        case OP_CHANGE_SIZE:
+            sprite->scale += get_input_val(p, n, 0, 10) / 100.0f;
+            if (sprite->scale < 0.05f) sprite->scale = 0.05f;
+            break;
+        case OP_NEXT_COSTUME:
+            if (!sprite->costumes.empty()) {
+                sprite->currentCostume =
+                    (sprite->currentCostume + 1) % (int)sprite->costumes.size();
+                Costume& c = sprite->costumes[sprite->currentCostume];
+                if (asset_costume_materialize(g_renderer, c))
+                    sprite->texture = c.texture;
+            }
+            break;
+        case OP_SWITCH_COSTUME: {
+            int idx = (int)get_input_val(p, n, 0, 0);
+            if (idx >= 1) idx--;
+            if (idx >= 0 && idx < (int)sprite->costumes.size()) {
+                sprite->currentCostume = idx;
+                if (asset_costume_materialize(g_renderer, sprite->costumes[idx]))
+                    sprite->texture = sprite->costumes[idx].texture;
+            }
+            break;
+        }
+        case OP_SWITCH_BACKDROP: {
+            int idx = (int)get_input_val(p, n, 0, 1);
+            if (g_stage) {
+                SDL_Color bgColors[] = {
+                    {255,255,255,255},
+                    {173,216,230,255},
+                    {255,228,196,255},
+                    {144,238,144,255}
                 };
-                sprite->penColor = colors[((idx % 6) + 6) % 6];
-            }
-            else if (txt.find("change pen size by") != std::string::npos) {
-                sprite->penSize += (int)get_input_val(b, 0, 1);
-                if (sprite->penSize < 1) sprite->penSize = 1;
-            }
-            else if (txt.find("set pen size to") != std::string::npos) {
-                sprite->penSize = (int)get_input_val(b, 0, 2);
-                if (sprite->penSize < 1) sprite->penSize = 1;
+                int ci = ((idx-1) % 4 + 4) % 4;
+                g_stage->color = bgColors[ci];
             }
+            break;
         }
-
-
-        else if (b->type == BLOCK_SOUND) {
-            if (g_soundsPanel) {
-                if (txt.find("play sound") != std::string::npos) {
-                    std::string sname = get_input_str(b, 0, "");
-                    bool untilDone = (txt.find("until done") != std::string::npos);
-                    for (auto& sc : g_soundsPanel->sounds) {
-                        bool match = sname.empty()
-                            || sc.name.find(sname) != std::string::npos
-                            || sname.find(sc.name) != std::string::npos;
-                        if (match) {
-                            if (sc.chunk) {
-                                int ch = Mix_PlayChannel(-1, sc.chunk, 0);
-                                sc.channel   = ch;
-                                sc.isPlaying = true;
-                                if (untilDone && sc.durationSecs > 0) {
-                                    waitUntil = SDL_GetTicks() + (Uint32)(sc.durationSecs * 1000);
-                                    waiting   = true;
-                                }
-                            }
-                            break;
-                        }
-                    }
-                }
-                else if (txt.find("stop all sounds") != std::string::npos) {
-                    Mix_HaltChannel(-1);
-                    for (auto& sc : g_soundsPanel->sounds)
-                        sc.isPlaying = false;
-                }
-                else if (txt.find("change volume by") != std::string::npos) {
-                    float delta = get_input_val(b, 0, 10);
-                    for (auto& sc : g_soundsPanel->sounds) {
-                        sc.volume = std::max(0.0f, std::min(100.0f, sc.volume + delta));
-                        if (sc.channel >= 0 && sc.isPlaying)
-                            Mix_Volume(sc.channel, (int)(sc.volume / 100.0f * MIX_MAX_VOLUME));
-                    }
-                }
-                else if (txt.find("set volume to") != std::string::npos) {
-                    float val = get_input_val(b, 0, 100);
-                    for (auto& sc : g_soundsPanel->sounds) {
-                        sc.volume = std::max(0.0f, std::min(100.0f, val));
-                        if (sc.channel >= 0 && sc.isPlaying)
-                            Mix_Volume(sc.channel, (int)(sc.volume / 100.0f * MIX_MAX_VOLUME));
-                    }
-                }
-                else if (txt.find("clear sound effects") != std::string::npos) {
-                    Mix_HaltChannel(-1);
-                }
-            }
+        case OP_NEXT_BACKDROP:
+            if (g_stage) {
+                static int bgIdx = 0;
+                bgIdx = (bgIdx + 1) % 4;
+                SDL_Color bgColors[] = {
+                    {255,255,255,255},{173,216,230,255},
+                    {255,228,196,255},{144,238,144,255}
+                };
+                g_stage->color = bgColors[bgIdx];
+            }
+            break;
+
+        case OP_PEN_DOWN:
+            sprite->penDown  = true;
+            sprite->lastPenX = sprite->x;
+            sprite->lastPenY = sprite->y;
+            break;
+        case OP_PEN_UP:
+            sprite->penDown  = false;
+            sprite->lastPenX = -9999;
+            sprite->lastPenY = -9999;
+            break;
+        case OP_PEN_CLEAR:
+            if (g_renderer) pen_trail_clear(g_renderer);
+            break;
+        case OP_STAMP:
+            if (g_renderer) pen_stamp(g_renderer, sprite);
+            break;
+        case OP_PEN_COLOR: {
+            int idx = (int)get_input_val(p, n, 0, 0);
+            SDL_Color colors[] = {
+                {0,0,0,255},{220,50,50,255},{50,180,50,255},
+                {50,50,220,255},{230,170,30,255},{150,60,200,255}
+            };
+            sprite->penColor = colors[((idx % 6) + 6) % 6];
+            break;
         }
-
-        else if (b->type == BLOCK_SENSING) {
-            if (txt.find("ask") != std::string::npos &&
-                txt.find("and wait") != std::string::npos) {
-                std::string question = get_input_str(b, 0, "What's your name?");
-                sprite->sayText  = question;
-                sprite->sayTimer = 999999;
-                g_askPending  = true;
-                g_askQuestion = question;
-                g_answer      = "";
-            }
-            else if (txt.find("reset timer") != std::string::npos) {
-                g_timerStart = SDL_GetTicks();
-            }
+        case OP_CHANGE_PEN_SIZE:
+            sprite->penSize += (int)get_input_val(p, n, 0, 1);
+            if (sprite->penSize < 1) sprite->penSize = 1;
+            break;
+        case OP_SET_PEN_SIZE:
+            sprite->penSize = (int)get_input_val(p, n, 0, 2);
+            if (sprite->penSize < 1) sprite->penSize = 1;
+            break;
+
+        case OP_DRUM: {
+            int   drum  = (int)get_input_val(p, n, 0, 1);
+            float beats = get_input_val(p, n, 1, 0.25f);
+            synth_drum(drum, schedule_music(beats), synthOwner);
+            break;
         }
-
-        else if (b->type == BLOCK_CONTROL) {
-            if (txt.find("wait") != std::string::npos &&
-                txt.find("secs") != std::string::npos &&
-                txt.find("until") == std::string::npos) {
-                float secs = get_input_val(b, 0, 1);
-                waitUntil = SDL_GetTicks() + (Uint32)(secs * 1000);
-                waiting = true; saySilent = false;
-            }
-            else if (txt.find("wait until") != std::string::npos) {
-                if (!eval_condition(b)) {
-                    return true;
-                }
-            }
-            else if (txt.find("repeat") != std::string::npos &&
-                     txt.find("forever") == std::string::npos) {
-                int count = (int)get_input_val(b, 0, 10);
-                if (b->isCShaped && b->innerFirst) {
-                    loopStack.push_back({b, b->innerFirst, count, false});
-                    current = b->innerFirst;
-                    return true;
-                }
-            }
-            else if (txt.find("forever") != std::string::npos) {
-                if (b->isCShaped && b->innerFirst) {
-                    loopStack.push_back({b, b->innerFirst, -1, false});
-                    current = b->innerFirst;
-                    return true;
-                }
-            }
-            else if (txt.find("if") != std::string::npos &&
-                     txt.find("then") != std::string::npos) {
-                bool cond = eval_condition(b);
-                if (b->hasElse) {
-                    if (cond && b->innerFirst) {
-                        loopStack.push_back({b, b->innerFirst, 1, false});
-                        current = b->innerFirst;
-                        return true;
-                    } else if (!cond && b->elseFirst) {
-                        loopStack.push_back({b, b->elseFirst, 1, true});
-                        current = b->elseFirst;
-                        return true;
-                    }
-                } else {
-                    if (cond && b->innerFirst) {
-                        loopStack.push_back({b, b->innerFirst, 1, false});
-                        current = b->innerFirst;
-                        return true;
+        case OP_REST:
+            schedule_music(get_input_val(p, n, 0, 0.25f));
+            break;
+        case OP_NOTE: {
+            int   note  = (int)std::lround(get_input_val(p, n, 0, 60));
+            float beats = get_input_val(p, n, 1, 0.25f);
+            Uint64 start = schedule_music(beats);
+            synth_note(note, start, synth_beats_to_frames(beats), sprite->instrument, synthOwner);
+            break;
+        }
+        case OP_INSTRUMENT:
+            sprite->instrument = (int)get_input_val(p, n, 0, 1);
+            break;
+        case OP_SET_TEMPO:
+            g_musicTempo = std::max(20.0f, std::min(500.0f, get_input_val(p, n, 0, 60)));
+            break;
+        case OP_CHANGE_TEMPO:
+            g_musicTempo = std::max(20.0f, std::min(500.0f, g_musicTempo + get_input_val(p, n, 0, 20)));
+            break;
+
+        case OP_PLAY_SOUND:
+        case OP_PLAY_SOUND_WAIT:
+            if (g_soundsPanel) {
+                bool untilDone = (op == OP_PLAY_SOUND_WAIT);
+                if (SoundClip* sc = find_sound(get_input_str(p, n, 0, ""))) {
+                    SoundHandle h = audio_start(*sc, untilDone ? MIXER_PRIO_NORMAL
+                                                               : MIXER_PRIO_LOW);
+                    if (untilDone && audio_handle_active(h)) {
+                        waitSound    = h;
+                        waitingSound = true;
                     }
                 }
             }
-            else if (txt.find("stop all") != std::string::npos &&
-                     txt.find("script") == std::string::npos) {
-                stop(); return true;
-            }
-            else if (txt.find("stop this script") != std::string::npos ||
-                     txt.find("stop other") != std::string::npos) {
-                stop(); return true;
-            }
-        }
-
-        else if (b->type == BLOCK_VARIABLES) {
-            if (txt.find("set ") == 0 && txt.find(" to ") != std::string::npos) {
-                size_t toPos = txt.find(" to ");
-                std::string varName = txt.substr(4, toPos - 4);
-                float val = get_input_val(b, 0, 0.0f);
-                g_vars[varName] = val;
-            }
-            else if (txt.find("change ") == 0 &&
-                     txt.find(" by ") != std::string::npos) {
-                size_t byPos = txt.find(" by ");
-                std::string varName = txt.substr(7, byPos - 7);
-                float delta = get_input_val(b, 0, 1.0f);
-                g_vars[varName] += delta;
-            }
-            else if (txt.find("show variable") != std::string::npos) {
-                if (vars) {
-                    size_t p = txt.find("variable ") + 9;
-                    std::string vname = txt.substr(p);
-                    for (auto& v : *vars)
-                        if (v.name == vname) v.showOnStage = true;
+            break;
+        case OP_STOP_SOUNDS:
+            if (g_soundsPanel) audio_stop_all(*g_soundsPanel);
+            break;
+        case OP_CHANGE_VOLUME:
+            if (g_soundsPanel) {
+                float delta = get_input_val(p, n, 0, 10);
+                for (auto& sc : g_soundsPanel->sounds) {
+                    sc.volume = std::max(0.0f, std::min(100.0f, sc.volume + delta));
+                    audio_apply_params(sc);
                 }
             }
-            else if (txt.find("hide variable") != std::string::npos) {
-                if (vars) {
-                    size_t p = txt.find("variable ") + 9;
-                    std::string vname = txt.substr(p);
-                    for (auto& v : *vars)
-                        if (v.name == vname) v.showOnStage = false;
+            break;
+        case OP_SET_VOLUME:
+            if (g_soundsPanel) {
+                float val = get_input_val(p, n, 0, 100);
+                for (auto& sc : g_soundsPanel->sounds) {
+                    sc.volume = std::max(0.0f, std::min(100.0f, val));
+                    audio_apply_params(sc);
                 }
             }
-        }
+            break;
 
-        else if (b->type == BLOCK_OPERATORS) {
-            float a = get_input_val(b, 0, 0.0f);
-            float c = get_input_val(b, 1, 0.0f);
-            float result = 0.0f;
-            bool  computed = true;
-
-            if      (txt.find("() + ()") != std::string::npos) {
-                result = a + c;
-                g_operatorResultText = float_to_str(a)+" + "+float_to_str(c)+" = "+float_to_str(result);
-            }
-            else if (txt.find("() - ()") != std::string::npos) {
-                result = a - c;
-                g_operatorResultText = float_to_str(a)+" - "+float_to_str(c)+" = "+float_to_str(result);
-            }
-            else if (txt.find("() * ()") != std::string::npos) {
-                result = a * c;
-                g_operatorResultText = float_to_str(a)+" × "+float_to_str(c)+" = "+float_to_str(result);
-            }
-            else if (txt.find("() / ()") != std::string::npos) {
-                result = (c != 0) ? a / c : 0;
-                g_operatorResultText = float_to_str(a)+" ÷ "+float_to_str(c)+" = "+(c!=0?float_to_str(result):"ERR");
-            }
-            else if (txt.find("() mod ()") != std::string::npos) {
-                result = (c != 0) ? std::fmod(a, c) : 0;
-                g_operatorResultText = float_to_str(a)+" mod "+float_to_str(c)+" = "+float_to_str(result);
-            }
-            else if (txt.find("() < ()") != std::string::npos) {
-                result = (a < c) ? 1 : 0;
-                g_operatorResultText = float_to_str(a)+" < "+float_to_str(c)+" → "+(result?"true":"false");
-            }
-            else if (txt.find("() > ()") != std::string::npos) {
-                result = (a > c) ? 1 : 0;
-                g_operatorResultText = float_to_str(a)+" > "+float_to_str(c)+" → "+(result?"true":"false");
-            }
-            else if (txt.find("() = ()") != std::string::npos) {
-                result = (a == c) ? 1 : 0;
-                g_operatorResultText = float_to_str(a)+" = "+float_to_str(c)+" → "+(result?"true":"false");
-            }
-            else if (txt.find("and") != std::string::npos) {
-                bool ba = get_input_bool(b, 0);
-                bool bc = get_input_bool(b, 1);
-                result = (ba && bc) ? 1 : 0;
-                g_operatorResultText = std::string(ba?"true":"false") + " AND " + std::string(bc?"true":"false") + " → " + std::string(result?"true":"false");            }
-            else if (txt.find("or") != std::string::npos) {
-                bool ba = get_input_bool(b, 0);
-                bool bc = get_input_bool(b, 1);
-                result = (ba || bc) ? 1 : 0;
-                g_operatorResultText = std::string(ba?"true":"false") + " OR " + std::string(bc?"true":"false") + " → " + std::string(result?"true":"false");
-            }
-            else if (txt.find("not <>") != std::string::npos) {
-                bool ba = get_input_bool(b, 0);
-                result = (!ba) ? 1 : 0;
-                g_operatorResultText = std::string("NOT ") + std::string(ba?"true":"false") + " → " + std::string(result?"true":"false");
-            }
-            else if (txt.find("round ()") != std::string::npos) {
-                result = std::round(a);
-                g_operatorResultText = "round("+float_to_str(a)+") = "+float_to_str(result);
-            }
-            else if (txt.find("abs of ()") != std::string::npos) {
-                result = std::abs(a);
-                g_operatorResultText = "abs("+float_to_str(a)+") = "+float_to_str(result);
-            }
-            else if (txt.find("sqrt of ()") != std::string::npos) {
-                result = (a >= 0) ? std::sqrt(a) : 0;
-                g_operatorResultText = "√("+float_to_str(a)+") = "+float_to_str(result);
-            }
-            else if (txt.find("floor of ()") != std::string::npos) {
-                result = std::floor(a);
-                g_operatorResultText = "floor("+float_to_str(a)+") = "+float_to_str(result);
-            }
-            else if (txt.find("ceiling of ()") != std::string::npos) {
-                result = std::ceil(a);
-                g_operatorResultText = "ceiling("+float_to_str(a)+") = "+float_to_str(result);
-            }
-            else if (txt.find("sin of ()") != std::string::npos) {
-                result = (float)std::sin(a * M_PI / 180.0);
-                g_operatorResultText = "sin("+float_to_str(a)+"°) = "+float_to_str(result);
-            }
-            else if (txt.find("cos of ()") != std::string::npos) {
-                result = (float)std::cos(a * M_PI / 180.0);
-                g_operatorResultText = "cos("+float_to_str(a)+"°) = "+float_to_str(result);
-            }
-            else if (txt.find("tan of ()") != std::string::npos) {
-                result = (float)std::tan(a * M_PI / 180.0);
-                g_operatorResultText = "tan("+float_to_str(a)+"°) = "+float_to_str(result);
-            }
-            else if (txt.find("pick random") != std::string::npos) {
-                int lo = (int)get_input_val(b, 0, 1);
-                int hi = (int)get_input_val(b, 1, 10);
-                if (hi < lo) std::swap(lo, hi);
-                result = (float)(lo + rand() % (hi - lo + 1));
-                g_operatorResultText = "random("+std::to_string(lo)+","+std::to_string(hi)+") = "+float_to_str(result);
-            }
-            else if (txt.find("join () ()") != std::string::npos) {
-                std::string s1 = get_input_str(b, 0, "hello");
-                std::string s2 = get_input_str(b, 1, "world");
-                std::string res = s1 + s2;
-                g_operatorResultText = "join: \"" + res + "\"";
-                sprite->sayText  = res;
-                sprite->sayTimer = 180;
-                g_hasOperatorResult = true;
-                return false;
-            }
-            else if (txt.find("length of ()") != std::string::npos) {
-                std::string s = get_input_str(b, 0, "");
-                result = (float)s.size();
-                g_operatorResultText = "length(\""+s+"\") = "+float_to_str(result);
-            }
-            else if (txt.find("letter () of ()") != std::string::npos) {
-                int idx2 = (int)get_input_val(b, 0, 1) - 1;
-                std::string s = get_input_str(b, 1, "");
-                std::string res = (idx2 >= 0 && idx2 < (int)s.size())
-                                  ? std::string(1, s[idx2]) : "";
-                g_operatorResultText = "letter "+std::to_string(idx2+1)+" of \""+s+"\" = \""+res+"\"";
-                sprite->sayText = res; sprite->sayTimer = 180;
-                g_hasOperatorResult = true;
-                return false;
-            }
-            else { computed = false; }
+        case OP_ASK: {
+            std::string question = get_input_str(p, n, 0, "What's your name?");
+            sprite->sayText  = question;
+            sprite->sayTimer = 999999;
+            g_askPending  = true;
+            g_askQuestion = question;
+            g_answer      = "";
+            break;
+        }
+        case OP_RESET_TIMER:
+            g_timerStart = SDL_GetTicks();
+            break;
+
+        case OP_WAIT: {
+            float secs = get_input_val(p, n, 0, 1);
+            waitUntil = SDL_GetTicks() + (Uint32)(secs * 1000);
+            waiting = true; saySilent = false;
+            break;
+        }
+        case OP_WAIT_UNTIL:
+            if (!get_input_bool(p, n, 0)) return true;
+            break;
+        case OP_REPEAT: {
+            int count = (int)get_input_val(p, n, 0, 10);
+            if (p.inner[n] != PACK_NONE) return enter(n, p.inner[n], count, false);
+            break;
+        }
+        case OP_FOREVER:
+            if (p.inner[n] != PACK_NONE) return enter(n, p.inner[n], -1, false);
+            break;
+        case OP_IF:
+            if (get_input_bool(p, n, 0) && p.inner[n] != PACK_NONE)
+                return enter(n, p.inner[n], 1, false);
+            break;
+        case OP_IF_ELSE: {
+            bool cond = get_input_bool(p, n, 0);
+            if (cond && p.inner[n] != PACK_NONE)
+                return enter(n, p.inner[n], 1, false);
+            if (!cond && p.alt[n] != PACK_NONE)
+                return enter(n, p.alt[n], 1, true);
+            break;
+        }
+        case OP_STOP:
+            stop();
+            return true;
+
+        case OP_SET_VAR:
+            g_vars[p.name[n]] = get_input_val(p, n, 0, 0.0f);
+            break;
+        case OP_CHANGE_VAR:
+            g_vars[p.name[n]] += get_input_val(p, n, 0, 1.0f);
+            break;
+        case OP_SHOW_VAR:
+        case OP_HIDE_VAR:
+            if (vars) {
+                for (auto& v : *vars)
+                    if (v.name == p.name[n]) v.showOnStage = (op == OP_SHOW_VAR);
+            }
+            break;
+
+        default:
+            break;
+        }
+        return false;
+    }
 
-            if (computed) {
-                g_lastOperatorResult = result;
-                g_hasOperatorResult  = true;
-                sprite->sayText  = g_operatorResultText;
-                sprite->sayTimer = 180;
-            }
+    bool execute_operator(Uint32 n, Uint8 op, Sprite* sprite) {
+        const PackedScript& p = prog;
+        float a = get_input_val(p, n, 0, 0.0f);
+        float c = get_input_val(p, n, 1, 0.0f);
+        float result = 0.0f;
+
+        switch (op) {
+        case OP_CALC_ADD:
+            result = a + c;
+            g_operatorResultText = float_to_str(a)+" + "+float_to_str(c)+" = "+float_to_str(result);
+            break;
+        case OP_CALC_SUB:
+            result = a - c;
+            g_operatorResultText = float_to_str(a)+" - "+float_to_str(c)+" = "+float_to_str(result);
+            break;
+        case OP_CALC_MUL:
+            result = a * c;
+            g_operatorResultText = float_to_str(a)+" × "+float_to_str(c)+" = "+float_to_str(result);
+            break;
+        case OP_CALC_DIV:
+            result = (c != 0) ? a / c : 0;
+            g_operatorResultText = float_to_str(a)+" ÷ "+float_to_str(c)+" = "+(c!=0?float_to_str(result):"ERR");
+            break;
+        case OP_CALC_MOD:
+            result = (c != 0) ? std::fmod(a, c) : 0;
+            g_operatorResultText = float_to_str(a)+" mod "+float_to_str(c)+" = "+float_to_str(result);
+            break;
+        case OP_CALC_LT:
+            result = (a < c) ? 1 : 0;
+            g_operatorResultText = float_to_str(a)+" < "+float_to_str(c)+" → "+(result?"true":"false");
+            break;
+        case OP_CALC_GT:
+            result = (a > c) ? 1 : 0;
+            g_operatorResultText = float_to_str(a)+" > "+float_to_str(c)+" → "+(result?"true":"false");
+            break;
+        case OP_CALC_EQ:
+            result = (a == c) ? 1 : 0;
+            g_operatorResultText = float_to_str(a)+" = "+float_to_str(c)+" → "+(result?"true":"false");
+            break;
+        case OP_CALC_AND: {
+            bool ba = get_input_bool(p, n, 0);
+            bool bc = get_input_bool(p, n, 1);
+            result = (ba && bc) ? 1 : 0;
+            g_operatorResultText = std::string(ba?"true":"false") + " AND " + std::string(bc?"true":"false") + " → " + std::string(result?"true":"false");
+            break;
+        }
+        case OP_CALC_OR: {
+            bool ba = get_input_bool(p, n, 0);
+            bool bc = get_input_bool(p, n, 1);
+            result = (ba || bc) ? 1 : 0;
+            g_operatorResultText = std::string(ba?"true":"false") + " OR " + std::string(bc?"true":"false") + " → " + std::string(result?"true":"false");
+            break;
+        }
+        case OP_CALC_NOT: {
+            bool ba = get_input_bool(p, n, 0);
+            result = (!ba) ? 1 : 0;
+            g_operatorResultText = std::string("NOT ") + std::string(ba?"true":"false") + " → " + std::string(result?"true":"false");
+            break;
+        }
+        case OP_CALC_ROUND:
+            result = std::round(a);
+            g_operatorResultText = "round("+float_to_str(a)+") = "+float_to_str(result);
+            break;
+        case OP_CALC_ABS:
+            result = std::abs(a);
+            g_operatorResultText = "abs("+float_to_str(a)+") = "+float_to_str(result);
+            break;
+        case OP_CALC_SQRT:
+            result = (a >= 0) ? std::sqrt(a) : 0;
+            g_operatorResultText = "√("+float_to_str(a)+") = "+float_to_str(result);
+            break;
+        case OP_CALC_FLOOR:
+            result = std::floor(a);
+            g_operatorResultText = "floor("+float_to_str(a)+") = "+float_to_str(result);
+            break;
+        case OP_CALC_CEIL:
+            result = std::ceil(a);
+            g_operatorResultText = "ceiling("+float_to_str(a)+") = "+float_to_str(result);
+            break;
+        case OP_CALC_SIN:
+            result = (float)std::sin(a * M_PI / 180.0);
+            g_operatorResultText = "sin("+float_to_str(a)+"°) = "+float_to_str(result);
+            break;
+        case OP_CALC_COS:
+            result = (float)std::cos(a * M_PI / 180.0);
+            g_operatorResultText = "cos("+float_to_str(a)+"°) = "+float_to_str(result);
+            break;
+        case OP_CALC_TAN:
+            result = (float)std::tan(a * M_PI / 180.0);
+            g_operatorResultText = "tan("+float_to_str(a)+"°) = "+float_to_str(result);
+            break;
+        case OP_CALC_RANDOM: {
+            int lo = (int)get_input_val(p, n, 0, 1);
+            int hi = (int)get_input_val(p, n, 1, 10);
+            if (hi < lo) std::swap(lo, hi);
+            result = (float)(lo + rand() % (hi - lo + 1));
+            g_operatorResultText = "random("+std::to_string(lo)+","+std::to_string(hi)+") = "+float_to_str(result);
+            break;
+        }
+        case OP_CALC_JOIN: {
+            std::string s1 = get_input_str(p, n, 0, "hello");
+            std::string s2 = get_input_str(p, n, 1, "world");
+            std::string res = s1 + s2;
+            g_operatorResultText = "join: \"" + res + "\"";
+            sprite->sayText  = res;
+            sprite->sayTimer = 180;
+            g_hasOperatorResult = true;
+            return false;
+        }
+        case OP_CALC_LENGTH: {
+            std::string s = get_input_str(p, n, 0, "");
+            result = (float)s.size();
+            g_operatorResultText = "length(\""+s+"\") = "+float_to_str(result);
+            break;
+        }
+        case OP_CALC_LETTER: {
+            int idx2 = (int)get_input_val(p, n, 0, 1) - 1;
+            std::string s = get_input_str(p, n, 1, "");
+            std::string res = (idx2 >= 0 && idx2 < (int)s.size())
+                              ? std::string(1, s[idx2]) : "";
+            g_operatorResultText = "letter "+std::to_string(idx2+1)+" of \""+s+"\" = \""+res+"\"";
+            sprite->sayText = res; sprite->sayTimer = 180;
+            g_hasOperatorResult = true;
+            return false;
+        }
+        default:
+            return false;
         }
 
+        g_lastOperatorResult = result;
+        g_hasOperatorResult  = true;
+        sprite->sayText  = g_operatorResultText;
+        sprite->sayTimer = 180;
         return false;
     }
 
-    void advance(Block* b, Sprite* /*sprite*/) {
-        if (b->next) {
-            current = b->next;
+    void advance(Uint32 n, Sprite* /*sprite*/) {
+        if (prog.next[n] != PACK_NONE) {
+            current = prog.next[n];
             return;
         }
         if (!loopStack.empty()) {
             advance_loop(nullptr);
             return;
         }
-        current = nullptr;
+        current = PACK_NONE;
         running = false;
     }
 
     void advance_loop(Sprite* /*sprite*/) {
-        if (loopStack.empty()) { current = nullptr; running = false; return; }
+        if (loopStack.empty()) { current = PACK_NONE; running = false; return; }
 
         LoopFrame& f = loopStack.back();
 
-        Block* nextInner = f.current ? f.current->next : nullptr;
+        Uint32 nextInner = f.current != PACK_NONE ? prog.next[f.current] : PACK_NONE;
 
-        if (nextInner) {
+        if (nextInner != PACK_NONE) {
             f.current = nextInner;
             current   = nextInner;
             return;
         }
 
         if (f.remaining == -1) {
-            Block* first = f.inElse ? f.loopBlock->elseFirst
-                                     : f.loopBlock->innerFirst;
+            Uint32 first = f.inElse ? prog.alt[f.loopBlock] : prog.inner[f.loopBlock];
             f.current = first;
             current   = first;
             return;
         }
         if (f.remaining > 1) {
             f.remaining--;
-            Block* first = f.loopBlock->innerFirst;
+            Uint32 first = prog.inner[f.loopBlock];
             f.current = first;
             current   = first;
             return;
         }
-        Block* afterC = f.loopBlock->next;
+        Uint32 afterC = prog.next[f.loopBlock];
         loopStack.pop_back();
-        if (afterC) {
+        if (afterC != PACK_NONE) {
             current = afterC;
         } else if (!loopStack.empty()) {
             advance_loop(nullptr);
         } else {
-            current = nullptr; running = false;
+            current = PACK_NONE; running = false;
         }
     }
 };
@@ -874,6 +950,20 @@ Block* find_key_event(std::vector<Block*>& blocks, const std::string& keyName) {
     return nullptr;
 }
 
+Block* poll_loudness_event(std::vector<Block*>& blocks) {
+    Block* fired = nullptr;
+    int loud = audio_loudness();
+    for (Block* b : blocks) {
+        if (b->type != BLOCK_EVENT || b->prev != nullptr ||
+            b->text.find("when loudness >") == std::string::npos)
+            continue;
+        bool above = loud > (int)block_input_val(b, 0, 10);
+        if (above && !b->hatFired && b->next && !fired) fired = b;
+        b->hatFired = above;
+    }
+    return fired;
+}
+
 Block* find_sprite_click_event(std::vector<Block*>& blocks) {
     for (Block* b : blocks)
         if (b->type == BLOCK_EVENT && b->prev == nullptr && b->next != nullptr &&
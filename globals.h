@@ -29,7 +29,7 @@ const int BLOCK_H       = 36;
 const int BLOCK_PADDING = 8;
 const int SNAP_DISTANCE = 25;
 const int CAT_CIRCLE_R  = 10;
-const int CAT_ITEM_H    = 56;
+const int CAT_ITEM_H    = 52;
 
 const int COSTUME_PANEL_X = STAGE_X;
 const int COSTUME_PANEL_Y = STAGE_Y + STAGE_HEIGHT;
@@ -65,6 +65,7 @@ const SDL_Color COLOR_OPERATORS  = {89,  192, 89,  255};
 const SDL_Color COLOR_VARIABLES  = {242, 100, 47,  255};
 const SDL_Color COLOR_MYBLOCKS   = {194, 68,  68,  255};
 const SDL_Color COLOR_EXTENSION  = {76,  151, 76,  255};
+const SDL_Color COLOR_MUSIC      = {15,  189, 140, 255};
 
 const SDL_Color COLOR_BG_CATBAR    = {255, 255, 255, 255};
 const SDL_Color COLOR_BG_BLOCKLIST = {250, 250, 250, 255};
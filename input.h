@@ -9,6 +9,7 @@
 #include "structs.h"
 #include "globals.h"
 #include "utils.h"
+#include "undo.h"
 
 static void collect_all_c_blocks(std::vector<Block*>& blocks,
                                   std::vector<Block*>& result) {
@@ -40,7 +41,8 @@ static bool can_embed_in_numeric(Block* b) {
     if (b->type == BLOCK_OPERATORS) return !is_boolean_operator(b->text);
     if (b->type == BLOCK_SENSING) {
         const std::string& t = b->text;
-        return t == "mouse x" || t == "mouse y" || t == "timer" || t == "answer";
+        return t == "mouse x" || t == "mouse y" || t == "timer" || t == "answer"
+            || t == "loudness";
     }
     return false;
 }
@@ -60,101 +62,40 @@ static bool is_embeddable(Block* b) {
     return can_embed_in_numeric(b) || can_embed_in_boolean(b);
 }
 
-static BlockInput* find_slot_for_drop(Block* target, Block* dragged, int mx, int my) {
-    for (auto& inp : target->inputs) {
-        if (!point_in_rect(mx, my, inp.rect.x, inp.rect.y, inp.rect.w, inp.rect.h))
-            continue;
-        if (inp.slotType == SLOT_BOOLEAN && can_embed_in_boolean(dragged))
-            return &inp;
-        if (inp.slotType == SLOT_NUMERIC && can_embed_in_numeric(dragged))
-            return &inp;
-    }
-    for (auto& inp : target->inputs) {
-        if (inp.embeddedBlock) {
-            BlockInput* r = find_slot_for_drop(inp.embeddedBlock, dragged, mx, my);
-            if (r) return r;
-        }
-    }
-    return nullptr;
+static bool slot_accepts(const BlockInput& inp, Block* dragged) {
+    if (inp.slotType == SLOT_BOOLEAN) return can_embed_in_boolean(dragged);
+    if (inp.slotType == SLOT_NUMERIC) return can_embed_in_numeric(dragged);
+    return false;
 }
 
 static bool try_embed_operator(Block* dragged, std::vector<Block*>& blocks, int mx, int my) {
     if (!is_embeddable(dragged)) return false;
 
-    auto checkAndEmbed = [&](Block* target) -> bool {
-        if (!target || target == dragged || target->isDragging) return false;
-        update_block_input_rects(target);
-        BlockInput* slot = find_slot_for_drop(target, dragged, mx, my);
-        if (!slot) return false;
-        if (slot->embeddedBlock) {
-            delete slot->embeddedBlock;
-        }
-        slot->embeddedBlock = dragged;
-        slot->value = "0";
-        return true;
-    };
-
-    for (int i = (int)blocks.size() - 1; i >= 0; i--) {
-        Block* b = blocks[i];
-        if (b == dragged) continue;
-        if (checkAndEmbed(b)) return true;
-        if (b->isCShaped) {
-            Block* inner = b->innerFirst;
-            while (inner) {
-                if (checkAndEmbed(inner)) return true;
-                inner = inner->next;
-            }
-            if (b->hasElse) {
-                Block* el = b->elseFirst;
-                while (el) {
-                    if (checkAndEmbed(el)) return true;
-                    el = el->next;
-                }
-            }
-        }
+    layout_workspace(blocks);
+    Block* target = nullptr;
+    BlockInput* slot = spatial_drop_slot(dragged, mx, my, slot_accepts, &target);
+    if (!slot) return false;
+    undo_touch(target);
+    undo_touch(dragged);
+    if (slot->embeddedBlock) {
+        undo_free_reporters(slot->embeddedBlock);
     }
-    return false;
+    slot->embeddedBlock = dragged;
+    slot->value = "0";
+    return true;
 }
 
 static Block* try_extract_embedded(std::vector<Block*>& blocks, int mx, int my) {
-
-    auto extractFrom = [&](Block* b, auto& self) -> Block* {
-        for (auto& inp : b->inputs) {
-            if (!inp.embeddedBlock) continue;
-            Block* eb = inp.embeddedBlock;
-            if (point_in_rect(mx, my, eb->x, eb->y, eb->w, eb->h)) {
-                inp.embeddedBlock = nullptr;
-                inp.value = "0";
-                return eb;
-            }
-            Block* found = self(eb, self);
-            if (found) return found;
-        }
-        return nullptr;
-    };
-
-    for (int i = (int)blocks.size() - 1; i >= 0; i--) {
-        Block* b = blocks[i];
-        Block* extracted = extractFrom(b, extractFrom);
-        if (extracted) return extracted;
-        if (b->isCShaped) {
-            Block* inner = b->innerFirst;
-            while (inner) {
-                extracted = extractFrom(inner, extractFrom);
-                if (extracted) return extracted;
-                inner = inner->next;
-            }
-            if (b->hasElse) {
-                Block* el = b->elseFirst;
-                while (el) {
-                    extracted = extractFrom(el, extractFrom);
-                    if (extracted) return extracted;
-                    el = el->next;
-                }
-            }
-        }
-    }
-    return nullptr;
+    layout_workspace(blocks);
+    Block* parent = nullptr;
+    int input = 0;
+    Block* eb = spatial_reporter_at(mx, my, &parent, &input);
+    if (!eb) return nullptr;
+    undo_touch(parent);
+    undo_touch(eb);
+    parent->inputs[input].embeddedBlock = nullptr;
+    parent->inputs[input].value = "0";
+    return eb;
 }
 
 static void detach_from_c_blocks(Block* dragged, std::vector<Block*>& blocks) {
@@ -165,6 +106,9 @@ static void detach_from_c_blocks(Block* dragged, std::vector<Block*>& blocks) {
         Block* cur = cb->innerFirst;
         while (cur) {
             if (cur == dragged) {
+                undo_touch(cb);
+                undo_touch(prev2);
+                undo_touch(cur->next);
                 if (prev2) prev2->next = cur->next;
                 else cb->innerFirst = cur->next;
                 if (cur->next) cur->next->prev = prev2;
@@ -179,6 +123,9 @@ static void detach_from_c_blocks(Block* dragged, std::vector<Block*>& blocks) {
             prev2 = nullptr; cur = cb->elseFirst;
             while (cur) {
                 if (cur == dragged) {
+                    undo_touch(cb);
+                    undo_touch(prev2);
+                    undo_touch(cur->next);
                     if (prev2) prev2->next = cur->next;
                     else cb->elseFirst = cur->next;
                     if (cur->next) cur->next->prev = prev2;
@@ -205,6 +152,7 @@ static bool try_snap_into_c(Block* dragged, Block* cb) {
         if (cb->innerFirst == nullptr) {
             if (std::abs(dragged->x - dropX) < SNAP_D &&
                 std::abs(dragged->y - dropY) < SNAP_D) {
+                undo_touch(cb);
                 dragged->x = dropX;
                 dragged->y = dropY;
                 dragged->prev = nullptr;
@@ -219,6 +167,8 @@ static bool try_snap_into_c(Block* dragged, Block* cb) {
             int lastBottomY = last->y + block_total_height(last);
             if (std::abs(dragged->x - last->x) < SNAP_D &&
                 std::abs(dragged->y - lastBottomY) < SNAP_D) {
+                undo_touch(cb);
+                undo_touch(last);
                 dragged->x    = last->x;
                 dragged->y    = lastBottomY;
                 dragged->prev = last;
@@ -237,6 +187,7 @@ static bool try_snap_into_c(Block* dragged, Block* cb) {
         if (cb->elseFirst == nullptr) {
             if (std::abs(dragged->x - dropX) < SNAP_D &&
                 std::abs(dragged->y - dropY) < SNAP_D) {
+                undo_touch(cb);
                 dragged->x = dropX;
                 dragged->y = dropY;
                 dragged->prev = nullptr;
@@ -250,6 +201,8 @@ static bool try_snap_into_c(Block* dragged, Block* cb) {
             int lastBottomY = last->y + block_total_height(last);
             if (std::abs(dragged->x - last->x) < SNAP_D &&
                 std::abs(dragged->y - lastBottomY) < SNAP_D) {
+                undo_touch(cb);
+                undo_touch(last);
                 dragged->x    = last->x;
                 dragged->y    = lastBottomY;
                 dragged->prev = last;
@@ -266,11 +219,25 @@ static bool try_snap_into_c(Block* dragged, Block* cb) {
 void handle_snap(Block* dragged, std::vector<Block*>& blocks) {
     if (!dragged) return;
 
+    undo_touch(dragged);
     detach_from_c_blocks(dragged, blocks);
+    undo_touch(dragged->prev);
+    undo_touch(dragged->next);
     if (dragged->prev) { dragged->prev->next = nullptr; dragged->prev = nullptr; }
     if (dragged->next) { dragged->next->prev = nullptr; dragged->next = nullptr; }
 
-    for (Block* b : blocks) {
+    layout_workspace(blocks);
+    auto byOrder = [](const SpatialHit& a, const SpatialHit& b) {
+        return a.order != b.order ? a.order < b.order : a.kind > b.kind;
+    };
+
+    std::vector<SpatialHit> hits;
+    spatial_snap_candidates(dragged->x, dragged->y, SNAP_DISTANCE + 8,
+                            (1 << SPATIAL_DROP_INNER) | (1 << SPATIAL_DROP_ELSE), hits);
+    std::sort(hits.begin(), hits.end(), byOrder);
+    for (size_t i = 0; i < hits.size(); i++) {
+        Block* b = hits[i].b;
+        if (i > 0 && hits[i - 1].b == b) continue;
         if (b == dragged || b->isDragging || !b->isCShaped) continue;
         if (try_snap_into_c(dragged, b)) {
             layout_inner_blocks(b);
@@ -278,69 +245,53 @@ void handle_snap(Block* dragged, std::vector<Block*>& blocks) {
         }
     }
 
-    for (Block* b : blocks) {
+    // Bottom points near the dragged block's top, top points near its
+    // bottom; tried per block in list order, bottom first, as before.
+    hits.clear();
+    spatial_snap_candidates(dragged->x, dragged->y, SNAP_DISTANCE,
+                            1 << SPATIAL_BOTTOM, hits);
+    spatial_snap_candidates(dragged->x, dragged->y + block_total_height(dragged),
+                            SNAP_DISTANCE, 1 << SPATIAL_TOP, hits);
+    std::sort(hits.begin(), hits.end(), byOrder);
+    for (size_t i = 0; i < hits.size(); i++) {
+        Block* b = hits[i].b;
         if (b == dragged || b->isDragging) continue;
         int dx = std::abs(dragged->x - b->x);
 
-        int bBottom = b->y + block_total_height(b);
-        int dy1 = std::abs(dragged->y - bBottom);
-        if (dx < SNAP_DISTANCE && dy1 < SNAP_DISTANCE && b->next == nullptr) {
-            dragged->x    = b->x;
-            dragged->y    = bBottom;
-            b->next       = dragged;
-            dragged->prev = b;
-            return;
-        }
-
-        int dy2 = std::abs((dragged->y + block_total_height(dragged)) - b->y);
-        if (dx < SNAP_DISTANCE && dy2 < SNAP_DISTANCE && b->prev == nullptr) {
-            dragged->x    = b->x;
-            dragged->y    = b->y - block_total_height(dragged);
-            dragged->next = b;
-            b->prev       = dragged;
-            return;
+        if (hits[i].kind == SPATIAL_BOTTOM) {
+            int bBottom = b->y + block_total_height(b);
+            int dy1 = std::abs(dragged->y - bBottom);
+            if (dx < SNAP_DISTANCE && dy1 < SNAP_DISTANCE && b->next == nullptr) {
+                undo_touch(b);
+                dragged->x    = b->x;
+                dragged->y    = bBottom;
+                b->next       = dragged;
+                dragged->prev = b;
+                return;
+            }
+        } else {
+            int dy2 = std::abs((dragged->y + block_total_height(dragged)) - b->y);
+            if (dx < SNAP_DISTANCE && dy2 < SNAP_DISTANCE && b->prev == nullptr) {
+                undo_touch(b);
+                dragged->x    = b->x;
+                dragged->y    = b->y - block_total_height(dragged);
+                dragged->next = b;
+                b->prev       = dragged;
+                return;
+            }
         }
     }
 }
 
 static Block* find_clicked_block(int mx, int my, std::vector<Block*>& blocks) {
-    for (int i = (int)blocks.size() - 1; i >= 0; i--) {
-        Block* b = blocks[i];
-
-        if (point_in_rect(mx, my, b->x, b->y, b->w, b->h))
-            return b;
-
-        if (b->isCShaped) {
-            Block* inner = b->innerFirst;
-            while (inner) {
-                if (point_in_rect(mx, my, inner->x, inner->y, inner->w, inner->h))
-                    return inner;
-                if (inner->isCShaped) {
-                    Block* nested = inner->innerFirst;
-                    while (nested) {
-                        if (point_in_rect(mx, my, nested->x, nested->y, nested->w, nested->h))
-                            return nested;
-                        nested = nested->next;
-                    }
-                }
-                inner = inner->next;
-            }
-            if (b->hasElse) {
-                Block* el = b->elseFirst;
-                while (el) {
-                    if (point_in_rect(mx, my, el->x, el->y, el->w, el->h))
-                        return el;
-                    el = el->next;
-                }
-            }
-        }
-    }
-    return nullptr;
+    layout_workspace(blocks);
+    return spatial_block_at(mx, my);
 }
 
 void handle_mouse_down(SDL_Event& e, std::vector<Block*>& blocks, Block** draggedBlock) {
     int mx = e.button.x, my = e.button.y;
 
+    undo_begin(blocks, UNDO_DRAG);
     Block* extracted = try_extract_embedded(blocks, mx, my);
     if (extracted) {
         extracted->x = mx - extracted->w / 2;
@@ -355,10 +306,13 @@ void handle_mouse_down(SDL_Event& e, std::vector<Block*>& blocks, Block** dragge
     }
 
     Block* clicked = find_clicked_block(mx, my, blocks);
-    if (!clicked) return;
+    if (!clicked) { undo_commit(); return; }
 
+    undo_touch(clicked);
     detach_from_c_blocks(clicked, blocks);
 
+    undo_touch(clicked->prev);
+    undo_touch(clicked->next);
     if (clicked->prev) { clicked->prev->next = nullptr; clicked->prev = nullptr; }
     if (clicked->next) { clicked->next->prev = nullptr; clicked->next = nullptr; }
 
@@ -380,24 +334,25 @@ void handle_mouse_motion(SDL_Event& e, Block** draggedBlock, Workspace&) {
     (*draggedBlock)->y = e.motion.y - (*draggedBlock)->dragOffsetY;
 }
 
+// `view` is the part of the plane the workspace shows and (mx, my) the
+// mouse on the plane (camera.h).
 void handle_mouse_up(Block** draggedBlock, std::vector<Block*>& blocks,
-                     Workspace& workspace) {
+                     const Workspace& view, int mx, int my) {
     if (!*draggedBlock) return;
     Block* b = *draggedBlock;
     b->isDragging = false;
 
-    int mx, my;
-    SDL_GetMouseState(&mx, &my);
-
     bool inWS = point_in_rect(b->x + b->w/2, b->y + b->h/2,
-                               workspace.x, workspace.y,
-                               workspace.w, workspace.h);
+                               view.x, view.y,
+                               view.w, view.h);
     if (!inWS) {
         detach_from_c_blocks(b, blocks);
-        blocks.erase(std::remove(blocks.begin(), blocks.end(), b), blocks.end());
+        undo_touch(b->prev);
+        undo_touch(b->next);
         if (b->prev) b->prev->next = nullptr;
         if (b->next) b->next->prev = nullptr;
-        delete b;
+        undo_delete(b, blocks);
+        undo_commit(b);
         *draggedBlock = nullptr;
         return;
     }
@@ -405,46 +360,21 @@ void handle_mouse_up(Block** draggedBlock, std::vector<Block*>& blocks,
     if (is_embeddable(b)) {
         if (try_embed_operator(b, blocks, mx, my)) {
             blocks.erase(std::remove(blocks.begin(), blocks.end(), b), blocks.end());
+            undo_commit(b);
             *draggedBlock = nullptr;
             return;
         }
     }
 
     handle_snap(b, blocks);
+    undo_commit(b);
     *draggedBlock = nullptr;
 }
 
-BlockInput* check_input_click(int mx, int my, std::vector<Block*>& blocks) {
-    auto checkBlock = [&](Block* b) -> BlockInput* {
-        if (!b || b->isDragging) return nullptr;
-        for (auto& inp : b->inputs) {
-            if (inp.embeddedBlock) continue;
-            if (inp.rect.w > 0 &&
-                point_in_rect(mx, my, inp.rect.x, inp.rect.y,
-                              inp.rect.w, inp.rect.h))
-                return &inp;
-        }
-        return nullptr;
-    };
-
-    for (Block* b : blocks) {
-        if (auto* r = checkBlock(b)) return r;
-        if (b->isCShaped) {
-            Block* inner = b->innerFirst;
-            while (inner) {
-                if (auto* r = checkBlock(inner)) return r;
-                inner = inner->next;
-            }
-            if (b->hasElse) {
-                Block* el = b->elseFirst;
-                while (el) {
-                    if (auto* r = checkBlock(el)) return r;
-                    el = el->next;
-                }
-            }
-        }
-    }
-    return nullptr;
+BlockInput* check_input_click(int mx, int my, std::vector<Block*>& blocks,
+                              Block** owner = nullptr) {
+    layout_workspace(blocks);
+    return spatial_input_at(mx, my, owner);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,819 @@
+#ifndef SCRATCH_FOP_JOURNAL_H
+#define SCRATCH_FOP_JOURNAL_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <SDL2/SDL.h>
+#include "structs.h"
+#include "utils.h"
+#include "SaveSystem.h"
+#include "sb3.h"
+
+// Sidecar edit log for a binary project. Every edit batch appends compact
+// records (block create/move/link/input/delete, variable table) to
+// <project>.journal; Save appends a commit marker and fsyncs, and only
+// rewrites the base file (compaction) once the log grows large or costumes
+// and sounds change. The log header carries the base file's epoch, so a log
+// left over from an older base is ignored.
+//
+// Record framing: Uint32 payload size, Uint32 FNV-1a of the payload, then
+// the payload starting with a JournalOp byte. A torn tail fails the check
+// and everything from there on is dropped.
+//
+// Edits reach the log through journal_touch(), which undo_touch() calls on
+// every block an edit changes, so a sync only compares the marked blocks
+// with their shadows.
+
+static const char   JOURNAL_MAGIC[4]      = {'S', 'F', 'O', 'J'};
+static const Uint32 JOURNAL_VERSION       = 1;
+static const char*  JOURNAL_SUFFIX        = ".journal";
+static const long   JOURNAL_COMPACT_BYTES = 4 << 20;
+
+enum JournalOp {
+    JOURNAL_CREATE = 1,
+    JOURNAL_MOVE,
+    JOURNAL_LINK,
+    JOURNAL_INPUT,
+    JOURNAL_DELETE,
+    JOURNAL_VARS,
+    JOURNAL_COMMIT
+};
+
+struct JournalHeader {
+    char   magic[4];
+    Uint32 version;
+    Uint32 epoch;
+    Uint32 reserved;
+};
+
+struct JournalInputShadow {
+    std::string value;
+    int         slotType;
+    int         embedded;
+};
+
+// Last journaled state of a block; links are block ids, -1 for none.
+struct JournalShadow {
+    int         type;
+    std::string text;
+    int         x, y;
+    int         next, innerFirst, elseFirst;
+    bool        embedded;
+    std::vector<JournalInputShadow> inputs;
+};
+
+struct Journal {
+    FILE*       file = nullptr;
+    std::string basePath;
+    Uint32      epoch = 0;
+    long        bytes = 0;
+    bool        assetsDirty = false;
+    Uint64      assetDigest = 0;
+    std::unordered_map<int, JournalShadow> shadow;
+    std::unordered_map<int, int> parentOf;   // reporter id -> id of the block holding it
+    std::vector<std::pair<Uint32, int>> dirty;   // handle bits, block id
+    std::unordered_set<Uint32> dirtySet;
+    std::vector<Variable> vars;
+    std::vector<Uint8>    batch;
+};
+
+static Journal g_journal;
+
+inline std::string journal_path(const std::string& projectPath)
+{
+    return projectPath + JOURNAL_SUFFIX;
+}
+
+static Uint32 journal_check(const Uint8* p, size_t n)
+{
+    Uint32 h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void journal_put(const void* p, size_t n)
+{
+    const Uint8* b = (const Uint8*)p;
+    g_journal.batch.insert(g_journal.batch.end(), b, b + n);
+}
+
+static void journal_put_i32(Sint32 v) { journal_put(&v, 4); }
+
+static void journal_put_str(const std::string& s)
+{
+    journal_put_i32((Sint32)s.size());
+    journal_put(s.data(), s.size());
+}
+
+static size_t journal_begin(JournalOp op)
+{
+    size_t at = g_journal.batch.size();
+    g_journal.batch.resize(at + 8);
+    Uint8 b = (Uint8)op;
+    journal_put(&b, 1);
+    return at;
+}
+
+static void journal_end(size_t at)
+{
+    Uint32 size  = (Uint32)(g_journal.batch.size() - at - 8);
+    Uint32 check = journal_check(g_journal.batch.data() + at + 8, size);
+    std::memcpy(g_journal.batch.data() + at,     &size,  4);
+    std::memcpy(g_journal.batch.data() + at + 4, &check, 4);
+}
+
+static void journal_collect(Block* b, bool embedded,
+                            std::vector<std::pair<Block*, bool>>& out)
+{
+    out.push_back({b, embedded});
+    for (auto& inp : b->inputs)
+        if (inp.embeddedBlock) journal_collect(inp.embeddedBlock, true, out);
+}
+
+static std::vector<std::pair<Block*, bool>> journal_all_blocks(const std::vector<Block*>& wsBlocks)
+{
+    std::vector<std::pair<Block*, bool>> all;
+    all.reserve(wsBlocks.size());
+    for (Block* b : wsBlocks)
+        if (b) journal_collect(b, false, all);
+    return all;
+}
+
+static Uint64 journal_asset_digest(const Sprite& sprite, const SoundsPanel& sounds)
+{
+    Uint64 h = 14695981039346656037ull;
+    auto mix = [&h](const void* p, size_t n) {
+        for (size_t i = 0; i < n; i++) { h ^= ((const Uint8*)p)[i]; h *= 1099511628211ull; }
+    };
+    for (const auto& c : sprite.costumes) {
+        const void* id = c.source ? (const void*)c.source.get() : (const void*)c.texture;
+        mix(c.name.data(), c.name.size());
+        mix(&id, sizeof(id));
+    }
+    for (const auto& s : sounds.sounds) {
+        const void* id = s.source ? (const void*)s.source.get() : (const void*)s.pcm.get();
+        mix(s.name.data(), s.name.size());
+        mix(&id, sizeof(id));
+        mix(&s.volume, sizeof(s.volume));
+        mix(&s.pitch, sizeof(s.pitch));
+        mix(&s.pan, sizeof(s.pan));
+    }
+    mix(sprite.name.data(), sprite.name.size());
+    return h;
+}
+
+static JournalShadow journal_shadow_of(const Block* b, bool embedded)
+{
+    JournalShadow s;
+    s.type       = (int)b->type;
+    s.text       = b->text;
+    s.x          = b->x;
+    s.y          = b->y;
+    s.next       = b->next       ? b->next->id       : -1;
+    s.innerFirst = b->innerFirst ? b->innerFirst->id : -1;
+    s.elseFirst  = b->elseFirst  ? b->elseFirst->id  : -1;
+    s.embedded   = embedded;
+    s.inputs.reserve(b->inputs.size());
+    for (const auto& inp : b->inputs)
+        s.inputs.push_back({inp.value, (int)inp.slotType,
+                            inp.embeddedBlock ? inp.embeddedBlock->id : -1});
+    return s;
+}
+
+static void journal_emit_create(int id, const JournalShadow& s)
+{
+    size_t at = journal_begin(JOURNAL_CREATE);
+    journal_put_i32(id);
+    journal_put_i32(s.type);
+    journal_put_i32(s.x);
+    journal_put_i32(s.y);
+    journal_put_str(s.text);
+    journal_end(at);
+}
+
+static void journal_emit_link(int id, const JournalShadow& s)
+{
+    size_t at = journal_begin(JOURNAL_LINK);
+    journal_put_i32(id);
+    journal_put_i32(s.next);
+    journal_put_i32(s.innerFirst);
+    journal_put_i32(s.elseFirst);
+    journal_put_i32(s.embedded ? 1 : 0);
+    journal_end(at);
+}
+
+static void journal_emit_input(int id, int idx, const JournalInputShadow& in)
+{
+    size_t at = journal_begin(JOURNAL_INPUT);
+    journal_put_i32(id);
+    journal_put_i32(idx);
+    journal_put_i32(in.slotType);
+    journal_put_i32(in.embedded);
+    journal_put_str(in.value);
+    journal_end(at);
+}
+
+static void journal_emit_vars(const std::vector<Variable>& vars)
+{
+    size_t at = journal_begin(JOURNAL_VARS);
+    journal_put_i32((Sint32)vars.size());
+    for (const auto& v : vars) {
+        journal_put_str(v.name);
+        journal_put(&v.value, 4);
+        journal_put_i32(v.showOnStage ? 1 : 0);
+    }
+    journal_end(at);
+}
+
+static bool journal_vars_equal(const std::vector<Variable>& a, const std::vector<Variable>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++)
+        if (a[i].name != b[i].name || a[i].value != b[i].value ||
+            a[i].showOnStage != b[i].showOnStage) return false;
+    return true;
+}
+
+static bool journal_flush_batch(bool sync)
+{
+    if (!g_journal.file) return false;
+    bool ok = true;
+    if (!g_journal.batch.empty()) {
+        size_t n = g_journal.batch.size();
+        ok = fwrite(g_journal.batch.data(), 1, n, g_journal.file) == n;
+        g_journal.bytes += (long)n;
+        g_journal.batch.clear();
+    }
+    ok = (sync ? save_sync_file(g_journal.file) : fflush(g_journal.file) == 0) && ok;
+    if (!ok) std::cerr << "[Journal] Write to '" << journal_path(g_journal.basePath) << "' failed\n";
+    return ok;
+}
+
+// Rebuilds the shadow from the live project without emitting anything.
+static void journal_capture(const std::vector<Block*>& wsBlocks, const VariablesPanel& vars,
+                            const Sprite& sprite, const SoundsPanel& sounds)
+{
+    g_journal.shadow.clear();
+    g_journal.parentOf.clear();
+    g_journal.dirty.clear();
+    g_journal.dirtySet.clear();
+    for (auto& p : journal_all_blocks(wsBlocks)) {
+        g_journal.shadow[p.first->id] = journal_shadow_of(p.first, p.second);
+        for (auto& inp : p.first->inputs)
+            if (inp.embeddedBlock) g_journal.parentOf[inp.embeddedBlock->id] = p.first->id;
+    }
+    g_journal.vars        = vars.variables;
+    g_journal.assetDigest = journal_asset_digest(sprite, sounds);
+    g_journal.assetsDirty = false;
+}
+
+// Gives every block a distinct id; the log addresses blocks by id.
+inline void journal_unique_ids(const std::vector<Block*>& wsBlocks, int& nextId)
+{
+    std::unordered_set<int> seen;
+    for (auto& p : journal_all_blocks(wsBlocks)) {
+        if (p.first->id >= nextId) nextId = p.first->id + 1;
+        if (!seen.insert(p.first->id).second) p.first->id = -1;
+    }
+    for (auto& p : journal_all_blocks(wsBlocks))
+        if (p.first->id < 0) p.first->id = nextId++;
+}
+
+// Marks a block to be compared with its shadow at the next sync.
+void journal_touch(Block* b)
+{
+    if (!g_journal.file || !b || !block_owned(g_blockPool, b)) return;
+    if (g_journal.dirtySet.insert(b->self.bits).second)
+        g_journal.dirty.push_back({b->self.bits, b->id});
+}
+
+static void journal_emit_delete(int id)
+{
+    size_t at = journal_begin(JOURNAL_DELETE);
+    journal_put_i32(id);
+    journal_end(at);
+}
+
+// Appends records for the blocks marked since the last call.
+inline void journal_sync(const VariablesPanel& vars, const Sprite& sprite,
+                         const SoundsPanel& sounds)
+{
+    if (!g_journal.file) return;
+
+    // Blocks that are gone leave the shadow; live ones first re-register
+    // the reporters they hold, so each can tell whether it is embedded.
+    std::vector<Block*> live;
+    for (auto& d : g_journal.dirty) {
+        BlockRef r;
+        r.bits = d.first;
+        Block* b = block_ref_valid(r) ? block_at(g_blockPool, block_ref_slot(r)) : nullptr;
+        if (b && b->buried) b = nullptr;
+        auto it = g_journal.shadow.find(d.second);
+        if (it != g_journal.shadow.end())
+            for (auto& in : it->second.inputs) {
+                auto p = g_journal.parentOf.find(in.embedded);
+                if (p != g_journal.parentOf.end() && p->second == d.second)
+                    g_journal.parentOf.erase(p);
+            }
+        if (!b) {
+            if (it != g_journal.shadow.end()) {
+                journal_emit_delete(d.second);
+                g_journal.shadow.erase(it);
+            }
+            continue;
+        }
+        for (auto& inp : b->inputs)
+            if (inp.embeddedBlock) g_journal.parentOf[inp.embeddedBlock->id] = b->id;
+        live.push_back(b);
+    }
+    g_journal.dirty.clear();
+    g_journal.dirtySet.clear();
+
+    for (const Block* b : live) {
+        JournalShadow cur = journal_shadow_of(b, g_journal.parentOf.count(b->id) != 0);
+        auto it = g_journal.shadow.find(b->id);
+        if (it == g_journal.shadow.end()) {
+            journal_emit_create(b->id, cur);
+            journal_emit_link(b->id, cur);
+            for (size_t k = 0; k < cur.inputs.size(); k++)
+                journal_emit_input(b->id, (int)k, cur.inputs[k]);
+            g_journal.shadow[b->id] = std::move(cur);
+            continue;
+        }
+        JournalShadow& old = it->second;
+        bool recreate = old.type != cur.type || old.text != cur.text ||
+                        old.inputs.size() != cur.inputs.size();
+        if (recreate) {
+            journal_emit_create(b->id, cur);
+        } else if (old.x != cur.x || old.y != cur.y) {
+            size_t at = journal_begin(JOURNAL_MOVE);
+            journal_put_i32(b->id);
+            journal_put_i32(cur.x);
+            journal_put_i32(cur.y);
+            journal_end(at);
+        }
+        if (recreate || old.next != cur.next || old.innerFirst != cur.innerFirst ||
+            old.elseFirst != cur.elseFirst || old.embedded != cur.embedded)
+            journal_emit_link(b->id, cur);
+        for (size_t k = 0; k < cur.inputs.size(); k++) {
+            const JournalInputShadow& a = cur.inputs[k];
+            if (recreate || a.value != old.inputs[k].value ||
+                a.slotType != old.inputs[k].slotType || a.embedded != old.inputs[k].embedded)
+                journal_emit_input(b->id, (int)k, a);
+        }
+        old = std::move(cur);
+    }
+
+    if (!journal_vars_equal(g_journal.vars, vars.variables)) {
+        journal_emit_vars(vars.variables);
+        g_journal.vars = vars.variables;
+    }
+
+    Uint64 digest = journal_asset_digest(sprite, sounds);
+    if (digest != g_journal.assetDigest) {
+        g_journal.assetDigest = digest;
+        g_journal.assetsDirty = true;
+    }
+
+    if (!g_journal.batch.empty()) journal_flush_batch(false);
+}
+
+inline void journal_close()
+{
+    if (g_journal.file) fclose(g_journal.file);
+    g_journal = Journal{};
+}
+
+// Replaces the log for projectPath with a header for epoch followed by
+// body, then keeps it open for appending.
+static bool journal_start(const std::string& projectPath, Uint32 epoch,
+                          const Uint8* body, size_t bodyBytes)
+{
+    journal_close();
+    std::string path = journal_path(projectPath);
+    std::string tmp  = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        std::cerr << "[Journal] Cannot open '" << tmp << "' for writing\n";
+        return false;
+    }
+    JournalHeader h;
+    std::memcpy(h.magic, JOURNAL_MAGIC, 4);
+    h.version  = JOURNAL_VERSION;
+    h.epoch    = epoch;
+    h.reserved = 0;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    if (ok && bodyBytes) ok = fwrite(body, 1, bodyBytes, f) == bodyBytes;
+    ok = ok && save_sync_file(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok || !save_replace_file(tmp, path)) {
+        std::cerr << "[Journal] Cannot create '" << path << "'\n";
+        remove(tmp.c_str());
+        return false;
+    }
+    g_journal.file = fopen(path.c_str(), "ab");
+    if (!g_journal.file) return false;
+    g_journal.basePath = projectPath;
+    g_journal.epoch    = epoch;
+    g_journal.bytes    = (long)(sizeof(h) + bodyBytes);
+    return true;
+}
+
+// Rewrites the base file from the live project under a new epoch and
+// starts an empty log. A crash between the two steps leaves a log whose
+// epoch no longer matches, which loading ignores.
+inline bool journal_compact(const std::string& projectPath,
+                            const std::vector<Block*>& wsBlocks, const VariablesPanel& vars,
+                            Sprite& sprite, const SoundsPanel& sounds, SDL_Renderer* r)
+{
+    Uint32 epoch = g_journal.basePath == projectPath ? g_journal.epoch + 1
+                                                     : (Uint32)time(nullptr) | 1u;
+    SaveSnapshot s;
+    save_snapshot(s, wsBlocks, vars, sprite, sounds, r);
+    s.epoch = epoch;
+    if (!save_write_snapshot(s, projectPath)) return false;
+    if (!journal_start(projectPath, epoch, nullptr, 0)) return false;
+    journal_capture(wsBlocks, vars, sprite, sounds);
+    return true;
+}
+
+struct JournalReader {
+    const Uint8* p;
+    size_t       n;
+    size_t       at = 0;
+    bool         ok = true;
+
+    Sint32 i32() {
+        Sint32 v = 0;
+        if (at + 4 > n) { ok = false; return 0; }
+        std::memcpy(&v, p + at, 4);
+        at += 4;
+        return v;
+    }
+    float f32() {
+        Sint32 bits = i32();
+        float v;
+        std::memcpy(&v, &bits, 4);
+        return v;
+    }
+    std::string str() {
+        Sint32 len = i32();
+        if (!ok || len < 0 || (size_t)len > n - at) { ok = false; return std::string(); }
+        std::string s((const char*)p + at, (size_t)len);
+        at += (size_t)len;
+        return s;
+    }
+};
+
+struct JournalLinks {
+    int next, innerFirst, elseFirst;
+};
+
+// Links name blocks that may only be created later in the same batch, so
+// they are collected by id and resolved once the whole log is applied.
+struct JournalReplay {
+    std::unordered_map<int, Block*> byId;
+    std::unordered_map<int, bool>   embedded;
+    std::unordered_map<int, JournalLinks> links;
+    std::unordered_map<int, std::vector<std::pair<int, int>>> inputLinks;
+    std::vector<int>                created;
+    std::vector<Block*>             dead;
+};
+
+static void journal_apply(JournalReplay& st, JournalReader& rd, VariablesPanel& vars)
+{
+    Uint8 op = rd.n ? rd.p[0] : 0;
+    rd.at = 1;
+    if (op == JOURNAL_VARS) {
+        Sint32 count = rd.i32();
+        std::vector<Variable> vs;
+        for (Sint32 i = 0; i < count && rd.ok; i++) {
+            Variable v;
+            v.name        = rd.str();
+            v.value       = rd.f32();
+            v.showOnStage = rd.i32() != 0;
+            vs.push_back(v);
+        }
+        if (rd.ok) vars.variables = std::move(vs);
+        return;
+    }
+    if (op == JOURNAL_COMMIT) return;
+
+    int id = rd.i32();
+    if (!rd.ok) return;
+    auto it = st.byId.find(id);
+    Block* b = it != st.byId.end() ? it->second : nullptr;
+
+    switch (op) {
+        case JOURNAL_CREATE: {
+            int type = rd.i32(), x = rd.i32(), y = rd.i32();
+            std::string text = rd.str();
+            if (!rd.ok) return;
+            if (!b) {
+                b = block_alloc();
+                b->id = id;
+                st.byId[id] = b;
+                st.embedded[id] = false;
+                st.created.push_back(id);
+            }
+            b->type = (BlockType)type;
+            b->text = text;
+            b->x    = x;
+            b->y    = y;
+            b->h    = BLOCK_H;
+            init_block_inputs(b);
+            break;
+        }
+        case JOURNAL_MOVE: {
+            int x = rd.i32(), y = rd.i32();
+            if (rd.ok && b) { b->x = x; b->y = y; }
+            break;
+        }
+        case JOURNAL_LINK: {
+            int next = rd.i32(), inner = rd.i32(), els = rd.i32(), emb = rd.i32();
+            if (!rd.ok || !b) return;
+            st.links[id]    = {next, inner, els};
+            st.embedded[id] = emb != 0;
+            break;
+        }
+        case JOURNAL_INPUT: {
+            int idx = rd.i32(), slot = rd.i32(), emb = rd.i32();
+            std::string value = rd.str();
+            if (!rd.ok || !b || idx < 0 || idx >= (int)b->inputs.size()) return;
+            BlockInput& inp = b->inputs[idx];
+            inp.value       = value;
+            inp.slotType    = slot == SLOT_BOOLEAN ? SLOT_BOOLEAN : SLOT_NUMERIC;
+            st.inputLinks[id].push_back({idx, emb});
+            break;
+        }
+        case JOURNAL_DELETE:
+            if (!b) return;
+            st.byId.erase(id);
+            st.embedded.erase(id);
+            st.dead.push_back(b);
+            break;
+        default:
+            break;
+    }
+}
+
+struct JournalScan {
+    size_t validBytes  = 0;
+    size_t commitBytes = 0;
+    int    records     = 0;
+    int    committed   = 0;
+};
+
+// Walks the framed records after the header, stopping at the first one that
+// fails its size or checksum.
+static JournalScan journal_scan(const Uint8* data, size_t size)
+{
+    JournalScan sc;
+    size_t at = sizeof(JournalHeader);
+    sc.validBytes = sc.commitBytes = at;
+    while (at + 8 <= size) {
+        Uint32 len, check;
+        std::memcpy(&len,   data + at,     4);
+        std::memcpy(&check, data + at + 4, 4);
+        if (len == 0 || len > size - at - 8 || journal_check(data + at + 8, len) != check) break;
+        at += 8 + len;
+        sc.validBytes = at;
+        sc.records++;
+        if (data[at - len] == JOURNAL_COMMIT) {
+            sc.commitBytes = at;
+            sc.committed   = sc.records;
+        }
+    }
+    return sc;
+}
+
+// Loads projectPath and replays its log on top. Normally only committed
+// records are applied; recover also applies the uncommitted tail, as after
+// a crash. The log is then rewritten to exactly what was applied and kept
+// open for further edits. Text projects load without a log.
+inline bool journal_load(const std::string& projectPath,
+                         std::vector<Block*>& wsBlocks, VariablesPanel& vars,
+                         Sprite& sprite, SoundsPanel& sounds, SDL_Renderer* r,
+                         int& nextId, bool recover = false)
+{
+    journal_close();
+    if (is_sb3_project(projectPath))
+        return load_project_sb3(projectPath, wsBlocks, vars, sprite, sounds, r, nextId);
+    Uint32 epoch = 0;
+    if (!project_load(projectPath, wsBlocks, vars, sprite, sounds, r, nextId, &epoch))
+        return false;
+    if (!is_binary_project(projectPath)) return true;
+    journal_unique_ids(wsBlocks, nextId);
+
+    MappedFile mf;
+    JournalScan sc;
+    bool have = map_file(journal_path(projectPath), mf);
+    if (have) {
+        JournalHeader h;
+        have = mf.size >= sizeof(h);
+        if (have) {
+            std::memcpy(&h, mf.data, sizeof(h));
+            have = std::memcmp(h.magic, JOURNAL_MAGIC, 4) == 0 &&
+                   h.version == JOURNAL_VERSION && h.epoch == epoch;
+        }
+        if (have) sc = journal_scan(mf.data, mf.size);
+    }
+
+    size_t end  = recover ? sc.validBytes : sc.commitBytes;
+    size_t body = have ? end - sizeof(JournalHeader) : 0;
+    if (body) {
+        JournalReplay st;
+        for (auto& p : journal_all_blocks(wsBlocks)) {
+            st.byId[p.first->id]     = p.first;
+            st.embedded[p.first->id] = p.second;
+        }
+        for (size_t at = sizeof(JournalHeader); at < end; ) {
+            Uint32 len;
+            std::memcpy(&len, mf.data + at, 4);
+            JournalReader rd{mf.data + at + 8, len};
+            journal_apply(st, rd, vars);
+            at += 8 + len;
+        }
+
+        auto lookup = [&st](int ref) -> Block* {
+            auto f = st.byId.find(ref);
+            return f != st.byId.end() ? f->second : nullptr;
+        };
+        for (auto& kv : st.links) {
+            Block* b = lookup(kv.first);
+            if (!b) continue;
+            b->next       = lookup(kv.second.next);
+            b->innerFirst = lookup(kv.second.innerFirst);
+            b->elseFirst  = lookup(kv.second.elseFirst);
+        }
+        for (auto& kv : st.inputLinks) {
+            Block* b = lookup(kv.first);
+            if (!b) continue;
+            for (auto& il : kv.second)
+                if (il.first < (int)b->inputs.size())
+                    b->inputs[il.first].embeddedBlock = lookup(il.second);
+        }
+
+        std::vector<Block*> order;
+        std::unordered_set<Block*> live;
+        for (auto& kv : st.byId) live.insert(kv.second);
+        for (Block* b : wsBlocks)
+            if (live.count(b) && !st.embedded[b->id]) order.push_back(b);
+        for (int id : st.created) {
+            auto it = st.byId.find(id);
+            if (it != st.byId.end() && !st.embedded[id]) order.push_back(it->second);
+        }
+        std::unordered_set<Block*> placed(order.begin(), order.end());
+        for (auto& kv : st.byId)
+            if (!st.embedded[kv.first] && !placed.count(kv.second)) order.push_back(kv.second);
+
+        auto keep = [&live](Block* p) { return live.count(p) ? p : nullptr; };
+        std::unordered_set<Block*> owned;
+        for (Block* b : live) {
+            b->next       = keep(b->next);
+            b->innerFirst = keep(b->innerFirst);
+            b->elseFirst  = keep(b->elseFirst);
+            b->prev       = nullptr;
+            for (auto& inp : b->inputs)
+                if ((inp.embeddedBlock = keep(inp.embeddedBlock))) owned.insert(inp.embeddedBlock);
+        }
+        // A reporter whose parent did not survive the replay goes with it.
+        std::vector<Block*> orphans;
+        for (auto& kv : st.byId)
+            if (st.embedded[kv.first] && !owned.count(kv.second)) orphans.push_back(kv.second);
+        if (!orphans.empty())
+            std::cerr << "[Journal] Dropped " << orphans.size() << " reporter(s) with no parent\n";
+        for (Block* o : orphans) {
+            std::vector<Block*> gone;
+            block_collect(o, gone);
+            for (Block* g : gone) live.erase(g);
+            block_free_reporters(o);
+        }
+        for (Block* b : live) {
+            if (b->next) b->next->prev = b;
+            b->innerLast = b->innerFirst;
+            while (b->innerLast && b->innerLast->next) b->innerLast = b->innerLast->next;
+            if (b->id >= nextId) nextId = b->id + 1;
+        }
+        for (Block* d : st.dead) block_free(d);
+        wsBlocks = std::move(order);
+
+        int applied = recover ? sc.records : sc.committed;
+        std::cerr << "[Journal] Replayed " << applied << " record(s) onto '" << projectPath << "'";
+        if (recover && sc.records > sc.committed)
+            std::cerr << ", " << sc.records - sc.committed << " of them uncommitted";
+        std::cerr << "\n";
+    }
+
+    std::vector<Uint8> kept;
+    if (body) kept.assign(mf.data + sizeof(JournalHeader), mf.data + end);
+    unmap_file(mf);
+    journal_start(projectPath, epoch, kept.data(), kept.size());
+    journal_capture(wsBlocks, vars, sprite, sounds);
+    return true;
+}
+
+// True when projectPath's log holds edits past its last commit, i.e. the
+// previous session ended without saving them.
+inline bool journal_has_uncommitted(const std::string& projectPath)
+{
+    MappedFile mf;
+    if (!map_file(journal_path(projectPath), mf)) return false;
+    bool dirty = mf.size > sizeof(JournalHeader) &&
+                 std::memcmp(mf.data, JOURNAL_MAGIC, 4) == 0;
+    if (dirty) {
+        JournalScan sc = journal_scan(mf.data, mf.size);
+        dirty = sc.records > sc.committed;
+    }
+    unmap_file(mf);
+    return dirty;
+}
+
+// Cuts projectPath's log back to its last commit.
+inline void journal_discard_uncommitted(const std::string& projectPath)
+{
+    MappedFile mf;
+    if (!map_file(journal_path(projectPath), mf)) return;
+    if (mf.size < sizeof(JournalHeader)) { unmap_file(mf); return; }
+    JournalHeader h;
+    std::memcpy(&h, mf.data, sizeof(h));
+    JournalScan sc = journal_scan(mf.data, mf.size);
+    std::vector<Uint8> kept(mf.data + sizeof(JournalHeader), mf.data + sc.commitBytes);
+    unmap_file(mf);
+    if (journal_start(projectPath, h.epoch, kept.data(), kept.size()))
+        std::cerr << "[Journal] Discarded " << sc.records - sc.committed
+                  << " unsaved record(s) of '" << projectPath << "'\n";
+    journal_close();
+}
+
+// Offers the edits a previous session left unsaved in projectPath's log and
+// replays them if the user agrees. Turned down, they are cut from the log.
+inline bool journal_offer_recover(SDL_Window* window, const std::string& projectPath,
+                                  std::vector<Block*>& wsBlocks, VariablesPanel& vars,
+                                  Sprite& sprite, SoundsPanel& sounds,
+                                  SDL_Renderer* r, int& nextId)
+{
+    if (!journal_has_uncommitted(projectPath)) return false;
+
+    const SDL_MessageBoxButtonData buttons[] = {
+        { SDL_MESSAGEBOX_BUTTON_ESCAPEKEY_DEFAULT, 0, "Discard" },
+        { SDL_MESSAGEBOX_BUTTON_RETURNKEY_DEFAULT, 1, "Recover" },
+    };
+    std::string text = "The last session ended with unsaved edits to '" + projectPath +
+                       "'. Recover them?";
+    SDL_MessageBoxData box = { SDL_MESSAGEBOX_WARNING, window, "Unsaved edits found",
+                               text.c_str(), 2, buttons, nullptr };
+    int choice = -1;
+    if (SDL_ShowMessageBox(&box, &choice) != 0) {
+        std::cerr << "[Journal] Could not ask about '" << projectPath << "': " << SDL_GetError() << "\n";
+        return false;
+    }
+    if (choice != 1) {
+        journal_discard_uncommitted(projectPath);
+        return false;
+    }
+    return journal_load(projectPath, wsBlocks, vars, sprite, sounds, r, nextId, true);
+}
+
+// Saving to the project the log belongs to just commits the pending edits;
+// anything else (another path, changed assets, an oversized log) compacts.
+// A ".txt" path still goes to the text export and ".sb3" to the Scratch export,
+// which only queues the export; its result comes from sb3_export_poll().
+inline bool journal_is_export(const std::string& path, const char* ext = nullptr)
+{
+    auto ends = [&path](const char* e) {
+        size_t n = std::strlen(e);
+        return path.size() >= n && path.compare(path.size() - n, n, e) == 0;
+    };
+    return ext ? ends(ext) : ends(".txt") || ends(".sb3");
+}
+
+inline bool journal_save(const std::string& projectPath,
+                         const std::vector<Block*>& wsBlocks, const VariablesPanel& vars,
+                         Sprite& sprite, const SoundsPanel& sounds, SDL_Renderer* r)
+{
+    if (journal_is_export(projectPath, ".txt"))
+        return project_save(projectPath, wsBlocks, vars, sprite, sounds, r);
+    if (journal_is_export(projectPath, ".sb3"))
+        return save_project_sb3(projectPath, wsBlocks, vars, sprite, sounds, r);
+
+    if (g_journal.file && g_journal.basePath == projectPath) {
+        journal_sync(vars, sprite, sounds);
+        if (!g_journal.assetsDirty && g_journal.bytes < JOURNAL_COMPACT_BYTES) {
+            journal_end(journal_begin(JOURNAL_COMMIT));
+            if (journal_flush_batch(true)) return true;
+        }
+    }
+    return journal_compact(projectPath, wsBlocks, vars, sprite, sounds, r);
+}
+
+#endif
@@ -0,0 +1,332 @@
+#ifndef SCRATCH_FOP_JSON_H
+#define SCRATCH_FOP_JSON_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <cmath>
+#include <SDL2/SDL.h>
+
+// Single-pass JSON parser. The whole document becomes one flat node array
+// in document order; a container's children follow it directly and `end`
+// is the index just past its last descendant, so siblings are walked by
+// jumping to `end`. Strings are unescaped in place and viewed, not copied.
+
+enum JsonType : Uint8 {
+    JSON_NULL = 0,
+    JSON_FALSE,
+    JSON_TRUE,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+static const Uint32 JSON_NONE      = 0xFFFFFFFFu;
+static const int    JSON_MAX_DEPTH = 512;
+
+struct JsonNode {
+    JsonType         type  = JSON_NULL;
+    Uint32           end   = 0;
+    Uint32           count = 0;
+    double           num   = 0.0;
+    std::string_view key;
+    std::string_view str;
+};
+
+struct JsonDoc {
+    std::vector<char>     text;
+    std::vector<JsonNode> nodes;
+    std::string           error;
+};
+
+static inline bool json_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static int json_hex4(const char* p)
+{
+    int v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9')      v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return -1;
+    }
+    return v;
+}
+
+static char* json_put_utf8(char* o, Uint32 cp)
+{
+    if (cp < 0x80) {
+        *o++ = (char)cp;
+    } else if (cp < 0x800) {
+        *o++ = (char)(0xC0 | cp >> 6);
+        *o++ = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *o++ = (char)(0xE0 | cp >> 12);
+        *o++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *o++ = (char)(0x80 | (cp & 0x3F));
+    } else {
+        *o++ = (char)(0xF0 | cp >> 18);
+        *o++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+        *o++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *o++ = (char)(0x80 | (cp & 0x3F));
+    }
+    return o;
+}
+
+// Parses the string starting after the opening quote at p. The unescaped
+// bytes overwrite the source, which is never longer than the result.
+static bool json_string(char*& p, char* end, std::string_view& out)
+{
+    char* start = p;
+    while (p < end && *p != '"' && *p != '\\') p++;
+    char* o = p;
+    while (p < end && *p != '"') {
+        if (*p != '\\') { *o++ = *p++; continue; }
+        if (++p >= end) return false;
+        switch (*p++) {
+        case '"':  *o++ = '"';  break;
+        case '\\': *o++ = '\\'; break;
+        case '/':  *o++ = '/';  break;
+        case 'b':  *o++ = '\b'; break;
+        case 'f':  *o++ = '\f'; break;
+        case 'n':  *o++ = '\n'; break;
+        case 'r':  *o++ = '\r'; break;
+        case 't':  *o++ = '\t'; break;
+        case 'u': {
+            if (end - p < 4) return false;
+            int cp = json_hex4(p);
+            if (cp < 0) return false;
+            p += 4;
+            if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                int lo = json_hex4(p + 2);
+                if (lo >= 0xDC00 && lo < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    p += 6;
+                }
+            }
+            o = json_put_utf8(o, (Uint32)cp);
+            break;
+        }
+        default: return false;
+        }
+    }
+    if (p >= end) return false;
+    out = std::string_view(start, (size_t)(o - start));
+    p++;
+    return true;
+}
+
+inline bool json_parse(JsonDoc& doc, const char* data, size_t size)
+{
+    doc.text.assign(data, data + size);
+    doc.nodes.clear();
+    doc.nodes.reserve(size / 8 + 16);
+    doc.error.clear();
+
+    char* p   = doc.text.data();
+    char* end = p + size;
+    std::vector<Uint32> stack;
+    std::string_view key;
+    bool expectKey = false;
+
+    auto fail = [&](const char* what) {
+        doc.error = std::string(what) + " at byte " + std::to_string(p - doc.text.data());
+        doc.nodes.clear();
+        return false;
+    };
+
+    for (;;) {
+        while (p < end && json_space(*p)) p++;
+        if (p >= end) return fail("unexpected end");
+
+        if (expectKey) {
+            if (*p == '}') goto close;
+            if (*p != '"') return fail("expected key");
+            p++;
+            if (!json_string(p, end, key)) return fail("bad key");
+            while (p < end && json_space(*p)) p++;
+            if (p >= end || *p != ':') return fail("expected ':'");
+            p++;
+            while (p < end && json_space(*p)) p++;
+            if (p >= end) return fail("unexpected end");
+        } else if (*p == ']' && !stack.empty() && doc.nodes[stack.back()].type == JSON_ARRAY &&
+                   doc.nodes[stack.back()].count == 0) {
+            goto close;
+        }
+
+        {
+            if (!stack.empty()) doc.nodes[stack.back()].count++;
+            JsonNode n;
+            n.key = key;
+            key   = {};
+            char c = *p;
+            if (c == '{' || c == '[') {
+                if ((int)stack.size() >= JSON_MAX_DEPTH) return fail("nesting too deep");
+                n.type = c == '{' ? JSON_OBJECT : JSON_ARRAY;
+                stack.push_back((Uint32)doc.nodes.size());
+                doc.nodes.push_back(n);
+                p++;
+                expectKey = c == '{';
+                continue;
+            }
+            if (c == '"') {
+                p++;
+                n.type = JSON_STRING;
+                if (!json_string(p, end, n.str)) return fail("bad string");
+            } else if (c == 't' && end - p >= 4 && std::string_view(p, 4) == "true") {
+                n.type = JSON_TRUE;  p += 4;
+            } else if (c == 'f' && end - p >= 5 && std::string_view(p, 5) == "false") {
+                n.type = JSON_FALSE; p += 5;
+            } else if (c == 'n' && end - p >= 4 && std::string_view(p, 4) == "null") {
+                n.type = JSON_NULL;  p += 4;
+            } else {
+                char* s = p;
+                if (p < end && *p == '-') p++;
+                while (p < end && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' ||
+                                   *p == 'E' || *p == '+' || *p == '-'))
+                    p++;
+                auto res = std::from_chars(s, p, n.num);
+                if (res.ec != std::errc() || res.ptr != p) {
+                    p = s;
+                    return fail("bad value");
+                }
+                n.type = JSON_NUMBER;
+                n.str  = std::string_view(s, (size_t)(p - s));
+            }
+            n.end = (Uint32)doc.nodes.size() + 1;
+            doc.nodes.push_back(n);
+        }
+
+    after_value:
+        if (stack.empty()) {
+            while (p < end && json_space(*p)) p++;
+            if (p != end) return fail("trailing data");
+            return true;
+        }
+        while (p < end && json_space(*p)) p++;
+        if (p >= end) return fail("unexpected end");
+        if (*p == ',') {
+            p++;
+            expectKey = doc.nodes[stack.back()].type == JSON_OBJECT;
+            continue;
+        }
+        if (*p != (doc.nodes[stack.back()].type == JSON_OBJECT ? '}' : ']'))
+            return fail("expected ',' or close");
+
+    close:
+        p++;
+        doc.nodes[stack.back()].end = (Uint32)doc.nodes.size();
+        stack.pop_back();
+        expectKey = false;
+        goto after_value;
+    }
+}
+
+// ── Queries ─────────────────────────────────────────────────
+
+inline bool json_valid(const JsonDoc& doc, Uint32 i) { return i < doc.nodes.size(); }
+
+inline JsonType json_type(const JsonDoc& doc, Uint32 i)
+{
+    return i < doc.nodes.size() ? doc.nodes[i].type : JSON_NULL;
+}
+
+inline Uint32 json_first(const JsonDoc& doc, Uint32 i)
+{
+    if (i >= doc.nodes.size() || doc.nodes[i].count == 0) return JSON_NONE;
+    return i + 1;
+}
+
+inline Uint32 json_next(const JsonDoc& doc, Uint32 parent, Uint32 child)
+{
+    Uint32 n = doc.nodes[child].end;
+    return n < doc.nodes[parent].end ? n : JSON_NONE;
+}
+
+inline Uint32 json_get(const JsonDoc& doc, Uint32 obj, std::string_view key)
+{
+    if (json_type(doc, obj) != JSON_OBJECT) return JSON_NONE;
+    for (Uint32 c = json_first(doc, obj); c != JSON_NONE; c = json_next(doc, obj, c))
+        if (doc.nodes[c].key == key) return c;
+    return JSON_NONE;
+}
+
+inline Uint32 json_at(const JsonDoc& doc, Uint32 arr, Uint32 k)
+{
+    if (json_type(doc, arr) != JSON_ARRAY) return JSON_NONE;
+    Uint32 c = json_first(doc, arr);
+    while (c != JSON_NONE && k--) c = json_next(doc, arr, c);
+    return c;
+}
+
+// Scratch stores literals as either numbers or strings; both read as text.
+inline std::string json_text(const JsonDoc& doc, Uint32 i, const std::string& fallback = "")
+{
+    JsonType t = json_type(doc, i);
+    if (i == JSON_NONE || (t != JSON_STRING && t != JSON_NUMBER)) return fallback;
+    return std::string(doc.nodes[i].str);
+}
+
+inline double json_num(const JsonDoc& doc, Uint32 i, double fallback = 0.0)
+{
+    JsonType t = json_type(doc, i);
+    if (t == JSON_NUMBER) return doc.nodes[i].num;
+    if (t == JSON_STRING) {
+        double v = fallback;
+        std::string_view s = doc.nodes[i].str;
+        if (std::from_chars(s.data(), s.data() + s.size(), v).ec == std::errc()) return v;
+    }
+    return fallback;
+}
+
+inline bool json_bool(const JsonDoc& doc, Uint32 i, bool fallback = false)
+{
+    JsonType t = json_type(doc, i);
+    if (t == JSON_TRUE)  return true;
+    if (t == JSON_FALSE) return false;
+    return fallback;
+}
+
+// ── Writing ─────────────────────────────────────────────────
+
+inline void json_put_string(std::string& out, std::string_view s)
+{
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n";  break;
+        case '\r': out += "\\r";  break;
+        case '\t': out += "\\t";  break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                out += "\\u00";
+                out += hex[(c >> 4) & 15];
+                out += hex[c & 15];
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+// Shortest round-trip form, so the same value always prints the same way.
+inline void json_put_number(std::string& out, double v)
+{
+    if (!std::isfinite(v)) v = 0.0;
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, res.ptr);
+}
+
+#endif
@@ -10,18 +10,31 @@
 #include "utils.h"
 #include "input.h"
 #include "render.h"
+#include "camera.h"
+#include "minimap.h"
+#include "search_panel.h"
+#include "cleanup.h"
 #include "engine.h"
 #include "costume_editor.h"
+#include "asset_store.h"
 #include "tab_bar.h"
-#include "audio.h"
+#include "SaveSystem.h"
+#include "autosave.h"
+#include "journal.h"
+#include "Audio.h"
 #include "Sound_panel.h"
 #include "OperatorManager.h"
+#include "bench.h"
 
 using namespace std;
 
 SoundsPanel* g_soundsPanel = nullptr;
 
+#ifndef SCRATCH_LIBFUZZER
 int main(int argc, char* argv[]) {
+    int benchExit = bench_command(argc, argv);
+    if (benchExit >= 0) return benchExit;
+
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_AUDIO);
     audio_init();
     IMG_Init(IMG_INIT_PNG | IMG_INIT_JPG);
@@ -50,12 +63,13 @@ int main(int argc, char* argv[]) {
     TTF_Font* fontBig   = TTF_OpenFont(fontPathB, 16);
     if (!fontSmall) cerr << "Font error: " << TTF_GetError() << endl;
 
+    tex_init();
     SDL_Texture* playTex = nullptr, *stopTex = nullptr;
     {
         SDL_Surface* ps = IMG_Load("play1.png");
-        if (ps) { playTex = SDL_CreateTextureFromSurface(renderer, ps); SDL_FreeSurface(ps); }
+        if (ps) { playTex = tex_from_surface(renderer, TEX_UI, ps); SDL_FreeSurface(ps); }
         SDL_Surface* ss = IMG_Load("stop1.png");
-        if (ss) { stopTex = SDL_CreateTextureFromSurface(renderer, ss); SDL_FreeSurface(ss); }
+        if (ss) { stopTex = tex_from_surface(renderer, TEX_UI, ss); SDL_FreeSurface(ss); }
     }
 
     Sprite sprite;
@@ -80,27 +94,22 @@ int main(int argc, char* argv[]) {
     int    lastCostumeClickIdx  = -1;
 
     auto load_costume = [&](const char* path, const char* name) {
-        SDL_Surface* s = IMG_Load(path);
         Costume c;
         c.name = name;
-        if (s) {
-            c.texture = SDL_CreateTextureFromSurface(renderer, s);
-            c.w = s->w; c.h = s->h;
-            SDL_FreeSurface(s);
-        } else {
-            c.texture = nullptr;
-            c.w = 96; c.h = 96;
-        }
+        c.w = 96; c.h = 96;
+        c.source = asset_read_file(path);
         sprite.costumes.push_back(c);
     };
     load_costume("sprite.png",  "costume1");
     load_costume("sprite2.png", "costume2");
 
-    if (!sprite.costumes.empty() && sprite.costumes[0].texture)
+    if (!sprite.costumes.empty() && asset_costume_materialize(renderer, sprite.costumes[0]))
         sprite.texture = sprite.costumes[0].texture;
 
     Stage stage = {STAGE_X, STAGE_Y, STAGE_WIDTH, STAGE_HEIGHT, {255,255,255,255}};
     Workspace workspace = {WORKSPACE_X, STAGE_Y, WORKSPACE_W, SCREEN_HEIGHT - STAGE_Y};
+    Camera camera;
+    camera_reset(camera, workspace);
 
     Palette palette;
     palette.activeCategory = CAT_MOTION;
@@ -131,11 +140,12 @@ int main(int argc, char* argv[]) {
     addCat(CAT_VARIABLES, "Variables", COLOR_VARIABLES);
     addCat(CAT_MYBLOCKS,  "My Blocks", COLOR_MYBLOCKS);
     addCat(CAT_EXTENSION, "Pen",       COLOR_EXTENSION);
+    addCat(CAT_MUSIC,     "Music",     COLOR_MUSIC);
 
     vector<Block*> paletteBlocks;
     int bid = 1;
     auto addPB = [&](BlockType t, const string& txt) {
-        Block* b = new Block();
+        Block* b = block_alloc(g_palettePool);
         b->id = bid++;
         b->type = t;
         b->text = txt;
@@ -190,6 +200,7 @@ addPB(BLOCK_SOUND, "clear sound effects");
 addPB(BLOCK_EVENT, "when flag clicked");
 addPB(BLOCK_EVENT, "when key pressed");
 addPB(BLOCK_EVENT, "when sprite clicked");
+addPB(BLOCK_EVENT, "when loudness > ()");
 
 addPB(BLOCK_CONTROL, "wait () secs");
 addPB(BLOCK_CONTROL, "repeat ()");
@@ -210,6 +221,7 @@ addPB(BLOCK_SENSING, "mouse down?");
 addPB(BLOCK_SENSING, "mouse x");
 addPB(BLOCK_SENSING, "mouse y");
 addPB(BLOCK_SENSING, "timer");
+addPB(BLOCK_SENSING, "loudness");
 addPB(BLOCK_SENSING, "reset timer");
 addPB(BLOCK_SENSING, "distance to mouse-pointer");
 
@@ -250,6 +262,13 @@ addPB(BLOCK_EXTENSION, "set pen color to ()");
 addPB(BLOCK_EXTENSION, "set pen size to ()");
 addPB(BLOCK_EXTENSION, "change pen size by ()");
 
+addPB(BLOCK_MUSIC, "play drum () for () beats");
+addPB(BLOCK_MUSIC, "rest for () beats");
+addPB(BLOCK_MUSIC, "play note () for () beats");
+addPB(BLOCK_MUSIC, "set instrument to ()");
+addPB(BLOCK_MUSIC, "set tempo to ()");
+addPB(BLOCK_MUSIC, "change tempo by ()");
+
     VariablesPanel varsPanel;
     varsPanel.x = 0; varsPanel.y = 0;
     varsPanel.w = VAR_PANEL_W; varsPanel.h = VAR_PANEL_H;
@@ -285,7 +304,6 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
         sc.name     = name;
         sc.filePath = path;
         sc.volume   = 100.0f;
-        sc.chunk    = nullptr;
         sc.channel  = -1;
         sc.isPlaying = false;
         audio_load(sc);
@@ -321,7 +339,12 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
 
     vector<Block*> workspaceBlocks;
     Block* draggedBlock = nullptr;
+    bool   panning      = false;
+    bool   minimapHeld  = false;
+    bool   cleanupMenuOpen = false;
+    SDL_Rect cleanupMenu = {0, 0, 0, 0};
     BlockInput* activeInput = nullptr;
+    Block*      activeInputBlock = nullptr;
     std::string askInputText = "";
     bool askInputActive = false;
     bool   quit         = false;
@@ -340,7 +363,41 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
     bool isVarCat   = false;
     bool isMyBlocks = false;
 
-    const std::string projectFile = "project.scratch";
+    std::string projectFile = "project.scratch";
+
+    if (journal_has_uncommitted(projectFile)) {
+        if (journal_offer_recover(window, projectFile, workspaceBlocks, varsPanel,
+                                  sprite, soundsPanel, renderer, bid))
+            costumePanel.selectedIndex = sprite.currentCostume;
+    } else if (autosave_offer_restore(window, projectFile, workspaceBlocks, varsPanel,
+                                      sprite, soundsPanel, renderer, bid)) {
+        costumePanel.selectedIndex = sprite.currentCostume;
+    }
+    autosave_init(projectFile);
+    bool journalPending = false;
+
+    // Saving or loading a project file makes it the open project, so the
+    // autosave follows it; .txt and .sb3 are exports and imports.
+    auto save_project_as = [&](const std::string& path) {
+        if (!journal_save(path, workspaceBlocks, varsPanel, sprite, soundsPanel, renderer)) return;
+        if (journal_is_export(path)) return;
+        projectFile = path;
+        autosave_retarget(projectFile);
+        autosave_saved(workspaceBlocks, varsPanel, sprite, soundsPanel, renderer);
+    };
+    auto load_project_from = [&](const std::string& path) {
+        undo_clear(true);
+        search_clear();
+        if (journal_load(path, workspaceBlocks, varsPanel, sprite, soundsPanel, renderer, bid) &&
+            is_binary_project(path)) {
+            projectFile = path;
+            autosave_retarget(projectFile);
+            autosave_mark_clean(workspaceBlocks, varsPanel, sprite, soundsPanel, renderer);
+        }
+        costumePanel.selectedIndex = sprite.currentCostume;
+        camera_reset(camera, workspace);
+        layout_touch_all();
+    };
 
     auto toggle_fullscreen = [&]() {
         Uint32 flags = SDL_GetWindowFlags(window);
@@ -358,6 +415,22 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
     while (!quit) {
         while (SDL_PollEvent(&e)) {
             if (e.type == SDL_QUIT) { quit = true; break; }
+            if (e.type == SDL_MOUSEBUTTONUP || e.type == SDL_KEYDOWN || e.type == SDL_TEXTINPUT) {
+                journalPending = true;
+                scriptRunner.invalidate();
+            }
+            if (e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_KEYDOWN)
+                cleanup_finish();
+            // Handlers mark the blocks they change through undo_touch();
+            // anything else they do only moves blocks.
+            if (e.type == SDL_TEXTINPUT) {
+                layout_touch(activeInputBlock);
+                search_touch(activeInputBlock);
+                journal_touch(activeInputBlock);
+            }
+            else if (e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_MOUSEBUTTONUP ||
+                     e.type == SDL_KEYDOWN || (e.type == SDL_MOUSEMOTION && draggedBlock))
+                layout_moved();
 
             if (e.type == SDL_WINDOWEVENT) {
                 if (e.window.event == SDL_WINDOWEVENT_MAXIMIZED) {
@@ -366,18 +439,59 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                 }
             }
 
+            if (g_searchPanel.focused && activeTab == TAB_CODE &&
+                (e.type == SDL_KEYDOWN || e.type == SDL_TEXTINPUT)) {
+                if (Block* b = search_panel_key(e))
+                    camera_center_on(camera, workspace, b->x + b->w/2, b->y + b->h/2);
+                continue;
+            }
+
             if (e.type == SDL_KEYDOWN) {
+                if ((e.key.keysym.mod & KMOD_CTRL) && activeTab == TAB_CODE &&
+                    e.key.keysym.sym == SDLK_f) {
+                    if (activeInput) {
+                        undo_commit(activeInputBlock);
+                        activeInput->editing = false;
+                        activeInput = nullptr;
+                        activeInputBlock = nullptr;
+                    }
+                    search_panel_open();
+                    continue;
+                }
                 if (e.key.keysym.sym == SDLK_f) {
                     toggle_fullscreen();
                     continue;
                 }
+                if (e.key.keysym.sym == SDLK_F3) {
+                    g_texOverlay = !g_texOverlay;
+                    continue;
+                }
+                if ((e.key.keysym.mod & KMOD_CTRL) && activeTab == TAB_CODE && !draggedBlock &&
+                    (e.key.keysym.sym == SDLK_z || e.key.keysym.sym == SDLK_y)) {
+                    if (activeInput) {
+                        undo_commit(activeInputBlock);
+                        activeInput->editing = false;
+                        activeInput = nullptr;
+                        activeInputBlock = nullptr;
+                        SDL_StopTextInput();
+                    }
+                    bool redo = e.key.keysym.sym == SDLK_y || (e.key.keysym.mod & KMOD_SHIFT);
+                    if (redo) redo_step(workspaceBlocks);
+                    else      undo_step(workspaceBlocks);
+                    continue;
+                }
+                if ((e.key.keysym.mod & KMOD_CTRL) && activeTab == TAB_CODE &&
+                    e.key.keysym.sym == SDLK_0) {
+                    camera_reset(camera, workspace);
+                    continue;
+                }
 
                 if ((saveDialogOpen || loadDialogOpen) && fileDialogEditing) {
                     if (e.key.keysym.sym == SDLK_RETURN || e.key.keysym.sym == SDLK_KP_ENTER) {
                         if (saveDialogOpen) {
-                            save_project(fileDialogInput, workspaceBlocks, varsPanel);
+                            save_project_as(fileDialogInput);
                         } else {
-                            load_project(fileDialogInput, workspaceBlocks, varsPanel, bid);
+                            load_project_from(fileDialogInput);
                         }
                         saveDialogOpen = loadDialogOpen = false;
                         fileDialogEditing = false;
@@ -406,8 +520,7 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                                 std::string fn = (sl != std::string::npos) ? spriteUploadPath.substr(sl+1) : spriteUploadPath;
                                 size_t dot = fn.find_last_of('.');
                                 nc.name = (dot != std::string::npos) ? fn.substr(0, dot) : fn;
-                                nc.texture = SDL_CreateTextureFromSurface(renderer, s);
-                                nc.w = s->w; nc.h = s->h;
+                                asset_costume_from_surface(renderer, nc, s);
                                 SDL_FreeSurface(s);
                                 sprite.costumes.push_back(nc);
                                 sprite.currentCostume = (int)sprite.costumes.size() - 1;
@@ -475,7 +588,6 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                                           ? fname.substr(0, dot) : fname;
                             nc.filePath = path;
                             nc.volume   = 100.0f;
-                            nc.chunk    = nullptr;
                             nc.channel  = -1;
                             nc.isPlaying = false;
                             audio_load(nc);
@@ -698,6 +810,21 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                     continue;
                 }
 
+                if (activeTab == TAB_CODE && search_panel_hit(workspace, mx, my)) {
+                    search_panel_scroll(e.wheel.y);
+                    continue;
+                }
+                if (activeTab == TAB_CODE &&
+                    point_in_rect(mx, my, workspace.x, workspace.y, workspace.w, workspace.h)) {
+                    if (SDL_GetModState() & KMOD_CTRL)
+                        camera_zoom_at(camera, workspace, mx, my, std::pow(1.1f, (float)e.wheel.y));
+                    else if (SDL_GetModState() & KMOD_SHIFT)
+                        camera_pan(camera, e.wheel.y * 40, 0);
+                    else
+                        camera_pan(camera, e.wheel.x * 40, e.wheel.y * 40);
+                    continue;
+                }
+
                 if (point_in_rect(mx, my, palette.blockListX, palette.blockListY,
                                   palette.blockListW, palette.blockListH))
                     handle_scroll_value(e, palette.scrollOffset);
@@ -710,17 +837,45 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                 }
             }
 
+            if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_RIGHT &&
+                activeTab == TAB_CODE && !draggedBlock && !saveDialogOpen && !loadDialogOpen &&
+                !confirmNewProject && !spriteUploadOpen &&
+                point_in_rect(e.button.x, e.button.y, workspace.x, workspace.y,
+                              workspace.w, workspace.h) &&
+                !search_panel_hit(workspace, e.button.x, e.button.y) &&
+                !minimap_hit(workspace, e.button.x, e.button.y)) {
+                cleanupMenu = cleanup_menu_rect(e.button.x, e.button.y);
+                cleanupMenuOpen = true;
+                continue;
+            }
+
             if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) {
                 int mx = e.button.x, my = e.button.y;
 
+                if (cleanupMenuOpen) {
+                    cleanupMenuOpen = false;
+                    if (point_in_rect(mx, my, cleanupMenu.x, cleanupMenu.y,
+                                      cleanupMenu.w, cleanupMenu.h)) {
+                        cleanup_blocks(workspaceBlocks, camera_view(camera, workspace));
+                        continue;
+                    }
+                }
+
+                if (g_searchPanel.focused && !search_panel_hit(workspace, mx, my)) {
+                    g_searchPanel.focused = false;
+                    SDL_StopTextInput();
+                }
+
                 if (soundsPanel.uploadDialogOpen) {
                     handle_upload_dialog_click(mx, my, soundsPanel, fontSmall);
                     continue;
                 }
 
                 if (activeInput) {
+                    undo_commit(activeInputBlock);
                     activeInput->editing = false;
                     activeInput = nullptr;
+                    activeInputBlock = nullptr;
                     SDL_StopTextInput();
                 }
 
@@ -763,6 +918,9 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                         handle_sounds_panel_click(mx, my, soundsPanel);
                         continue;
                     }
+                    if (handle_sound_wave_press(mx, my, soundsPanel) ||
+                        handle_sound_edit_click(mx, my, soundsPanel))
+                        continue;
                     handle_sounds_workspace_click(mx, my, soundsPanel);
                     continue;
                 }
@@ -773,12 +931,18 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                         scriptRunner.togglePause();
                     } else {
                         Block* s = find_script_start(workspaceBlocks);
-                        if (s) scriptRunner.start(s, &varsPanel.variables);
+                        if (s) {
+                            synth_stop_all();
+                            audio_stop_all(soundsPanel);
+                            scriptRunner.start(s, &varsPanel.variables);
+                        }
                     }
                 }
                 else if (point_in_rect(mx, my, stopBtn.x, stopBtn.y,
                                        stopBtn.w, stopBtn.h)) {
                     scriptRunner.stop();
+                    synth_stop_all();
+                    audio_stop_all(soundsPanel);
                     sprite.sayText = ""; sprite.sayTimer = 0;
                 }
                 else if (point_in_rect(mx, my, pauseBtn.x, pauseBtn.y,
@@ -907,13 +1071,15 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                         if (point_in_rect(mx, my, deleteBtn.x, deleteBtn.y, deleteBtn.w, deleteBtn.h)) {
                             int idx = sprite.currentCostume;
                             if (idx >= 0 && idx < (int)sprite.costumes.size() && sprite.costumes.size() > 1) {
-                                if (sprite.costumes[idx].texture)
-                                    SDL_DestroyTexture(sprite.costumes[idx].texture);
+                                asset_costume_release(sprite.costumes[idx]);
                                 sprite.costumes.erase(sprite.costumes.begin() + idx);
                                 sprite.currentCostume = std::max(0, idx - 1);
                                 costumePanel.selectedIndex = sprite.currentCostume;
-                                if (!sprite.costumes.empty())
-                                    sprite.texture = sprite.costumes[sprite.currentCostume].texture;
+                                if (!sprite.costumes.empty()) {
+                                    Costume& cur = sprite.costumes[sprite.currentCostume];
+                                    asset_costume_materialize(renderer, cur);
+                                    sprite.texture = cur.texture;
+                                }
                             }
                             continue;
                         }
@@ -935,7 +1101,7 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                                 lastCostumeClickIdx  = idx;
                                 costumePanel.selectedIndex = idx;
                                 sprite.currentCostume      = idx;
-                                if (sprite.costumes[idx].texture)
+                                if (asset_costume_materialize(renderer, sprite.costumes[idx]))
                                     sprite.texture = sprite.costumes[idx].texture;
                             }
                         }
@@ -950,18 +1116,48 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                     Block* clicked = check_palette_click(mx, my, paletteBlocks, palette);
                     if (clicked) {
                         Block* nb = clone_block(clicked);
-                        nb->x = mx - nb->w/2; nb->y = my - nb->h/2;
+                        nb->id = bid++;
+                        int wmx, wmy;
+                        camera_to_world(camera, workspace, mx, my, wmx, wmy);
+                        nb->x = wmx - nb->w/2; nb->y = wmy - nb->h/2;
                         nb->isDragging   = true;
                         nb->dragOffsetX  = nb->w/2;
                         nb->dragOffsetY  = nb->h/2;
+                        undo_begin(workspaceBlocks, UNDO_CREATE);
+                        undo_born(nb);
                         workspaceBlocks.push_back(nb);
                         draggedBlock = nb;
                     }
                 }
+                else if (activeTab == TAB_CODE && search_panel_hit(workspace, mx, my)) {
+                    bool renamed = false;
+                    std::string from = g_searchPanel.query;
+                    Block* b = search_panel_click(mx, my, workspace, workspaceBlocks, paletteBlocks,
+                                                  varsPanel.variables, &renamed);
+                    if (b) camera_center_on(camera, workspace, b->x + b->w/2, b->y + b->h/2);
+                    if (renamed) {
+                        from = search_strip(from, "var:");
+                        auto it = g_vars.find(from);
+                        if (it != g_vars.end()) {
+                            g_vars[search_strip(g_searchPanel.replace, "")] = it->second;
+                            g_vars.erase(it);
+                        }
+                        layout_touch_all();
+                    }
+                    scriptRunner.invalidate();
+                }
+                else if (activeTab == TAB_CODE && minimap_hit(workspace, mx, my)) {
+                    minimap_jump(camera, workspace, mx, my);
+                    minimapHeld = true;
+                }
                 else if (point_in_rect(mx, my, workspace.x, workspace.y,
                                        workspace.w, workspace.h)) {
-                    BlockInput* clicked_inp = check_input_click(mx, my, workspaceBlocks);
+                    SDL_Event we = camera_event(camera, workspace, e);
+                    BlockInput* clicked_inp = check_input_click(we.button.x, we.button.y,
+                                                                workspaceBlocks, &activeInputBlock);
                     if (clicked_inp) {
+                        undo_begin(workspaceBlocks, UNDO_EDIT);
+                        undo_touch(activeInputBlock);
                         activeInput = clicked_inp;
                         activeInput->editing = true;
                         activeInput->value   = "";
@@ -975,7 +1171,8 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                         continue;
                     }
 
-                    handle_mouse_down(e, workspaceBlocks, &draggedBlock);
+                    handle_mouse_down(we, workspaceBlocks, &draggedBlock);
+                    panning = !draggedBlock;
                 }
 
                 if (point_in_rect(mx, my, STAGE_X, STAGE_Y, STAGE_WIDTH, STAGE_HEIGHT)) {
@@ -992,20 +1189,52 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
             }
             else if (e.type == SDL_MOUSEBUTTONUP &&
                      e.button.button == SDL_BUTTON_LEFT) {
-                handle_mouse_up(&draggedBlock, workspaceBlocks, workspace);
+                SDL_Event we = camera_event(camera, workspace, e);
+                handle_mouse_up(&draggedBlock, workspaceBlocks, camera_view(camera, workspace),
+                                we.button.x, we.button.y);
+                panning = false;
+                minimapHeld = false;
+                soundsPanel.selDragging = false;
             }
             else if (e.type == SDL_MOUSEMOTION) {
-                handle_mouse_motion(e, &draggedBlock, workspace);
+                if (minimapHeld) {
+                    minimap_jump(camera, workspace, e.motion.x, e.motion.y);
+                } else if (panning) {
+                    camera_pan(camera, e.motion.xrel, e.motion.yrel);
+                } else {
+                    SDL_Event we = camera_event(camera, workspace, e);
+                    handle_mouse_motion(we, &draggedBlock, workspace);
+                }
                 if (activeTab == TAB_SOUNDS &&
                     (e.motion.state & SDL_BUTTON(1))) {
                     int mx2 = e.motion.x, my2 = e.motion.y;
-                    handle_sounds_workspace_click(mx2, my2, soundsPanel);
+                    if (soundsPanel.selDragging)
+                        handle_sound_wave_drag(mx2, soundsPanel);
+                    else
+                        handle_sounds_workspace_click(mx2, my2, soundsPanel);
                 }
             }
         }
 
         layout_palette_blocks(paletteBlocks, palette);
+        cleanup_step(SDL_GetTicks());
+        layout_workspace(workspaceBlocks);
+        if (Block* loudBlock = poll_loudness_event(workspaceBlocks))
+            scriptRunner.start(loudBlock->next, &varsPanel.variables);
         scriptRunner.update(&sprite);
+        asset_pump(renderer, sprite, soundsPanel);
+        bool exportOk = true;
+        std::string exportPath;
+        if (sb3_export_poll(&exportOk, &exportPath) && !exportOk) {
+            std::string msg = "Could not export '" + exportPath + "'.";
+            SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Export failed", msg.c_str(), window);
+        }
+        if (!draggedBlock) {
+            if (journalPending)
+                journal_sync(varsPanel, sprite, soundsPanel);
+            journalPending = false;
+            autosave_tick(workspaceBlocks, varsPanel, sprite, soundsPanel, renderer);
+        }
         if (sprite.sayTimer > 0) {
             sprite.sayTimer--;
             if (sprite.sayTimer == 0) sprite.sayText = "";
@@ -1098,30 +1327,13 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
         }
 
         if (activeTab == TAB_CODE) {
-            draw_workspace_bg(renderer, workspace);
-            for (Block* b : workspaceBlocks) {
-                if (b->isCShaped) layout_inner_blocks(b);
-            }
-            for (Block* b : workspaceBlocks) {
-                update_block_input_rects(b);
-                draw_block(renderer, fontSmall, b);
-                if (b->isCShaped) {
-                    Block* inner = b->innerFirst;
-                    while (inner) {
-                        update_block_input_rects(inner);
-                        draw_block(renderer, fontSmall, inner);
-                        inner = inner->next;
-                    }
-                    if (b->hasElse) {
-                        Block* el = b->elseFirst;
-                        while (el) {
-                            update_block_input_rects(el);
-                            draw_block(renderer, fontSmall, el);
-                            el = el->next;
-                        }
-                    }
-                }
-            }
+            camera_draw_grid(renderer, camera, workspace);
+            camera_draw_blocks(renderer, fontSmall, camera, workspace, draggedBlock);
+            minimap_update(renderer, workspaceBlocks, draggedBlock);
+            minimap_draw(renderer, camera, workspace);
+            search_panel_refresh(workspaceBlocks);
+            search_panel_draw(renderer, fontSmall, camera, workspace);
+            if (cleanupMenuOpen) draw_cleanup_menu(renderer, fontSmall, cleanupMenu);
 
             auto draw_name_dialog = [&](const string& title,
                                         const string& inputText) {
@@ -1228,8 +1440,11 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
             bool curFD = (cmb2 & SDL_BUTTON(1));
             if (curFD && !prevFD) {
                 if (point_in_rect(cmx2, cmy2, btnOk.x, btnOk.y, btnOk.w, btnOk.h)) {
-                    if (saveDialogOpen) save_project(fileDialogInput, workspaceBlocks, varsPanel);
-                    else load_project(fileDialogInput, workspaceBlocks, varsPanel, bid);
+                    if (saveDialogOpen) {
+                        save_project_as(fileDialogInput);
+                    } else {
+                        load_project_from(fileDialogInput);
+                    }
                     saveDialogOpen = loadDialogOpen = false;
                     fileDialogEditing = false;
                     SDL_StopTextInput();
@@ -1291,8 +1506,7 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
                             std::string fn = (sl != std::string::npos) ? spriteUploadPath.substr(sl+1) : spriteUploadPath;
                             size_t dot = fn.find_last_of('.');
                             nc.name = (dot != std::string::npos) ? fn.substr(0, dot) : fn;
-                            nc.texture = SDL_CreateTextureFromSurface(renderer, s);
-                            nc.w = s->w; nc.h = s->h;
+                            asset_costume_from_surface(renderer, nc, s);
                             SDL_FreeSurface(s);
                             sprite.costumes.push_back(nc);
                             sprite.currentCostume = (int)sprite.costumes.size() - 1;
@@ -1348,16 +1562,28 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
             bool curClick = (cmb & SDL_BUTTON(1));
             if (curClick && !prevClick) {
                 if (point_in_rect(cmx, cmy, btnSaveNew.x, btnSaveNew.y, btnSaveNew.w, btnSaveNew.h)) {
-                    save_project(projectFile, workspaceBlocks, varsPanel);
-                    for (auto b : workspaceBlocks) delete b;
+                    if (journal_save(projectFile, workspaceBlocks, varsPanel, sprite, soundsPanel, renderer))
+                        autosave_saved(workspaceBlocks, varsPanel, sprite, soundsPanel, renderer);
+                    journal_close();
+                    undo_clear(false);
+                    block_pool_clear();
+                    spatial_clear();
+                    search_clear();
                     workspaceBlocks.clear();
+                    camera_reset(camera, workspace);
                     varsPanel.variables.clear();
                     varsPanel.variables.push_back({"score", 0.0f, true});
                     confirmNewProject = false;
                 }
                 else if (point_in_rect(cmx, cmy, btnJustNew.x, btnJustNew.y, btnJustNew.w, btnJustNew.h)) {
-                    for (auto b : workspaceBlocks) delete b;
+                    journal_close();
+                    autosave_discard();
+                    undo_clear(false);
+                    block_pool_clear();
+                    spatial_clear();
+                    search_clear();
                     workspaceBlocks.clear();
+                    camera_reset(camera, workspace);
                     varsPanel.variables.clear();
                     varsPanel.variables.push_back({"score", 0.0f, true});
                     confirmNewProject = false;
@@ -1370,21 +1596,27 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
         }
 
         ce_render(costumeEditor, renderer, fontSmall, fontBig);
+        draw_texture_overlay(renderer, fontSmall);
 
         SDL_RenderPresent(renderer);
     }
 
+    journal_sync(varsPanel, sprite, soundsPanel);
+    journal_close();
+    autosave_discard();
+    autosave_quit();
+    sb3_export_wait();
+
     audio_free_all(soundsPanel);
     audio_quit();
 
-    if (costumeEditor.canvasTex)  SDL_DestroyTexture(costumeEditor.canvasTex);
-    if (costumeEditor.canvasSurf) SDL_FreeSurface(costumeEditor.canvasSurf);
-    for (auto b : paletteBlocks)   delete b;
-    for (auto b : workspaceBlocks) delete b;
-    for (auto& c : sprite.costumes)
-        if (c.texture) SDL_DestroyTexture(c.texture);
-    if (playTex) SDL_DestroyTexture(playTex);
-    if (stopTex) SDL_DestroyTexture(stopTex);
+    ce_close(costumeEditor);
+    pen_trail_quit();
+    minimap_quit();
+    asset_release_costumes(sprite);
+    asset_store_quit();
+    tex_destroy(playTex);
+    tex_destroy(stopTex);
     TTF_CloseFont(fontSmall);
     if (fontBig) TTF_CloseFont(fontBig);
     SDL_DestroyRenderer(renderer);
@@ -1393,4 +1625,5 @@ addPB(BLOCK_EXTENSION, "change pen size by ()");
     IMG_Quit();
     SDL_Quit();
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,224 @@
+#ifndef SCRATCH_FOP_MINIMAP_H
+#define SCRATCH_FOP_MINIMAP_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <SDL2/SDL.h>
+#include "structs.h"
+#include "utils.h"
+#include "render.h"
+#include "camera.h"
+#include "texture_manager.h"
+
+// Overview of the whole plane in the corner of the code area. Each stack
+// is drawn once, as colored bars, into a small texture of its own, and
+// the panel just copies those. A stack's texture is keyed by its top
+// block's handle and redrawn only when the stack's shape changes: the
+// signature covers the blocks' types and sizes and their positions
+// relative to the top, so moving a whole stack only moves its texture.
+// Nothing is looked at between layout passes, nor while a block is being
+// dragged. Clicking or dragging on the panel centers the camera there.
+
+static const int   MINIMAP_W = 200, MINIMAP_H = 130, MINIMAP_MARGIN = 10;
+static const float MINIMAP_THUMB_SCALE = 0.125f;
+static const int   MINIMAP_THUMB_MAX   = 256;
+
+struct MinimapThumb {
+    Uint64       sig   = 0;
+    SDL_Rect     box   = {0, 0, 0, 0};   // the stack's extent on the plane
+    SDL_Texture* tex   = nullptr;
+    Uint32       seen  = 0;
+};
+
+struct Minimap {
+    std::unordered_map<Uint32, MinimapThumb> thumbs;   // by top block's handle
+    Uint32   pass    = 0;
+    Uint32   stamp   = 0;
+    SDL_Rect content = {0, 0, 0, 0};
+    Uint32   redraws = 0;
+};
+
+static Minimap g_minimap;
+
+inline SDL_Rect minimap_rect(const Workspace& ws)
+{
+    return {ws.x + ws.w - MINIMAP_W - MINIMAP_MARGIN, ws.y + ws.h - MINIMAP_H - MINIMAP_MARGIN,
+            MINIMAP_W, MINIMAP_H};
+}
+
+inline void minimap_mix(Uint64& h, Uint64 v)
+{
+    h = (h ^ v) * 1099511628211ull;
+}
+
+static void minimap_scan(Block* b, int ox, int oy, Uint64& sig, SDL_Rect& box)
+{
+    for (; b; b = b->next) {
+        int th = block_total_height(b);
+        minimap_mix(sig, (Uint64)b->type);
+        minimap_mix(sig, (Uint64)(Uint32)(b->x - ox));
+        minimap_mix(sig, (Uint64)(Uint32)(b->y - oy));
+        minimap_mix(sig, ((Uint64)(Uint32)b->w << 32) | (Uint32)th);
+        int x1 = std::max(box.x + box.w, b->x + b->w);
+        int y1 = std::max(box.y + box.h, b->y + th);
+        box.x = std::min(box.x, b->x);
+        box.y = std::min(box.y, b->y);
+        box.w = x1 - box.x;
+        box.h = y1 - box.y;
+        minimap_scan(b->innerFirst, ox, oy, sig, box);
+        minimap_mix(sig, 0x1f);
+        minimap_scan(b->elseFirst, ox, oy, sig, box);
+        minimap_mix(sig, 0x2f);
+    }
+}
+
+static void minimap_redraw(SDL_Renderer* r, Block* top, MinimapThumb& t)
+{
+    float s = std::min(MINIMAP_THUMB_SCALE,
+                       std::min((float)MINIMAP_THUMB_MAX / std::max(1, t.box.w),
+                                (float)MINIMAP_THUMB_MAX / std::max(1, t.box.h)));
+    int tw = std::max(1, (int)std::ceil(t.box.w * s));
+    int th = std::max(1, (int)std::ceil(t.box.h * s));
+    int w = 0, h = 0;
+    if (t.tex) SDL_QueryTexture(t.tex, nullptr, nullptr, &w, &h);
+    if (!t.tex || w != tw || h != th) {
+        tex_destroy(t.tex);
+        t.tex = tex_create(r, TEX_MINIMAP, SDL_PIXELFORMAT_ARGB8888,
+                           SDL_TEXTUREACCESS_TARGET, tw, th);
+        if (!t.tex) return;
+        SDL_SetTextureBlendMode(t.tex, SDL_BLENDMODE_BLEND);
+    }
+    SDL_SetRenderTarget(r, t.tex);
+    SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+    SDL_RenderClear(r);
+    SDL_RenderSetScale(r, s, s);
+    g_blockView.dx   = -t.box.x;
+    g_blockView.dy   = -t.box.y;
+    g_blockView.bars = true;
+    camera_draw_stack(r, nullptr, top);
+    g_blockView = BlockView{};
+    SDL_RenderSetScale(r, 1.0f, 1.0f);
+    SDL_SetRenderTarget(r, nullptr);
+    g_minimap.redraws++;
+}
+
+// Brings the thumbnails up to date after a layout pass.
+inline void minimap_update(SDL_Renderer* r, std::vector<Block*>& blocks, Block* dragged)
+{
+    if (dragged || g_minimap.pass == g_layoutPass) return;
+    g_minimap.pass = g_layoutPass;
+    Uint32 stamp = ++g_minimap.stamp;
+
+    std::unordered_set<Block*> bodies;
+    for (Block* b : blocks) {
+        for (Block* c = b->innerFirst; c; c = c->next) bodies.insert(c);
+        for (Block* c = b->elseFirst;  c; c = c->next) bodies.insert(c);
+    }
+
+    bool any = false;
+    SDL_Rect content = {0, 0, 0, 0};
+    for (Block* b : blocks) {
+        if (b->prev || bodies.count(b)) continue;
+        Uint64 sig = 1469598103934665603ull;
+        SDL_Rect box = {b->x, b->y, 0, 0};
+        minimap_scan(b, b->x, b->y, sig, box);
+        MinimapThumb& t = g_minimap.thumbs[b->self.bits];
+        t.seen = stamp;
+        t.box  = box;
+        if (!t.tex || t.sig != sig) {
+            t.sig = sig;
+            minimap_redraw(r, b, t);
+        }
+        if (!any) content = box;
+        else SDL_UnionRect(&content, &box, &content);
+        any = true;
+    }
+    g_minimap.content = content;
+
+    for (auto it = g_minimap.thumbs.begin(); it != g_minimap.thumbs.end(); ) {
+        if (it->second.seen != stamp) {
+            tex_destroy(it->second.tex);
+            it = g_minimap.thumbs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Where the plane sits in the panel: the stacks and the camera's view,
+// fitted and centered. Screen x = px + (world x - ox) * s.
+static void minimap_frame(const Camera& cam, const Workspace& ws,
+                          float& ox, float& oy, float& s)
+{
+    Workspace v = camera_view(cam, ws);
+    SDL_Rect all = {v.x, v.y, v.w, v.h};
+    if (!g_minimap.thumbs.empty()) SDL_UnionRect(&all, &g_minimap.content, &all);
+    SDL_Rect pr = minimap_rect(ws);
+    s = std::min((float)(pr.w - 8) / std::max(1, all.w), (float)(pr.h - 8) / std::max(1, all.h));
+    ox = all.x + all.w / 2.0f - (pr.w / 2.0f) / s;
+    oy = all.y + all.h / 2.0f - (pr.h / 2.0f) / s;
+}
+
+inline bool minimap_hit(const Workspace& ws, int mx, int my)
+{
+    SDL_Rect pr = minimap_rect(ws);
+    return point_in_rect(mx, my, pr.x, pr.y, pr.w, pr.h);
+}
+
+// Centers the camera on the plane point under (mx, my) in the panel.
+inline void minimap_jump(Camera& cam, const Workspace& ws, int mx, int my)
+{
+    float ox, oy, s;
+    minimap_frame(cam, ws, ox, oy, s);
+    SDL_Rect pr = minimap_rect(ws);
+    camera_center_on(cam, ws, (int)std::lround(ox + (mx - pr.x) / s),
+                              (int)std::lround(oy + (my - pr.y) / s));
+}
+
+void minimap_draw(SDL_Renderer* r, const Camera& cam, const Workspace& ws)
+{
+    SDL_Rect pr = minimap_rect(ws);
+    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(r, 240, 240, 245, 220);
+    SDL_RenderFillRect(r, &pr);
+
+    float ox, oy, s;
+    minimap_frame(cam, ws, ox, oy, s);
+    auto to_panel = [&](const SDL_Rect& box) {
+        SDL_Rect d;
+        d.x = pr.x + (int)std::floor((box.x - ox) * s);
+        d.y = pr.y + (int)std::floor((box.y - oy) * s);
+        d.w = std::max(1, (int)std::ceil(box.w * s));
+        d.h = std::max(1, (int)std::ceil(box.h * s));
+        return d;
+    };
+
+    SDL_RenderSetClipRect(r, &pr);
+    for (auto& kv : g_minimap.thumbs) {
+        if (!kv.second.tex) continue;
+        SDL_Rect d = to_panel(kv.second.box);
+        SDL_RenderCopy(r, kv.second.tex, nullptr, &d);
+    }
+    Workspace v = camera_view(cam, ws);
+    SDL_Rect vr = to_panel({v.x, v.y, v.w, v.h});
+    SDL_SetRenderDrawColor(r, 60, 100, 255, 60);
+    SDL_RenderFillRect(r, &vr);
+    SDL_SetRenderDrawColor(r, 60, 100, 255, 255);
+    SDL_RenderDrawRect(r, &vr);
+    SDL_RenderSetClipRect(r, nullptr);
+
+    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
+    SDL_SetRenderDrawColor(r, 180, 180, 190, 255);
+    SDL_RenderDrawRect(r, &pr);
+}
+
+inline void minimap_quit()
+{
+    for (auto& kv : g_minimap.thumbs) tex_destroy(kv.second.tex);
+    g_minimap = Minimap{};
+}
+
+#endif
@@ -0,0 +1,600 @@
+#ifndef SCRATCH_FOP_MIXER_H
+#define SCRATCH_FOP_MIXER_H
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_mixer.h>
+#include <atomic>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include "structs.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Voices are mixed into a float stereo bus from SDL_mixer's postmix hook.
+// The main thread owns slot allocation and talks to the audio thread only
+// through a single-producer command ring; the audio thread reports finished
+// voices by publishing the last generation that ended in each slot.
+
+const int   MIXER_MAX_VOICES = 128;
+const int   MIXER_CMD_RING   = 512;
+const int   MIXER_BUS_FRAMES = 4096;
+const float MIXER_LIMIT      = 0.98f;
+const int   MIXER_METER_CHUNK = 256;
+const int   MIXER_METER_SLOTS = 8;
+
+enum MixerPriority {
+    MIXER_PRIO_LOW    = 0,
+    MIXER_PRIO_NORMAL = 1,
+    MIXER_PRIO_HIGH   = 2
+};
+
+enum MixerCmdType {
+    MIXER_CMD_PLAY, MIXER_CMD_STOP, MIXER_CMD_STOP_ALL, MIXER_CMD_PARAMS
+};
+
+struct MixerCmd {
+    MixerCmdType type   = MIXER_CMD_STOP;
+    int          slot   = -1;
+    Uint32       gen    = 0;
+    const float* pcm    = nullptr;
+    Uint32       frames = 0;
+    float        gainL  = 1.0f;
+    float        gainR  = 1.0f;
+    float        pitch  = 1.0f;
+};
+
+struct MixerVoice {
+    const float* pcm     = nullptr;
+    Uint32       frames  = 0;
+    Uint32       gen     = 0;
+    double       pos     = 0.0;
+    float        pitch   = 1.0f;
+    float        gainL   = 1.0f;
+    float        gainR   = 1.0f;
+    float        targetL = 1.0f;
+    float        targetR = 1.0f;
+    bool         active  = false;
+};
+
+struct MixerSlot {
+    Uint32 gen      = 0;
+    int    priority = 0;
+    Uint64 order    = 0;
+};
+
+struct MixerPin {
+    int       slot = -1;
+    Uint32    gen  = 0;
+    PcmBuffer pcm;
+};
+
+static int    g_audioFreq     = 44100;
+static Uint16 g_audioFormat   = MIX_DEFAULT_FORMAT;
+static int    g_audioChannels = 2;
+static std::atomic<Uint64> g_audioFramesMixed{0};
+static std::atomic<int>    g_audioBlockFrames{2048};
+
+typedef void (*MixerBusHook)(float* bus, int frames, Uint64 startFrame);
+static MixerBusHook g_mixerBusHook = nullptr;
+
+static bool       g_mixerOpen = false;
+static MixerVoice g_mixVoices[MIXER_MAX_VOICES];
+static int        g_mixActive[MIXER_MAX_VOICES];
+static int        g_mixActiveCount = 0;
+static float      g_mixBus[MIXER_BUS_FRAMES * 2];
+static float      g_mixLimiterGain    = 1.0f;
+static float      g_mixLimiterRelease = 0.0005f;
+static std::atomic<Uint32> g_mixDoneGen[MIXER_MAX_VOICES];
+
+static double             g_meterSlots[MIXER_METER_SLOTS];
+static int                g_meterSlot     = 0;
+static double             g_meterAccum    = 0.0;
+static int                g_meterFill     = 0;
+static float              g_meterLastRms  = 0.0f;
+static std::atomic<float> g_audioRms{0.0f};
+static std::atomic<float> g_audioPeak{0.0f};
+static std::atomic<int>   g_audioLoudness{0};
+
+static MixerCmd            g_mixCmds[MIXER_CMD_RING];
+static std::atomic<Uint32> g_mixCmdHead{0};
+static std::atomic<Uint32> g_mixCmdTail{0};
+
+static std::vector<MixerSlot> g_mixSlots;
+static std::vector<MixerPin>  g_mixPins;
+static Uint64                 g_mixOrder = 0;
+
+inline int audio_bytes_per_frame()
+{
+    return (SDL_AUDIO_BITSIZE(g_audioFormat) / 8) * g_audioChannels;
+}
+
+inline Uint64 audio_clock_frames()
+{
+    return g_audioFramesMixed.load(std::memory_order_acquire);
+}
+
+inline double audio_clock_secs()
+{
+    return (double)audio_clock_frames() / (double)g_audioFreq;
+}
+
+inline bool mixer_format_supported()
+{
+    return g_audioFormat == AUDIO_S16SYS || g_audioFormat == AUDIO_S32SYS ||
+           g_audioFormat == AUDIO_F32SYS;
+}
+
+inline float mixer_read_sample(const Uint8* buf, size_t i)
+{
+    switch (g_audioFormat) {
+        case AUDIO_S16SYS: return ((const Sint16*)buf)[i] * (1.0f / 32768.0f);
+        case AUDIO_S32SYS: return (float)((const Sint32*)buf)[i] * (1.0f / 2147483648.0f);
+        case AUDIO_F32SYS: return ((const float*)buf)[i];
+    }
+    return 0.0f;
+}
+
+inline void mixer_write_sample(Uint8* buf, size_t i, float v)
+{
+    v = std::max(-1.0f, std::min(1.0f, v));
+    switch (g_audioFormat) {
+        case AUDIO_S16SYS: ((Sint16*)buf)[i] = (Sint16)lrintf(v * 32767.0f); break;
+        case AUDIO_S32SYS: ((Sint32*)buf)[i] = (Sint32)llrint((double)v * 2147483647.0); break;
+        case AUDIO_F32SYS: ((float*)buf)[i]  = v; break;
+    }
+}
+
+static void mixer_s16_to_float(const Sint16* src, float* dst, int n)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    for (; i + 8 <= n; i += 8) {
+        __m128i s  = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        _mm_storeu_ps(dst + i,     _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = src[i] * (1.0f / 32768.0f);
+}
+
+static void mixer_float_to_s16(const float* src, Sint16* dst, int n)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 hiLim = _mm_set1_ps(1.0f);
+    const __m128 loLim = _mm_set1_ps(-1.0f);
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_max_ps(loLim, _mm_min_ps(hiLim, _mm_loadu_ps(src + i)));
+        __m128 b = _mm_max_ps(loLim, _mm_min_ps(hiLim, _mm_loadu_ps(src + i + 4)));
+        __m128i ia = _mm_cvtps_epi32(_mm_mul_ps(a, scale));
+        __m128i ib = _mm_cvtps_epi32(_mm_mul_ps(b, scale));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(ia, ib));
+    }
+#endif
+    for (; i < n; i++) {
+        float v = std::max(-1.0f, std::min(1.0f, src[i]));
+        dst[i] = (Sint16)lrintf(v * 32767.0f);
+    }
+}
+
+static void mixer_accumulate(float* bus, const float* src, int n, float gl, float gr)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 g = _mm_setr_ps(gl, gr, gl, gr);
+    for (; i + 8 <= n; i += 8) {
+        __m128 b0 = _mm_loadu_ps(bus + i);
+        __m128 b1 = _mm_loadu_ps(bus + i + 4);
+        b0 = _mm_add_ps(b0, _mm_mul_ps(_mm_loadu_ps(src + i),     g));
+        b1 = _mm_add_ps(b1, _mm_mul_ps(_mm_loadu_ps(src + i + 4), g));
+        _mm_storeu_ps(bus + i,     b0);
+        _mm_storeu_ps(bus + i + 4, b1);
+    }
+#endif
+    for (; i + 1 < n; i += 2) {
+        bus[i]     += src[i]     * gl;
+        bus[i + 1] += src[i + 1] * gr;
+    }
+}
+
+static float mixer_peak(const float* bus, int n)
+{
+    float peak = 0.0f;
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 m = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4)
+        m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(bus + i), absMask));
+    float lanes[4];
+    _mm_storeu_ps(lanes, m);
+    peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+    for (; i < n; i++)
+        peak = std::max(peak, std::fabs(bus[i]));
+    return peak;
+}
+
+static double mixer_sum_squares(const float* bus, int n)
+{
+    double sum = 0.0;
+    int i = 0;
+#if defined(__SSE2__)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(bus + i);
+        acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < n; i++)
+        sum += (double)bus[i] * bus[i];
+    return sum;
+}
+
+// Windowed RMS over the last MIXER_METER_SLOTS chunks of limiter output,
+// published for the loudness reporter and the Sounds tab meter.
+static void mixer_meter(const float* bus, int frames)
+{
+    float peak = mixer_peak(bus, frames * 2);
+    for (int f = 0; f < frames; ) {
+        int n = std::min(frames - f, MIXER_METER_CHUNK - g_meterFill);
+        g_meterAccum += mixer_sum_squares(bus + f * 2, n * 2);
+        g_meterFill  += n;
+        f            += n;
+        if (g_meterFill == MIXER_METER_CHUNK) {
+            g_meterSlots[g_meterSlot] = g_meterAccum;
+            g_meterSlot  = (g_meterSlot + 1) % MIXER_METER_SLOTS;
+            g_meterAccum = 0.0;
+            g_meterFill  = 0;
+        }
+    }
+
+    double sum = 0.0;
+    for (double s : g_meterSlots) sum += s;
+    float rms = (float)std::sqrt(sum / (MIXER_METER_SLOTS * MIXER_METER_CHUNK * 2));
+
+    float smoothed = std::max(rms, g_meterLastRms * 0.6f);
+    g_meterLastRms = smoothed;
+    int loud = (int)std::lround(std::sqrt(smoothed * 1.63f) * 100.0f);
+
+    g_audioRms.store(rms, std::memory_order_relaxed);
+    g_audioPeak.store(peak, std::memory_order_relaxed);
+    g_audioLoudness.store(std::min(loud, 100), std::memory_order_relaxed);
+}
+
+// Converts interleaved device-format audio to interleaved float stereo.
+static void mixer_device_to_float(const Uint8* src, float* dst, int frames)
+{
+    int ch = g_audioChannels;
+    if (g_audioFormat == AUDIO_S16SYS && ch == 2) {
+        mixer_s16_to_float((const Sint16*)src, dst, frames * 2);
+        return;
+    }
+    for (int i = 0; i < frames; i++) {
+        float l = mixer_read_sample(src, (size_t)i * ch);
+        float r = ch > 1 ? mixer_read_sample(src, (size_t)i * ch + 1) : l;
+        dst[i * 2]     = l;
+        dst[i * 2 + 1] = r;
+    }
+}
+
+static void mixer_float_to_device(const float* src, Uint8* dst, int frames)
+{
+    int ch = g_audioChannels;
+    if (g_audioFormat == AUDIO_S16SYS && ch == 2) {
+        mixer_float_to_s16(src, (Sint16*)dst, frames * 2);
+        return;
+    }
+    for (int i = 0; i < frames; i++) {
+        if (ch == 1) {
+            mixer_write_sample(dst, i, (src[i * 2] + src[i * 2 + 1]) * 0.5f);
+        } else {
+            mixer_write_sample(dst, (size_t)i * ch,     src[i * 2]);
+            mixer_write_sample(dst, (size_t)i * ch + 1, src[i * 2 + 1]);
+        }
+    }
+}
+
+inline PcmBuffer mixer_pcm_from_device(const Uint8* buf, Uint32 bytes)
+{
+    int bpf = audio_bytes_per_frame();
+    if (bpf <= 0 || !mixer_format_supported()) return nullptr;
+    int frames = (int)(bytes / bpf);
+    auto pcm = std::make_shared<std::vector<float>>((size_t)frames * 2);
+    mixer_device_to_float(buf, pcm->data(), frames);
+    return pcm;
+}
+
+static void mixer_voice_end(int activeIdx)
+{
+    int slot = g_mixActive[activeIdx];
+    MixerVoice& v = g_mixVoices[slot];
+    v.active = false;
+    g_mixDoneGen[slot].store(v.gen, std::memory_order_release);
+    g_mixActive[activeIdx] = g_mixActive[--g_mixActiveCount];
+}
+
+static void mixer_voice_end_slot(int slot)
+{
+    for (int i = 0; i < g_mixActiveCount; i++) {
+        if (g_mixActive[i] == slot) {
+            mixer_voice_end(i);
+            return;
+        }
+    }
+}
+
+static void mixer_apply(const MixerCmd& c)
+{
+    if (c.type == MIXER_CMD_STOP_ALL) {
+        while (g_mixActiveCount > 0)
+            mixer_voice_end(g_mixActiveCount - 1);
+        return;
+    }
+    if (c.slot < 0 || c.slot >= MIXER_MAX_VOICES) return;
+    MixerVoice& v = g_mixVoices[c.slot];
+
+    switch (c.type) {
+        case MIXER_CMD_PLAY:
+            if (v.active)
+                g_mixDoneGen[c.slot].store(v.gen, std::memory_order_release);
+            else
+                g_mixActive[g_mixActiveCount++] = c.slot;
+            v.pcm     = c.pcm;
+            v.frames  = c.frames;
+            v.gen     = c.gen;
+            v.pos     = 0.0;
+            v.pitch   = c.pitch;
+            v.gainL   = v.targetL = c.gainL;
+            v.gainR   = v.targetR = c.gainR;
+            v.active  = true;
+            break;
+        case MIXER_CMD_STOP:
+            if (v.active && v.gen == c.gen)
+                mixer_voice_end_slot(c.slot);
+            break;
+        case MIXER_CMD_PARAMS:
+            if (v.active && v.gen == c.gen) {
+                v.targetL = c.gainL;
+                v.targetR = c.gainR;
+                v.pitch   = c.pitch;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void mixer_drain_commands()
+{
+    Uint32 tail = g_mixCmdTail.load(std::memory_order_relaxed);
+    Uint32 head = g_mixCmdHead.load(std::memory_order_acquire);
+    while (tail != head) {
+        mixer_apply(g_mixCmds[tail % MIXER_CMD_RING]);
+        tail++;
+    }
+    g_mixCmdTail.store(tail, std::memory_order_release);
+}
+
+// Returns false once the voice has played past its last frame.
+static bool mixer_render_voice(MixerVoice& v, float* bus, int frames)
+{
+    float gl = v.gainL, gr = v.gainR;
+    float dl = (v.targetL - gl) / frames;
+    float dr = (v.targetR - gr) / frames;
+
+    if (dl == 0.0f && dr == 0.0f && v.pitch == 1.0f && v.pos == std::floor(v.pos)) {
+        Uint32 p = (Uint32)v.pos;
+        Uint32 n = std::min((Uint32)frames, v.frames - p);
+        mixer_accumulate(bus, v.pcm + (size_t)p * 2, (int)n * 2, gl, gr);
+        v.pos += n;
+        return v.pos < v.frames;
+    }
+
+    for (int i = 0; i < frames; i++) {
+        Uint32 p = (Uint32)v.pos;
+        if (p >= v.frames) break;
+        float frac = (float)(v.pos - p);
+        const float* a = v.pcm + (size_t)p * 2;
+        const float* b = p + 1 < v.frames ? a + 2 : a;
+        bus[i * 2]     += (a[0] + (b[0] - a[0]) * frac) * gl;
+        bus[i * 2 + 1] += (a[1] + (b[1] - a[1]) * frac) * gr;
+        gl += dl;
+        gr += dr;
+        v.pos += v.pitch;
+    }
+    v.gainL = v.targetL;
+    v.gainR = v.targetR;
+    return v.pos < v.frames;
+}
+
+// Instant-attack peak limiter; skipped when the block is already under the ceiling.
+static void mixer_limit(float* bus, int frames)
+{
+    if (g_mixLimiterGain >= 0.9999f && mixer_peak(bus, frames * 2) <= MIXER_LIMIT) {
+        g_mixLimiterGain = 1.0f;
+        return;
+    }
+    float g = g_mixLimiterGain;
+    for (int i = 0; i < frames; i++) {
+        float peak   = std::max(std::fabs(bus[i * 2]), std::fabs(bus[i * 2 + 1]));
+        float target = peak > MIXER_LIMIT ? MIXER_LIMIT / peak : 1.0f;
+        if (target < g) g = target;
+        else            g += (target - g) * g_mixLimiterRelease;
+        bus[i * 2]     *= g;
+        bus[i * 2 + 1] *= g;
+    }
+    g_mixLimiterGain = g;
+}
+
+static void mixer_postmix(void*, Uint8* stream, int len)
+{
+    mixer_drain_commands();
+
+    int bpf = audio_bytes_per_frame();
+    if (bpf <= 0) return;
+    int frames = len / bpf;
+    Uint64 clock = g_audioFramesMixed.load(std::memory_order_relaxed);
+    g_audioBlockFrames.store(frames, std::memory_order_relaxed);
+
+    if (mixer_format_supported()) {
+        for (int done = 0; done < frames; ) {
+            int n = std::min(frames - done, MIXER_BUS_FRAMES);
+            Uint8* dst = stream + (size_t)done * bpf;
+            mixer_device_to_float(dst, g_mixBus, n);
+            for (int i = g_mixActiveCount - 1; i >= 0; i--)
+                if (!mixer_render_voice(g_mixVoices[g_mixActive[i]], g_mixBus, n))
+                    mixer_voice_end(i);
+            if (g_mixerBusHook)
+                g_mixerBusHook(g_mixBus, n, clock + done);
+            mixer_limit(g_mixBus, n);
+            mixer_meter(g_mixBus, n);
+            mixer_float_to_device(g_mixBus, dst, n);
+            done += n;
+        }
+    }
+
+    g_audioFramesMixed.fetch_add((Uint64)frames, std::memory_order_release);
+}
+
+inline void mixer_init()
+{
+    if (!mixer_format_supported())
+        std::cerr << "[Mixer] Unsupported device format 0x" << std::hex
+                  << g_audioFormat << std::dec << ", sounds will be silent\n";
+
+    g_mixLimiterRelease = 1.0f - std::exp(-1.0f / (0.05f * (float)g_audioFreq));
+    g_mixSlots.reserve(MIXER_MAX_VOICES);
+    Mix_SetPostMix(mixer_postmix, nullptr);
+    g_mixerOpen = true;
+}
+
+inline void mixer_quit()
+{
+    Mix_SetPostMix(nullptr, nullptr);
+    g_mixerOpen = false;
+    g_mixPins.clear();
+}
+
+inline bool mixer_voice_active(int slot, Uint32 gen)
+{
+    if (slot < 0 || slot >= MIXER_MAX_VOICES || gen == 0) return false;
+    return gen > g_mixDoneGen[slot].load(std::memory_order_acquire);
+}
+
+inline bool mixer_push(const MixerCmd& c)
+{
+    Uint32 head = g_mixCmdHead.load(std::memory_order_relaxed);
+    Uint32 tail = g_mixCmdTail.load(std::memory_order_acquire);
+    if (head - tail >= (Uint32)MIXER_CMD_RING) {
+        std::cerr << "[Mixer] Command queue full\n";
+        return false;
+    }
+    g_mixCmds[head % MIXER_CMD_RING] = c;
+    g_mixCmdHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// Free slot if any, otherwise grow the pool, otherwise steal the oldest
+// voice of the lowest priority not above the requested one.
+inline int mixer_pick_slot(int priority)
+{
+    int victim = -1;
+    for (int i = 0; i < (int)g_mixSlots.size(); i++) {
+        const MixerSlot& s = g_mixSlots[i];
+        if (!mixer_voice_active(i, s.gen)) return i;
+        if (s.priority > priority) continue;
+        if (victim < 0 || s.priority < g_mixSlots[victim].priority ||
+            (s.priority == g_mixSlots[victim].priority && s.order < g_mixSlots[victim].order))
+            victim = i;
+    }
+    if ((int)g_mixSlots.size() < MIXER_MAX_VOICES) {
+        g_mixSlots.push_back({});
+        return (int)g_mixSlots.size() - 1;
+    }
+    return victim;
+}
+
+inline SoundHandle mixer_play(const PcmBuffer& pcm, float gainL, float gainR,
+                              float pitch, int priority)
+{
+    SoundHandle h;
+    if (!g_mixerOpen || !pcm || pcm->size() < 2) return h;
+
+    int slot = mixer_pick_slot(priority);
+    if (slot < 0) return h;
+    MixerSlot& s = g_mixSlots[slot];
+
+    MixerCmd c;
+    c.type   = MIXER_CMD_PLAY;
+    c.slot   = slot;
+    c.gen    = s.gen + 1;
+    c.pcm    = pcm->data();
+    c.frames = (Uint32)(pcm->size() / 2);
+    c.gainL  = gainL;
+    c.gainR  = gainR;
+    c.pitch  = pitch;
+    if (!mixer_push(c)) return h;
+
+    s.gen      = c.gen;
+    s.priority = priority;
+    s.order    = ++g_mixOrder;
+    g_mixPins.push_back({slot, c.gen, pcm});
+
+    h.channel = slot;
+    h.gen     = c.gen;
+    return h;
+}
+
+inline void mixer_stop(const SoundHandle& h)
+{
+    if (!mixer_voice_active(h.channel, h.gen)) return;
+    MixerCmd c;
+    c.type = MIXER_CMD_STOP;
+    c.slot = h.channel;
+    c.gen  = h.gen;
+    mixer_push(c);
+}
+
+inline void mixer_stop_all()
+{
+    if (!g_mixerOpen) return;
+    MixerCmd c;
+    c.type = MIXER_CMD_STOP_ALL;
+    mixer_push(c);
+}
+
+inline void mixer_set_params(const SoundHandle& h, float gainL, float gainR, float pitch)
+{
+    if (!mixer_voice_active(h.channel, h.gen)) return;
+    MixerCmd c;
+    c.type  = MIXER_CMD_PARAMS;
+    c.slot  = h.channel;
+    c.gen   = h.gen;
+    c.gainL = gainL;
+    c.gainR = gainR;
+    c.pitch = pitch;
+    mixer_push(c);
+}
+
+// Drops PCM references once the audio thread has finished with them.
+inline void mixer_update()
+{
+    g_mixPins.erase(std::remove_if(g_mixPins.begin(), g_mixPins.end(),
+        [](const MixerPin& p) {
+            return g_mixDoneGen[p.slot].load(std::memory_order_acquire) >= p.gen;
+        }), g_mixPins.end());
+}
+
+#endif
@@ -0,0 +1,384 @@
+#ifndef SCRATCH_FOP_PACKED_SCRIPT_H
+#define SCRATCH_FOP_PACKED_SCRIPT_H
+
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_map>
+#include <SDL2/SDL.h>
+#include "structs.h"
+
+// The interpreter does not walk Block trees. script_pack() flattens
+// everything reachable from a script's first block into parallel arrays
+// indexed by node: the opcode (decoded from the block text once, here, not
+// on every step), the links the runner follows and the pre-parsed numeric
+// inputs sit in small contiguous arrays. Literal strings, variable names
+// and the source blocks are kept in separate arrays the hot path rarely
+// touches. Reporters embedded in inputs are nodes as well.
+
+enum ScriptOp : Uint8 {
+    OP_NOP,
+
+    OP_MOVE, OP_TURN_RIGHT, OP_TURN_LEFT, OP_GOTO_XY, OP_GOTO_RANDOM, OP_GOTO_MOUSE,
+    OP_GLIDE, OP_POINT_DIR, OP_POINT_MOUSE, OP_CHANGE_X, OP_CHANGE_Y, OP_SET_X,
+    OP_SET_Y, OP_BOUNCE,
+
+    OP_SAY_FOR, OP_SAY, OP_SAY_HELLO, OP_SHOW, OP_HIDE, OP_SET_SIZE, OP_CHANGE_SIZE,
+    OP_NEXT_COSTUME, OP_SWITCH_COSTUME, OP_SWITCH_BACKDROP, OP_NEXT_BACKDROP,
+
+    OP_PEN_DOWN, OP_PEN_UP, OP_PEN_CLEAR, OP_STAMP, OP_PEN_COLOR, OP_CHANGE_PEN_SIZE,
+    OP_SET_PEN_SIZE,
+
+    OP_DRUM, OP_REST, OP_NOTE, OP_INSTRUMENT, OP_SET_TEMPO, OP_CHANGE_TEMPO,
+
+    OP_PLAY_SOUND, OP_PLAY_SOUND_WAIT, OP_STOP_SOUNDS, OP_CHANGE_VOLUME, OP_SET_VOLUME,
+
+    OP_ASK, OP_RESET_TIMER,
+
+    OP_WAIT, OP_WAIT_UNTIL, OP_REPEAT, OP_FOREVER, OP_IF, OP_IF_ELSE, OP_STOP,
+
+    OP_SET_VAR, OP_CHANGE_VAR, OP_SHOW_VAR, OP_HIDE_VAR,
+
+    // Operator blocks run as statements show their result on the stage.
+    // Both inputs are evaluated first for every operator block, including
+    // the ones that match nothing (OP_CALC_NONE).
+    OP_CALC_ADD, OP_CALC_SUB, OP_CALC_MUL, OP_CALC_DIV, OP_CALC_MOD, OP_CALC_LT,
+    OP_CALC_GT, OP_CALC_EQ, OP_CALC_AND, OP_CALC_OR, OP_CALC_NOT, OP_CALC_ROUND,
+    OP_CALC_ABS, OP_CALC_SQRT, OP_CALC_FLOOR, OP_CALC_CEIL, OP_CALC_SIN, OP_CALC_COS,
+    OP_CALC_TAN, OP_CALC_RANDOM, OP_CALC_JOIN, OP_CALC_LENGTH, OP_CALC_LETTER,
+    OP_CALC_NONE,
+
+    // Reporters evaluated as numbers.
+    OP_NUM_ADD, OP_NUM_SUB, OP_NUM_MUL, OP_NUM_DIV, OP_NUM_MOD, OP_NUM_ROUND,
+    OP_NUM_ABS, OP_NUM_SQRT, OP_NUM_FLOOR, OP_NUM_CEIL, OP_NUM_SIN, OP_NUM_COS,
+    OP_NUM_TAN, OP_NUM_RANDOM, OP_NUM_TIMER, OP_NUM_LOUDNESS, OP_NUM_MOUSE_X,
+    OP_NUM_MOUSE_Y, OP_NUM_ANSWER, OP_NUM_MOUSE_DIST, OP_NUM_LT, OP_NUM_GT,
+    OP_NUM_EQ, OP_NUM_AND, OP_NUM_OR, OP_NUM_NOT, OP_NUM_ZERO,
+
+    // Reporters evaluated as conditions; OP_BOOL_NUMBER tests the number.
+    OP_BOOL_LT, OP_BOOL_GT, OP_BOOL_EQ, OP_BOOL_AND, OP_BOOL_OR, OP_BOOL_NOT,
+    OP_BOOL_TOUCH_MOUSE, OP_BOOL_TOUCH_EDGE, OP_BOOL_MOUSE_DOWN, OP_BOOL_KEY,
+    OP_BOOL_NUMBER
+};
+
+static const Uint32 PACK_NONE = 0xFFFFFFFFu;
+
+enum ArgKind : Uint8 {
+    ARG_TEXT,    // literal that does not parse as a number
+    ARG_NUMBER,  // literal, parsed into argNum
+    ARG_EXPR     // reporter node in argExpr
+};
+
+struct PackedScript {
+    // Per node.
+    std::vector<Uint8>  op;
+    std::vector<Uint8>  boolOp;    // reporters only
+    std::vector<Uint8>  argCount;
+    std::vector<Uint32> firstArg;
+    std::vector<Uint32> next;
+    std::vector<Uint32> inner;
+    std::vector<Uint32> alt;       // else branch
+    std::vector<Sint32> imm;       // scancode for "key () pressed?"
+
+    // Per input.
+    std::vector<Uint8>  argKind;
+    std::vector<float>  argNum;
+    std::vector<Uint32> argExpr;
+
+    // Cold.
+    std::vector<std::string> argText;
+    std::vector<std::string> name;  // variable blocks
+    std::vector<BlockRef>    source;   // handles, so a freed block is not mistaken for a reused slot
+    std::unordered_map<const Block*, Uint32> nodeOf;
+};
+
+inline bool op_has(const std::string& txt, const char* s)
+{
+    return txt.find(s) != std::string::npos;
+}
+
+// Each decoder tests the block text in the same order the interpreter
+// always has, so overlapping matches resolve the same way.
+inline ScriptOp decode_statement(const Block* b)
+{
+    const std::string& txt = b->text;
+    switch (b->type) {
+    case BLOCK_MOTION:
+        if (op_has(txt, "move") && op_has(txt, "steps"))          return OP_MOVE;
+        if (op_has(txt, "turn right") || (op_has(txt, "turn") && !op_has(txt, "left")))
+                                                                  return OP_TURN_RIGHT;
+        if (op_has(txt, "turn left"))                             return OP_TURN_LEFT;
+        if (op_has(txt, "go to x:"))                              return OP_GOTO_XY;
+        if (op_has(txt, "go to random"))                          return OP_GOTO_RANDOM;
+        if (op_has(txt, "go to mouse"))                           return OP_GOTO_MOUSE;
+        if (op_has(txt, "glide") && op_has(txt, "secs"))          return OP_GLIDE;
+        if (op_has(txt, "point in direction"))                    return OP_POINT_DIR;
+        if (op_has(txt, "point towards mouse"))                   return OP_POINT_MOUSE;
+        if (op_has(txt, "change x by"))                           return OP_CHANGE_X;
+        if (op_has(txt, "change y by"))                           return OP_CHANGE_Y;
+        if (op_has(txt, "set x to"))                              return OP_SET_X;
+        if (op_has(txt, "set y to"))                              return OP_SET_Y;
+        if (op_has(txt, "if on edge"))                            return OP_BOUNCE;
+        return OP_NOP;
+    case BLOCK_LOOKS:
+        if (op_has(txt, "say") || op_has(txt, "think")) {
+            if (op_has(txt, "for") && b->inputs.size() >= 2)      return OP_SAY_FOR;
+            return b->inputs.empty() ? OP_SAY_HELLO : OP_SAY;
+        }
+        if (txt == "show")                                        return OP_SHOW;
+        if (txt == "hide")                                        return OP_HIDE;
+        if (op_has(txt, "set size to"))                           return OP_SET_SIZE;
+        if (op_has(txt, "change size by"))                        return OP_CHANGE_SIZE;
+        if (op_has(txt, "next costume"))                          return OP_NEXT_COSTUME;
+        if (op_has(txt, "switch costume to"))                     return OP_SWITCH_COSTUME;
+        if (op_has(txt, "switch backdrop to"))                    return OP_SWITCH_BACKDROP;
+        if (op_has(txt, "next backdrop"))                         return OP_NEXT_BACKDROP;
+        return OP_NOP;
+    case BLOCK_EXTENSION:
+        if (op_has(txt, "pen down"))                              return OP_PEN_DOWN;
+        if (op_has(txt, "pen up"))                                return OP_PEN_UP;
+        if (op_has(txt, "erase all"))                             return OP_PEN_CLEAR;
+        if (op_has(txt, "stamp"))                                 return OP_STAMP;
+        if (op_has(txt, "set pen color"))                         return OP_PEN_COLOR;
+        if (op_has(txt, "change pen size by"))                    return OP_CHANGE_PEN_SIZE;
+        if (op_has(txt, "set pen size to"))                       return OP_SET_PEN_SIZE;
+        return OP_NOP;
+    case BLOCK_MUSIC:
+        if (op_has(txt, "play drum"))                             return OP_DRUM;
+        if (op_has(txt, "rest for"))                              return OP_REST;
+        if (op_has(txt, "play note"))                             return OP_NOTE;
+        if (op_has(txt, "set instrument"))                        return OP_INSTRUMENT;
+        if (op_has(txt, "set tempo"))                             return OP_SET_TEMPO;
+        if (op_has(txt, "change tempo"))                          return OP_CHANGE_TEMPO;
+        return OP_NOP;
+    case BLOCK_SOUND:
+        if (op_has(txt, "play sound"))
+            return op_has(txt, "until done") ? OP_PLAY_SOUND_WAIT : OP_PLAY_SOUND;
+        if (op_has(txt, "stop all sounds"))                       return OP_STOP_SOUNDS;
+        if (op_has(txt, "change volume by"))                      return OP_CHANGE_VOLUME;
+        if (op_has(txt, "set volume to"))                         return OP_SET_VOLUME;
+        if (op_has(txt, "clear sound effects"))                   return OP_STOP_SOUNDS;
+        return OP_NOP;
+    case BLOCK_SENSING:
+        if (op_has(txt, "ask") && op_has(txt, "and wait"))        return OP_ASK;
+        if (op_has(txt, "reset timer"))                           return OP_RESET_TIMER;
+        return OP_NOP;
+    case BLOCK_CONTROL:
+        if (op_has(txt, "wait") && op_has(txt, "secs") && !op_has(txt, "until"))
+                                                                  return OP_WAIT;
+        if (op_has(txt, "wait until"))                            return OP_WAIT_UNTIL;
+        if (op_has(txt, "repeat") && !op_has(txt, "forever"))
+            return b->isCShaped ? OP_REPEAT : OP_NOP;
+        if (op_has(txt, "forever"))
+            return b->isCShaped ? OP_FOREVER : OP_NOP;
+        if (op_has(txt, "if") && op_has(txt, "then"))
+            return b->hasElse ? OP_IF_ELSE : OP_IF;
+        if (op_has(txt, "stop all") && !op_has(txt, "script"))    return OP_STOP;
+        if (op_has(txt, "stop this script") || op_has(txt, "stop other"))
+                                                                  return OP_STOP;
+        return OP_NOP;
+    case BLOCK_VARIABLES:
+        if (txt.find("set ") == 0 && op_has(txt, " to "))         return OP_SET_VAR;
+        if (txt.find("change ") == 0 && op_has(txt, " by "))      return OP_CHANGE_VAR;
+        if (op_has(txt, "show variable"))                         return OP_SHOW_VAR;
+        if (op_has(txt, "hide variable"))                         return OP_HIDE_VAR;
+        return OP_NOP;
+    case BLOCK_OPERATORS:
+        if (op_has(txt, "() + ()"))                               return OP_CALC_ADD;
+        if (op_has(txt, "() - ()"))                               return OP_CALC_SUB;
+        if (op_has(txt, "() * ()"))                               return OP_CALC_MUL;
+        if (op_has(txt, "() / ()"))                               return OP_CALC_DIV;
+        if (op_has(txt, "() mod ()"))                             return OP_CALC_MOD;
+        if (op_has(txt, "() < ()"))                               return OP_CALC_LT;
+        if (op_has(txt, "() > ()"))                               return OP_CALC_GT;
+        if (op_has(txt, "() = ()"))                               return OP_CALC_EQ;
+        if (op_has(txt, "and"))                                   return OP_CALC_AND;
+        if (op_has(txt, "or"))                                    return OP_CALC_OR;
+        if (op_has(txt, "not <>"))                                return OP_CALC_NOT;
+        if (op_has(txt, "round ()"))                              return OP_CALC_ROUND;
+        if (op_has(txt, "abs of ()"))                             return OP_CALC_ABS;
+        if (op_has(txt, "sqrt of ()"))                            return OP_CALC_SQRT;
+        if (op_has(txt, "floor of ()"))                           return OP_CALC_FLOOR;
+        if (op_has(txt, "ceiling of ()"))                         return OP_CALC_CEIL;
+        if (op_has(txt, "sin of ()"))                             return OP_CALC_SIN;
+        if (op_has(txt, "cos of ()"))                             return OP_CALC_COS;
+        if (op_has(txt, "tan of ()"))                             return OP_CALC_TAN;
+        if (op_has(txt, "pick random"))                           return OP_CALC_RANDOM;
+        if (op_has(txt, "join () ()"))                            return OP_CALC_JOIN;
+        if (op_has(txt, "length of ()"))                          return OP_CALC_LENGTH;
+        if (op_has(txt, "letter () of ()"))                       return OP_CALC_LETTER;
+        return OP_CALC_NONE;
+    default:
+        return OP_NOP;
+    }
+}
+
+inline ScriptOp decode_number(const std::string& txt)
+{
+    if (op_has(txt, "() + ()"))             return OP_NUM_ADD;
+    if (op_has(txt, "() - ()"))             return OP_NUM_SUB;
+    if (op_has(txt, "() * ()"))             return OP_NUM_MUL;
+    if (op_has(txt, "() / ()"))             return OP_NUM_DIV;
+    if (op_has(txt, "() mod ()"))           return OP_NUM_MOD;
+    if (op_has(txt, "round ()"))            return OP_NUM_ROUND;
+    if (op_has(txt, "abs of ()"))           return OP_NUM_ABS;
+    if (op_has(txt, "sqrt of ()"))          return OP_NUM_SQRT;
+    if (op_has(txt, "floor of ()"))         return OP_NUM_FLOOR;
+    if (op_has(txt, "ceiling of ()"))       return OP_NUM_CEIL;
+    if (op_has(txt, "sin of ()"))           return OP_NUM_SIN;
+    if (op_has(txt, "cos of ()"))           return OP_NUM_COS;
+    if (op_has(txt, "tan of ()"))           return OP_NUM_TAN;
+    if (op_has(txt, "pick random"))         return OP_NUM_RANDOM;
+    if (op_has(txt, "timer"))               return OP_NUM_TIMER;
+    if (txt == "loudness")                  return OP_NUM_LOUDNESS;
+    if (txt == "mouse x")                   return OP_NUM_MOUSE_X;
+    if (txt == "mouse y")                   return OP_NUM_MOUSE_Y;
+    if (txt == "answer")                    return OP_NUM_ANSWER;
+    if (op_has(txt, "distance to mouse"))   return OP_NUM_MOUSE_DIST;
+    if (op_has(txt, "() < ()"))             return OP_NUM_LT;
+    if (op_has(txt, "() > ()"))             return OP_NUM_GT;
+    if (op_has(txt, "() = ()"))             return OP_NUM_EQ;
+    if (op_has(txt, "<> and <>"))           return OP_NUM_AND;
+    if (op_has(txt, "<> or <>"))            return OP_NUM_OR;
+    if (op_has(txt, "not <>"))              return OP_NUM_NOT;
+    return OP_NUM_ZERO;
+}
+
+// Returns the scancode a "key () pressed?" block tests, or -1 for none.
+inline Sint32 decode_key(const std::string& txt)
+{
+    if (op_has(txt, "space"))               return SDL_SCANCODE_SPACE;
+    if (op_has(txt, "right"))               return SDL_SCANCODE_RIGHT;
+    if (op_has(txt, "left"))                return SDL_SCANCODE_LEFT;
+    if (op_has(txt, "up"))                  return SDL_SCANCODE_UP;
+    if (op_has(txt, "down"))                return SDL_SCANCODE_DOWN;
+    if (op_has(txt, "enter"))               return SDL_SCANCODE_RETURN;
+    if (op_has(txt, "escape"))              return SDL_SCANCODE_ESCAPE;
+    for (char ch = 'a'; ch <= 'z'; ch++)
+        if (txt.find(ch) != std::string::npos)
+            return SDL_GetScancodeFromKey(SDLK_a + (ch - 'a'));
+    for (char ch = '0'; ch <= '9'; ch++)
+        if (txt.find(ch) != std::string::npos)
+            return SDL_GetScancodeFromKey(SDLK_0 + (ch - '0'));
+    return -1;
+}
+
+inline ScriptOp decode_condition(const std::string& txt)
+{
+    if (op_has(txt, "() < ()"))             return OP_BOOL_LT;
+    if (op_has(txt, "() > ()"))             return OP_BOOL_GT;
+    if (op_has(txt, "() = ()"))             return OP_BOOL_EQ;
+    if (op_has(txt, "<> and <>"))           return OP_BOOL_AND;
+    if (op_has(txt, "<> or <>"))            return OP_BOOL_OR;
+    if (op_has(txt, "not <>"))              return OP_BOOL_NOT;
+    if (op_has(txt, "touching mouse-pointer"))
+                                            return OP_BOOL_TOUCH_MOUSE;
+    if (op_has(txt, "touching edge"))       return OP_BOOL_TOUCH_EDGE;
+    if (op_has(txt, "mouse down") || (op_has(txt, "down") && op_has(txt, "mouse")))
+                                            return OP_BOOL_MOUSE_DOWN;
+    if (op_has(txt, "key") && op_has(txt, "pressed"))
+                                            return OP_BOOL_KEY;
+    return OP_BOOL_NUMBER;
+}
+
+// Parses a literal the way std::stof does, without the exceptions.
+inline bool parse_literal(const std::string& s, float& out)
+{
+    const char* p = s.c_str();
+    char* end = nullptr;
+    errno = 0;
+    out = std::strtof(p, &end);
+    return end != p && errno != ERANGE;
+}
+
+static Uint32 script_pack_chain(PackedScript& p, Block* head);
+
+static Uint32 script_pack_node(PackedScript& p, Block* b, bool reporter)
+{
+    Uint32 n = (Uint32)p.op.size();
+    p.nodeOf[b] = n;
+    p.op.push_back(reporter ? decode_number(b->text) : decode_statement(b));
+    p.boolOp.push_back(reporter ? decode_condition(b->text) : OP_NOP);
+    p.imm.push_back(reporter && p.boolOp.back() == OP_BOOL_KEY ? decode_key(b->text) : -1);
+    p.next.push_back(PACK_NONE);
+    p.inner.push_back(PACK_NONE);
+    p.alt.push_back(PACK_NONE);
+    p.source.push_back(b);
+
+    std::string name;
+    const std::string& txt = b->text;
+    if (p.op[n] == OP_SET_VAR)
+        name = txt.substr(4, txt.find(" to ") - 4);
+    else if (p.op[n] == OP_CHANGE_VAR)
+        name = txt.substr(7, txt.find(" by ") - 7);
+    else if (p.op[n] == OP_SHOW_VAR || p.op[n] == OP_HIDE_VAR)
+        name = txt.substr(txt.find("variable ") + 9);
+    p.name.push_back(std::move(name));
+
+    // Reserve this node's inputs before packing any reporters inside them.
+    Uint32 first = (Uint32)p.argKind.size();
+    Uint32 count = (Uint32)std::min<size_t>(b->inputs.size(), 255);
+    p.firstArg.push_back(first);
+    p.argCount.push_back((Uint8)count);
+    p.argKind.resize(first + count, ARG_TEXT);
+    p.argNum.resize(first + count, 0.0f);
+    p.argExpr.resize(first + count, PACK_NONE);
+    p.argText.resize(first + count);
+    for (Uint32 k = 0; k < count; k++) {
+        const BlockInput& inp = b->inputs[k];
+        if (inp.embeddedBlock && !p.nodeOf.count(inp.embeddedBlock)) {
+            Uint32 e = script_pack_node(p, inp.embeddedBlock, true);
+            p.argKind[first + k] = ARG_EXPR;
+            p.argExpr[first + k] = e;
+            continue;
+        }
+        float v;
+        if (parse_literal(inp.value, v)) {
+            p.argKind[first + k] = ARG_NUMBER;
+            p.argNum[first + k]  = v;
+        }
+        p.argText[first + k] = inp.value;
+    }
+
+    if (!reporter) {
+        Uint32 in = script_pack_chain(p, b->innerFirst);
+        Uint32 el = script_pack_chain(p, b->elseFirst);
+        p.inner[n] = in;
+        p.alt[n]   = el;
+    }
+    return n;
+}
+
+// Packs a stack in order, so the usual next step is the adjacent node.
+// A block that is already packed is linked to instead of packed twice.
+static Uint32 script_pack_chain(PackedScript& p, Block* head)
+{
+    Uint32 first = PACK_NONE, prev = PACK_NONE;
+    for (Block* b = head; b; b = b->next) {
+        auto it = p.nodeOf.find(b);
+        bool packed = it != p.nodeOf.end();
+        Uint32 n = packed ? it->second : script_pack_node(p, b, false);
+        if (prev == PACK_NONE) first = n;
+        else p.next[prev] = n;
+        if (packed) break;
+        prev = n;
+    }
+    return first;
+}
+
+inline void script_pack(PackedScript& p, Block* first)
+{
+    p = PackedScript{};
+    script_pack_chain(p, first);
+}
+
+inline Uint32 script_node(const PackedScript& p, const Block* b)
+{
+    if (!b) return PACK_NONE;
+    auto it = p.nodeOf.find(b);
+    return it != p.nodeOf.end() ? it->second : PACK_NONE;
+}
+
+#endif
@@ -9,6 +9,8 @@
 #include <iomanip>
 #include <algorithm>
 #include "structs.h"
+#include "asset_store.h"
+#include "texture_manager.h"
 #include "globals.h"
 #include "utils.h"
 
@@ -18,11 +20,11 @@ void draw_text(SDL_Renderer* r, TTF_Font* font, const std::string& text,
     if (text.empty() || !font) return;
     SDL_Surface* surf = TTF_RenderUTF8_Blended(font, text.c_str(), color);
     if (!surf) return;
-    SDL_Texture* tex = SDL_CreateTextureFromSurface(r, surf);
+    SDL_Texture* tex = tex_from_surface(r, TEX_TEXT, surf);
     if (tex) {
         SDL_Rect rc = {x, y, surf->w, surf->h};
         SDL_RenderCopy(r, tex, nullptr, &rc);
-        SDL_DestroyTexture(tex);
+        tex_destroy(tex);
     }
     SDL_FreeSurface(surf);
 }
@@ -64,6 +66,7 @@ SDL_Color get_block_color(BlockType type) {
         case BLOCK_VARIABLES: return COLOR_VARIABLES;
         case BLOCK_MYBLOCKS:  return COLOR_MYBLOCKS;
         case BLOCK_EXTENSION: return COLOR_EXTENSION;
+        case BLOCK_MUSIC:     return COLOR_MUSIC;
         default: return {100,100,100,255};
     }
 }
@@ -74,6 +77,15 @@ SDL_Color darken(SDL_Color c, int amt = 40) {
             (Uint8)std::max(0,(int)c.b-amt),255};
 }
 
+// Offset added to block positions when drawing them, and whether to draw
+// them as plain bars. camera_begin() sets it for the code area; it is zero
+// for the palette.
+struct BlockView {
+    int  dx = 0, dy = 0;
+    bool bars = false;
+};
+static BlockView g_blockView;
+
 SDL_Color lighten(SDL_Color c, int amt = 50) {
     return {(Uint8)std::min(255,(int)c.r+amt),
             (Uint8)std::min(255,(int)c.g+amt),
@@ -88,14 +100,17 @@ static void draw_block_content(SDL_Renderer* r, TTF_Font* font, Block* block,
     const std::string& txt = block->text;
     SDL_Color tCol = isGhost ? SDL_Color{255,255,255,140} : SDL_Color{255,255,255,255};
 
+    int ox = g_blockView.dx, oy = g_blockView.dy;
+    int bx = block->x + ox, by = block->y + oy;
+
     if (block->inputs.empty()) {
-        if (font) draw_text(r, font, txt, block->x+10, block->y+(block->h-14)/2, tCol);
+        if (font) draw_text(r, font, txt, bx+10, by+(block->h-14)/2, tCol);
         return;
     }
 
     int inputIdx = 0;
-    int cx       = block->x + 10;
-    int cy       = block->y + (block->h - 14) / 2;
+    int cx       = bx + 10;
+    int cy       = by + (block->h - 14) / 2;
     std::string segment;
 
     for (size_t i = 0; i <= txt.size(); i++) {
@@ -119,12 +134,12 @@ static void draw_block_content(SDL_Renderer* r, TTF_Font* font, Block* block,
                 if (isBoolInput) {
                     int slotW = inp.rect.w > 0 ? inp.rect.w : 40;
                     int slotH = 20;
-                    int sx = cx, sy = block->y + (block->h - slotH) / 2;
-                    inp.rect = {sx, sy, slotW, slotH};
+                    int sx = cx, sy = by + (block->h - slotH) / 2;
+                    inp.rect = {sx - ox, sy - oy, slotW, slotH};
 
                     if (inp.embeddedBlock) {
-                        inp.embeddedBlock->x = sx + 2;
-                        inp.embeddedBlock->y = sy;
+                        inp.embeddedBlock->x = sx + 2 - ox;
+                        inp.embeddedBlock->y = sy - oy;
                         inp.embeddedBlock->h = slotH;
                         inp.embeddedBlock->w = slotW - 4;
                         draw_embedded_block(r, font, inp.embeddedBlock, true);
@@ -153,12 +168,12 @@ static void draw_block_content(SDL_Renderer* r, TTF_Font* font, Block* block,
                     int valW = inp.rect.w > 0 ? inp.rect.w :
                                std::max(30, (int)inp.value.size() * 8 + 8);
                     int slotH = 18;
-                    int sx = cx, sy = block->y + (block->h - slotH) / 2 - 1;
-                    inp.rect = {sx, sy, valW, slotH};
+                    int sx = cx, sy = by + (block->h - slotH) / 2 - 1;
+                    inp.rect = {sx - ox, sy - oy, valW, slotH};
 
                     if (inp.embeddedBlock) {
-                        inp.embeddedBlock->x = sx + 2;
-                        inp.embeddedBlock->y = sy;
+                        inp.embeddedBlock->x = sx + 2 - ox;
+                        inp.embeddedBlock->y = sy - oy;
                         inp.embeddedBlock->h = slotH;
                         inp.embeddedBlock->w = valW - 4;
                         draw_embedded_block(r, font, inp.embeddedBlock, false);
@@ -194,7 +209,7 @@ static void draw_embedded_block(SDL_Renderer* r, TTF_Font* font, Block* block, b
 
     SDL_Color col = get_block_color(block->type);
     SDL_Color dark = darken(col, 30);
-    int x = block->x, y = block->y, w = block->w, h = block->h;
+    int x = block->x + g_blockView.dx, y = block->y + g_blockView.dy, w = block->w, h = block->h;
 
     if (asBoolean) {
         SDL_SetRenderDrawColor(r, col.r, col.g, col.b, 255);
@@ -253,7 +268,7 @@ static void draw_normal_block(SDL_Renderer* r, TTF_Font* font,
     SDL_Color hl     = lighten(col, 50);
     if (isGhost) { SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND); col.a = 140; }
 
-    int x = block->x, y = block->y, w = block->w, h = block->h;
+    int x = block->x + g_blockView.dx, y = block->y + g_blockView.dy, w = block->w, h = block->h;
 
     if (block->type == BLOCK_OPERATORS) {
         bool isBool = is_boolean_operator(block->text);
@@ -359,7 +374,7 @@ static void draw_c_block(SDL_Renderer* r, TTF_Font* font,
     SDL_Color hl     = lighten(col, 50);
     if (isGhost) { SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND); col.a = 140; }
 
-    int x = block->x, y = block->y, w = block->w;
+    int x = block->x + g_blockView.dx, y = block->y + g_blockView.dy, w = block->w;
     int headerH = block->h;
     int indent   = 16;
     int capH     = 8;
@@ -427,14 +442,31 @@ static void draw_c_block(SDL_Renderer* r, TTF_Font* font,
     if (isGhost) SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
 }
 
+// Zoomed far out, text would be unreadable: a block is a bar in its color,
+// and a C-block a bracket around its body.
+static void draw_block_bar(SDL_Renderer* r, Block* block)
+{
+    SDL_Color col = get_block_color(block->type);
+    SDL_SetRenderDrawColor(r, col.r, col.g, col.b, 255);
+    int x = block->x + g_blockView.dx, y = block->y + g_blockView.dy;
+    SDL_Rect head = {x, y, block->w, block->h};
+    SDL_RenderFillRect(r, &head);
+    if (!block->isCShaped) return;
+    int total = block_total_height(block);
+    SDL_Rect arm = {x, y, 16, total};
+    SDL_Rect cap = {x, y + total - 8, block->w, 8};
+    SDL_RenderFillRect(r, &arm);
+    SDL_RenderFillRect(r, &cap);
+}
+
 void draw_block(SDL_Renderer* r, TTF_Font* font,
                 Block* block, bool isGhost = false)
 {
     if (!block) return;
-    block->w = std::max(BLOCK_W, compute_block_width(block));
-    update_block_input_rects(block);
 
-    if (block->isCShaped)
+    if (g_blockView.bars && !isGhost)
+        draw_block_bar(r, block);
+    else if (block->isCShaped)
         draw_c_block(r, font, block, isGhost);
     else
         draw_normal_block(r, font, block, isGhost);
@@ -631,18 +663,6 @@ void draw_ask_input(SDL_Renderer* r, TTF_Font* font, Stage* stage,
     draw_text_centered(r, font, "OK", okBtn, {255,255,255,255});
 }
 
-void draw_workspace_bg(SDL_Renderer* r, Workspace& ws) {
-    SDL_SetRenderDrawColor(r, 255, 255, 255, 255);
-    SDL_Rect rc = {ws.x, ws.y, ws.w, ws.h};
-    SDL_RenderFillRect(r, &rc);
-    SDL_SetRenderDrawColor(r, 215, 215, 215, 255);
-    for (int x = ws.x+12; x < ws.x+ws.w; x += 24)
-        for (int y = ws.y+12; y < ws.y+ws.h; y += 24)
-            SDL_RenderDrawPoint(r, x, y);
-    SDL_SetRenderDrawColor(r, 200, 200, 200, 255);
-    SDL_RenderDrawRect(r, &rc);
-}
-
 void draw_play_stop_buttons(SDL_Renderer* r, TTF_Font* font,
                              SDL_Rect& playBtn, SDL_Rect& stopBtn,
                              SDL_Texture* playTex, SDL_Texture* stopTex,
@@ -703,9 +723,14 @@ void draw_costume_panel(SDL_Renderer* r, TTF_Font* font, TTF_Font* fontBig,
         SDL_RenderDrawRect(r, &card);
 
         SDL_Rect thumbArea = {ix+4, iy+4, thumbW, thumbW};
+        // A texture evicted over budget comes straight back from its pixels;
+        // one not decoded yet is requested and shown as a placeholder.
+        if (sprite->costumes[i].pixels)
+            asset_costume_materialize(r, sprite->costumes[i]);
         if (sprite->costumes[i].texture)
             SDL_RenderCopy(r, sprite->costumes[i].texture, nullptr, &thumbArea);
         else {
+            asset_costume_prefetch(sprite->costumes[i]);
             SDL_SetRenderDrawColor(r, 200,200,220,255);
             SDL_RenderFillRect(r, &thumbArea);
             if (font) draw_text_centered(r, font, "?", thumbArea, COLOR_TEXT_DARK);
@@ -883,4 +908,32 @@ void draw_variables_panel(SDL_Renderer* r, TTF_Font* font, TTF_Font* fontBig,
     (void)r; (void)font; (void)fontBig; (void)vp; (void)ws;
 }
 
+// Debug overlay (F3): texture memory by kind against the budget.
+void draw_texture_overlay(SDL_Renderer* r, TTF_Font* font) {
+    if (!g_texOverlay || !font) return;
+    auto mb = [](size_t bytes) { return (double)bytes / (1024.0 * 1024.0); };
+    char line[96];
+    SDL_Rect box = {8, SCREEN_HEIGHT - 24 - 16 * (TEX_KIND_COUNT + 2), 250, 16 * (TEX_KIND_COUNT + 2) + 16};
+    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(r, 0, 0, 0, 190);
+    SDL_RenderFillRect(r, &box);
+    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
+
+    int y = box.y + 8;
+    snprintf(line, sizeof(line), "Textures %.1f / %.0f MB (peak %.1f)",
+             mb(g_texTotal), mb(g_texBudget), mb(g_texPeak));
+    SDL_Color head = tex_over_budget() ? SDL_Color{255, 120, 100, 255} : COLOR_TEXT_WHITE;
+    draw_text(r, font, line, box.x + 8, y, head);
+    for (int k = 0; k < TEX_KIND_COUNT; k++) {
+        y += 16;
+        snprintf(line, sizeof(line), "  %-10s %6.1f MB  x%d",
+                 TEX_KIND_NAMES[k], mb(g_texBytes[k]), g_texCount[k]);
+        draw_text(r, font, line, box.x + 8, y, {200, 200, 210, 255});
+    }
+    y += 16;
+    snprintf(line, sizeof(line), "Evicted %u, re-uploaded %u",
+             (unsigned)g_texEvictions, (unsigned)g_texReuploads);
+    draw_text(r, font, line, box.x + 8, y, {200, 200, 210, 255});
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,1370 @@
+#ifndef SCRATCH_FOP_SB3_H
+#define SCRATCH_FOP_SB3_H
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <unordered_set>
+#include <cstdio>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <SDL2/SDL_mixer.h>
+#include "globals.h"
+#include "structs.h"
+#include "utils.h"
+#include "zip.h"
+#include "json.h"
+#include "SaveSystem.h"
+#include "asset_store.h"
+
+// Scratch 3 (.sb3) import and export. Only one sprite is supported here, so
+// the first sprite target is imported along with the stage's (global)
+// variables, and export writes that sprite plus a stage holding the variables.
+
+// One Scratch opcode. '%' in text is replaced by the value of `field`
+// (looked up on the block, then on the menu shadow of the input of the same
+// name); `inputs` name the Scratch inputs feeding the text's slots in order.
+struct Sb3Opcode {
+    const char* opcode;
+    BlockType   type;
+    const char* text;
+    const char* field;
+    const char* inputs[3];
+};
+
+static const Sb3Opcode SB3_OPCODES[] = {
+    { "motion_movesteps",          BLOCK_MOTION,    "move () steps",              nullptr, { "STEPS" } },
+    { "motion_turnright",          BLOCK_MOTION,    "turn right () degrees",      nullptr, { "DEGREES" } },
+    { "motion_turnleft",           BLOCK_MOTION,    "turn left () degrees",       nullptr, { "DEGREES" } },
+    { "motion_gotoxy",             BLOCK_MOTION,    "go to x:() y:()",            nullptr, { "X", "Y" } },
+    { "motion_goto",               BLOCK_MOTION,    "go to %",                    "TO",    {} },
+    { "motion_glidesecstoxy",      BLOCK_MOTION,    "glide () secs to x:() y:()", nullptr, { "SECS", "X", "Y" } },
+    { "motion_pointindirection",   BLOCK_MOTION,    "point in direction ()",      nullptr, { "DIRECTION" } },
+    { "motion_pointtowards",       BLOCK_MOTION,    "point towards %",            "TOWARDS", {} },
+    { "motion_changexby",          BLOCK_MOTION,    "change x by ()",             nullptr, { "DX" } },
+    { "motion_setx",               BLOCK_MOTION,    "set x to ()",                nullptr, { "X" } },
+    { "motion_changeyby",          BLOCK_MOTION,    "change y by ()",             nullptr, { "DY" } },
+    { "motion_sety",               BLOCK_MOTION,    "set y to ()",                nullptr, { "Y" } },
+    { "motion_ifonedgebounce",     BLOCK_MOTION,    "if on edge, bounce",         nullptr, {} },
+    { "looks_say",                 BLOCK_LOOKS,     "say ()",                     nullptr, { "MESSAGE" } },
+    { "looks_sayforsecs",          BLOCK_LOOKS,     "say () for () secs",         nullptr, { "MESSAGE", "SECS" } },
+    { "looks_think",               BLOCK_LOOKS,     "think ()",                   nullptr, { "MESSAGE" } },
+    { "looks_show",                BLOCK_LOOKS,     "show",                       nullptr, {} },
+    { "looks_hide",                BLOCK_LOOKS,     "hide",                       nullptr, {} },
+    { "looks_nextcostume",         BLOCK_LOOKS,     "next costume",               nullptr, {} },
+    { "looks_switchcostumeto",     BLOCK_LOOKS,     "switch costume to ()",       nullptr, { "COSTUME" } },
+    { "looks_setsizeto",           BLOCK_LOOKS,     "set size to ()",             nullptr, { "SIZE" } },
+    { "looks_changesizeby",        BLOCK_LOOKS,     "change size by ()",          nullptr, { "CHANGE" } },
+    { "looks_switchbackdropto",    BLOCK_LOOKS,     "switch backdrop to ()",      nullptr, { "BACKDROP" } },
+    { "looks_nextbackdrop",        BLOCK_LOOKS,     "next backdrop",              nullptr, {} },
+    { "sound_play",                BLOCK_SOUND,     "play sound ()",              nullptr, { "SOUND_MENU" } },
+    { "sound_playuntildone",       BLOCK_SOUND,     "play sound () until done",   nullptr, { "SOUND_MENU" } },
+    { "sound_stopallsounds",       BLOCK_SOUND,     "stop all sounds",            nullptr, {} },
+    { "sound_changevolumeby",      BLOCK_SOUND,     "change volume by ()",        nullptr, { "VOLUME" } },
+    { "sound_setvolumeto",         BLOCK_SOUND,     "set volume to ()",           nullptr, { "VOLUME" } },
+    { "sound_cleareffects",        BLOCK_SOUND,     "clear sound effects",        nullptr, {} },
+    { "event_whenflagclicked",     BLOCK_EVENT,     "when flag clicked",          nullptr, {} },
+    { "event_whenkeypressed",      BLOCK_EVENT,     "when key pressed",           nullptr, {} },
+    { "event_whenthisspriteclicked", BLOCK_EVENT,   "when sprite clicked",        nullptr, {} },
+    { "event_whengreaterthan",     BLOCK_EVENT,     "when loudness > ()",         nullptr, { "VALUE" } },
+    { "control_wait",              BLOCK_CONTROL,   "wait () secs",               nullptr, { "DURATION" } },
+    { "control_repeat",            BLOCK_CONTROL,   "repeat ()",                  nullptr, { "TIMES" } },
+    { "control_forever",           BLOCK_CONTROL,   "forever",                    nullptr, {} },
+    { "control_if",                BLOCK_CONTROL,   "if <> then",                 nullptr, { "CONDITION" } },
+    { "control_if_else",           BLOCK_CONTROL,   "if <> then else",            nullptr, { "CONDITION" } },
+    { "control_wait_until",        BLOCK_CONTROL,   "wait until <>",              nullptr, { "CONDITION" } },
+    { "control_stop",              BLOCK_CONTROL,   "stop %",                     "STOP_OPTION", {} },
+    { "sensing_askandwait",        BLOCK_SENSING,   "ask () and wait",            nullptr, { "QUESTION" } },
+    { "sensing_answer",            BLOCK_SENSING,   "answer",                     nullptr, {} },
+    { "sensing_touchingobject",    BLOCK_SENSING,   "touching %?",                "TOUCHINGOBJECTMENU", {} },
+    { "sensing_keypressed",        BLOCK_SENSING,   "key % pressed?",             "KEY_OPTION", {} },
+    { "sensing_mousedown",         BLOCK_SENSING,   "mouse down?",                nullptr, {} },
+    { "sensing_mousex",            BLOCK_SENSING,   "mouse x",                    nullptr, {} },
+    { "sensing_mousey",            BLOCK_SENSING,   "mouse y",                    nullptr, {} },
+    { "sensing_timer",             BLOCK_SENSING,   "timer",                      nullptr, {} },
+    { "sensing_loudness",          BLOCK_SENSING,   "loudness",                   nullptr, {} },
+    { "sensing_resettimer",        BLOCK_SENSING,   "reset timer",                nullptr, {} },
+    { "sensing_distanceto",        BLOCK_SENSING,   "distance to %",              "DISTANCETOMENU", {} },
+    { "operator_add",              BLOCK_OPERATORS, "() + ()",                    nullptr, { "NUM1", "NUM2" } },
+    { "operator_subtract",         BLOCK_OPERATORS, "() - ()",                    nullptr, { "NUM1", "NUM2" } },
+    { "operator_multiply",         BLOCK_OPERATORS, "() * ()",                    nullptr, { "NUM1", "NUM2" } },
+    { "operator_divide",           BLOCK_OPERATORS, "() / ()",                    nullptr, { "NUM1", "NUM2" } },
+    { "operator_mod",              BLOCK_OPERATORS, "() mod ()",                  nullptr, { "NUM1", "NUM2" } },
+    { "operator_lt",               BLOCK_OPERATORS, "() < ()",                    nullptr, { "OPERAND1", "OPERAND2" } },
+    { "operator_gt",               BLOCK_OPERATORS, "() > ()",                    nullptr, { "OPERAND1", "OPERAND2" } },
+    { "operator_equals",           BLOCK_OPERATORS, "() = ()",                    nullptr, { "OPERAND1", "OPERAND2" } },
+    { "operator_and",              BLOCK_OPERATORS, "<> and <>",                  nullptr, { "OPERAND1", "OPERAND2" } },
+    { "operator_or",               BLOCK_OPERATORS, "<> or <>",                   nullptr, { "OPERAND1", "OPERAND2" } },
+    { "operator_not",              BLOCK_OPERATORS, "not <>",                     nullptr, { "OPERAND" } },
+    { "operator_random",           BLOCK_OPERATORS, "pick random () to ()",       nullptr, { "FROM", "TO" } },
+    { "operator_round",            BLOCK_OPERATORS, "round ()",                   nullptr, { "NUM" } },
+    { "operator_mathop",           BLOCK_OPERATORS, "% of ()",                    "OPERATOR", { "NUM" } },
+    { "operator_join",             BLOCK_OPERATORS, "join () ()",                 nullptr, { "STRING1", "STRING2" } },
+    { "operator_letter_of",        BLOCK_OPERATORS, "letter () of ()",            nullptr, { "LETTER", "STRING" } },
+    { "operator_length",           BLOCK_OPERATORS, "length of ()",               nullptr, { "STRING" } },
+    { "data_setvariableto",        BLOCK_VARIABLES, "set % to ()",                "VARIABLE", { "VALUE" } },
+    { "data_changevariableby",     BLOCK_VARIABLES, "change % by ()",             "VARIABLE", { "VALUE" } },
+    { "data_showvariable",         BLOCK_VARIABLES, "show variable %",            "VARIABLE", {} },
+    { "data_hidevariable",         BLOCK_VARIABLES, "hide variable %",            "VARIABLE", {} },
+    { "pen_penDown",               BLOCK_EXTENSION, "pen down",                   nullptr, {} },
+    { "pen_penUp",                 BLOCK_EXTENSION, "pen up",                     nullptr, {} },
+    { "pen_clear",                 BLOCK_EXTENSION, "erase all",                  nullptr, {} },
+    { "pen_stamp",                 BLOCK_EXTENSION, "stamp",                      nullptr, {} },
+    { "pen_setPenColorToColor",    BLOCK_EXTENSION, "set pen color to ()",        nullptr, { "COLOR" } },
+    { "pen_setPenSizeTo",          BLOCK_EXTENSION, "set pen size to ()",         nullptr, { "SIZE" } },
+    { "pen_changePenSizeBy",       BLOCK_EXTENSION, "change pen size by ()",      nullptr, { "SIZE" } },
+    { "music_playDrumForBeats",    BLOCK_MUSIC,     "play drum () for () beats",  nullptr, { "DRUM", "BEATS" } },
+    { "music_restForBeats",        BLOCK_MUSIC,     "rest for () beats",          nullptr, { "BEATS" } },
+    { "music_playNoteForBeats",    BLOCK_MUSIC,     "play note () for () beats",  nullptr, { "NOTE", "BEATS" } },
+    { "music_setInstrument",       BLOCK_MUSIC,     "set instrument to ()",       nullptr, { "INSTRUMENT" } },
+    { "music_setTempo",            BLOCK_MUSIC,     "set tempo to ()",            nullptr, { "TEMPO" } },
+    { "music_changeTempo",         BLOCK_MUSIC,     "change tempo by ()",         nullptr, { "TEMPO" } },
+};
+
+inline const Sb3Opcode* sb3_opcode(std::string_view opcode)
+{
+    static std::unordered_map<std::string_view, const Sb3Opcode*> index;
+    if (index.empty())
+        for (const auto& op : SB3_OPCODES) index[op.opcode] = &op;
+    auto it = index.find(opcode);
+    return it != index.end() ? it->second : nullptr;
+}
+
+// Menu values like "_mouse_" are spelled out the way this editor's blocks read.
+static std::string sb3_menu_text(const std::string& v)
+{
+    if (v == "_mouse_")  return "mouse-pointer";
+    if (v == "_random_") return "random position";
+    if (v == "_edge_")   return "edge";
+    if (v == "_stage_")  return "stage";
+    return v;
+}
+
+// ── Asset decode ─────────────────────────────────────────────
+
+struct Sb3Asset {
+    const ZipEntry* entry  = nullptr;
+    bool            sound  = false;
+    bool            decode = false;
+    AssetBytes      bytes;
+    AssetDecoded    decoded;
+};
+
+// Assets stay encoded (see asset_store.h) except the ones needed at once.
+static void sb3_decode_asset(const ZipArchive& za, Sb3Asset& a)
+{
+    auto bytes = std::make_shared<std::vector<Uint8>>();
+    if (!a.entry || !zip_extract(za, *a.entry, *bytes) || bytes->empty()) return;
+    a.bytes = std::move(bytes);
+    if (!a.decode) return;
+    a.decoded.source = a.bytes;
+    a.decoded.sound  = a.sound;
+    asset_decode(a.decoded);
+}
+
+// Inflate and the eager decodes dominate import time, so assets are spread
+// over worker threads. Textures are created afterwards on the calling
+// thread, through the asset store so repeated images upload once.
+static void sb3_decode_assets(const ZipArchive& za, std::vector<Sb3Asset>& assets)
+{
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < assets.size(); )
+            sb3_decode_asset(za, assets[i]);
+    };
+    size_t n = std::min<size_t>(assets.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < n; t++) pool.emplace_back(work);
+    work();
+    for (auto& t : pool) t.join();
+}
+
+// ── Block mapping ────────────────────────────────────────────
+
+static const int SB3_MAX_DEPTH = 256;
+
+struct Sb3Import {
+    const JsonDoc& doc;
+    int&           nextId;
+    Uint32         blocks  = JSON_NONE;
+    int            skipped = 0;
+    int            depth   = 0;
+    std::unordered_map<std::string_view, Uint32> byId;
+    std::vector<Uint8>       used;
+    std::vector<std::string> costumeNames;
+    std::vector<std::string> backdropNames;
+
+    Sb3Import(const JsonDoc& d, int& id) : doc(d), nextId(id) {}
+};
+
+static Uint32 sb3_block(const Sb3Import& im, Uint32 ref)
+{
+    if (json_type(im.doc, ref) != JSON_STRING) return JSON_NONE;
+    auto it = im.byId.find(im.doc.nodes[ref].str);
+    return it != im.byId.end() ? it->second : JSON_NONE;
+}
+
+// First field of a shadow block (math_number, menus, ...), or the value of
+// a compact primitive such as [4, "10"] or [12, "score", "id"].
+static std::string sb3_shadow_value(const Sb3Import& im, Uint32 ref)
+{
+    const JsonDoc& d = im.doc;
+    if (json_type(d, ref) == JSON_ARRAY) return json_text(d, json_at(d, ref, 1));
+    Uint32 blk = sb3_block(im, ref);
+    if (blk == JSON_NONE) return "";
+    Uint32 fields = json_get(d, blk, "fields");
+    return json_text(d, json_at(d, json_first(d, fields), 0));
+}
+
+static std::string sb3_field(const Sb3Import& im, Uint32 blk, const char* name)
+{
+    const JsonDoc& d = im.doc;
+    Uint32 f = json_get(d, json_get(d, blk, "fields"), name);
+    if (f != JSON_NONE) return json_text(d, json_at(d, f, 0));
+    Uint32 in = json_get(d, json_get(d, blk, "inputs"), name);
+    return in != JSON_NONE ? sb3_shadow_value(im, json_at(d, in, 1)) : "";
+}
+
+static Block* sb3_chain(Sb3Import& im, Uint32 blk);
+
+static Block* sb3_convert(Sb3Import& im, Uint32 blk)
+{
+    const JsonDoc& d = im.doc;
+    std::string_view opcode;
+    Uint32 op = json_get(d, blk, "opcode");
+    if (json_type(d, op) == JSON_STRING) opcode = d.nodes[op].str;
+    const Sb3Opcode* map = sb3_opcode(opcode);
+    // Each Scratch block converts once, which also stops reference cycles
+    // in a damaged project.json.
+    if (!map || im.used[blk] || im.depth >= SB3_MAX_DEPTH) {
+        im.skipped++;
+        return nullptr;
+    }
+    im.used[blk] = 1;
+    im.depth++;
+
+    Block* b = block_alloc();
+    b->id          = im.nextId++;
+    b->type        = map->type;
+    b->text        = map->text;
+    b->x           = 0;
+    b->y           = 0;
+    b->h           = BLOCK_H;
+    b->isDragging  = false;
+    b->dragOffsetX = 0;
+    b->dragOffsetY = 0;
+    b->next        = nullptr;
+    b->prev        = nullptr;
+    if (map->field) {
+        size_t pct = b->text.find('%');
+        b->text.replace(pct, 1, sb3_menu_text(sb3_field(im, blk, map->field)));
+    }
+    init_block_inputs(b);
+
+    Uint32 inputs = json_get(d, blk, "inputs");
+    for (int k = 0; k < 3 && map->inputs[k] && k < (int)b->inputs.size(); k++) {
+        Uint32 in = json_get(d, inputs, map->inputs[k]);
+        if (json_type(d, in) != JSON_ARRAY) continue;
+        BlockInput& slot = b->inputs[k];
+        Uint32 ref    = json_at(d, in, 1);
+        Uint32 target = sb3_block(im, ref);
+        if (target != JSON_NONE && !json_bool(d, json_get(d, target, "shadow")))
+            slot.embeddedBlock = sb3_convert(im, target);
+        if (!slot.embeddedBlock) {
+            // A reporter this editor lacks falls back to the shadow behind it.
+            Uint32 shadow = json_at(d, in, 2);
+            if (target == JSON_NONE || shadow == JSON_NONE) shadow = ref;
+            std::string v = sb3_shadow_value(im, shadow);
+            if (!v.empty() || slot.slotType == SLOT_NUMERIC) slot.value = v;
+        }
+    }
+
+    // The engine switches costumes and backdrops by 1-based index.
+    if ((opcode == "looks_switchcostumeto" || opcode == "looks_switchbackdropto") &&
+        !b->inputs.empty() && !b->inputs[0].embeddedBlock) {
+        const auto& names = opcode == "looks_switchcostumeto" ? im.costumeNames : im.backdropNames;
+        auto it = std::find(names.begin(), names.end(), b->inputs[0].value);
+        if (it != names.end()) b->inputs[0].value = std::to_string(it - names.begin() + 1);
+    }
+
+    if (b->isCShaped) {
+        b->innerFirst = sb3_chain(im, sb3_block(im, json_at(d, json_get(d, inputs, "SUBSTACK"), 1)));
+        if (b->hasElse)
+            b->elseFirst = sb3_chain(im, sb3_block(im, json_at(d, json_get(d, inputs, "SUBSTACK2"), 1)));
+        b->innerLast = b->innerFirst;
+        while (b->innerLast && b->innerLast->next) b->innerLast = b->innerLast->next;
+    }
+    im.depth--;
+    return b;
+}
+
+// Converts a `next` chain; blocks with no counterpart here are dropped and
+// the chain closes over them.
+static Block* sb3_chain(Sb3Import& im, Uint32 blk)
+{
+    Block* head = nullptr;
+    Block* tail = nullptr;
+    while (blk != JSON_NONE && !im.used[blk]) {
+        Block* b = sb3_convert(im, blk);
+        im.used[blk] = 1;
+        if (b) {
+            if (tail) { tail->next = b; b->prev = tail; }
+            else head = b;
+            tail = b;
+        }
+        blk = sb3_block(im, json_get(im.doc, blk, "next"));
+    }
+    return head;
+}
+
+// Positions a chain top-down; returns its height. Inner chains are laid
+// out first so each C-block knows its mouth height.
+static int sb3_layout(Block* b, int x, int y)
+{
+    int top = y;
+    for (; b; b = b->next) {
+        b->x = x;
+        b->y = y;
+        if (b->isCShaped) {
+            b->innerH = std::max(40, sb3_layout(b->innerFirst, x + 16, c_inner_y(b) + 4) + 4);
+            if (b->hasElse)
+                b->elseH = std::max(40, sb3_layout(b->elseFirst, x + 16, c_else_y(b) + 24) + 4);
+        }
+        y = c_bottom_y(b);
+    }
+    return y - top;
+}
+
+static void sb3_collect(Block* b, std::vector<Block*>& out)
+{
+    for (; b; b = b->next) {
+        out.push_back(b);
+        sb3_collect(b->innerFirst, out);
+        sb3_collect(b->elseFirst, out);
+    }
+}
+
+static void sb3_read_vars(const JsonDoc& d, Uint32 target, VariablesPanel& vars,
+                          const std::unordered_map<std::string, bool>& shown)
+{
+    Uint32 vs = json_get(d, target, "variables");
+    for (Uint32 v = json_first(d, vs); v != JSON_NONE; v = json_next(d, vs, v)) {
+        std::string name = json_text(d, json_at(d, v, 0));
+        if (name.empty()) continue;
+        float value = (float)json_num(d, json_at(d, v, 1));
+        auto sh   = shown.find(name);
+        bool show = sh != shown.end() && sh->second;
+        bool found = false;
+        for (auto& var : vars.variables) {
+            if (var.name == name) {
+                var.value       = value;
+                var.showOnStage = show;
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            vars.variables.push_back({name, value, show});
+    }
+}
+
+static const ZipEntry* sb3_asset_entry(const ZipArchive& za, const JsonDoc& d, Uint32 asset)
+{
+    std::string file = json_text(d, json_get(d, asset, "md5ext"));
+    if (file.empty())
+        file = json_text(d, json_get(d, asset, "assetId")) + "." +
+               json_text(d, json_get(d, asset, "dataFormat"));
+    return zip_find(za, file);
+}
+
+inline bool is_sb3_project(const std::string& path)
+{
+    std::ifstream f(path, std::ios::binary);
+    char magic[4] = {};
+    return f.read(magic, 4) && std::memcmp(magic, "PK\x03\x04", 4) == 0;
+}
+
+inline bool load_project_sb3(const std::string& path,
+                             std::vector<Block*>& wsBlocks,
+                             VariablesPanel& vars,
+                             Sprite& sprite,
+                             SoundsPanel& sounds,
+                             SDL_Renderer* r,
+                             int& nextId)
+{
+    Uint32 t0 = SDL_GetTicks();
+    MappedFile mf;
+    if (!map_file(path, mf)) {
+        std::cerr << "[Sb3] Cannot map '" << path << "'\n";
+        return false;
+    }
+    ZipArchive za;
+    std::vector<Uint8> json;
+    const ZipEntry* pj = nullptr;
+    if (!zip_open(mf.data, mf.size, za) || !(pj = zip_find(za, "project.json")) ||
+        !zip_extract(za, *pj, json)) {
+        std::cerr << "[Sb3] '" << path << "' is not a Scratch 3 project\n";
+        unmap_file(mf);
+        return false;
+    }
+    JsonDoc d;
+    if (!json_parse(d, (const char*)json.data(), json.size())) {
+        std::cerr << "[Sb3] project.json: " << d.error << "\n";
+        unmap_file(mf);
+        return false;
+    }
+
+    Uint32 targets = json_get(d, 0, "targets");
+    Uint32 stage = JSON_NONE, spr = JSON_NONE;
+    for (Uint32 t = json_first(d, targets); t != JSON_NONE; t = json_next(d, targets, t)) {
+        if (json_bool(d, json_get(d, t, "isStage"))) { if (stage == JSON_NONE) stage = t; }
+        else if (spr == JSON_NONE) spr = t;
+    }
+    if (spr == JSON_NONE) spr = stage;
+    if (spr == JSON_NONE) {
+        std::cerr << "[Sb3] '" << path << "' has no targets\n";
+        unmap_file(mf);
+        return false;
+    }
+
+    // Costumes and sounds are extracted in the background while the scripts
+    // map; only the costume on show is decoded now.
+    std::vector<Sb3Asset> assets;
+    Uint32 costumes = json_get(d, spr, "costumes");
+    Uint32 sndList  = json_get(d, spr, "sounds");
+    int    showing  = (int)json_num(d, json_get(d, spr, "currentCostume"));
+    for (Uint32 c = json_first(d, costumes); c != JSON_NONE; c = json_next(d, costumes, c)) {
+        Sb3Asset a;
+        a.entry  = sb3_asset_entry(za, d, c);
+        a.decode = (int)assets.size() == showing;
+        assets.push_back(std::move(a));
+    }
+    if (showing < 0 || showing >= (int)assets.size()) {
+        showing = 0;
+        if (!assets.empty()) assets[0].decode = true;
+    }
+    size_t firstSound = assets.size();
+    for (Uint32 s = json_first(d, sndList); s != JSON_NONE; s = json_next(d, sndList, s)) {
+        Sb3Asset a;
+        a.entry = sb3_asset_entry(za, d, s);
+        a.sound = true;
+        assets.push_back(std::move(a));
+    }
+    std::thread decoder(sb3_decode_assets, std::cref(za), std::ref(assets));
+
+    for (auto* b : wsBlocks) block_free_reporters(b);
+    wsBlocks.clear();
+
+    Sb3Import im(d, nextId);
+    im.blocks = json_get(d, spr, "blocks");
+    im.used.assign(d.nodes.size(), 0);
+    for (Uint32 b = json_first(d, im.blocks); b != JSON_NONE; b = json_next(d, im.blocks, b))
+        im.byId[d.nodes[b].key] = b;
+    for (Uint32 c = json_first(d, costumes); c != JSON_NONE; c = json_next(d, costumes, c))
+        im.costumeNames.push_back(json_text(d, json_get(d, c, "name")));
+    if (stage != JSON_NONE) {
+        Uint32 bd = json_get(d, stage, "costumes");
+        for (Uint32 c = json_first(d, bd); c != JSON_NONE; c = json_next(d, bd, c))
+            im.backdropNames.push_back(json_text(d, json_get(d, c, "name")));
+    }
+
+    struct Script { Block* head; double x, y; };
+    std::vector<Script> scripts;
+    double minX = 1e300, minY = 1e300;
+    for (Uint32 b = json_first(d, im.blocks); b != JSON_NONE; b = json_next(d, im.blocks, b)) {
+        if (json_type(d, b) != JSON_OBJECT || !json_bool(d, json_get(d, b, "topLevel")) ||
+            json_bool(d, json_get(d, b, "shadow")))
+            continue;
+        Block* head = sb3_chain(im, b);
+        if (!head) continue;
+        double x = json_num(d, json_get(d, b, "x")), y = json_num(d, json_get(d, b, "y"));
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        scripts.push_back({head, x, y});
+    }
+    for (auto& s : scripts) {
+        sb3_layout(s.head, WORKSPACE_X + 20 + (int)(s.x - minX), STAGE_Y + 20 + (int)(s.y - minY));
+        sb3_collect(s.head, wsBlocks);
+    }
+
+    std::unordered_map<std::string, bool> shown;
+    Uint32 monitors = json_get(d, 0, "monitors");
+    for (Uint32 m = json_first(d, monitors); m != JSON_NONE; m = json_next(d, monitors, m))
+        if (json_text(d, json_get(d, m, "opcode")) == "data_variable")
+            shown[json_text(d, json_get(d, json_get(d, m, "params"), "VARIABLE"))] =
+                json_bool(d, json_get(d, m, "visible"));
+    if (stage != JSON_NONE && stage != spr) sb3_read_vars(d, stage, vars, shown);
+    sb3_read_vars(d, spr, vars, shown);
+
+    sprite.name      = json_text(d, json_get(d, spr, "name"), sprite.name);
+    sprite.x         = (float)json_num(d, json_get(d, spr, "x")) + STAGE_WIDTH / 2.0f - sprite.w / 2.0f;
+    sprite.y         = -(float)json_num(d, json_get(d, spr, "y")) + STAGE_HEIGHT / 2.0f - sprite.h / 2.0f;
+    sprite.direction = (float)json_num(d, json_get(d, spr, "direction"), 90.0);
+    sprite.scale     = (float)json_num(d, json_get(d, spr, "size"), 100.0) / 100.0f;
+    sprite.visible   = json_bool(d, json_get(d, spr, "visible"), true);
+
+    decoder.join();
+
+    int failed = 0;
+    if (firstSound > 0) {
+        std::vector<Costume> loaded;
+        size_t i = 0;
+        for (Uint32 c = json_first(d, costumes); c != JSON_NONE; c = json_next(d, costumes, c), i++) {
+            Sb3Asset& a = assets[i];
+            Costume cos;
+            cos.name   = json_text(d, json_get(d, c, "name"));
+            cos.source = a.bytes;
+            if (!a.bytes) failed++;
+            if (r && a.decoded.pixels) {
+                asset_costume_set(r, cos, a.decoded.pixels, a.decoded.w, a.decoded.h, a.decoded.hash);
+                if (!cos.texture) failed++;
+            }
+            loaded.push_back(std::move(cos));
+        }
+        asset_release_costumes(sprite);
+        sprite.costumes = std::move(loaded);
+        sprite.currentCostume = showing;
+        asset_costume_materialize(r, sprite.costumes[showing]);
+        sprite.texture = sprite.costumes[showing].texture;
+    }
+
+    if (firstSound < assets.size()) {
+        audio_free_all(sounds);
+        sounds.sounds.clear();
+        sounds.selectedIndex = -1;
+        size_t i = firstSound;
+        for (Uint32 s = json_first(d, sndList); s != JSON_NONE; s = json_next(d, sndList, s), i++) {
+            SoundClip sc;
+            sc.name      = json_text(d, json_get(d, s, "name"));
+            sc.source    = assets[i].bytes;
+            sc.channel   = -1;
+            sc.isPlaying = false;
+            if (!sc.source) failed++;
+            // Known without decoding, so the list can show it.
+            double rate = json_num(d, json_get(d, s, "rate"));
+            if (rate > 0)
+                sc.durationSecs = (float)(json_num(d, json_get(d, s, "sampleCount")) / rate);
+            sounds.sounds.push_back(std::move(sc));
+        }
+    }
+
+    std::cerr << "[Sb3] Imported '" << path << "': " << wsBlocks.size() << " blocks, "
+              << firstSound << " costumes, " << assets.size() - firstSound << " sounds in "
+              << SDL_GetTicks() - t0 << " ms";
+    if (im.skipped) std::cerr << " (" << im.skipped << " unsupported blocks dropped)";
+    if (failed)     std::cerr << " (" << failed << " assets failed to load)";
+    std::cerr << "\n";
+    unmap_file(mf);
+    return true;
+}
+
+// ── Export ──────────────────────────────────────────────────
+
+// Numeric-slot inputs that Scratch keeps behind a menu shadow; field-driven
+// menus (`%` in the text) use the same table. The shadow's field has the
+// input's name.
+struct Sb3Menu {
+    const char* input;
+    const char* opcode;
+};
+
+static const Sb3Menu SB3_MENUS[] = {
+    { "TO",                 "motion_goto_menu" },
+    { "TOWARDS",            "motion_pointtowards_menu" },
+    { "TOUCHINGOBJECTMENU", "sensing_touchingobjectmenu" },
+    { "KEY_OPTION",         "sensing_keyoptions" },
+    { "DISTANCETOMENU",     "sensing_distancetomenu" },
+    { "COSTUME",            "looks_costume" },
+    { "BACKDROP",           "looks_backdrops" },
+    { "SOUND_MENU",         "sound_sounds_menu" },
+    { "DRUM",               "music_menu_DRUM" },
+    { "INSTRUMENT",         "music_menu_INSTRUMENT" },
+    { "NOTE",               "note" },
+};
+
+static const char* sb3_menu_opcode(std::string_view input)
+{
+    for (const auto& m : SB3_MENUS)
+        if (input == m.input) return m.opcode;
+    return nullptr;
+}
+
+static bool sb3_text_input(std::string_view input)
+{
+    return input == "MESSAGE" || input == "QUESTION" || input == "STRING" ||
+           input == "STRING1" || input == "STRING2" || input == "OPERAND1" ||
+           input == "OPERAND2" || input == "VALUE";
+}
+
+static std::string sb3_menu_value(const std::string& v)
+{
+    if (v == "mouse-pointer")   return "_mouse_";
+    if (v == "random position") return "_random_";
+    if (v == "edge")            return "_edge_";
+    if (v == "stage")           return "_stage_";
+    return v;
+}
+
+// Finds the opcode a block's text came from. Fixed texts match exactly;
+// texts with a menu value match the text around the '%', which is returned
+// in `field`.
+static const Sb3Opcode* sb3_match(const Block* b, std::string& field)
+{
+    static std::unordered_map<std::string_view, const Sb3Opcode*> exact;
+    if (exact.empty())
+        for (const auto& op : SB3_OPCODES)
+            if (!op.field) exact[op.text] = &op;
+    auto it = exact.find(b->text);
+    if (it != exact.end() && it->second->type == b->type) return it->second;
+
+    const std::string& s = b->text;
+    for (const auto& op : SB3_OPCODES) {
+        if (!op.field || op.type != b->type) continue;
+        std::string_view t = op.text;
+        size_t pct = t.find('%');
+        std::string_view pre = t.substr(0, pct), suf = t.substr(pct + 1);
+        if (s.size() > pre.size() + suf.size() && s.compare(0, pre.size(), pre) == 0 &&
+            s.compare(s.size() - suf.size(), suf.size(), suf) == 0) {
+            field = s.substr(pre.size(), s.size() - pre.size() - suf.size());
+            return &op;
+        }
+    }
+    return nullptr;
+}
+
+struct Sb3Emit {
+    std::string              out;
+    int                      nextId  = 0;
+    int                      skipped = 0;
+    bool                     pen     = false;
+    bool                     music   = false;
+    std::vector<std::string> varNames;
+};
+
+static std::string sb3_var_id(Sb3Emit& e, const std::string& name)
+{
+    auto it = std::find(e.varNames.begin(), e.varNames.end(), name);
+    if (it == e.varNames.end()) it = e.varNames.insert(e.varNames.end(), name);
+    return "v" + std::to_string(it - e.varNames.begin());
+}
+
+static void sb3_put_key(std::string& out, std::string_view key)
+{
+    if (out.size() > 1 && out.back() != '{' && out.back() != '[') out += ',';
+    json_put_string(out, key);
+    out += ':';
+}
+
+static void sb3_put_entry(Sb3Emit& e, const std::string& id, const std::string& body)
+{
+    if (!e.out.empty()) e.out += ',';
+    json_put_string(e.out, id);
+    e.out += ':';
+    e.out += body;
+}
+
+static void sb3_emit_menu(Sb3Emit& e, const std::string& id, const std::string& parent,
+                          const char* opcode, const char* input, const std::string& value)
+{
+    std::string j = "{\"opcode\":";
+    json_put_string(j, opcode);
+    j += ",\"next\":null,\"parent\":";
+    json_put_string(j, parent);
+    j += ",\"inputs\":{},\"fields\":{";
+    json_put_string(j, input);
+    j += ":[";
+    json_put_string(j, value);
+    j += ",null]},\"shadow\":true,\"topLevel\":false}";
+    sb3_put_entry(e, id, j);
+}
+
+static std::string sb3_emit_chain(Sb3Emit& e, const Block* head, const std::string& parent,
+                                  bool topLevel);
+
+static void sb3_emit_block(Sb3Emit& e, const Block* b, const Sb3Opcode* op,
+                           const std::string& field, const std::string& id,
+                           const std::string& parent, const std::string& next, bool topLevel);
+
+// Embedded reporters become child blocks; one with no Scratch counterpart is
+// dropped and its slot keeps the typed value.
+static std::string sb3_emit_reporter(Sb3Emit& e, const Block* b, const std::string& parent)
+{
+    std::string field;
+    const Sb3Opcode* op = sb3_match(b, field);
+    if (!op) {
+        e.skipped++;
+        return "";
+    }
+    std::string id = "b" + std::to_string(e.nextId++);
+    sb3_emit_block(e, b, op, field, id, parent, "", false);
+    return id;
+}
+
+static void sb3_emit_block(Sb3Emit& e, const Block* b, const Sb3Opcode* op,
+                           const std::string& field, const std::string& id,
+                           const std::string& parent, const std::string& next, bool topLevel)
+{
+    std::string_view opcode = op->opcode;
+    if (opcode.substr(0, 4) == "pen_")   e.pen   = true;
+    if (opcode.substr(0, 6) == "music_") e.music = true;
+
+    std::string inputs = "{", fields = "{";
+    for (int k = 0; k < 3 && op->inputs[k] && k < (int)b->inputs.size(); k++) {
+        const char* name = op->inputs[k];
+        const BlockInput& in = b->inputs[k];
+        std::string child = in.embeddedBlock ? sb3_emit_reporter(e, in.embeddedBlock, id) : "";
+        if (in.slotType == SLOT_BOOLEAN) {
+            if (child.empty()) continue;
+            sb3_put_key(inputs, name);
+            inputs += "[2,";
+            json_put_string(inputs, child);
+            inputs += ']';
+            continue;
+        }
+        std::string shadow;
+        if (const char* menu = sb3_menu_opcode(name)) {
+            std::string menuId = id + "_" + name;
+            sb3_emit_menu(e, menuId, id, menu, name, in.value);
+            json_put_string(shadow, menuId);
+        } else {
+            bool color = std::string_view(name) == "COLOR" && !in.value.empty() && in.value[0] == '#';
+            shadow = color ? "[9," : sb3_text_input(name) ? "[10," : "[4,";
+            json_put_string(shadow, in.value);
+            shadow += ']';
+        }
+        sb3_put_key(inputs, name);
+        if (child.empty()) {
+            inputs += "[1," + shadow + "]";
+        } else {
+            inputs += "[3,";
+            json_put_string(inputs, child);
+            inputs += "," + shadow + "]";
+        }
+    }
+
+    if (op->field) {
+        std::string f = field;
+        if (const char* menu = sb3_menu_opcode(op->field)) {
+            std::string menuId = id + "_" + op->field;
+            sb3_emit_menu(e, menuId, id, menu, op->field, sb3_menu_value(f));
+            sb3_put_key(inputs, op->field);
+            inputs += "[1,";
+            json_put_string(inputs, menuId);
+            inputs += ']';
+        } else {
+            sb3_put_key(fields, op->field);
+            fields += '[';
+            json_put_string(fields, f);
+            fields += ',';
+            if (std::string_view(op->field) == "VARIABLE") json_put_string(fields, sb3_var_id(e, f));
+            else fields += "null";
+            fields += ']';
+        }
+    } else if (opcode == "event_whenkeypressed") {
+        fields += "\"KEY_OPTION\":[\"any\",null]";
+    } else if (opcode == "event_whengreaterthan") {
+        fields += "\"WHENGREATERTHANMENU\":[\"LOUDNESS\",null]";
+    }
+
+    if (b->isCShaped) {
+        std::string inner = sb3_emit_chain(e, b->innerFirst, id, false);
+        if (!inner.empty()) {
+            sb3_put_key(inputs, "SUBSTACK");
+            inputs += "[2,";
+            json_put_string(inputs, inner);
+            inputs += ']';
+        }
+        std::string other = b->hasElse ? sb3_emit_chain(e, b->elseFirst, id, false) : "";
+        if (!other.empty()) {
+            sb3_put_key(inputs, "SUBSTACK2");
+            inputs += "[2,";
+            json_put_string(inputs, other);
+            inputs += ']';
+        }
+    }
+    inputs += '}';
+    fields += '}';
+
+    std::string j = "{\"opcode\":";
+    json_put_string(j, opcode);
+    j += ",\"next\":";
+    if (next.empty()) j += "null";
+    else json_put_string(j, next);
+    j += ",\"parent\":";
+    if (parent.empty()) j += "null";
+    else json_put_string(j, parent);
+    j += ",\"inputs\":" + inputs + ",\"fields\":" + fields + ",\"shadow\":false,\"topLevel\":";
+    j += topLevel ? "true" : "false";
+    if (topLevel) {
+        j += ",\"x\":";
+        json_put_number(j, b->x - WORKSPACE_X);
+        j += ",\"y\":";
+        json_put_number(j, b->y - STAGE_Y);
+    }
+    j += '}';
+    sb3_put_entry(e, id, j);
+}
+
+// Emits a `next` chain and returns its first block's id. Blocks with no
+// Scratch counterpart are left out and the chain closes over them.
+static std::string sb3_emit_chain(Sb3Emit& e, const Block* head, const std::string& parent,
+                                  bool topLevel)
+{
+    struct Item { const Block* b; const Sb3Opcode* op; std::string field, id; };
+    std::vector<Item> items;
+    for (const Block* b = head; b; b = b->next) {
+        Item it{b, nullptr, "", ""};
+        it.op = sb3_match(b, it.field);
+        if (!it.op) {
+            e.skipped++;
+            continue;
+        }
+        it.id = "b" + std::to_string(e.nextId++);
+        items.push_back(std::move(it));
+    }
+    for (size_t i = 0; i < items.size(); i++)
+        sb3_emit_block(e, items[i].b, items[i].op, items[i].field, items[i].id,
+                       i ? items[i - 1].id : parent,
+                       i + 1 < items.size() ? items[i + 1].id : "", topLevel && i == 0);
+    return items.empty() ? "" : items[0].id;
+}
+
+// ── Asset encode ─────────────────────────────────────────────
+
+struct Sb3Md5 {
+    Uint32  h[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    Uint8   buf[64];
+    size_t  fill  = 0;
+    Uint64  total = 0;
+};
+
+static void sb3_md5_block(Sb3Md5& m, const Uint8* p)
+{
+    static const Uint32 K[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+    };
+    static const int R[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+    Uint32 w[16];
+    for (int i = 0; i < 16; i++) w[i] = zip_u32(p + i * 4);
+    Uint32 a = m.h[0], b = m.h[1], c = m.h[2], d = m.h[3];
+    for (int i = 0; i < 64; i++) {
+        Uint32 f;
+        int g;
+        switch (i >> 4) {
+        case 0:  f = (b & c) | (~b & d); g = i;                break;
+        case 1:  f = (d & b) | (~d & c); g = (5 * i + 1) & 15; break;
+        case 2:  f = b ^ c ^ d;          g = (3 * i + 5) & 15; break;
+        default: f = c ^ (b | ~d);       g = (7 * i) & 15;     break;
+        }
+        Uint32 t = a + f + K[i] + w[g];
+        int r = R[(i >> 4) * 4 + (i & 3)];
+        a = d;
+        d = c;
+        c = b;
+        b += (t << r) | (t >> (32 - r));
+    }
+    m.h[0] += a; m.h[1] += b; m.h[2] += c; m.h[3] += d;
+}
+
+static void sb3_md5_update(Sb3Md5& m, const Uint8* p, size_t n)
+{
+    m.total += n;
+    while (n) {
+        if (m.fill == 0 && n >= 64) {
+            sb3_md5_block(m, p);
+            p += 64;
+            n -= 64;
+            continue;
+        }
+        size_t k = std::min(n, 64 - m.fill);
+        std::memcpy(m.buf + m.fill, p, k);
+        m.fill += k;
+        p += k;
+        n -= k;
+        if (m.fill == 64) {
+            sb3_md5_block(m, m.buf);
+            m.fill = 0;
+        }
+    }
+}
+
+// Scratch names assets by the MD5 of their file bytes.
+static std::string sb3_md5(const std::vector<Uint8>& data)
+{
+    Sb3Md5 m;
+    sb3_md5_update(m, data.data(), data.size());
+    Uint64 bits = m.total * 8;
+    Uint8 pad[72] = { 0x80 };
+    size_t padLen = (m.fill < 56 ? 56 : 120) - m.fill;
+    for (int i = 0; i < 8; i++) pad[padLen + i] = (Uint8)(bits >> (8 * i));
+    sb3_md5_update(m, pad, padLen + 8);
+
+    static const char hex[] = "0123456789abcdef";
+    std::string s;
+    for (Uint32 v : m.h)
+        for (int i = 0; i < 4; i++) {
+            Uint8 byte = (Uint8)(v >> (8 * i));
+            s += hex[byte >> 4];
+            s += hex[byte & 15];
+        }
+    return s;
+}
+
+static void sb3_be32(std::vector<Uint8>& v, Uint32 x)
+{
+    v.push_back((Uint8)(x >> 24));
+    v.push_back((Uint8)(x >> 16));
+    v.push_back((Uint8)(x >> 8));
+    v.push_back((Uint8)x);
+}
+
+static void sb3_png_chunk(std::vector<Uint8>& out, const char* type, const std::vector<Uint8>& data)
+{
+    sb3_be32(out, (Uint32)data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    sb3_be32(out, zip_crc32(0, out.data() + start, out.size() - start));
+}
+
+// RGBA PNG with a per-row choice of the None, Sub and Up filters.
+static std::vector<Uint8> sb3_encode_png(const std::vector<Uint32>& px, int w, int h)
+{
+    size_t stride = (size_t)w * 4;
+    std::vector<Uint8> raw((stride + 1) * h), cur(stride), prev(stride, 0), trial(stride);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            Uint32 p = px[(size_t)y * w + x];
+            cur[x * 4 + 0] = (Uint8)(p >> 16);
+            cur[x * 4 + 1] = (Uint8)(p >> 8);
+            cur[x * 4 + 2] = (Uint8)p;
+            cur[x * 4 + 3] = (Uint8)(p >> 24);
+        }
+        Uint8* row = raw.data() + (stride + 1) * y;
+        Uint64 best = ~0ull;
+        for (Uint8 filter = 0; filter < 3; filter++) {
+            Uint64 cost = 0;
+            for (size_t i = 0; i < stride; i++) {
+                Uint8 pred = filter == 1 ? (i >= 4 ? cur[i - 4] : 0) : filter == 2 ? prev[i] : 0;
+                trial[i] = (Uint8)(cur[i] - pred);
+                cost += (Uint64)std::abs((int)(Sint8)trial[i]);
+            }
+            if (cost < best) {
+                best   = cost;
+                row[0] = filter;
+                std::memcpy(row + 1, trial.data(), stride);
+            }
+        }
+        std::swap(cur, prev);
+    }
+
+    std::vector<Uint8> idat = { 0x78, 0x9C };
+    zip_deflate(raw.data(), raw.size(), 6, [&idat](const Uint8* p, size_t n) {
+        idat.insert(idat.end(), p, p + n);
+        return true;
+    });
+    Uint32 a = 1, b = 0;
+    for (size_t i = 0; i < raw.size(); ) {
+        size_t end = std::min(raw.size(), i + 5552);
+        for (; i < end; i++) {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    sb3_be32(idat, b << 16 | a);
+
+    std::vector<Uint8> out = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<Uint8> ihdr;
+    sb3_be32(ihdr, (Uint32)w);
+    sb3_be32(ihdr, (Uint32)h);
+    ihdr.insert(ihdr.end(), { 8, 6, 0, 0, 0 });
+    sb3_png_chunk(out, "IHDR", ihdr);
+    sb3_png_chunk(out, "IDAT", idat);
+    sb3_png_chunk(out, "IEND", {});
+    return out;
+}
+
+static Uint32 sb3_pcm_frames(const std::vector<float>& pcm)
+{
+    return (Uint32)(pcm.size() / PCM_CHANNELS);
+}
+
+static std::vector<Uint8> sb3_encode_wav(const std::vector<float>& pcm, int freq)
+{
+    Uint32 frameBytes = PCM_CHANNELS * 2;
+    Uint32 dataBytes  = sb3_pcm_frames(pcm) * frameBytes;
+    std::vector<Uint8> out;
+    out.reserve(44 + dataBytes);
+    out.insert(out.end(), { 'R', 'I', 'F', 'F' });
+    zip_le32(out, 36 + dataBytes);
+    out.insert(out.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+    zip_le32(out, 16);
+    zip_le16(out, 1);
+    zip_le16(out, PCM_CHANNELS);
+    zip_le32(out, (Uint32)freq);
+    zip_le32(out, (Uint32)freq * frameBytes);
+    zip_le16(out, (Uint16)frameBytes);
+    zip_le16(out, 16);
+    out.insert(out.end(), { 'd', 'a', 't', 'a' });
+    zip_le32(out, dataBytes);
+    out.resize(44 + dataBytes);
+    mixer_float_to_s16(pcm.data(), (Sint16*)(out.data() + 44), (int)(dataBytes / 2));
+    return out;
+}
+
+static const char* SB3_BLANK_COSTUME =
+    "<svg version=\"1.1\" width=\"2\" height=\"2\" viewBox=\"-1 -1 2 2\" "
+    "xmlns=\"http://www.w3.org/2000/svg\"></svg>";
+static const char* SB3_BLANK_BACKDROP =
+    "<svg version=\"1.1\" width=\"480\" height=\"360\" viewBox=\"0 0 480 360\" "
+    "xmlns=\"http://www.w3.org/2000/svg\"><rect width=\"480\" height=\"360\" fill=\"#ffffff\"/></svg>";
+
+struct Sb3OutAsset {
+    std::string name;
+    const char* format = "png";
+    std::shared_ptr<const std::vector<Uint32>> pixels;
+    int         w = 0, h = 0;
+    PcmBuffer   pcm;
+    AssetBytes  source;
+    // Filled in on a worker.
+    std::vector<Uint8> file;
+    std::string        md5;
+    std::vector<Uint8> comp;
+    Uint16             method = ZIP_STORED;
+    Uint32             crc    = 0;
+};
+
+static void sb3_blank_asset(Sb3OutAsset& a, const char* svg, int w, int h)
+{
+    a.format = "svg";
+    a.w      = w;
+    a.h      = h;
+    a.file.assign(svg, svg + std::strlen(svg));
+}
+
+// Encodes, hashes and deflates one asset. PNG is already deflated inside,
+// so it only gets a fast pass; entries that do not shrink are stored.
+static void sb3_encode_asset(Sb3OutAsset& a, int freq)
+{
+    if (a.source) {
+        AssetDecoded d;
+        d.source = std::move(a.source);
+        d.sound  = std::strcmp(a.format, "wav") == 0;
+        asset_decode(d);
+        if (d.sound) {
+            a.pcm = d.pcm ? d.pcm : std::make_shared<const std::vector<float>>();
+        } else if (d.pixels) {
+            a.pixels = d.pixels;
+            a.w      = d.w;
+            a.h      = d.h;
+        } else {
+            sb3_blank_asset(a, SB3_BLANK_COSTUME, 2, 2);
+        }
+    }
+    if (a.pixels)   a.file = sb3_encode_png(*a.pixels, a.w, a.h);
+    else if (a.pcm) a.file = sb3_encode_wav(*a.pcm, freq);
+    a.md5 = sb3_md5(a.file);
+    a.crc = zip_crc32(0, a.file.data(), a.file.size());
+    zip_deflate(a.file.data(), a.file.size(), a.pixels ? 1 : 6, [&a](const Uint8* p, size_t n) {
+        a.comp.insert(a.comp.end(), p, p + n);
+        return true;
+    });
+    if (a.comp.size() < a.file.size()) {
+        a.method = ZIP_DEFLATE;
+    } else {
+        a.comp.clear();
+        a.method = ZIP_STORED;
+    }
+}
+
+// Everything the writer thread needs, copied off the UI state.
+struct Sb3Export {
+    std::string path;
+    std::string blocks;
+    std::vector<Variable>    vars;
+    std::vector<std::string> varNames;
+    bool        pen = false, music = false;
+    std::string spriteName;
+    double      x = 0, y = 0, size = 100, direction = 90;
+    bool        visible = true;
+    int         currentCostume = 0;
+    int         freq = 44100;
+    std::vector<Sb3OutAsset> assets;
+    size_t      firstSound = 0;
+};
+
+static void sb3_put_costume(std::string& j, const Sb3OutAsset& a, bool first)
+{
+    if (!first) j += ',';
+    j += "{\"name\":";
+    json_put_string(j, a.name);
+    j += ",\"bitmapResolution\":1,\"dataFormat\":";
+    json_put_string(j, a.format);
+    j += ",\"assetId\":";
+    json_put_string(j, a.md5);
+    j += ",\"md5ext\":";
+    json_put_string(j, a.md5 + "." + a.format);
+    j += ",\"rotationCenterX\":";
+    json_put_number(j, a.w / 2);
+    j += ",\"rotationCenterY\":";
+    json_put_number(j, a.h / 2);
+    j += '}';
+}
+
+static std::string sb3_project_json(const Sb3Export& x, const Sb3OutAsset& backdrop)
+{
+    std::string j = "{\"targets\":[{\"isStage\":true,\"name\":\"Stage\",\"variables\":{";
+    for (size_t i = 0; i < x.varNames.size(); i++) {
+        if (i) j += ',';
+        json_put_string(j, "v" + std::to_string(i));
+        j += ":[";
+        json_put_string(j, x.varNames[i]);
+        j += ',';
+        json_put_number(j, i < x.vars.size() ? x.vars[i].value : 0.0);
+        j += ']';
+    }
+    j += "},\"lists\":{},\"broadcasts\":{},\"blocks\":{},\"comments\":{},\"currentCostume\":0,"
+         "\"costumes\":[";
+    sb3_put_costume(j, backdrop, true);
+    j += "],\"sounds\":[],\"volume\":100,\"layerOrder\":0,\"tempo\":60,\"videoTransparency\":50,"
+         "\"videoState\":\"on\",\"textToSpeechLanguage\":null},";
+
+    j += "{\"isStage\":false,\"name\":";
+    json_put_string(j, x.spriteName);
+    j += ",\"variables\":{},\"lists\":{},\"broadcasts\":{},\"blocks\":{" + x.blocks +
+         "},\"comments\":{},\"currentCostume\":";
+    json_put_number(j, x.currentCostume);
+    j += ",\"costumes\":[";
+    for (size_t i = 0; i < x.firstSound; i++) sb3_put_costume(j, x.assets[i], i == 0);
+    j += "],\"sounds\":[";
+    for (size_t i = x.firstSound; i < x.assets.size(); i++) {
+        const Sb3OutAsset& a = x.assets[i];
+        if (i > x.firstSound) j += ',';
+        j += "{\"name\":";
+        json_put_string(j, a.name);
+        j += ",\"assetId\":";
+        json_put_string(j, a.md5);
+        j += ",\"dataFormat\":\"wav\",\"format\":\"\",\"rate\":";
+        json_put_number(j, x.freq);
+        j += ",\"sampleCount\":";
+        json_put_number(j, a.pcm ? (double)sb3_pcm_frames(*a.pcm) : 0.0);
+        j += ",\"md5ext\":";
+        json_put_string(j, a.md5 + ".wav");
+        j += '}';
+    }
+    j += "],\"volume\":100,\"layerOrder\":1,\"visible\":";
+    j += x.visible ? "true" : "false";
+    j += ",\"x\":";
+    json_put_number(j, x.x);
+    j += ",\"y\":";
+    json_put_number(j, x.y);
+    j += ",\"size\":";
+    json_put_number(j, x.size);
+    j += ",\"direction\":";
+    json_put_number(j, x.direction);
+    j += ",\"draggable\":false,\"rotationStyle\":\"all around\"}],\"monitors\":[";
+
+    bool first = true;
+    int row = 0;
+    for (size_t i = 0; i < x.vars.size(); i++) {
+        if (!x.vars[i].showOnStage) continue;
+        if (!first) j += ',';
+        first = false;
+        j += "{\"id\":";
+        json_put_string(j, "v" + std::to_string(i));
+        j += ",\"mode\":\"default\",\"opcode\":\"data_variable\",\"params\":{\"VARIABLE\":";
+        json_put_string(j, x.vars[i].name);
+        j += "},\"spriteName\":null,\"value\":";
+        json_put_number(j, x.vars[i].value);
+        j += ",\"width\":0,\"height\":0,\"x\":5,\"y\":";
+        json_put_number(j, 5 + 27 * row++);
+        j += ",\"visible\":true,\"sliderMin\":0,\"sliderMax\":100,\"isDiscrete\":true}";
+    }
+    j += "],\"extensions\":[";
+    if (x.pen)   j += "\"pen\"";
+    if (x.music) j += x.pen ? ",\"music\"" : "\"music\"";
+    j += "],\"meta\":{\"semver\":\"3.0.0\",\"vm\":\"0.2.0\",\"agent\":\"Scratch-fop\"}}";
+    return j;
+}
+
+static std::thread       g_sb3Export;
+static std::atomic<bool> g_sb3ExportOk{true};
+static std::atomic<bool> g_sb3ExportDone{false};
+static std::string       g_sb3ExportPath;
+
+// Runs on g_sb3Export. Assets encode on a worker pool; the archive is then
+// written in a fixed order (project.json, then assets as they appear in the
+// project, each file once) to path+".tmp" and renamed over path.
+static void sb3_write_export(Sb3Export x)
+{
+    Uint32 t0 = SDL_GetTicks();
+    Sb3OutAsset backdrop;
+    backdrop.name = "backdrop1";
+    sb3_blank_asset(backdrop, SB3_BLANK_BACKDROP, 480, 360);
+
+    std::vector<Sb3OutAsset*> work = { &backdrop };
+    for (auto& a : x.assets) work.push_back(&a);
+    std::atomic<size_t> next{0};
+    auto encode = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < work.size(); )
+            sb3_encode_asset(*work[i], x.freq);
+    };
+    size_t n = std::min<size_t>(work.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < n; t++) pool.emplace_back(encode);
+    encode();
+    for (auto& t : pool) t.join();
+
+    std::string json = sb3_project_json(x, backdrop);
+
+    std::string tmp = x.path + ".tmp";
+    ZipWriter w;
+    w.f = std::fopen(tmp.c_str(), "wb");
+    if (!w.f) {
+        std::cerr << "[Sb3] Cannot write '" << tmp << "'\n";
+        g_sb3ExportOk = false;
+        return;
+    }
+    zip_writer_add(w, "project.json", (const Uint8*)json.data(), json.size(), 6);
+    std::vector<std::string> written;
+    for (const Sb3OutAsset* a : work) {
+        std::string name = a->md5 + "." + a->format;
+        if (std::find(written.begin(), written.end(), name) != written.end()) continue;
+        written.push_back(name);
+        const std::vector<Uint8>& data = a->method == ZIP_DEFLATE ? a->comp : a->file;
+        zip_writer_add_raw(w, name, a->method, a->crc, (Uint32)a->file.size(), data.data(), data.size());
+    }
+    bool ok = zip_writer_finish(w) && save_sync_file(w.f);
+    ok = std::fclose(w.f) == 0 && ok;
+    if (!ok || !save_replace_file(tmp, x.path)) {
+        std::cerr << "[Sb3] Export to '" << x.path << "' failed\n";
+        std::remove(tmp.c_str());
+        g_sb3ExportOk = false;
+        return;
+    }
+    std::cerr << "[Sb3] Exported '" << x.path << "': " << written.size() << " files, "
+              << w.offset << " bytes in " << SDL_GetTicks() - t0 << " ms\n";
+    g_sb3ExportOk = true;
+}
+
+// Blocks until the running export (if any) has finished; returns whether it
+// succeeded.
+inline bool sb3_export_wait()
+{
+    if (g_sb3Export.joinable()) g_sb3Export.join();
+    return g_sb3ExportOk;
+}
+
+// Call once a frame. Returns true, once per export, when the last queued
+// export has finished; *ok says whether it succeeded and *path where to.
+inline bool sb3_export_poll(bool* ok, std::string* path)
+{
+    if (!g_sb3ExportDone) return false;
+    sb3_export_wait();
+    g_sb3ExportDone = false;
+    *ok   = g_sb3ExportOk;
+    *path = g_sb3ExportPath;
+    return true;
+}
+
+// Snapshots the project on the calling (UI) thread and hands the encoding
+// and writing to a background thread. Returns once the export is queued,
+// so true does not mean it was written: sb3_export_poll() reports that.
+inline bool save_project_sb3(const std::string& path,
+                             const std::vector<Block*>& wsBlocks,
+                             const VariablesPanel& vars,
+                             Sprite& sprite,
+                             const SoundsPanel& sounds,
+                             SDL_Renderer* r)
+{
+    zip_init();
+    Sb3Export x;
+    x.path = path;
+
+    Sb3Emit e;
+    for (const auto& v : vars.variables) e.varNames.push_back(v.name);
+    std::unordered_set<const Block*> bodies;
+    for (const Block* b : wsBlocks) {
+        if (!b) continue;
+        if (b->innerFirst) bodies.insert(b->innerFirst);
+        if (b->elseFirst)  bodies.insert(b->elseFirst);
+    }
+    for (const Block* b : wsBlocks)
+        if (b && !b->prev && !bodies.count(b)) sb3_emit_chain(e, b, "", true);
+    x.blocks   = std::move(e.out);
+    x.vars     = vars.variables;
+    x.varNames = std::move(e.varNames);
+    x.pen      = e.pen;
+    x.music    = e.music;
+
+    x.spriteName     = sprite.name;
+    x.x              = sprite.x - STAGE_WIDTH / 2.0 + sprite.w / 2.0;
+    x.y              = -(sprite.y - STAGE_HEIGHT / 2.0 + sprite.h / 2.0);
+    x.size           = sprite.scale * 100.0;
+    x.direction      = sprite.direction;
+    x.visible        = sprite.visible;
+    x.currentCostume = sprite.costumes.empty() ? 0 : sprite.currentCostume;
+    x.freq           = g_audioFreq;
+
+    for (auto& c : sprite.costumes) {
+        save_cache_costume_pixels(r, c);
+        Sb3OutAsset a;
+        a.name = c.name;
+        if (c.pixels && c.pixels->size() == (size_t)c.w * c.h && c.w > 0 && c.h > 0) {
+            a.pixels = c.pixels;
+            a.w      = c.w;
+            a.h      = c.h;
+        } else if (!c.texture && c.source) {
+            a.source = c.source;
+        } else {
+            sb3_blank_asset(a, SB3_BLANK_COSTUME, 2, 2);
+        }
+        x.assets.push_back(std::move(a));
+    }
+    if (x.assets.empty()) {
+        Sb3OutAsset a;
+        a.name = "costume1";
+        sb3_blank_asset(a, SB3_BLANK_COSTUME, 2, 2);
+        x.assets.push_back(std::move(a));
+    }
+    x.firstSound = x.assets.size();
+    for (const auto& clip : sounds.sounds) {
+        if (!clip.pcm && !clip.source) continue;
+        if (clip.pcm && clip.pcm->empty()) continue;
+        Sb3OutAsset a;
+        a.name   = clip.name;
+        a.format = "wav";
+        a.pcm    = clip.pcm;
+        if (!clip.pcm) a.source = clip.source;
+        x.assets.push_back(std::move(a));
+    }
+    if (e.skipped)
+        std::cerr << "[Sb3] " << e.skipped << " block(s) with no Scratch equivalent were left out\n";
+
+    sb3_export_wait();
+    g_sb3ExportDone = false;
+    g_sb3ExportPath = path;
+    g_sb3Export = std::thread([x = std::move(x)]() mutable {
+        sb3_write_export(std::move(x));
+        g_sb3ExportDone = true;
+    });
+    return true;
+}
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef SCRATCH_FOP_SEARCH_H
+#define SCRATCH_FOP_SEARCH_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <SDL2/SDL.h>
+#include "structs.h"
+#include "block_pool.h"
+#include "packed_script.h"
+#include "undo.h"
+
+// Inverted index over the workspace blocks, reporters included. A block is
+// entered under the words of its text, of the variable it names and of its
+// literal inputs, and under three keys:
+//   op:<text without inputs or variable, words joined by '_'>  e.g. op:move_steps
+//   var:<variable name>
+//   val:<whole literal value>
+// Keys and words are lower case. A query is words, optionally followed by
+// one key, which takes the rest of the query so names with spaces work.
+// Each is matched as a prefix, and a block must match all of them.
+//
+// The index is kept up to date incrementally. Every edit goes through
+// undo_touch(), which calls search_touch(), so only the blocks marked
+// since the last query are re-entered. search_clear() drops everything
+// and the next query rebuilds from the workspace list, as after a load.
+
+struct SearchIndex {
+    std::map<std::string, std::unordered_set<Uint32>>           words;   // by word, for prefixes
+    std::map<std::string, std::unordered_set<Uint32>>           keys;
+    std::unordered_map<Uint32, std::vector<std::string>>        entered; // by handle
+    std::vector<Uint32>        dirty;
+    std::unordered_set<Uint32> dirtySet;
+    bool   stale   = true;
+    Uint32 version = 0;      // bumped whenever the index changes
+};
+
+static SearchIndex g_search;
+
+inline std::string search_lower(const std::string& s)
+{
+    std::string out = s;
+    for (char& c : out)
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+    return out;
+}
+
+inline bool search_word_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || (unsigned char)c >= 0x80;
+}
+
+static void search_split(const std::string& s, std::vector<std::string>& out)
+{
+    size_t i = 0;
+    while (i < s.size()) {
+        while (i < s.size() && !search_word_char(s[i])) i++;
+        size_t j = i;
+        while (j < s.size() && search_word_char(s[j])) j++;
+        if (j > i) out.push_back(search_lower(s.substr(i, j - i)));
+        i = j;
+    }
+}
+
+// Where the variable name sits in a variable block's text, found the way
+// script_pack_node() finds it. False for other blocks.
+inline bool search_var_span(const Block* b, size_t& pos, size_t& len)
+{
+    if (b->type != BLOCK_VARIABLES) return false;
+    const std::string& txt = b->text;
+    size_t end;
+    switch (decode_statement(b)) {
+    case OP_SET_VAR:    pos = 4; end = txt.find(" to "); break;
+    case OP_CHANGE_VAR: pos = 7; end = txt.find(" by "); break;
+    case OP_SHOW_VAR:
+    case OP_HIDE_VAR:   pos = txt.find("variable ") + 9; end = txt.size(); break;
+    default: return false;
+    }
+    if (end == std::string::npos || end < pos) return false;
+    len = end - pos;
+    return true;
+}
+
+static void search_terms(const Block* b, std::vector<std::string>& out)
+{
+    std::string txt = b->text;
+    size_t vp, vl;
+    if (search_var_span(b, vp, vl)) {
+        std::string name = txt.substr(vp, vl);
+        out.push_back("var:" + search_lower(name));
+        search_split(name, out);
+        txt.erase(vp, vl);
+    }
+
+    std::string op;
+    size_t i = 0;
+    while (i < txt.size()) {
+        while (i < txt.size() && txt[i] == ' ') i++;
+        size_t j = txt.find(' ', i);
+        if (j == std::string::npos) j = txt.size();
+        std::string w = txt.substr(i, j - i);
+        if (!w.empty() && w != "()" && w != "<>") {
+            if (!op.empty()) op += '_';
+            op += search_lower(w);
+        }
+        i = j;
+    }
+    out.push_back("op:" + op);
+    search_split(txt, out);
+
+    for (const auto& inp : b->inputs) {
+        if (inp.embeddedBlock || inp.value.empty()) continue;
+        out.push_back("val:" + search_lower(inp.value));
+        search_split(inp.value, out);
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+inline bool search_is_key(const std::string& t)
+{
+    return t.compare(0, 3, "op:") == 0 || t.compare(0, 4, "var:") == 0 ||
+           t.compare(0, 4, "val:") == 0;
+}
+
+static void search_leave(Uint32 h)
+{
+    auto it = g_search.entered.find(h);
+    if (it == g_search.entered.end()) return;
+    for (const std::string& t : it->second) {
+        if (search_is_key(t)) {
+            auto k = g_search.keys.find(t);
+            if (k != g_search.keys.end() && (k->second.erase(h), k->second.empty()))
+                g_search.keys.erase(k);
+        } else {
+            auto w = g_search.words.find(t);
+            if (w != g_search.words.end() && (w->second.erase(h), w->second.empty()))
+                g_search.words.erase(w);
+        }
+    }
+    g_search.entered.erase(it);
+}
+
+static void search_enter(Block* b)
+{
+    Uint32 h = b->self.bits;
+    std::vector<std::string>& terms = g_search.entered[h];
+    search_terms(b, terms);
+    for (const std::string& t : terms) {
+        if (search_is_key(t)) g_search.keys[t].insert(h);
+        else                  g_search.words[t].insert(h);
+    }
+}
+
+static void search_enter_tree(Block* b)
+{
+    search_enter(b);
+    for (auto& inp : b->inputs)
+        if (inp.embeddedBlock) search_enter_tree(inp.embeddedBlock);
+}
+
+// Marks a block to be re-entered before the next query.
+void search_touch(Block* b)
+{
+    if (!b || !block_owned(g_blockPool, b)) return;
+    if (g_search.dirtySet.insert(b->self.bits).second) g_search.dirty.push_back(b->self.bits);
+}
+
+void search_clear()
+{
+    Uint32 version = g_search.version;
+    g_search = SearchIndex{};
+    g_search.version = version + 1;
+}
+
+// The block behind a handle in the index, or null if it has been freed.
+inline Block* search_block(Uint32 h)
+{
+    BlockRef r;
+    r.bits = h;
+    return block_ref_valid(r) ? block_at(g_blockPool, block_ref_slot(r)) : nullptr;
+}
+
+inline Block* search_live(Uint32 h)
+{
+    Block* b = search_block(h);
+    return b && !b->buried ? b : nullptr;
+}
+
+void search_sync(const std::vector<Block*>& blocks)
+{
+    if (g_search.stale) {
+        search_clear();
+        g_search.stale = false;
+        for (Block* b : blocks) search_enter_tree(b);
+        return;
+    }
+    if (g_search.dirty.empty()) return;
+    for (Uint32 h : g_search.dirty) {
+        search_leave(h);
+        if (Block* b = search_live(h)) search_enter(b);
+    }
+    g_search.dirty.clear();
+    g_search.dirtySet.clear();
+    g_search.version++;
+}
+
+// Blocks matching the query, top to bottom.
+void search_find(const std::string& query, std::vector<Block*>& out)
+{
+    out.clear();
+    std::vector<std::vector<Uint32>> sets;
+    std::string q = search_lower(query);
+    size_t key = std::string::npos;
+    for (const char* p : {"op:", "var:", "val:"}) key = std::min(key, q.find(p));
+
+    auto prefixed = [&](const std::map<std::string, std::unordered_set<Uint32>>& m,
+                        const std::string& w) {
+        std::vector<Uint32> s;
+        for (auto it = m.lower_bound(w); it != m.end() && it->first.compare(0, w.size(), w) == 0; ++it)
+            s.insert(s.end(), it->second.begin(), it->second.end());
+        sets.push_back(std::move(s));
+    };
+    std::vector<std::string> words;
+    search_split(q.substr(0, key), words);
+    for (const std::string& w : words) prefixed(g_search.words, w);
+    if (key != std::string::npos) {
+        std::string k = q.substr(key);
+        while (!k.empty() && k.back() == ' ') k.pop_back();
+        prefixed(g_search.keys, k);
+    }
+    if (sets.empty()) return;
+
+    for (auto& s : sets) {
+        std::sort(s.begin(), s.end());
+        s.erase(std::unique(s.begin(), s.end()), s.end());
+    }
+    std::sort(sets.begin(), sets.end(),
+              [](const std::vector<Uint32>& a, const std::vector<Uint32>& b) { return a.size() < b.size(); });
+    std::vector<Uint32> hits = sets[0], tmp;
+    for (size_t i = 1; i < sets.size() && !hits.empty(); i++) {
+        tmp.clear();
+        std::set_intersection(hits.begin(), hits.end(), sets[i].begin(), sets[i].end(),
+                              std::back_inserter(tmp));
+        hits.swap(tmp);
+    }
+    for (Uint32 h : hits)
+        if (Block* b = search_live(h)) out.push_back(b);
+    std::sort(out.begin(), out.end(), [](const Block* a, const Block* b) {
+        return a->y != b->y ? a->y < b->y : a->x < b->x;
+    });
+}
+
+// Sets every literal input whose whole value is `find` (ignoring case) to
+// `with`, as one undoable edit. Returns how many inputs changed.
+int search_replace_values(std::vector<Block*>& blocks, const std::string& find,
+                          const std::string& with)
+{
+    search_sync(blocks);
+    auto it = g_search.keys.find("val:" + search_lower(find));
+    if (it == g_search.keys.end()) return 0;
+    std::vector<Uint32> hits(it->second.begin(), it->second.end());
+    std::string lf = search_lower(find);
+    int n = 0;
+    undo_begin(blocks, UNDO_EDIT);
+    for (Uint32 h : hits) {
+        Block* b = search_live(h);
+        if (!b) continue;
+        undo_touch(b);
+        for (auto& inp : b->inputs) {
+            if (inp.embeddedBlock || search_lower(inp.value) != lf) continue;
+            inp.value = with;
+            n++;
+        }
+    }
+    undo_commit();
+    return n;
+}
+
+static bool search_rename_in(Block* b, const std::string& from, const std::string& to)
+{
+    size_t pos, len;
+    if (!search_var_span(b, pos, len) || b->text.compare(pos, len, from) != 0) return false;
+    b->text.replace(pos, len, to);
+    return true;
+}
+
+// Renames a variable in the variables list, in every block that names it
+// and in the palette. Fails if `from` does not exist or `to` is taken.
+// Block text is not part of the undo history, so this is not undoable.
+bool search_rename_variable(std::vector<Block*>& blocks, std::vector<Block*>& palette,
+                            std::vector<Variable>& vars,
+                            const std::string& from, const std::string& to)
+{
+    if (to.empty() || from == to) return false;
+    Variable* var = nullptr;
+    for (auto& v : vars) {
+        if (v.name == to) {
+            std::cerr << "[Search] A variable named '" << to << "' already exists\n";
+            return false;
+        }
+        if (v.name == from) var = &v;
+    }
+    if (!var) return false;
+    var->name = to;
+
+    search_sync(blocks);
+    auto it = g_search.keys.find("var:" + search_lower(from));
+    if (it != g_search.keys.end()) {
+        std::vector<Uint32> hits(it->second.begin(), it->second.end());
+        for (Uint32 h : hits)
+            if (Block* b = search_live(h))
+                if (search_rename_in(b, from, to)) {
+                    search_touch(b);
+                    journal_touch(b);
+                }
+    }
+    // Deleted blocks undo can bring back are not in the index.
+    for (Uint32 slot = 0; slot < g_blockPool.used; slot++) {
+        Block* b = block_at(g_blockPool, slot);
+        if (g_blockPool.alive[slot] && b->buried) search_rename_in(b, from, to);
+    }
+    for (Block* b : palette) search_rename_in(b, from, to);
+    return true;
+}
+
+#endif
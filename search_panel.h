@@ -0,0 +1,297 @@
+#ifndef SCRATCH_FOP_SEARCH_PANEL_H
+#define SCRATCH_FOP_SEARCH_PANEL_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include "structs.h"
+#include "globals.h"
+#include "utils.h"
+#include "render.h"
+#include "camera.h"
+#include "search.h"
+
+// Find panel over the top right of the code area (Ctrl+F). The first field
+// is the query (see search.h), the second what "Replace" puts into inputs
+// whose value is the query and what "Rename" renames the variable the
+// query names to. Clicking a result, or Enter in the query, centers the
+// camera on the block.
+
+static const int SEARCH_W = 300, SEARCH_ROW_H = 20, SEARCH_ROWS = 10;
+
+struct SearchPanel {
+    bool open    = false;
+    bool focused = false;
+    int  field   = 0;             // 0 query, 1 replacement
+    std::string query, replace;
+    std::string status;
+    std::vector<BlockRef> results;
+    std::string shownQuery;       // what results were found for
+    Uint32 shownVersion = 0;
+    int selected = -1;
+    int scroll   = 0;
+};
+
+static SearchPanel g_searchPanel;
+
+inline SDL_Rect search_panel_rect(const Workspace& ws)
+{
+    return {ws.x + ws.w - SEARCH_W - 10, ws.y + 10, SEARCH_W,
+            112 + SEARCH_ROWS * SEARCH_ROW_H + 6};
+}
+
+inline SDL_Rect search_field_rect(const SDL_Rect& p, int field)
+{
+    return {p.x + 8, p.y + 8 + field * 28, p.w - 16, 22};
+}
+
+inline SDL_Rect search_button_rect(const SDL_Rect& p, int i)
+{
+    int bw = (p.w - 24) / 2;
+    return {p.x + 8 + i * (bw + 8), p.y + 64, bw, 22};
+}
+
+inline bool search_panel_hit(const Workspace& ws, int mx, int my)
+{
+    if (!g_searchPanel.open) return false;
+    SDL_Rect p = search_panel_rect(ws);
+    return point_in_rect(mx, my, p.x, p.y, p.w, p.h);
+}
+
+// The block's text with its inputs filled in, as a result row.
+static std::string search_label(const Block* b)
+{
+    std::string out;
+    const std::string& t = b->text;
+    size_t k = 0;
+    for (size_t i = 0; i < t.size(); i++) {
+        bool slot = i + 1 < t.size() &&
+                    ((t[i] == '(' && t[i + 1] == ')') || (t[i] == '<' && t[i + 1] == '>'));
+        if (!slot) { out += t[i]; continue; }
+        if (k < b->inputs.size()) {
+            const BlockInput& inp = b->inputs[k++];
+            out += inp.embeddedBlock ? "(" + search_label(inp.embeddedBlock) + ")"
+                                     : "[" + inp.value + "]";
+        }
+        i++;
+    }
+    return out;
+}
+
+inline void search_panel_open()
+{
+    g_searchPanel.open    = true;
+    g_searchPanel.focused = true;
+    g_searchPanel.field   = 0;
+    SDL_StartTextInput();
+}
+
+inline void search_panel_close()
+{
+    g_searchPanel.open    = false;
+    g_searchPanel.focused = false;
+    SDL_StopTextInput();
+}
+
+// Brings the index and the results up to date; call once a frame while
+// the panel is open.
+void search_panel_refresh(std::vector<Block*>& blocks)
+{
+    SearchPanel& sp = g_searchPanel;
+    if (!sp.open) return;
+    search_sync(blocks);
+    if (sp.shownQuery == sp.query && sp.shownVersion == g_search.version) return;
+    bool sameQuery = sp.shownQuery == sp.query;
+    sp.shownQuery   = sp.query;
+    sp.shownVersion = g_search.version;
+    static std::vector<Block*> found;
+    search_find(sp.query, found);
+    sp.results.assign(found.begin(), found.end());
+    if (!sameQuery) { sp.selected = -1; sp.scroll = 0; }
+    sp.selected = std::min(sp.selected, (int)sp.results.size() - 1);
+    sp.scroll   = std::max(0, std::min(sp.scroll, (int)sp.results.size() - SEARCH_ROWS));
+}
+
+inline Block* search_result(int i)
+{
+    if (i < 0 || i >= (int)g_searchPanel.results.size()) return nullptr;
+    return search_live(g_searchPanel.results[i].bits);
+}
+
+static std::string search_strip(std::string s, const char* prefix)
+{
+    size_t n = std::strlen(prefix);
+    if (s.size() >= n && search_lower(s.substr(0, n)) == prefix) s.erase(0, n);
+    while (!s.empty() && s.front() == ' ') s.erase(s.begin());
+    while (!s.empty() && s.back() == ' ') s.pop_back();
+    return s;
+}
+
+static void search_panel_replace(std::vector<Block*>& blocks)
+{
+    SearchPanel& sp = g_searchPanel;
+    std::string find = search_strip(sp.query, "val:");
+    int n = find.empty() ? 0 : search_replace_values(blocks, find, sp.replace);
+    sp.status = "Replaced " + std::to_string(n) + (n == 1 ? " value" : " values");
+}
+
+static bool search_panel_rename(std::vector<Block*>& blocks, std::vector<Block*>& palette,
+                                std::vector<Variable>& vars)
+{
+    SearchPanel& sp = g_searchPanel;
+    std::string from = search_strip(sp.query, "var:");
+    std::string to   = search_strip(sp.replace, "");
+    if (!search_rename_variable(blocks, palette, vars, from, to)) {
+        sp.status = "No variable '" + from + "' to rename, or '" + to + "' is taken";
+        return false;
+    }
+    sp.status = "Renamed '" + from + "' to '" + to + "'";
+    sp.query  = "var:" + to;
+    return true;
+}
+
+// A click inside the panel. Returns the block to show, if a result was
+// clicked, and sets *renamed after a variable rename.
+Block* search_panel_click(int mx, int my, const Workspace& ws, std::vector<Block*>& blocks,
+                          std::vector<Block*>& palette, std::vector<Variable>& vars,
+                          bool* renamed)
+{
+    SearchPanel& sp = g_searchPanel;
+    SDL_Rect p = search_panel_rect(ws);
+    sp.focused = true;
+    SDL_StartTextInput();
+    for (int f = 0; f < 2; f++) {
+        SDL_Rect r = search_field_rect(p, f);
+        if (point_in_rect(mx, my, r.x, r.y, r.w, r.h)) { sp.field = f; return nullptr; }
+    }
+    SDL_Rect rb = search_button_rect(p, 0), nb = search_button_rect(p, 1);
+    if (point_in_rect(mx, my, rb.x, rb.y, rb.w, rb.h)) {
+        search_panel_replace(blocks);
+        return nullptr;
+    }
+    if (point_in_rect(mx, my, nb.x, nb.y, nb.w, nb.h)) {
+        *renamed = search_panel_rename(blocks, palette, vars);
+        return nullptr;
+    }
+    int row = (my - (p.y + 112)) / SEARCH_ROW_H;
+    if (my >= p.y + 112 && row < SEARCH_ROWS) {
+        int i = sp.scroll + row;
+        if (Block* b = search_result(i)) { sp.selected = i; return b; }
+    }
+    return nullptr;
+}
+
+// Keys and text while the panel has focus. Returns the block to show
+// when Enter steps to the next result.
+Block* search_panel_key(const SDL_Event& e)
+{
+    SearchPanel& sp = g_searchPanel;
+    std::string& text = sp.field == 0 ? sp.query : sp.replace;
+    if (e.type == SDL_TEXTINPUT) {
+        text += e.text.text;
+        sp.status.clear();
+        return nullptr;
+    }
+    if (e.type != SDL_KEYDOWN) return nullptr;
+    SDL_Keycode k = e.key.keysym.sym;
+    if (k == SDLK_ESCAPE || (k == SDLK_f && (e.key.keysym.mod & KMOD_CTRL))) {
+        search_panel_close();
+    } else if (k == SDLK_TAB) {
+        sp.field = 1 - sp.field;
+    } else if (k == SDLK_BACKSPACE && !text.empty()) {
+        text.pop_back();
+        sp.status.clear();
+    } else if ((k == SDLK_RETURN || k == SDLK_KP_ENTER) && sp.field == 0 && !sp.results.empty()) {
+        int n = (int)sp.results.size();
+        sp.selected = (sp.selected + 1) % n;
+        if (sp.selected < sp.scroll) sp.scroll = sp.selected;
+        if (sp.selected >= sp.scroll + SEARCH_ROWS) sp.scroll = sp.selected - SEARCH_ROWS + 1;
+        return search_result(sp.selected);
+    }
+    return nullptr;
+}
+
+inline void search_panel_scroll(int wheelY)
+{
+    SearchPanel& sp = g_searchPanel;
+    sp.scroll = std::max(0, std::min(sp.scroll - wheelY, (int)sp.results.size() - SEARCH_ROWS));
+}
+
+void search_panel_draw(SDL_Renderer* r, TTF_Font* font, const Camera& cam, const Workspace& ws)
+{
+    SearchPanel& sp = g_searchPanel;
+    if (!sp.open) return;
+
+    if (Block* b = search_result(sp.selected)) {
+        int sx, sy;
+        camera_to_screen(cam, ws, b->x, b->y, sx, sy);
+        SDL_Rect hl = {sx - 3, sy - 3, (int)(b->w * cam.zoom) + 6,
+                       (int)(block_total_height(b) * cam.zoom) + 6};
+        SDL_Rect clip = {ws.x, ws.y, ws.w, ws.h};
+        SDL_RenderSetClipRect(r, &clip);
+        SDL_SetRenderDrawColor(r, 255, 200, 0, 255);
+        SDL_RenderDrawRect(r, &hl);
+        hl = {hl.x - 1, hl.y - 1, hl.w + 2, hl.h + 2};
+        SDL_RenderDrawRect(r, &hl);
+        SDL_RenderSetClipRect(r, nullptr);
+    }
+
+    SDL_Rect p = search_panel_rect(ws);
+    SDL_SetRenderDrawColor(r, 250, 250, 255, 255);
+    SDL_RenderFillRect(r, &p);
+    SDL_SetRenderDrawColor(r, 150, 150, 200, 255);
+    SDL_RenderDrawRect(r, &p);
+
+    const char* hints[2] = {"Find: words, op:, var:, val:", "Replace with / rename to"};
+    const std::string* texts[2] = {&sp.query, &sp.replace};
+    for (int f = 0; f < 2; f++) {
+        SDL_Rect fr = search_field_rect(p, f);
+        SDL_SetRenderDrawColor(r, 255, 255, 255, 255);
+        SDL_RenderFillRect(r, &fr);
+        bool active = sp.focused && sp.field == f;
+        if (active) SDL_SetRenderDrawColor(r, 100, 100, 220, 255);
+        else        SDL_SetRenderDrawColor(r, 190, 190, 200, 255);
+        SDL_RenderDrawRect(r, &fr);
+        if (texts[f]->empty() && !active)
+            draw_text(r, font, hints[f], fr.x + 4, fr.y + 4, {160, 160, 170, 255});
+        else
+            draw_text(r, font, *texts[f] + (active ? "|" : ""), fr.x + 4, fr.y + 4, COLOR_TEXT_DARK);
+    }
+
+    const char* labels[2] = {"Replace values", "Rename variable"};
+    for (int i = 0; i < 2; i++) {
+        SDL_Rect br = search_button_rect(p, i);
+        SDL_SetRenderDrawColor(r, 100, 100, 220, 255);
+        SDL_RenderFillRect(r, &br);
+        draw_text_centered(r, font, labels[i], br, COLOR_TEXT_WHITE);
+    }
+
+    std::string status = sp.status.empty()
+        ? std::to_string(sp.results.size()) + (sp.results.size() == 1 ? " block" : " blocks")
+        : sp.status;
+    draw_text(r, font, status, p.x + 8, p.y + 92, {110, 110, 130, 255});
+
+    SDL_Rect list = {p.x + 4, p.y + 112, p.w - 8, SEARCH_ROWS * SEARCH_ROW_H};
+    SDL_RenderSetClipRect(r, &list);
+    for (int row = 0; row < SEARCH_ROWS; row++) {
+        int i = sp.scroll + row;
+        Block* b = search_result(i);
+        if (!b) continue;
+        SDL_Rect rr = {list.x, list.y + row * SEARCH_ROW_H, list.w, SEARCH_ROW_H};
+        if (i == sp.selected) {
+            SDL_SetRenderDrawColor(r, 225, 225, 250, 255);
+            SDL_RenderFillRect(r, &rr);
+        }
+        SDL_Color c = get_block_color(b->type);
+        SDL_SetRenderDrawColor(r, c.r, c.g, c.b, 255);
+        SDL_Rect sw = {rr.x + 4, rr.y + 5, 10, 10};
+        SDL_RenderFillRect(r, &sw);
+        draw_text(r, font, search_label(b), rr.x + 20, rr.y + 3, COLOR_TEXT_DARK);
+    }
+    SDL_RenderSetClipRect(r, nullptr);
+}
+
+#endif
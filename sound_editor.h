@@ -0,0 +1,371 @@
+#ifndef SCRATCH_FOP_SOUND_EDITOR_H
+#define SCRATCH_FOP_SOUND_EDITOR_H
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "structs.h"
+#include "mixer.h"
+#include "Audio.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const size_t SE_UNDO_BYTES     = 64u << 20;   // per clip
+static const int   SE_PEAK_FRAMES     = 256;
+static const int   SE_SILENCE_FRAMES  = 512;
+static const float SE_SILENCE_LEVEL   = 0.02f;
+static const float SE_SILENCE_MIN_SEC = 0.15f;
+
+enum SEOp {
+    SE_OP_TRIM = 0,
+    SE_OP_FADE_IN,
+    SE_OP_FADE_OUT,
+    SE_OP_REVERSE,
+    SE_OP_NORMALIZE,
+    SE_OP_FASTER,
+    SE_OP_SLOWER,
+    SE_OP_REMOVE_SILENCE,
+    SE_OP_UNDO,
+    SE_OP_REDO,
+    SE_OP_COUNT
+};
+
+static const char* SE_OP_LABELS[SE_OP_COUNT] = {
+    "Trim", "Fade In", "Fade Out", "Reverse", "Normalize",
+    "Faster", "Slower", "No Silence", "Undo", "Redo"
+};
+
+// out = in * (g0 + step * frame), or in / (...) to take a ramp back out.
+static void se_scale_ramp(const float* in, float* out, size_t frames,
+                          float g0, float step, bool divide)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128 g  = _mm_setr_ps(g0, g0, g0 + step, g0 + step);
+    __m128 dg = _mm_set1_ps(step * 2.0f);
+    for (; i + 2 <= frames; i += 2) {
+        __m128 v = _mm_loadu_ps(in + i * 2);
+        _mm_storeu_ps(out + i * 2, divide ? _mm_div_ps(v, g) : _mm_mul_ps(v, g));
+        g = _mm_add_ps(g, dg);
+    }
+#endif
+    for (; i < frames; i++) {
+        float gi = g0 + step * (float)i;
+        out[i * 2]     = divide ? in[i * 2]     / gi : in[i * 2]     * gi;
+        out[i * 2 + 1] = divide ? in[i * 2 + 1] / gi : in[i * 2 + 1] * gi;
+    }
+}
+
+static void se_reverse_frames(const float* in, float* out, size_t frames)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= frames; i += 2) {
+        __m128 v = _mm_loadu_ps(in + (frames - i - 2) * 2);
+        _mm_storeu_ps(out + i * 2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    }
+#endif
+    for (; i < frames; i++) {
+        out[i * 2]     = in[(frames - 1 - i) * 2];
+        out[i * 2 + 1] = in[(frames - 1 - i) * 2 + 1];
+    }
+}
+
+static void se_min_max(const float* buf, size_t n, float& mn, float& mx)
+{
+    size_t i = 0;
+    mn = 0.0f; mx = 0.0f;
+#if defined(__SSE2__)
+    __m128 vmn = _mm_setzero_ps(), vmx = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(buf + i);
+        vmn = _mm_min_ps(vmn, v);
+        vmx = _mm_max_ps(vmx, v);
+    }
+    float a[4], b[4];
+    _mm_storeu_ps(a, vmn);
+    _mm_storeu_ps(b, vmx);
+    mn = std::min(std::min(a[0], a[1]), std::min(a[2], a[3]));
+    mx = std::max(std::max(b[0], b[1]), std::max(b[2], b[3]));
+#endif
+    for (; i < n; i++) {
+        mn = std::min(mn, buf[i]);
+        mx = std::max(mx, buf[i]);
+    }
+}
+
+inline void se_build_peaks(SoundClip& clip)
+{
+    clip.peaks.clear();
+    if (!clip.pcm) return;
+    const float* d = clip.pcm->data();
+    size_t frames  = clip.pcm->size() / 2;
+    size_t blocks  = (frames + SE_PEAK_FRAMES - 1) / SE_PEAK_FRAMES;
+    clip.peaks.resize(blocks * 2);
+    for (size_t b = 0; b < blocks; b++) {
+        size_t f0 = b * SE_PEAK_FRAMES;
+        size_t n  = std::min((size_t)SE_PEAK_FRAMES, frames - f0);
+        se_min_max(d + f0 * 2, n * 2, clip.peaks[b * 2], clip.peaks[b * 2 + 1]);
+    }
+}
+
+// Copies the frames outside [a,b) around a replacement for the range.
+static PcmBuffer se_splice(const std::vector<float>& src, size_t a, size_t b,
+                           const float* mid, size_t midFrames)
+{
+    size_t frames = src.size() / 2;
+    auto out = std::make_shared<std::vector<float>>((a + midFrames + frames - b) * 2);
+    float* o = out->data();
+    if (a)         std::memcpy(o, src.data(), a * 2 * sizeof(float));
+    if (midFrames) std::memcpy(o + a * 2, mid, midFrames * 2 * sizeof(float));
+    if (frames > b)
+        std::memcpy(o + (a + midFrames) * 2, src.data() + b * 2, (frames - b) * 2 * sizeof(float));
+    return out;
+}
+
+// A copy of src with frames [a,b) rewritten by fill(in, out, frames),
+// made in one pass.
+template <class Fill>
+static PcmBuffer se_map(const std::vector<float>& src, size_t a, size_t b, Fill fill)
+{
+    auto out = std::make_shared<std::vector<float>>();
+    out->reserve(src.size());
+    out->insert(out->end(), src.begin(), src.begin() + a * 2);
+    out->resize(b * 2);
+    fill(src.data() + a * 2, out->data() + a * 2, b - a);
+    out->insert(out->end(), src.begin() + b * 2, src.end());
+    return out;
+}
+
+static std::vector<float> se_resample(const float* src, size_t frames, float rate)
+{
+    size_t outFrames = (size_t)((double)frames / rate);
+    std::vector<float> out(outFrames * 2);
+    for (size_t i = 0; i < outFrames; i++) {
+        double pos  = (double)i * rate;
+        size_t p    = (size_t)pos;
+        float  frac = (float)(pos - (double)p);
+        size_t q    = p + 1 < frames ? p + 1 : p;
+        out[i * 2]     = src[p * 2]     + (src[q * 2]     - src[p * 2])     * frac;
+        out[i * 2 + 1] = src[p * 2 + 1] + (src[q * 2 + 1] - src[p * 2 + 1]) * frac;
+    }
+    return out;
+}
+
+// Drops silent runs longer than SE_SILENCE_MIN_SEC, keeping one block of
+// padding on each side so cuts land in near-silence.
+static PcmBuffer se_remove_silence(const std::vector<float>& src, size_t a, size_t b)
+{
+    size_t blocks  = (b - a + SE_SILENCE_FRAMES - 1) / SE_SILENCE_FRAMES;
+    size_t minRun  = std::max<size_t>(3, (size_t)(SE_SILENCE_MIN_SEC * g_audioFreq / SE_SILENCE_FRAMES));
+    std::vector<char> keep(blocks, 1);
+
+    size_t runStart = 0;
+    for (size_t i = 0; i <= blocks; i++) {
+        bool silent = false;
+        if (i < blocks) {
+            size_t f0 = a + i * SE_SILENCE_FRAMES;
+            size_t n  = std::min((size_t)SE_SILENCE_FRAMES, b - f0);
+            silent = mixer_peak(src.data() + f0 * 2, (int)(n * 2)) < SE_SILENCE_LEVEL;
+        }
+        if (silent) continue;
+        if (i - runStart >= minRun)
+            for (size_t k = runStart + 1; k + 1 < i; k++) keep[k] = 0;
+        runStart = i + 1;
+    }
+
+    std::vector<float> mid;
+    mid.reserve((b - a) * 2);
+    for (size_t i = 0; i < blocks; i++) {
+        if (!keep[i]) continue;
+        size_t f0 = a + i * SE_SILENCE_FRAMES;
+        size_t n  = std::min((size_t)SE_SILENCE_FRAMES, b - f0);
+        mid.insert(mid.end(), src.begin() + f0 * 2, src.begin() + (f0 + n) * 2);
+    }
+    return se_splice(src, a, b, mid.data(), mid.size() / 2);
+}
+
+inline void se_set_pcm(SoundClip& clip, PcmBuffer pcm)
+{
+    audio_stop(clip);
+    clip.pcm = std::move(pcm);
+    clip.source.reset();
+    audio_set_pcm_info(clip);
+    se_build_peaks(clip);
+}
+
+// The fades stop one step short of silence, so undo can divide them out.
+static void se_fade_gains(const SoundEdit& e, float& g0, float& step)
+{
+    float n = (float)(e.b - e.a);
+    if (e.op == SE_OP_FADE_IN) { g0 = 1.0f / n; step = 1.0f / n;  }
+    else                       { g0 = 1.0f;     step = -1.0f / n; }
+}
+
+// Performs e on src, keeping in e what undoing it needs. Null if it would
+// change nothing.
+static PcmBuffer se_forward(const std::vector<float>& src, SoundEdit& e)
+{
+    size_t frames = src.size() / 2, a = e.a, b = e.b;
+    if (b > frames || b <= a + 1) return nullptr;
+    PcmBuffer out;
+    e.saved.clear();
+    e.newB = e.b;
+    switch (e.op) {
+        case SE_OP_TRIM:
+            e.saved.assign(src.begin(), src.begin() + a * 2);
+            e.saved.insert(e.saved.end(), src.begin() + b * 2, src.end());
+            e.newB = (Uint32)(b - a);
+            return std::make_shared<std::vector<float>>(src.begin() + a * 2, src.begin() + b * 2);
+        case SE_OP_FADE_IN:
+        case SE_OP_FADE_OUT: {
+            float g0, step;
+            se_fade_gains(e, g0, step);
+            return se_map(src, a, b, [&](const float* in, float* o, size_t n) {
+                se_scale_ramp(in, o, n, g0, step, false);
+            });
+        }
+        case SE_OP_REVERSE:
+            return se_map(src, a, b, se_reverse_frames);
+        case SE_OP_NORMALIZE:
+            return se_map(src, a, b, [&](const float* in, float* o, size_t n) {
+                se_scale_ramp(in, o, n, e.gain, 0.0f, false);
+            });
+        case SE_OP_FASTER:
+        case SE_OP_SLOWER: {
+            std::vector<float> mid = se_resample(src.data() + a * 2, b - a,
+                                                 e.op == SE_OP_FASTER ? 1.25f : 0.75f);
+            out = se_splice(src, a, b, mid.data(), mid.size() / 2);
+            break;
+        }
+        case SE_OP_REMOVE_SILENCE:
+            out = se_remove_silence(src, a, b);
+            if (out->size() == src.size()) return nullptr;
+            break;
+        default:
+            return nullptr;
+    }
+    e.saved.assign(src.begin() + a * 2, src.begin() + b * 2);
+    e.newB = (Uint32)(b + out->size() / 2 - frames);
+    return out;
+}
+
+// Takes e back out of cur and drops the samples it kept.
+static PcmBuffer se_backward(const std::vector<float>& cur, SoundEdit& e)
+{
+    size_t a = e.a, b = e.b, nb = e.newB;
+    PcmBuffer out;
+    switch (e.op) {
+        case SE_OP_TRIM: {
+            auto full = std::make_shared<std::vector<float>>();
+            full->reserve(e.saved.size() + cur.size());
+            full->insert(full->end(), e.saved.begin(), e.saved.begin() + a * 2);
+            full->insert(full->end(), cur.begin(), cur.end());
+            full->insert(full->end(), e.saved.begin() + a * 2, e.saved.end());
+            out = full;
+            break;
+        }
+        case SE_OP_FADE_IN:
+        case SE_OP_FADE_OUT: {
+            float g0, step;
+            se_fade_gains(e, g0, step);
+            out = se_map(cur, a, b, [&](const float* in, float* o, size_t n) {
+                se_scale_ramp(in, o, n, g0, step, true);
+            });
+            break;
+        }
+        case SE_OP_REVERSE:
+            out = se_map(cur, a, b, se_reverse_frames);
+            break;
+        case SE_OP_NORMALIZE:
+            out = se_map(cur, a, b, [&](const float* in, float* o, size_t n) {
+                se_scale_ramp(in, o, n, e.gain, 0.0f, true);
+            });
+            break;
+        default:
+            out = se_splice(cur, a, nb, e.saved.data(), e.saved.size() / 2);
+            break;
+    }
+    std::vector<float>().swap(e.saved);
+    return out;
+}
+
+inline size_t se_edit_bytes(const SoundEdit& e)
+{
+    return sizeof(SoundEdit) + e.saved.capacity() * sizeof(float);
+}
+
+// Keeps the newest edits that fit in SE_UNDO_BYTES, and always the last one.
+static void se_push_undo(SoundClip& clip, SoundEdit&& e)
+{
+    clip.undoBytes += se_edit_bytes(e);
+    clip.undoStack.push_back(std::move(e));
+    size_t drop = 0;
+    while (clip.undoBytes > SE_UNDO_BYTES && drop + 1 < clip.undoStack.size())
+        clip.undoBytes -= se_edit_bytes(clip.undoStack[drop++]);
+    clip.undoStack.erase(clip.undoStack.begin(), clip.undoStack.begin() + drop);
+}
+
+inline bool se_undo(SoundClip& clip)
+{
+    if (clip.undoStack.empty() || !clip.pcm) return false;
+    SoundEdit e = std::move(clip.undoStack.back());
+    clip.undoStack.pop_back();
+    clip.undoBytes -= se_edit_bytes(e);
+    PcmBuffer prev = se_backward(*clip.pcm, e);
+    clip.redoStack.push_back(std::move(e));
+    se_set_pcm(clip, std::move(prev));
+    return true;
+}
+
+inline bool se_redo(SoundClip& clip)
+{
+    if (clip.redoStack.empty() || !clip.pcm) return false;
+    SoundEdit e = std::move(clip.redoStack.back());
+    clip.redoStack.pop_back();
+    PcmBuffer next = se_forward(*clip.pcm, e);
+    if (!next) return false;
+    se_push_undo(clip, std::move(e));
+    se_set_pcm(clip, std::move(next));
+    return true;
+}
+
+// Applies op to the selected range [selStart,selEnd) given as 0..1 of the
+// clip, or to the whole clip when the selection is empty. Undo keeps the
+// op and its range, plus the samples that trim, speed changes and silence
+// removal replace; fades, reverse and normalize are undone by inverting
+// them. The buffers themselves are shared read-only with the mixer and
+// with saves, so each edit still writes a new one.
+inline bool se_apply(SoundClip& clip, SEOp op, float selStart, float selEnd)
+{
+    if (op == SE_OP_UNDO) return se_undo(clip);
+    if (op == SE_OP_REDO) return se_redo(clip);
+    if (!clip.pcm || clip.pcm->size() < 4) return false;
+
+    const std::vector<float>& src = *clip.pcm;
+    size_t frames = src.size() / 2;
+    bool   hasSel = selEnd - selStart > 0.001f;
+    if (op == SE_OP_TRIM && !hasSel) return false;
+
+    SoundEdit e;
+    e.op = op;
+    e.a  = hasSel ? (Uint32)(std::max(0.0f, selStart) * frames) : 0;
+    e.b  = hasSel ? (Uint32)(std::min(1.0f, selEnd) * frames) : (Uint32)frames;
+    if (e.b <= e.a + 1) return false;
+    if (op == SE_OP_NORMALIZE) {
+        float peak = mixer_peak(src.data() + (size_t)e.a * 2, (int)((e.b - e.a) * 2));
+        if (peak < 1e-6f) return false;
+        e.gain = MIXER_LIMIT / peak;
+    }
+
+    PcmBuffer result = se_forward(src, e);
+    if (!result) return false;
+    se_push_undo(clip, std::move(e));
+    clip.redoStack.clear();
+    se_set_pcm(clip, std::move(result));
+    return true;
+}
+
+#endif
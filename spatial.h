@@ -0,0 +1,351 @@
+#ifndef SCRATCH_FOP_SPATIAL_H
+#define SCRATCH_FOP_SPATIAL_H
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <SDL2/SDL.h>
+#include "structs.h"
+#include "globals.h"
+#include "block_pool.h"
+#include "utils.h"
+
+// Uniform grid over the workspace. Every laid-out workspace block is
+// entered in the cells its rectangle (with its input slots) covers, and
+// statement blocks also enter their top and bottom snap points and, for
+// C-blocks, the points a block dropped into each mouth snaps to. The
+// layout pass re-enters a block whenever it rebuilds its rects, so the
+// grid is current after layout_workspace().
+//
+// A query only looks at the cells around a point and then checks each
+// candidate against its live geometry, so a hit test costs the same at
+// any nesting depth and with any number of blocks. Candidates are ranked
+// by their statement block's index in the workspace list, which is the
+// order the scans over that list used.
+
+static const int SPATIAL_SHIFT = 6;   // 64 px cells
+
+enum SpatialKind : Uint8 {
+    SPATIAL_RECT, SPATIAL_TOP, SPATIAL_BOTTOM, SPATIAL_DROP_INNER, SPATIAL_DROP_ELSE
+};
+
+struct SpatialEntry {
+    Uint32 slot;
+    Uint8  kind;
+};
+
+struct SpatialRecord {
+    bool   placed = false;
+    int    order  = 0;      // index of the statement block in the workspace
+    Uint32 pass   = 0;      // layout pass that last saw it in the workspace
+    Uint32 owner  = 0;      // slot of that statement block
+    Uint32 parent = 0;      // slot of the block whose input holds a reporter
+    int    input  = 0;
+    int    depth  = 0;      // 0 for statement blocks
+    int    cx0 = 0, cy0 = 0, cx1 = -1, cy1 = -1;
+    Uint64 point[4] = {};
+    Uint8  points = 0;      // bit k set if point[k] is entered
+};
+
+struct SpatialGrid {
+    std::unordered_map<Uint64, std::vector<SpatialEntry>> cells;
+    std::vector<SpatialRecord> records;   // by g_blockPool slot
+};
+
+static SpatialGrid g_spatial;
+
+inline Uint64 spatial_key(int cx, int cy)
+{
+    return ((Uint64)(Uint32)cx << 32) | (Uint32)cy;
+}
+
+inline Uint64 spatial_point_key(int x, int y)
+{
+    return spatial_key(x >> SPATIAL_SHIFT, y >> SPATIAL_SHIFT);
+}
+
+static void spatial_insert(Uint64 key, Uint32 slot, Uint8 kind)
+{
+    g_spatial.cells[key].push_back({slot, kind});
+}
+
+static void spatial_erase(Uint64 key, Uint32 slot, Uint8 kind)
+{
+    auto it = g_spatial.cells.find(key);
+    if (it == g_spatial.cells.end()) return;
+    std::vector<SpatialEntry>& v = it->second;
+    for (size_t i = 0; i < v.size(); i++) {
+        if (v[i].slot == slot && v[i].kind == kind) {
+            v[i] = v.back();
+            v.pop_back();
+            break;
+        }
+    }
+    if (v.empty()) g_spatial.cells.erase(it);
+}
+
+static void spatial_unplace(SpatialRecord& r, Uint32 slot)
+{
+    if (!r.placed) return;
+    for (int cy = r.cy0; cy <= r.cy1; cy++)
+        for (int cx = r.cx0; cx <= r.cx1; cx++)
+            spatial_erase(spatial_key(cx, cy), slot, SPATIAL_RECT);
+    for (int k = 0; k < 4; k++)
+        if (r.points & (1 << k)) spatial_erase(r.point[k], slot, (Uint8)(SPATIAL_TOP + k));
+    r.points = 0;
+    r.placed = false;
+}
+
+static SpatialRecord& spatial_record(Uint32 slot)
+{
+    if (slot >= g_spatial.records.size()) g_spatial.records.resize(slot + 1);
+    return g_spatial.records[slot];
+}
+
+// Where a block dropped into the inner (or else) mouth of cb snaps to; the
+// same points try_snap_into_c() tests.
+inline void spatial_drop_point(Block* cb, bool inElse, int& x, int& y)
+{
+    Block* last = inElse ? cb->elseFirst : cb->innerFirst;
+    if (!last) {
+        x = cb->x + 16;
+        y = inElse ? c_else_y(cb) + 20 + 4 : c_inner_y(cb) + 4;
+        return;
+    }
+    while (last->next) last = last->next;
+    x = last->x;
+    y = last->y + block_total_height(last);
+}
+
+static void spatial_place_one(Block* b, Uint32 owner, Uint32 parent, int input, int depth)
+{
+    Uint32 slot = block_ref_slot(b->self);
+    SpatialRecord& r = spatial_record(slot);
+    spatial_unplace(r, slot);
+    r.owner  = owner;
+    r.parent = parent;
+    r.input  = input;
+    r.depth  = depth;
+
+    int x0 = b->x, y0 = b->y, x1 = b->x + b->w, y1 = b->y + b->h;
+    if (depth == 0) y1 = b->y + block_total_height(b);
+    for (auto& inp : b->inputs) {
+        if (inp.rect.w <= 0) continue;
+        x0 = std::min(x0, inp.rect.x);
+        y0 = std::min(y0, inp.rect.y);
+        x1 = std::max(x1, inp.rect.x + inp.rect.w);
+        y1 = std::max(y1, inp.rect.y + inp.rect.h);
+    }
+    r.cx0 = x0 >> SPATIAL_SHIFT; r.cy0 = y0 >> SPATIAL_SHIFT;
+    r.cx1 = x1 >> SPATIAL_SHIFT; r.cy1 = y1 >> SPATIAL_SHIFT;
+    for (int cy = r.cy0; cy <= r.cy1; cy++)
+        for (int cx = r.cx0; cx <= r.cx1; cx++)
+            spatial_insert(spatial_key(cx, cy), slot, SPATIAL_RECT);
+
+    if (depth == 0) {
+        int px[4], py[4];
+        Uint8 want = 0x3;
+        px[0] = b->x; py[0] = b->y;
+        px[1] = b->x; py[1] = b->y + block_total_height(b);
+        if (b->isCShaped) {
+            spatial_drop_point(b, false, px[2], py[2]);
+            want |= 0x4;
+            if (b->hasElse) {
+                spatial_drop_point(b, true, px[3], py[3]);
+                want |= 0x8;
+            }
+        }
+        for (int k = 0; k < 4; k++) {
+            if (!(want & (1 << k))) continue;
+            r.point[k] = spatial_point_key(px[k], py[k]);
+            spatial_insert(r.point[k], slot, (Uint8)(SPATIAL_TOP + k));
+        }
+        r.points = want;
+    }
+    r.placed = true;
+
+    for (size_t i = 0; i < b->inputs.size(); i++)
+        if (Block* e = b->inputs[i].embeddedBlock)
+            spatial_place_one(e, owner, slot, (int)i, depth + 1);
+}
+
+// Enters a statement block and the reporters in its inputs.
+void spatial_place(Block* b)
+{
+    if (!block_owned(g_blockPool, b)) return;
+    Uint32 slot = block_ref_slot(b->self);
+    spatial_place_one(b, slot, slot, 0, 0);
+}
+
+void spatial_order(Block* b, int order)
+{
+    if (!block_owned(g_blockPool, b)) return;
+    SpatialRecord& r = spatial_record(block_ref_slot(b->self));
+    r.order = order;
+    r.pass  = g_layoutPass;
+}
+
+// A reporter's entry is only trusted while its parent still holds it, and
+// a stack's while the last layout pass found its statement block in the
+// workspace list.
+static bool spatial_current(Block* b, const SpatialRecord& r)
+{
+    if (r.owner >= g_spatial.records.size() || g_spatial.records[r.owner].pass != g_layoutPass)
+        return false;
+    if (r.depth == 0) return true;
+    if (r.parent >= g_blockPool.used || !g_blockPool.alive[r.parent]) return false;
+    Block* p = block_at(g_blockPool, r.parent);
+    return r.input < (int)p->inputs.size() && p->inputs[r.input].embeddedBlock == b;
+}
+
+void spatial_clear()
+{
+    g_spatial.cells.clear();
+    g_spatial.records.clear();
+}
+
+// Calls f(block, record, kind) for live entries of the given kinds in the
+// cells covering [x0,x1] x [y0,y1].
+template <class F>
+static void spatial_visit(int x0, int y0, int x1, int y1, Uint8 kindMask, F f)
+{
+    for (int cy = y0 >> SPATIAL_SHIFT; cy <= (y1 >> SPATIAL_SHIFT); cy++) {
+        for (int cx = x0 >> SPATIAL_SHIFT; cx <= (x1 >> SPATIAL_SHIFT); cx++) {
+            auto it = g_spatial.cells.find(spatial_key(cx, cy));
+            if (it == g_spatial.cells.end()) continue;
+            for (const SpatialEntry& e : it->second) {
+                if (!(kindMask & (1 << e.kind))) continue;
+                if (e.slot >= g_blockPool.used || !g_blockPool.alive[e.slot]) continue;
+                const SpatialRecord& r = g_spatial.records[e.slot];
+                Block* b = block_at(g_blockPool, e.slot);
+                if (!r.placed || !spatial_current(b, r)) continue;
+                f(b, r, e.kind);
+            }
+        }
+    }
+}
+
+inline int spatial_rank(const SpatialRecord& r)
+{
+    return r.owner < g_spatial.records.size() ? g_spatial.records[r.owner].order : r.order;
+}
+
+inline Block* spatial_owner(const SpatialRecord& r)
+{
+    if (r.owner >= g_blockPool.used || !g_blockPool.alive[r.owner]) return nullptr;
+    return block_at(g_blockPool, r.owner);
+}
+
+// Topmost statement block under the point, at any nesting depth.
+Block* spatial_block_at(int mx, int my)
+{
+    Block* best = nullptr;
+    int bestRank = -1;
+    spatial_visit(mx, my, mx, my, 1 << SPATIAL_RECT, [&](Block* b, const SpatialRecord& r, Uint8) {
+        if (r.depth != 0 || !point_in_rect(mx, my, b->x, b->y, b->w, b->h)) return;
+        if (r.order > bestRank) { best = b; bestRank = r.order; }
+    });
+    return best;
+}
+
+// Outermost reporter under the point in the topmost stack, with the
+// block and input index holding it.
+Block* spatial_reporter_at(int mx, int my, Block** parent, int* input)
+{
+    Block* best = nullptr;
+    const SpatialRecord* bestRec = nullptr;
+    spatial_visit(mx, my, mx, my, 1 << SPATIAL_RECT, [&](Block* b, const SpatialRecord& r, Uint8) {
+        if (r.depth == 0 || !point_in_rect(mx, my, b->x, b->y, b->w, b->h)) return;
+        if (!bestRec || spatial_rank(r) > spatial_rank(*bestRec) ||
+            (spatial_rank(r) == spatial_rank(*bestRec) && r.depth < bestRec->depth)) {
+            best = b; bestRec = &r;
+        }
+    });
+    if (!best) return nullptr;
+    *parent = block_at(g_blockPool, bestRec->parent);
+    *input  = bestRec->input;
+    return best;
+}
+
+// Literal input under the point, in the topmost block that has one there.
+BlockInput* spatial_input_at(int mx, int my, Block** owner)
+{
+    BlockInput* best = nullptr;
+    const SpatialRecord* bestRec = nullptr;
+    spatial_visit(mx, my, mx, my, 1 << SPATIAL_RECT, [&](Block* b, const SpatialRecord& r, Uint8) {
+        Block* stmt = spatial_owner(r);
+        if (!stmt || stmt->isDragging) return;
+        for (auto& inp : b->inputs) {
+            if (inp.embeddedBlock || inp.rect.w <= 0) continue;
+            if (!point_in_rect(mx, my, inp.rect.x, inp.rect.y, inp.rect.w, inp.rect.h)) continue;
+            if (!bestRec || spatial_rank(r) > spatial_rank(*bestRec) ||
+                (spatial_rank(r) == spatial_rank(*bestRec) && r.depth > bestRec->depth)) {
+                best = &inp; bestRec = &r;
+                if (owner) *owner = b;
+            }
+            break;
+        }
+    });
+    return best;
+}
+
+// Input slot a dragged reporter dropped at the point would go into: in the
+// topmost stack, outer slots before the slots of reporters inside them.
+BlockInput* spatial_drop_slot(Block* dragged, int mx, int my,
+                              bool (*accepts)(const BlockInput&, Block*),
+                              Block** owner = nullptr)
+{
+    BlockInput* best = nullptr;
+    const SpatialRecord* bestRec = nullptr;
+    spatial_visit(mx, my, mx, my, 1 << SPATIAL_RECT, [&](Block* b, const SpatialRecord& r, Uint8) {
+        Block* stmt = spatial_owner(r);
+        if (!stmt || stmt == dragged || stmt->isDragging) return;
+        for (auto& inp : b->inputs) {
+            if (!point_in_rect(mx, my, inp.rect.x, inp.rect.y, inp.rect.w, inp.rect.h)) continue;
+            if (!accepts(inp, dragged)) continue;
+            if (!bestRec || spatial_rank(r) > spatial_rank(*bestRec) ||
+                (spatial_rank(r) == spatial_rank(*bestRec) && r.depth < bestRec->depth)) {
+                best = &inp; bestRec = &r;
+                if (owner) *owner = b;
+            }
+            break;
+        }
+    });
+    return best;
+}
+
+// Statement blocks whose area, with a C-block's mouths, overlaps
+// [x0,x1] x [y0,y1], in workspace order.
+void spatial_blocks_in(int x0, int y0, int x1, int y1, std::vector<Block*>& out)
+{
+    std::vector<std::pair<int, Block*>> found;
+    spatial_visit(x0, y0, x1, y1, 1 << SPATIAL_RECT, [&](Block* b, const SpatialRecord& r, Uint8) {
+        if (r.depth != 0) return;
+        if (b->x > x1 || b->x + b->w < x0 || b->y > y1 || b->y + block_total_height(b) < y0) return;
+        found.push_back({r.order, b});
+    });
+    std::sort(found.begin(), found.end(),
+              [](const std::pair<int, Block*>& a, const std::pair<int, Block*>& b) { return a.first < b.first; });
+    out.clear();
+    for (size_t i = 0; i < found.size(); i++)
+        if (i == 0 || found[i].second != found[i - 1].second) out.push_back(found[i].second);
+}
+
+struct SpatialHit {
+    int    order;
+    Uint8  kind;
+    Block* b;
+};
+
+// Statement blocks with a snap point of the given kinds within `radius` of
+// (x, y). The caller sorts them into the order it wants to try them in.
+void spatial_snap_candidates(int x, int y, int radius, Uint8 kindMask,
+                             std::vector<SpatialHit>& out)
+{
+    spatial_visit(x - radius, y - radius, x + radius, y + radius, kindMask,
+                  [&](Block* b, const SpatialRecord& r, Uint8 kind) {
+        out.push_back({r.order, kind, b});
+    });
+}
+
+#endif
@@ -5,22 +5,42 @@ using namespace std;
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <climits>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_mixer.h>
 
 enum BlockType {
     BLOCK_EVENT, BLOCK_MOTION, BLOCK_LOOKS, BLOCK_CONTROL,
     BLOCK_SOUND, BLOCK_SENSING, BLOCK_OPERATORS, BLOCK_VARIABLES, BLOCK_MYBLOCKS,
-    BLOCK_EXTENSION
+    BLOCK_EXTENSION, BLOCK_MUSIC
 };
 
 enum CategoryType {
     CAT_MOTION, CAT_LOOKS, CAT_SOUND, CAT_EVENTS, CAT_CONTROL,
-    CAT_SENSING, CAT_OPERATORS, CAT_VARIABLES, CAT_MYBLOCKS, CAT_EXTENSION
+    CAT_SENSING, CAT_OPERATORS, CAT_VARIABLES, CAT_MYBLOCKS, CAT_EXTENSION,
+    CAT_MUSIC
 };
 
 struct Block;
 
+// Links between blocks are 32-bit handles into the block pools rather than
+// pointers: the slot, which pool, and the slot's generation when the handle
+// was taken. A handle converts to and from Block*, so links still read like
+// pointers. Resolving one is defined in block_pool.h; debug builds check the
+// generation there and report handles to freed blocks.
+struct BlockRef {
+    Uint32 bits = 0;   // 0 is the null handle
+
+    BlockRef() = default;
+    BlockRef(std::nullptr_t) {}
+    BlockRef(const Block* b);
+
+    Block* get() const;
+    operator Block*() const { return get(); }
+    Block* operator->() const { return get(); }
+};
+
 enum SlotType { SLOT_NUMERIC, SLOT_BOOLEAN };
 
 struct BlockInput {
@@ -29,7 +49,7 @@ struct BlockInput {
     SDL_Rect rect = {0, 0, 0, 0};
     int index = 0;
     SlotType slotType = SLOT_NUMERIC;
-    Block* embeddedBlock = nullptr;
+    BlockRef embeddedBlock;
 };
 
 struct Block {
@@ -39,19 +59,32 @@ struct Block {
     int x, y, w, h;
     bool isDragging;
     int dragOffsetX, dragOffsetY;
-    Block* next;
-    Block* prev;
+    BlockRef next;
+    BlockRef prev;
     std::vector<BlockInput> inputs;
 
-    bool   isCShaped    = false;
-    Block* innerFirst   = nullptr;
-    Block* innerLast    = nullptr;
-    int    innerH       = 36;
-    Block* elseFirst    = nullptr;
-    int    elseH        = 36;
-    bool   hasElse      = false;
+    bool     isCShaped    = false;
+    BlockRef innerFirst;
+    BlockRef innerLast;
+    int      innerH       = 36;
+    BlockRef elseFirst;
+    int      elseH        = 36;
+    bool     hasElse      = false;
+    bool     hatFired     = false;
+    BlockRef self;                  // this block's own handle
+    bool     buried       = false;  // deleted, kept only for undo (undo.h)
+
+    // Cached by the layout pass in utils.h.
+    bool     layoutDirty  = true;
+    Uint32   layoutEpoch  = 0;
+    Uint32   layoutPass   = 0;
+    int      contentW     = 0;
+    int      layoutX      = INT_MIN;
+    int      layoutY      = INT_MIN;
 };
 
+inline BlockRef::BlockRef(const Block* b) : bits(b ? b->self.bits : 0) {}
+
 struct Stage {
     int x, y, w, h;
     SDL_Color color;
@@ -59,10 +92,18 @@ struct Stage {
     std::string  bgName    = "";
 };
 
+// Encoded asset file (PNG, WAV, ...) kept until the decoded form is needed.
+typedef std::shared_ptr<const std::vector<Uint8>> AssetBytes;
+
 struct Costume {
     std::string  name;
     SDL_Texture* texture = nullptr;
     int w = 48, h = 48;
+    std::shared_ptr<const std::vector<Uint32>> pixels;
+    SDL_Texture* pixelsTex = nullptr;
+    Uint64       hash      = 0;
+    AssetBytes   source;
+    Uint32       lastUse   = 0;
 };
 
 struct Sprite {
@@ -83,6 +124,8 @@ struct Sprite {
     int       penSize   = 2;
     float     lastPenX  = -9999;
     float     lastPenY  = -9999;
+
+    int       instrument = 1;
 };
 
 struct Workspace { int x, y, w, h; };
@@ -130,15 +173,45 @@ struct BlockToken {
     int    x, w;
 };
 
+// Interleaved float samples; mono sources are widened to two channels as
+// they are decoded.
+typedef std::shared_ptr<const std::vector<float>> PcmBuffer;
+static const int PCM_CHANNELS = 2;
+
+struct SoundHandle {
+    int    channel = -1;
+    Uint32 gen     = 0;
+};
+
+// A sound editor edit as undo keeps it: the op, the frames it covered and
+// only the samples it cannot recompute (sound_editor.h).
+struct SoundEdit {
+    int    op    = 0;
+    Uint32 a     = 0, b = 0;   // edited frames [a,b) before the edit
+    Uint32 newB  = 0;          // end of the edited frames after it
+    float  gain  = 1.0f;       // normalize
+    std::vector<float> saved;
+};
+
 struct SoundClip {
     std::string name;
     std::string filePath;
-    Mix_Chunk*  chunk       = nullptr;
+    PcmBuffer   pcm;
+    std::vector<float>     peaks;
+    std::vector<SoundEdit> undoStack;
+    std::vector<SoundEdit> redoStack;
+    size_t      undoBytes   = 0;
     float       durationSecs = 0.0f;
+    Uint32      frames      = 0;
     int         channel     = -1;
+    Uint32      channelGen  = 0;
+    Uint64      startFrame  = 0;
     bool        isPlaying   = false;
     float       volume      = 100.0f;
     float       pitch       = 1.0f;
+    float       pan         = 0.0f;
+    AssetBytes  source;
+    Uint32      lastUse     = 0;
 };
 
 struct SoundsPanel {
@@ -148,6 +221,11 @@ struct SoundsPanel {
     int  selectedIndex = -1;
     std::vector<SoundClip> sounds;
 
+    float       selStart    = 0.0f;
+    float       selEnd      = 0.0f;
+    float       selAnchor   = 0.0f;
+    bool        selDragging = false;
+
     bool        uploadDialogOpen = false;
     std::string uploadPathInput;
     bool        uploadEditing    = false;
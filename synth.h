@@ -0,0 +1,370 @@
+#ifndef SCRATCH_FOP_SYNTH_H
+#define SCRATCH_FOP_SYNTH_H
+#include <SDL2/SDL.h>
+#include <atomic>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "mixer.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Music extension voices. Tables and drum samples are synthesized once at
+// startup; notes are queued with an absolute start frame and triggered
+// inside the mixer callback at that exact frame. Each event carries the
+// owner that queued it (a script run), so one run's notes can be released
+// without touching the others.
+
+const int   SYNTH_TABLE       = 2048;
+const int   SYNTH_INSTRUMENTS = 10;
+const int   SYNTH_DRUMS       = 9;
+const int   SYNTH_MAX_VOICES  = 32;
+const int   SYNTH_MAX_PENDING = 256;
+const int   SYNTH_EVENT_RING  = 256;
+const float SYNTH_NOTE_GAIN   = 0.3f;
+
+struct SynthInstrument {
+    const char* name;
+    float harmonics[10];
+    float attack, decay, sustain, release;
+};
+
+static const SynthInstrument SYNTH_INSTRUMENT_DEFS[SYNTH_INSTRUMENTS] = {
+    {"Piano",      {1, .5f, .3f, .2f, .1f, .05f},              .005f, .9f,  0.0f, .3f },
+    {"Organ",      {1, .8f, 0, .5f, 0, .3f, 0, .2f},           .01f,  .05f, .9f,  .08f},
+    {"Guitar",     {1, .7f, .45f, .3f, .2f, .12f, .08f},        .002f, .8f,  0.0f, .2f },
+    {"Bass",       {1, .6f, .2f, .1f},                          .005f, .4f,  .3f,  .1f },
+    {"Flute",      {1, .1f, .05f},                              .06f,  .1f,  .8f,  .1f },
+    {"Clarinet",   {1, 0, .5f, 0, .3f, 0, .15f},                .03f,  .1f,  .8f,  .08f},
+    {"Synth Lead", {1, .5f, .33f, .25f, .2f, .17f, .14f, .12f, .11f, .1f}, .005f, .1f, .7f, .1f},
+    {"Synth Pad",  {1, .5f, .33f, .25f, .2f, .17f},             .4f,   .3f,  .7f,  .8f },
+    {"Music Box",  {1, 0, 0, .4f, 0, 0, 0, .2f},                .001f, 1.0f, 0.0f, .3f },
+    {"Marimba",    {1, 0, 0, .3f, 0, 0, 0, 0, 0, .1f},          .001f, .35f, 0.0f, .1f },
+};
+
+enum SynthEventType { SYNTH_EV_NOTE, SYNTH_EV_DRUM, SYNTH_EV_STOP_ALL, SYNTH_EV_RELEASE };
+
+struct SynthEvent {
+    SynthEventType type   = SYNTH_EV_NOTE;
+    Uint64         start  = 0;
+    Uint32         length = 0;
+    int            key    = 60;
+    int            instrument = 0;
+    Uint32         owner  = 0;
+};
+
+enum SynthEnvStage { SYNTH_ENV_ATTACK, SYNTH_ENV_DECAY, SYNTH_ENV_SUSTAIN, SYNTH_ENV_RELEASE };
+
+struct SynthVoice {
+    bool          active  = false;
+    Uint32        owner   = 0;
+    bool          drum    = false;
+    int           delay   = 0;
+    Uint32        hold    = 0;
+    const float*  table   = nullptr;
+    float         phase   = 0.0f;
+    float         inc     = 0.0f;
+    const float*  pcm     = nullptr;
+    Uint32        pos     = 0;
+    Uint32        len     = 0;
+    SynthEnvStage stage   = SYNTH_ENV_ATTACK;
+    float         level   = 0.0f;
+    float         atkStep = 0.0f;
+    float         decStep = 0.0f;
+    float         relStep = 0.0f;
+    float         sustain = 0.0f;
+    float         release = 0.0f;
+};
+
+static float              g_synthTables[SYNTH_INSTRUMENTS][SYNTH_TABLE + 1];
+static std::vector<float> g_synthDrums[SYNTH_DRUMS];
+static SynthVoice         g_synthVoices[SYNTH_MAX_VOICES];
+static SynthEvent         g_synthPending[SYNTH_MAX_PENDING];
+static int                g_synthPendingCount = 0;
+
+static SynthEvent          g_synthEvents[SYNTH_EVENT_RING];
+static std::atomic<Uint32> g_synthEvHead{0};
+static std::atomic<Uint32> g_synthEvTail{0};
+static Uint32              g_synthOwners = 0;
+
+static float g_musicTempo = 60.0f;
+
+static void synth_build_table(float* t, const float* harmonics)
+{
+    float peak = 0.0f;
+    for (int i = 0; i < SYNTH_TABLE; i++) {
+        double ph = 2.0 * M_PI * i / SYNTH_TABLE;
+        float v = 0.0f;
+        for (int h = 0; h < 10; h++)
+            if (harmonics[h] != 0.0f) v += harmonics[h] * (float)std::sin(ph * (h + 1));
+        t[i] = v;
+        peak = std::max(peak, std::fabs(v));
+    }
+    if (peak > 0.0f)
+        for (int i = 0; i < SYNTH_TABLE; i++) t[i] /= peak;
+    t[SYNTH_TABLE] = t[0];
+}
+
+static void synth_build_drums()
+{
+    float sr = (float)g_audioFreq;
+    Uint32 seed = 22222;
+    auto noise = [&]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (float)(seed >> 8) / 8388608.0f - 1.0f;
+    };
+    auto make = [&](int idx, float secs, auto fn) {
+        std::vector<float>& d = g_synthDrums[idx];
+        d.resize((size_t)(secs * sr));
+        float prev = 0.0f;
+        for (size_t i = 0; i < d.size(); i++) {
+            float t = (float)i / sr;
+            float n = noise();
+            float hp = n - prev;
+            prev = n;
+            d[i] = fn(t, n, hp) * 0.8f;
+        }
+    };
+
+    make(0, 0.3f, [](float t, float n, float) {
+        return n * std::exp(-t / 0.08f) * 0.6f +
+               std::sin(2.0f * (float)M_PI * 180.0f * t) * std::exp(-t / 0.05f) * 0.5f;
+    });
+    float kickPhase = 0.0f;
+    make(1, 0.5f, [&](float t, float, float) {
+        float f = 45.0f + 75.0f * std::exp(-t / 0.04f);
+        kickPhase += 2.0f * (float)M_PI * f / sr;
+        return std::sin(kickPhase) * std::exp(-t / 0.15f);
+    });
+    make(2, 0.1f, [](float t, float n, float) {
+        return std::sin(2.0f * (float)M_PI * 800.0f * t) * std::exp(-t / 0.01f) +
+               n * std::exp(-t / 0.005f) * 0.5f;
+    });
+    make(3, 1.5f, [](float t, float, float hp) { return hp * 0.5f * std::exp(-t / 0.5f); });
+    make(4, 0.6f, [](float t, float, float hp) { return hp * 0.5f * std::exp(-t / 0.2f); });
+    make(5, 0.15f, [](float t, float, float hp) { return hp * 0.5f * std::exp(-t / 0.03f); });
+    make(6, 0.3f, [](float t, float, float hp) {
+        return hp * 0.5f * std::exp(-t / 0.12f) *
+               (0.6f + 0.4f * std::sin(2.0f * (float)M_PI * 25.0f * t));
+    });
+    make(7, 0.3f, [](float t, float n, float) {
+        float burst = std::exp(-std::fmod(t, 0.011f) / 0.003f) * (t < 0.033f ? 1.0f : 0.0f);
+        return n * (burst + std::exp(-t / 0.08f) * 0.5f);
+    });
+    make(8, 0.4f, [](float t, float, float) {
+        float a = std::sin(2.0f * (float)M_PI * 560.0f * t) > 0 ? 1.0f : -1.0f;
+        float b = std::sin(2.0f * (float)M_PI * 845.0f * t) > 0 ? 1.0f : -1.0f;
+        return (a + b) * 0.25f * std::exp(-t / 0.1f);
+    });
+}
+
+inline Uint32 synth_beats_to_frames(float beats)
+{
+    if (beats < 0.0f) beats = 0.0f;
+    return (Uint32)(beats * 60.0f / g_musicTempo * (float)g_audioFreq);
+}
+
+static int synth_alloc_voice()
+{
+    int best = 0;
+    float bestScore = 1e9f;
+    for (int i = 0; i < SYNTH_MAX_VOICES; i++) {
+        SynthVoice& v = g_synthVoices[i];
+        if (!v.active) return i;
+        float score = v.level + (v.stage == SYNTH_ENV_RELEASE ? 0.0f : 1.0f);
+        if (score < bestScore) { bestScore = score; best = i; }
+    }
+    return best;
+}
+
+static void synth_trigger(const SynthEvent& e, int delay)
+{
+    SynthVoice& v = g_synthVoices[synth_alloc_voice()];
+    v = SynthVoice{};
+    v.active = true;
+    v.owner  = e.owner;
+    v.delay  = delay;
+    float sr = (float)g_audioFreq;
+
+    if (e.type == SYNTH_EV_DRUM) {
+        const std::vector<float>& d = g_synthDrums[e.key];
+        v.drum = true;
+        v.pcm  = d.data();
+        v.len  = (Uint32)d.size();
+        return;
+    }
+
+    const SynthInstrument& ins = SYNTH_INSTRUMENT_DEFS[e.instrument];
+    float freq = 440.0f * std::pow(2.0f, (e.key - 69) / 12.0f);
+    v.table   = g_synthTables[e.instrument];
+    v.inc     = freq * SYNTH_TABLE / sr;
+    v.hold    = std::max<Uint32>(1, e.length);
+    v.atkStep = 1.0f / std::max(1.0f, ins.attack * sr);
+    v.decStep = (1.0f - ins.sustain) / std::max(1.0f, ins.decay * sr);
+    v.sustain = ins.sustain;
+    v.release = ins.release;
+}
+
+static void synth_release(SynthVoice& v)
+{
+    v.stage   = SYNTH_ENV_RELEASE;
+    v.relStep = v.level / std::max(1.0f, v.release * (float)g_audioFreq);
+}
+
+static void synth_render_voice(SynthVoice& v, float* bus, int frames)
+{
+    for (int i = v.delay; i < frames; i++) {
+        float s;
+        if (v.drum) {
+            if (v.pos >= v.len) { v.active = false; break; }
+            s = v.pcm[v.pos++];
+        } else {
+            if (v.hold > 0 && --v.hold == 0 && v.stage != SYNTH_ENV_RELEASE)
+                synth_release(v);
+            switch (v.stage) {
+                case SYNTH_ENV_ATTACK:
+                    v.level += v.atkStep;
+                    if (v.level >= 1.0f) { v.level = 1.0f; v.stage = SYNTH_ENV_DECAY; }
+                    break;
+                case SYNTH_ENV_DECAY:
+                    v.level -= v.decStep;
+                    if (v.level <= v.sustain) { v.level = v.sustain; v.stage = SYNTH_ENV_SUSTAIN; }
+                    break;
+                case SYNTH_ENV_SUSTAIN:
+                    break;
+                case SYNTH_ENV_RELEASE:
+                    v.level -= v.relStep;
+                    break;
+            }
+            if (v.level <= 0.0f && v.stage != SYNTH_ENV_ATTACK) { v.active = false; break; }
+
+            int   idx  = (int)v.phase;
+            float frac = v.phase - (float)idx;
+            s = (v.table[idx] + (v.table[idx + 1] - v.table[idx]) * frac) * v.level * SYNTH_NOTE_GAIN;
+            v.phase += v.inc;
+            if (v.phase >= SYNTH_TABLE) v.phase -= SYNTH_TABLE;
+        }
+        bus[i * 2]     += s;
+        bus[i * 2 + 1] += s;
+    }
+    v.delay = 0;
+}
+
+static void synth_render(float* bus, int frames, Uint64 startFrame)
+{
+    Uint32 tail = g_synthEvTail.load(std::memory_order_relaxed);
+    Uint32 head = g_synthEvHead.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+        const SynthEvent& e = g_synthEvents[tail % SYNTH_EVENT_RING];
+        if (e.type == SYNTH_EV_STOP_ALL) {
+            g_synthPendingCount = 0;
+            for (auto& v : g_synthVoices) v.active = false;
+        } else if (e.type == SYNTH_EV_RELEASE) {
+            for (int i = 0; i < g_synthPendingCount; ) {
+                if (g_synthPending[i].owner == e.owner)
+                    g_synthPending[i] = g_synthPending[--g_synthPendingCount];
+                else
+                    i++;
+            }
+            for (auto& v : g_synthVoices)
+                if (v.active && v.owner == e.owner && !v.drum && v.stage != SYNTH_ENV_RELEASE)
+                    synth_release(v);
+        } else if (g_synthPendingCount < SYNTH_MAX_PENDING) {
+            g_synthPending[g_synthPendingCount++] = e;
+        }
+    }
+    g_synthEvTail.store(tail, std::memory_order_release);
+
+    Uint64 endFrame = startFrame + (Uint64)frames;
+    for (int i = 0; i < g_synthPendingCount; ) {
+        const SynthEvent& e = g_synthPending[i];
+        if (e.start >= endFrame) { i++; continue; }
+        synth_trigger(e, e.start > startFrame ? (int)(e.start - startFrame) : 0);
+        g_synthPending[i] = g_synthPending[--g_synthPendingCount];
+    }
+
+    for (auto& v : g_synthVoices)
+        if (v.active) synth_render_voice(v, bus, frames);
+}
+
+inline void synth_init()
+{
+    for (int i = 0; i < SYNTH_INSTRUMENTS; i++)
+        synth_build_table(g_synthTables[i], SYNTH_INSTRUMENT_DEFS[i].harmonics);
+    synth_build_drums();
+    g_mixerBusHook = synth_render;
+}
+
+inline bool synth_push(const SynthEvent& e)
+{
+    Uint32 head = g_synthEvHead.load(std::memory_order_relaxed);
+    Uint32 tail = g_synthEvTail.load(std::memory_order_acquire);
+    if (head - tail >= (Uint32)SYNTH_EVENT_RING) {
+        std::cerr << "[Synth] Event queue full\n";
+        return false;
+    }
+    g_synthEvents[head % SYNTH_EVENT_RING] = e;
+    g_synthEvHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// Earliest frame a new event can still be placed at without landing in a
+// block the callback may already be mixing.
+inline Uint64 synth_schedule_floor()
+{
+    return audio_clock_frames() + (Uint64)g_audioBlockFrames.load(std::memory_order_relaxed);
+}
+
+inline void synth_note(int key, Uint64 start, Uint32 length, int instrument, Uint32 owner = 0)
+{
+    if (!g_mixerOpen) return;
+    SynthEvent e;
+    e.type       = SYNTH_EV_NOTE;
+    e.owner      = owner;
+    e.start      = start;
+    e.length     = length;
+    e.key        = std::max(0, std::min(130, key));
+    e.instrument = ((instrument - 1) % SYNTH_INSTRUMENTS + SYNTH_INSTRUMENTS) % SYNTH_INSTRUMENTS;
+    synth_push(e);
+}
+
+inline void synth_drum(int drum, Uint64 start, Uint32 owner = 0)
+{
+    if (!g_mixerOpen) return;
+    SynthEvent e;
+    e.type  = SYNTH_EV_DRUM;
+    e.owner = owner;
+    e.start = start;
+    e.key   = ((drum - 1) % SYNTH_DRUMS + SYNTH_DRUMS) % SYNTH_DRUMS;
+    synth_push(e);
+}
+
+inline void synth_stop_all()
+{
+    if (!g_mixerOpen) return;
+    SynthEvent e;
+    e.type = SYNTH_EV_STOP_ALL;
+    synth_push(e);
+}
+
+// A new owner tag for synth_note()/synth_drum(); never 0.
+inline Uint32 synth_new_owner()
+{
+    if (++g_synthOwners == 0) ++g_synthOwners;
+    return g_synthOwners;
+}
+
+// Drops the owner's notes that have not started yet and lets the ones
+// sounding fade out over their release. Drums already playing finish.
+inline void synth_release_owner(Uint32 owner)
+{
+    if (!g_mixerOpen || !owner) return;
+    SynthEvent e;
+    e.type  = SYNTH_EV_RELEASE;
+    e.owner = owner;
+    synth_push(e);
+}
+
+#endif
@@ -11,6 +11,12 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
+#include <charconv>
+#include <climits>
+#include <cstdlib>
 #include <fstream>
 #include <sstream>
 #include <cmath>
@@ -158,20 +164,26 @@ inline bool tab_bar_click(int mx, int my, ActiveTab& active)
 inline std::string escape_str(const std::string& s) {
 
     std::string out;
+    out.reserve(s.size());
     for (char c : s) {
         if (c == '|')  out += "\\pipe";
         else if (c == '\n') out += "\\n";
+        else if (c == '\r') out += "\\r";
+        else if (c == '\\') out += "\\\\";
         else out += c;
     }
     return out;
 }
 
-inline std::string unescape_str(const std::string& s) {
+inline std::string unescape_str(std::string_view s) {
     std::string out;
+    out.reserve(s.size());
     for (size_t i = 0; i < s.size(); i++) {
         if (s[i] == '\\' && i+1 < s.size()) {
             if (s.substr(i+1, 4) == "pipe") { out += '|'; i += 4; }
             else if (s[i+1] == 'n') { out += '\n'; i += 1; }
+            else if (s[i+1] == 'r') { out += '\r'; i += 1; }
+            else if (s[i+1] == '\\') { out += '\\'; i += 1; }
             else out += s[i];
         } else {
             out += s[i];
@@ -220,53 +232,70 @@ inline bool save_project(const std::string& path,
     return true;
 }
 
-inline bool load_project(const std::string& path,
-                          std::vector<Block*>& wsBlocks,
-                          VariablesPanel& vars,
-                          int& nextId)
+inline bool parse_int_field(std::string_view s, int& out)
 {
-    std::ifstream f(path);
-    if (!f.is_open()) return false;
-
+    auto res = std::from_chars(s.data(), s.data() + s.size(), out);
+    return res.ec == std::errc() && res.ptr == s.data() + s.size();
+}
 
-    for (auto* b : wsBlocks) delete b;
+// Reads the text format from any stream. Lines that do not parse (bad
+// numbers, unknown block types, duplicate ids) are skipped and counted in
+// `skipped` rather than aborting the load, and prev links are only accepted
+// when they keep every stack a simple chain.
+inline bool load_project_stream(std::istream& f,
+                                std::vector<Block*>& wsBlocks,
+                                VariablesPanel& vars,
+                                int& nextId,
+                                int* skipped = nullptr)
+{
+    for (auto* b : wsBlocks) block_free_reporters(b);
     wsBlocks.clear();
 
-    std::map<int, Block*> idMap;
-    std::map<int, int>    prevMap;
-
-    auto split_line = [](const std::string& line, char delim)
-        -> std::vector<std::string>
-    {
-        std::vector<std::string> parts;
-        std::stringstream ss(line);
-        std::string part;
-        while (std::getline(ss, part, delim))
-            parts.push_back(part);
-        return parts;
+    std::unordered_map<int, Block*> idMap;
+    std::vector<int> prevIds;
+    std::unordered_map<std::string, size_t> varIndex;
+    for (size_t i = 0; i < vars.variables.size(); i++)
+        varIndex.emplace(vars.variables[i].name, i);
+    int bad = 0;
+
+    std::vector<std::string_view> parts;
+    auto split_line = [&parts](std::string_view line, char delim) {
+        parts.clear();
+        size_t start = 0;
+        for (;;) {
+            size_t end = line.find(delim, start);
+            if (end == std::string_view::npos) {
+                parts.push_back(line.substr(start));
+                return;
+            }
+            parts.push_back(line.substr(start, end - start));
+            start = end + 1;
+        }
     };
 
     std::string line;
     while (std::getline(f, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
         if (line.empty() || line[0] == '#') continue;
 
-        auto parts = split_line(line, '|');
-        if (parts.empty()) continue;
-
-        const std::string& token = parts[0];
+        split_line(line, '|');
+        std::string_view token = parts[0];
 
         if (token == "BLOCK" && parts.size() >= 7) {
-            int  id      = std::stoi(parts[1]);
-            int  typeInt = std::stoi(parts[2]);
-            int  bx      = std::stoi(parts[3]);
-            int  by      = std::stoi(parts[4]);
-            int  prevId  = std::stoi(parts[5]);
-            std::string text = unescape_str(parts[6]);
-
-            Block* b = new Block();
+            int id, typeInt, bx, by, prevId;
+            if (!parse_int_field(parts[1], id) || !parse_int_field(parts[2], typeInt) ||
+                !parse_int_field(parts[3], bx) || !parse_int_field(parts[4], by) ||
+                !parse_int_field(parts[5], prevId) ||
+                typeInt < BLOCK_EVENT || typeInt > BLOCK_MUSIC || id < 0 || id == INT_MAX ||
+                idMap.count(id)) {
+                bad++;
+                continue;
+            }
+
+            Block* b = block_alloc();
             b->id           = id;
             b->type         = (BlockType)typeInt;
-            b->text         = text;
+            b->text         = unescape_str(parts[6]);
             b->x            = bx;
             b->y            = by;
             b->w            = BLOCK_W;
@@ -276,74 +305,95 @@ inline bool load_project(const std::string& path,
             b->dragOffsetY  = 0;
             b->next         = nullptr;
             b->prev         = nullptr;
+            init_block_inputs(b);
 
-
-            b->inputs.clear();
-            int idx = 0;
-            for (size_t i = 0; i + 1 < text.size(); i++) {
-                if (text[i] == '(' && text[i+1] == ')') {
-                    BlockInput inp;
-                    inp.value   = "10";
-                    inp.editing = false;
-                    inp.index   = idx++;
-                    b->inputs.push_back(inp);
-                    ++i;
-                }
-            }
-
-            idMap[id]   = b;
-            prevMap[id] = prevId;
+            idMap[id] = b;
+            prevIds.push_back(prevId);
             wsBlocks.push_back(b);
 
             if (id >= nextId) nextId = id + 1;
         }
         else if (token == "INPUT" && parts.size() >= 4) {
-            int blockId  = std::stoi(parts[1]);
-            int inputIdx = std::stoi(parts[2]);
-            std::string val = unescape_str(parts[3]);
+            int blockId, inputIdx;
+            if (!parse_int_field(parts[1], blockId) || !parse_int_field(parts[2], inputIdx)) {
+                bad++;
+                continue;
+            }
 
             auto it = idMap.find(blockId);
             if (it != idMap.end()) {
                 Block* b = it->second;
                 if (inputIdx >= 0 && inputIdx < (int)b->inputs.size())
-                    b->inputs[inputIdx].value = val;
+                    b->inputs[inputIdx].value = unescape_str(parts[3]);
             }
         }
         else if (token == "VAR" && parts.size() >= 4) {
-            std::string name = unescape_str(parts[1]);
-            float val        = std::stof(parts[2]);
-            int   show       = std::stoi(parts[3]);
-
-            bool found = false;
-            for (auto& v : vars.variables) {
-                if (v.name == name) {
-                    v.value       = val;
-                    v.showOnStage = (show != 0);
-                    found = true;
-                    break;
-                }
+            int show;
+            std::string num(parts[2]);
+            char* end = nullptr;
+            float val = std::strtof(num.c_str(), &end);
+            if (num.empty() || *end || !parse_int_field(parts[3], show)) {
+                bad++;
+                continue;
             }
-            if (!found)
+
+            std::string name = unescape_str(parts[1]);
+            auto it = varIndex.find(name);
+            if (it != varIndex.end()) {
+                vars.variables[it->second].value       = val;
+                vars.variables[it->second].showOnStage = (show != 0);
+            } else {
+                varIndex.emplace(name, vars.variables.size());
                 vars.variables.push_back({ name, val, (show != 0) });
+            }
         }
     }
 
-    for (auto& kv : idMap) {
-        int    id  = kv.first;
-        Block* b   = kv.second;
-        int    pid = prevMap[id];
-
-        if (pid >= 0) {
-            auto pit = idMap.find(pid);
-            if (pit != idMap.end()) {
-                b->prev            = pit->second;
-                pit->second->next  = b;
-            }
+    // A block keeps its prev only if that block has no next yet; the first
+    // line in file order wins.
+    for (size_t i = 0; i < wsBlocks.size(); i++) {
+        Block* b = wsBlocks[i];
+        if (prevIds[i] < 0) continue;
+        auto pit = idMap.find(prevIds[i]);
+        if (pit == idMap.end() || pit->second == b || pit->second->next) {
+            bad++;
+            continue;
         }
+        b->prev           = pit->second;
+        pit->second->next = b;
     }
 
+    // With one prev and one next per block, anything not reachable from a
+    // stack top is a closed loop; cut each loop open where it was entered.
+    std::unordered_set<Block*> reached;
+    for (Block* b : wsBlocks)
+        if (!b->prev)
+            for (Block* c = b; c; c = c->next) reached.insert(c);
+    for (Block* b : wsBlocks) {
+        if (reached.count(b)) continue;
+        b->prev->next = nullptr;
+        b->prev       = nullptr;
+        for (Block* c = b; c; c = c->next) reached.insert(c);
+        bad++;
+    }
+
+    if (skipped) *skipped = bad;
     return true;
 }
 
-#endif
+inline bool load_project(const std::string& path,
+                          std::vector<Block*>& wsBlocks,
+                          VariablesPanel& vars,
+                          int& nextId)
+{
+    std::ifstream f(path);
+    if (!f.is_open()) return false;
 
+    int skipped = 0;
+    load_project_stream(f, wsBlocks, vars, nextId, &skipped);
+    if (skipped)
+        std::cerr << "[Load] '" << path << "': skipped " << skipped << " malformed entries\n";
+    return true;
+}
+
+#endif
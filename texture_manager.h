@@ -0,0 +1,91 @@
+#ifndef SCRATCH_FOP_TEXTURE_MANAGER_H
+#define SCRATCH_FOP_TEXTURE_MANAGER_H
+
+#include <cstdlib>
+#include <unordered_map>
+#include <SDL2/SDL.h>
+
+// Every texture the app creates goes through here, so its size is known.
+// Totals are kept per kind for the debug overlay (F3). Costume textures are
+// the only evictable kind: asset_pump() drops the coldest ones whenever the
+// total goes over g_texBudget, and they are re-uploaded from their pixels
+// on next use. The budget comes from SCRATCH_TEXTURE_BUDGET_MB.
+
+enum TexKind {
+    TEX_COSTUME,
+    TEX_PEN,
+    TEX_EDITOR,
+    TEX_UI,
+    TEX_TEXT,
+    TEX_SCRATCH,
+    TEX_MINIMAP,
+    TEX_KIND_COUNT
+};
+
+static const char* TEX_KIND_NAMES[TEX_KIND_COUNT] = {
+    "costumes", "pen trail", "editor", "icons", "text", "readback", "minimap"
+};
+
+struct TexEntry {
+    TexKind kind;
+    size_t  bytes;
+};
+
+static std::unordered_map<SDL_Texture*, TexEntry> g_texEntries;
+static size_t g_texBytes[TEX_KIND_COUNT] = {};
+static int    g_texCount[TEX_KIND_COUNT] = {};
+static size_t g_texTotal     = 0;
+static size_t g_texPeak      = 0;
+static size_t g_texBudget    = (size_t)256 << 20;
+static Uint32 g_texEvictions = 0;
+static Uint32 g_texReuploads = 0;
+static bool   g_texOverlay   = false;
+
+inline void tex_init()
+{
+    if (const char* env = std::getenv("SCRATCH_TEXTURE_BUDGET_MB")) {
+        long mb = std::strtol(env, nullptr, 10);
+        if (mb > 0) g_texBudget = (size_t)mb << 20;
+    }
+}
+
+static SDL_Texture* tex_track(SDL_Texture* t, TexKind kind, int w, int h)
+{
+    if (!t) return nullptr;
+    size_t bytes = (size_t)w * h * 4;
+    g_texEntries[t] = {kind, bytes};
+    g_texBytes[kind] += bytes;
+    g_texCount[kind]++;
+    g_texTotal += bytes;
+    if (g_texTotal > g_texPeak) g_texPeak = g_texTotal;
+    return t;
+}
+
+inline SDL_Texture* tex_create(SDL_Renderer* r, TexKind kind, Uint32 format, int access,
+                               int w, int h)
+{
+    return tex_track(SDL_CreateTexture(r, format, access, w, h), kind, w, h);
+}
+
+inline SDL_Texture* tex_from_surface(SDL_Renderer* r, TexKind kind, SDL_Surface* s)
+{
+    if (!s) return nullptr;
+    return tex_track(SDL_CreateTextureFromSurface(r, s), kind, s->w, s->h);
+}
+
+inline void tex_destroy(SDL_Texture* t)
+{
+    if (!t) return;
+    auto it = g_texEntries.find(t);
+    if (it != g_texEntries.end()) {
+        g_texBytes[it->second.kind] -= it->second.bytes;
+        g_texCount[it->second.kind]--;
+        g_texTotal -= it->second.bytes;
+        g_texEntries.erase(it);
+    }
+    SDL_DestroyTexture(t);
+}
+
+inline bool tex_over_budget() { return g_texTotal > g_texBudget; }
+
+#endif
@@ -0,0 +1,414 @@
+#ifndef SCRATCH_FOP_UNDO_H
+#define SCRATCH_FOP_UNDO_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <SDL2/SDL.h>
+#include "structs.h"
+#include "block_pool.h"
+#include "utils.h"
+
+// Undo history for the code area. A command keeps, for each block an edit
+// touched, what the edit can change as it was before and after: position,
+// links, input values and reporters, where the block sits in the workspace
+// list and whether it is deleted. Undo writes the before states back and
+// redo the after states, so either costs what the edit did no matter how
+// big the workspace is.
+//
+// Deleted blocks are not freed while a command can still bring them back.
+// They are marked buried and leave the workspace list, and are freed when
+// their command falls off the end of the ring or a new edit throws it
+// away from the redo side.
+//
+// The handlers bracket an edit with undo_begin() and undo_commit() and
+// call undo_touch() on a block before changing it. A drag is one command
+// from mouse down to drop, however many motion events it spans, and a
+// command that starts within UNDO_COALESCE_MS of the previous one ending,
+// on the same block and of the same kind, is merged into it.
+
+static const int    UNDO_CAPACITY    = 128;
+static const Uint32 UNDO_COALESCE_MS = 600;
+
+enum UndoKind { UNDO_DRAG, UNDO_CREATE, UNDO_EDIT };
+
+struct UndoInputState {
+    BlockRef    embedded;
+    std::string value;
+
+    bool operator==(const UndoInputState& o) const {
+        return embedded.bits == o.embedded.bits && value == o.value;
+    }
+};
+
+struct UndoBlockState {
+    int      listIndex = -1;    // -1 when not in the workspace list
+    int      x = 0, y = 0;
+    BlockRef next, prev, innerFirst, innerLast, elseFirst;
+    bool     buried = false;
+    std::vector<UndoInputState> inputs;   // empty if the edit left them alone
+};
+
+struct UndoDelta {
+    BlockRef       block;
+    UndoBlockState before, after;
+};
+
+struct UndoCommand {
+    UndoKind kind  = UNDO_DRAG;
+    BlockRef key;
+    Uint32   begin = 0, end = 0;
+    std::vector<UndoDelta> deltas;
+};
+
+struct UndoHistory {
+    std::vector<UndoCommand> ring;
+    int  first = 0;     // ring index of the oldest command
+    int  count = 0;
+    int  done  = 0;     // commands applied; the rest can be redone
+    bool open  = false;
+    UndoCommand pending;
+    std::unordered_map<Uint32, size_t> touched;   // handle bits -> pending delta
+    std::vector<Block*>* blocks = nullptr;
+    // Where each block sat in the list as the pending command found it.
+    // Built on the first touch, so a click that changes nothing costs
+    // nothing; handlers touch a block before moving it in the list.
+    std::unordered_map<Block*, int> start;
+    bool indexed = false;
+};
+
+static UndoHistory g_undo;
+
+static UndoCommand& undo_at(int i)
+{
+    return g_undo.ring[(g_undo.first + i) % UNDO_CAPACITY];
+}
+
+static void undo_capture(Block* b, int listIndex, UndoBlockState& s)
+{
+    s.listIndex  = listIndex;
+    s.x          = b->x;
+    s.y          = b->y;
+    s.next       = b->next;
+    s.prev       = b->prev;
+    s.innerFirst = b->innerFirst;
+    s.innerLast  = b->innerLast;
+    s.elseFirst  = b->elseFirst;
+    s.buried     = b->buried;
+    s.inputs.resize(b->inputs.size());
+    for (size_t i = 0; i < b->inputs.size(); i++)
+        s.inputs[i] = {b->inputs[i].embeddedBlock, b->inputs[i].value};
+}
+
+static bool undo_same(const UndoBlockState& a, const UndoBlockState& b)
+{
+    return a.listIndex == b.listIndex && a.x == b.x && a.y == b.y &&
+           a.next.bits == b.next.bits && a.prev.bits == b.prev.bits &&
+           a.innerFirst.bits == b.innerFirst.bits && a.innerLast.bits == b.innerLast.bits &&
+           a.elseFirst.bits == b.elseFirst.bits && a.buried == b.buried &&
+           a.inputs == b.inputs;
+}
+
+static void undo_restore(Block* b, const UndoBlockState& s)
+{
+    b->x          = s.x;
+    b->y          = s.y;
+    b->next       = s.next;
+    b->prev       = s.prev;
+    b->innerFirst = s.innerFirst;
+    b->innerLast  = s.innerLast;
+    b->elseFirst  = s.elseFirst;
+    b->buried     = s.buried;
+    for (size_t i = 0; i < s.inputs.size() && i < b->inputs.size(); i++) {
+        b->inputs[i].embeddedBlock = s.inputs[i].embedded;
+        b->inputs[i].value         = s.inputs[i].value;
+    }
+}
+
+// Frees a block the history held on to, unless something freed it already
+// or it is back in the project.
+static void undo_release(BlockRef r)
+{
+    if (!block_ref_valid(r)) return;
+    Block* b = block_at(block_ref_pool(r), block_ref_slot(r));
+    if (b->buried) block_free(b);
+}
+
+void undo_commit(Block* key = nullptr);
+
+static int undo_start_index(Block* b)
+{
+    if (!g_undo.indexed) {
+        g_undo.indexed = true;
+        if (g_undo.blocks) {
+            g_undo.start.reserve(g_undo.blocks->size());
+            for (size_t i = 0; i < g_undo.blocks->size(); i++)
+                g_undo.start.emplace((*g_undo.blocks)[i], (int)i);
+        }
+    }
+    auto it = g_undo.start.find(b);
+    return it != g_undo.start.end() ? it->second : -1;
+}
+
+// search.h, journal.h
+void search_touch(Block* b);
+void journal_touch(Block* b);
+
+void undo_touch(Block* b)
+{
+    layout_touch(b);
+    search_touch(b);
+    journal_touch(b);
+    if (!g_undo.open || !b || g_undo.touched.count(b->self.bits)) return;
+    int idx = undo_start_index(b);
+    g_undo.touched[b->self.bits] = g_undo.pending.deltas.size();
+    g_undo.pending.deltas.emplace_back();
+    UndoDelta& d = g_undo.pending.deltas.back();
+    d.block = b;
+    undo_capture(b, idx, d.before);
+}
+
+// undo_touch() on each block.
+void undo_touch_all(const std::vector<Block*>& bs)
+{
+    for (Block* b : bs) undo_touch(b);
+}
+
+// A block this edit created, with the reporters it came with.
+void undo_born(Block* b)
+{
+    if (!g_undo.open || !b) return;
+    std::vector<Block*> all;
+    block_collect(b, all);
+    undo_touch_all(all);
+    for (Block* x : all) {
+        UndoBlockState& s = g_undo.pending.deltas[g_undo.touched[x->self.bits]].before;
+        s.listIndex = -1;
+        s.buried    = true;
+    }
+}
+
+// block_delete() that leaves the blocks for undo to restore.
+void undo_delete(Block* b, std::vector<Block*>& blocks)
+{
+    std::vector<Block*> doomed;
+    block_collect(b, doomed);
+    undo_touch_all(doomed);
+    if (!g_undo.open) { block_delete(b, blocks); return; }
+    std::unordered_set<Block*> gone(doomed.begin(), doomed.end());
+    blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                [&](Block* x) { return gone.count(x) != 0; }),
+                 blocks.end());
+    for (Block* d : doomed) d->buried = true;
+}
+
+// block_free_reporters() for a reporter an edit replaces.
+void undo_free_reporters(Block* b)
+{
+    std::vector<Block*> doomed;
+    block_collect(b, doomed);
+    undo_touch_all(doomed);
+    if (!g_undo.open) { block_free_reporters(b); return; }
+    for (Block* d : doomed) d->buried = true;
+}
+
+void undo_begin(std::vector<Block*>& blocks, UndoKind kind)
+{
+    if (g_undo.open) undo_commit();
+    g_undo.open   = true;
+    g_undo.blocks = &blocks;
+    g_undo.pending = UndoCommand{};
+    g_undo.pending.kind  = kind;
+    g_undo.pending.begin = SDL_GetTicks();
+    g_undo.touched.clear();
+}
+
+// Where an untouched block at `idx` on one side of a command ends up on the
+// other: take out the touched blocks, then put them in at their positions
+// on the far side, lowest first.
+static int undo_remap(int idx, const std::vector<UndoDelta>& ds, bool toAfter)
+{
+    int pos = idx;
+    std::vector<int> ins;
+    for (const UndoDelta& d : ds) {
+        const UndoBlockState& from = toAfter ? d.before : d.after;
+        const UndoBlockState& to   = toAfter ? d.after  : d.before;
+        if (from.listIndex >= 0 && from.listIndex < idx) pos--;
+        if (to.listIndex >= 0) ins.push_back(to.listIndex);
+    }
+    std::sort(ins.begin(), ins.end());
+    for (int p : ins)
+        if (p <= pos) pos++;
+    return pos;
+}
+
+static void undo_merge(UndoCommand& prev, UndoCommand& c)
+{
+    std::unordered_map<Uint32, size_t> inPrev;
+    for (size_t i = 0; i < prev.deltas.size(); i++) inPrev[prev.deltas[i].block.bits] = i;
+    std::unordered_set<Uint32> inNext;
+    for (const UndoDelta& d : c.deltas) inNext.insert(d.block.bits);
+
+    for (UndoDelta& d : prev.deltas)
+        if (!inNext.count(d.block.bits) && d.after.listIndex >= 0)
+            d.after.listIndex = undo_remap(d.after.listIndex, c.deltas, true);
+    for (UndoDelta& d : c.deltas) {
+        auto it = inPrev.find(d.block.bits);
+        if (it != inPrev.end()) {
+            UndoDelta& p = prev.deltas[it->second];
+            if (p.before.inputs.empty() != d.after.inputs.empty()) {
+                // One command dropped the inputs as unchanged, so they are
+                // what the other recorded on that side.
+                if (p.before.inputs.empty()) p.before.inputs = d.before.inputs;
+                else d.after.inputs = p.after.inputs;
+            }
+            p.after = d.after;
+            continue;
+        }
+        if (d.before.listIndex >= 0)
+            d.before.listIndex = undo_remap(d.before.listIndex, prev.deltas, false);
+        prev.deltas.push_back(std::move(d));
+    }
+    prev.end = c.end;
+}
+
+void undo_commit(Block* key)
+{
+    if (!g_undo.open) return;
+    g_undo.open = false;
+    UndoCommand c = std::move(g_undo.pending);
+    g_undo.pending = UndoCommand{};
+    c.key = key;
+    c.end = SDL_GetTicks();
+
+    std::vector<int> listIndex(c.deltas.size(), -1);
+    if (g_undo.blocks) {
+        for (size_t i = 0; i < g_undo.blocks->size(); i++) {
+            auto it = g_undo.touched.find((*g_undo.blocks)[i]->self.bits);
+            if (it != g_undo.touched.end()) listIndex[it->second] = (int)i;
+        }
+    }
+    g_undo.touched.clear();
+    if (g_undo.indexed) {
+        g_undo.start.clear();
+        g_undo.indexed = false;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < c.deltas.size(); i++) {
+        UndoDelta& d = c.deltas[i];
+        Block* b = block_at(block_ref_pool(d.block), block_ref_slot(d.block));
+        undo_capture(b, listIndex[i], d.after);
+        if (undo_same(d.before, d.after)) continue;
+        if (d.before.inputs == d.after.inputs) {
+            d.before.inputs.clear();
+            d.after.inputs.clear();
+        }
+        if (kept != i) c.deltas[kept] = std::move(d);
+        kept++;
+    }
+    c.deltas.resize(kept);
+    if (c.deltas.empty()) return;
+
+    // A new edit ends whatever could still be redone. Blocks those
+    // commands created are not in the project any more.
+    for (int i = g_undo.count - 1; i >= g_undo.done; i--) {
+        for (const UndoDelta& d : undo_at(i).deltas)
+            if (d.before.buried) undo_release(d.block);
+        undo_at(i) = UndoCommand{};
+    }
+    g_undo.count = g_undo.done;
+
+    if (g_undo.done > 0 && c.key.bits && c.kind != UNDO_CREATE) {
+        UndoCommand& prev = undo_at(g_undo.done - 1);
+        if (prev.kind == c.kind && prev.key.bits == c.key.bits &&
+            c.begin - prev.end < UNDO_COALESCE_MS) {
+            undo_merge(prev, c);
+            return;
+        }
+    }
+
+    if ((int)g_undo.ring.size() < UNDO_CAPACITY) g_undo.ring.resize(UNDO_CAPACITY);
+    if (g_undo.count == UNDO_CAPACITY) {
+        for (const UndoDelta& d : undo_at(0).deltas)
+            if (d.after.buried) undo_release(d.block);
+        undo_at(0) = UndoCommand{};
+        g_undo.first = (g_undo.first + 1) % UNDO_CAPACITY;
+        g_undo.count--;
+    }
+    undo_at(g_undo.count) = std::move(c);
+    g_undo.count++;
+    g_undo.done = g_undo.count;
+}
+
+static void undo_apply(UndoCommand& c, bool redo, std::vector<Block*>& blocks)
+{
+    std::unordered_set<Block*> moved;
+    std::vector<std::pair<int, Block*>> ins;
+    for (const UndoDelta& d : c.deltas) {
+        Block* b = d.block;
+        if (!b) continue;
+        const UndoBlockState& s = redo ? d.after : d.before;
+        undo_restore(b, s);
+        layout_touch(b);
+        search_touch(b);
+        journal_touch(b);
+        moved.insert(b);
+        if (s.listIndex >= 0) ins.push_back({s.listIndex, b});
+    }
+    blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                [&](Block* x) { return moved.count(x) != 0; }),
+                 blocks.end());
+    std::sort(ins.begin(), ins.end());
+
+    std::vector<Block*> out;
+    out.reserve(blocks.size() + ins.size());
+    size_t k = 0;
+    for (Block* b : blocks) {
+        while (k < ins.size() && ins[k].first <= (int)out.size()) out.push_back(ins[k++].second);
+        out.push_back(b);
+    }
+    while (k < ins.size()) out.push_back(ins[k++].second);
+    blocks.swap(out);
+}
+
+bool undo_step(std::vector<Block*>& blocks)
+{
+    undo_commit();
+    if (g_undo.done == 0) return false;
+    undo_apply(undo_at(g_undo.done - 1), false, blocks);
+    g_undo.done--;
+    return true;
+}
+
+bool redo_step(std::vector<Block*>& blocks)
+{
+    undo_commit();
+    if (g_undo.done == g_undo.count) return false;
+    undo_apply(undo_at(g_undo.done), true, blocks);
+    g_undo.done++;
+    return true;
+}
+
+// Forgets the history. With freeDead, the deleted blocks it was keeping
+// are freed; leave it off when the pool is about to be cleared anyway.
+void undo_clear(bool freeDead)
+{
+    if (freeDead) {
+        for (int i = 0; i < g_undo.count; i++)
+            for (const UndoDelta& d : undo_at(i).deltas) undo_release(d.block);
+        for (const UndoDelta& d : g_undo.pending.deltas) undo_release(d.block);
+    }
+    g_undo.ring.clear();
+    g_undo.first = g_undo.count = g_undo.done = 0;
+    g_undo.open  = false;
+    g_undo.pending = UndoCommand{};
+    g_undo.touched.clear();
+    g_undo.start.clear();
+    g_undo.indexed = false;
+}
+
+#include "search.h"
+
+#endif
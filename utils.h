@@ -11,6 +11,7 @@
 #include <algorithm>
 #include "structs.h"
 #include "globals.h"
+#include "block_pool.h"
 
 bool point_in_rect(int px, int py, int rx, int ry, int rw, int rh) {
     return px >= rx && px <= rx + rw && py >= ry && py <= ry + rh;
@@ -59,6 +60,33 @@ bool is_numeric_operator(const std::string& txt) {
          || txt.find("letter () of ()") != std::string::npos);
 }
 
+// Block sizes and input rects are cached and only recomputed when a block
+// changes. layout_touch() marks one block whose text or inputs changed;
+// layout_touch_all() marks every block at once by moving to a new epoch.
+// layout_moved() asks for a pass that only repositions, e.g. while a block
+// is dragged. Newly allocated blocks start dirty.
+static bool   g_layoutDirty = true;
+static Uint32 g_layoutEpoch = 1;
+static Uint32 g_layoutPass  = 0;
+
+inline void layout_touch(Block* b) {
+    if (b) b->layoutDirty = true;
+    g_layoutDirty = true;
+}
+
+inline void layout_touch_all() {
+    g_layoutEpoch++;
+    g_layoutDirty = true;
+}
+
+inline void layout_moved() {
+    g_layoutDirty = true;
+}
+
+inline bool layout_stale(const Block* b) {
+    return b->layoutDirty || b->layoutEpoch != g_layoutEpoch;
+}
+
 int embedded_block_width(Block* b);
 
 int compute_block_width(Block* b) {
@@ -102,6 +130,7 @@ int compute_block_width(Block* b) {
 
 int embedded_block_width(Block* b) {
     if (!b) return 30;
+    if (!layout_stale(b)) return b->contentW;
     return compute_block_width(b);
 }
 
@@ -133,6 +162,19 @@ std::string default_input_val(const std::string& txt, int inputIdx) {
     if (txt.find("change volume") != std::string::npos)       return "10";
     if (txt.find("change pitch") != std::string::npos)        return "10";
     if (txt.find("set pitch") != std::string::npos)           return "100";
+    if (txt.find("play drum") != std::string::npos) {
+        if (inputIdx == 0) return "1";
+        return "0.25";
+    }
+    if (txt.find("play note") != std::string::npos) {
+        if (inputIdx == 0) return "60";
+        return "0.25";
+    }
+    if (txt.find("rest for") != std::string::npos)            return "0.25";
+    if (txt.find("set instrument") != std::string::npos)      return "1";
+    if (txt.find("set tempo") != std::string::npos)           return "60";
+    if (txt.find("change tempo") != std::string::npos)        return "20";
+    if (txt.find("when loudness") != std::string::npos)       return "10";
     if (txt.find("pick random") != std::string::npos) {
         if (inputIdx == 0) return "1";
         return "10";
@@ -172,13 +214,14 @@ void init_block_inputs(Block* b) {
     b->innerH    = 40;
     b->elseH     = 40;
     b->w         = compute_block_width(b);
+    layout_touch(b);
 }
 
 Block* clone_block(Block* src);
 
 static Block* clone_embedded(Block* src) {
     if (!src) return nullptr;
-    Block* nb = new Block(*src);
+    Block* nb = block_copy(*src);
     nb->next = nullptr; nb->prev = nullptr;
     nb->innerFirst = nullptr; nb->innerLast = nullptr;
     nb->elseFirst = nullptr;
@@ -193,7 +236,7 @@ static Block* clone_embedded(Block* src) {
 }
 
 Block* clone_block(Block* src) {
-    Block* nb = new Block(*src);
+    Block* nb = block_copy(*src);
     nb->next       = nullptr;
     nb->prev       = nullptr;
     nb->innerFirst = nullptr;
@@ -221,6 +264,7 @@ bool block_matches_category(Block* b, CategoryType cat) {
         case CAT_VARIABLES: return b->type == BLOCK_VARIABLES;
         case CAT_MYBLOCKS:  return b->type == BLOCK_MYBLOCKS;
         case CAT_EXTENSION: return b->type == BLOCK_EXTENSION;
+        case CAT_MUSIC:     return b->type == BLOCK_MUSIC;
         default: return false;
     }
 }
@@ -364,9 +408,115 @@ void update_block_input_rects(Block* b) {
     }
 }
 
+// Re-measures b and the reporters in its inputs where they are stale,
+// bottom-up, so a reporter's width is computed once. Returns true if any
+// of them was re-measured.
+static bool layout_measure(Block* b) {
+    bool changed = false;
+    for (auto& inp : b->inputs)
+        if (inp.embeddedBlock && layout_measure(inp.embeddedBlock)) changed = true;
+    if (changed || layout_stale(b)) {
+        b->contentW    = compute_block_width(b);
+        b->layoutDirty = false;
+        b->layoutEpoch = g_layoutEpoch;
+        changed = true;
+    }
+    return changed;
+}
+
+static bool layout_block(Block* b);
+
+// spatial.h
+void spatial_place(Block* b);
+void spatial_order(Block* b, int order);
+
+// Stacks a C-block's bodies under it and sizes the mouths to fit.
+static bool layout_body(Block* cblock) {
+    bool changed = false;
+    int innerX = cblock->x + 16;
+    int innerY = c_inner_y(cblock) + 4;
+    int h = 0;
+    for (Block* b = cblock->innerFirst; b; b = b->next) {
+        b->x = innerX;
+        b->y = innerY;
+        if (layout_block(b)) changed = true;
+        h      += block_total_height(b);
+        innerY += block_total_height(b);
+    }
+    int innerH = std::max(40, h + 4);
+    if (innerH != cblock->innerH) { cblock->innerH = innerH; changed = true; }
+
+    if (cblock->hasElse) {
+        int elseY = c_else_y(cblock) + 4 + 20;
+        h = 0;
+        for (Block* b = cblock->elseFirst; b; b = b->next) {
+            b->x = innerX;
+            b->y = elseY;
+            if (layout_block(b)) changed = true;
+            h     += block_total_height(b);
+            elseY += block_total_height(b);
+        }
+        int elseH = std::max(40, h + 4);
+        if (elseH != cblock->elseH) { cblock->elseH = elseH; changed = true; }
+    }
+    return changed;
+}
+
+// Lays out a statement block whose position is already set. Input rects
+// are only rebuilt if the block moved or something in it changed. Returns
+// true if its size or contents changed, so the caller re-stacks.
+static bool layout_block(Block* b) {
+    b->layoutPass = g_layoutPass;
+    bool changed = layout_measure(b);
+    int w = std::max(BLOCK_W, b->contentW);
+    if (b->w != w) { b->w = w; changed = true; }
+    if (b->isCShaped && layout_body(b)) changed = true;
+    if (changed || b->x != b->layoutX || b->y != b->layoutY) {
+        update_block_input_rects(b);
+        spatial_place(b);
+        b->layoutX = b->x;
+        b->layoutY = b->y;
+    }
+    return changed;
+}
+
+// Runs only when something was touched or moved since the last pass.
+// Blocks inside a C-block are laid out by it, not as stacks of their own.
+void layout_workspace(std::vector<Block*>& blocks) {
+    if (!g_layoutDirty) return;
+    g_layoutDirty = false;
+    g_layoutPass++;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        spatial_order(blocks[i], (int)i);
+        if (blocks[i]->layoutPass == g_layoutPass) continue;
+        layout_block(blocks[i]);
+    }
+}
+
+struct PaletteLayoutKey {
+    int    category = -1, scroll = 0, x = 0, y = 0, w = 0;
+    size_t count    = 0;
+    Uint32 epoch    = 0;
+};
+static PaletteLayoutKey g_paletteLayoutKey;
+
 void layout_palette_blocks(std::vector<Block*>& paletteBlocks,
                             const Palette& palette)
 {
+    PaletteLayoutKey key;
+    key.category = palette.activeCategory;
+    key.scroll   = palette.scrollOffset;
+    key.x        = palette.blockListX;
+    key.y        = palette.blockListY;
+    key.w        = palette.blockListW;
+    key.count    = paletteBlocks.size();
+    key.epoch    = g_layoutEpoch;
+    const PaletteLayoutKey& old = g_paletteLayoutKey;
+    if (key.category == old.category && key.scroll == old.scroll && key.x == old.x &&
+        key.y == old.y && key.w == old.w && key.count == old.count && key.epoch == old.epoch)
+        return;
+    g_paletteLayoutKey = key;
+
     int hdrH = (palette.activeCategory == CAT_VARIABLES ||
                 palette.activeCategory == CAT_MYBLOCKS) ? 88 : 44;
 
@@ -385,8 +535,10 @@ void layout_palette_blocks(std::vector<Block*>& paletteBlocks,
         }
         b->x = x;
         b->y = y;
-        b->w = std::max(bw, compute_block_width(b));
         b->h = BLOCK_H;
+        layout_measure(b);
+        b->w = std::max(BLOCK_W, b->contentW);
+        update_block_input_rects(b);
         y += BLOCK_H + 6;
     }
 }
@@ -420,4 +572,6 @@ void handle_scroll_value(SDL_Event& e, int& scrollOffset) {
     if (scrollOffset > 0) scrollOffset = 0;
 }
 
+#include "spatial.h"
+
 #endif
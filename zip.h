@@ -0,0 +1,886 @@
+#ifndef SCRATCH_FOP_ZIP_H
+#define SCRATCH_FOP_ZIP_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <SDL2/SDL.h>
+
+// Minimal zip archive support: central directory reader and writer with
+// stored and deflate (RFC 1951) entries. Enough for .sb3 files; no zip64,
+// no crypto.
+
+static const Uint32 ZIP_SIG_LOCAL   = 0x04034b50;
+static const Uint32 ZIP_SIG_CENTRAL = 0x02014b50;
+static const Uint32 ZIP_SIG_END     = 0x06054b50;
+static const Uint16 ZIP_STORED      = 0;
+static const Uint16 ZIP_DEFLATE     = 8;
+
+// Deflate cannot expand by more than 1032:1, so a central directory that
+// claims more than that (or more than the per-entry cap) is not trusted.
+static const Uint32 ZIP_MAX_ENTRY   = 256u << 20;
+
+struct ZipEntry {
+    std::string name;
+    Uint16 method     = 0;
+    Uint32 crc        = 0;
+    Uint32 compSize   = 0;
+    Uint32 size       = 0;
+    Uint32 localOffset = 0;
+};
+
+struct ZipArchive {
+    const Uint8* data = nullptr;
+    size_t       size = 0;
+    std::vector<ZipEntry> entries;
+};
+
+static inline Uint16 zip_u16(const Uint8* p) { return (Uint16)(p[0] | p[1] << 8); }
+static inline Uint32 zip_u32(const Uint8* p)
+{
+    return (Uint32)p[0] | (Uint32)p[1] << 8 | (Uint32)p[2] << 16 | (Uint32)p[3] << 24;
+}
+
+static Uint32 g_zipCrcTable[8][256];
+static bool   g_zipReady = false;
+
+static void zip_crc_tables()
+{
+    for (Uint32 i = 0; i < 256; i++) {
+        Uint32 c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        g_zipCrcTable[0][i] = c;
+    }
+    for (Uint32 i = 0; i < 256; i++)
+        for (int t = 1; t < 8; t++)
+            g_zipCrcTable[t][i] = (g_zipCrcTable[t - 1][i] >> 8) ^
+                                  g_zipCrcTable[0][g_zipCrcTable[t - 1][i] & 0xFF];
+}
+
+// Slicing-by-8 CRC-32; zip_init must have run first.
+inline Uint32 zip_crc32(Uint32 crc, const Uint8* p, size_t n)
+{
+    crc = ~crc;
+    while (n >= 8) {
+        Uint32 a = crc ^ zip_u32(p);
+        Uint32 b = zip_u32(p + 4);
+        crc = g_zipCrcTable[7][a & 0xFF]         ^ g_zipCrcTable[6][(a >> 8) & 0xFF] ^
+              g_zipCrcTable[5][(a >> 16) & 0xFF] ^ g_zipCrcTable[4][a >> 24] ^
+              g_zipCrcTable[3][b & 0xFF]         ^ g_zipCrcTable[2][(b >> 8) & 0xFF] ^
+              g_zipCrcTable[1][(b >> 16) & 0xFF] ^ g_zipCrcTable[0][b >> 24];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) crc = g_zipCrcTable[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// ── Inflate ──────────────────────────────────────────────────
+
+static const int ZIP_FAST_BITS = 9;
+
+// Canonical Huffman table. fast[] resolves codes up to ZIP_FAST_BITS long
+// in one lookup (entry = length << 9 | symbol); longer codes fall back to
+// the count/symbol walk.
+struct ZipHuffman {
+    Uint16 fast[1 << ZIP_FAST_BITS];
+    Uint16 count[16];
+    Uint16 symbol[288];
+};
+
+struct ZipInflater {
+    const Uint8* in    = nullptr;
+    size_t       inLen = 0;
+    size_t       inPos = 0;
+    Uint64       bits  = 0;
+    int          nbits = 0;
+    size_t       overrun = 0;
+    Uint8*       out    = nullptr;
+    size_t       outLen = 0;
+    size_t       outPos = 0;
+};
+
+static inline void zip_refill(ZipInflater& z)
+{
+    while (z.nbits <= 56) {
+        Uint64 byte = 0;
+        if (z.inPos < z.inLen) byte = z.in[z.inPos++];
+        else z.overrun++;
+        z.bits  |= byte << z.nbits;
+        z.nbits += 8;
+    }
+}
+
+static inline Uint32 zip_bits(ZipInflater& z, int n)
+{
+    if (z.nbits < n) zip_refill(z);
+    Uint32 v = (Uint32)(z.bits & ((1ull << n) - 1));
+    z.bits  >>= n;
+    z.nbits  -= n;
+    return v;
+}
+
+static bool zip_build_huffman(ZipHuffman& h, const Uint8* lengths, int n)
+{
+    std::memset(h.count, 0, sizeof(h.count));
+    std::memset(h.fast, 0, sizeof(h.fast));
+    for (int i = 0; i < n; i++) h.count[lengths[i]]++;
+    h.count[0] = 0;
+
+    int left = 1;
+    for (int len = 1; len < 16; len++) {
+        left <<= 1;
+        left -= h.count[len];
+        if (left < 0) return false;
+    }
+
+    Uint16 offs[16];
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++) offs[len + 1] = offs[len] + h.count[len];
+    for (int i = 0; i < n; i++)
+        if (lengths[i]) h.symbol[offs[lengths[i]]++] = (Uint16)i;
+
+    // Codes are assigned MSB-first but read LSB-first, so the fast table is
+    // indexed by the bit-reversed code.
+    Uint32 code = 0;
+    int    k    = 0;
+    for (int len = 1; len <= ZIP_FAST_BITS; len++) {
+        for (int c = 0; c < h.count[len]; c++, k++, code++) {
+            Uint32 rev = 0;
+            for (int b = 0; b < len; b++) rev |= ((code >> b) & 1) << (len - 1 - b);
+            for (Uint32 f = rev; f < (1u << ZIP_FAST_BITS); f += 1u << len)
+                h.fast[f] = (Uint16)(len << 9 | h.symbol[k]);
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+static inline int zip_decode(ZipInflater& z, const ZipHuffman& h)
+{
+    if (z.nbits < 15) zip_refill(z);
+    Uint16 e = h.fast[z.bits & ((1u << ZIP_FAST_BITS) - 1)];
+    if (e) {
+        int len = e >> 9;
+        z.bits  >>= len;
+        z.nbits  -= len;
+        return e & 0x1FF;
+    }
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+        code |= (int)(z.bits & 1);
+        z.bits >>= 1;
+        z.nbits--;
+        int count = h.count[len];
+        if (code - count < first) return h.symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code  <<= 1;
+    }
+    return -1;
+}
+
+static const Uint16 ZIP_LEN_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const Uint8 ZIP_LEN_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const Uint16 ZIP_DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577 };
+static const Uint8 ZIP_DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static ZipHuffman g_zipFixedLit, g_zipFixedDist;
+
+static bool zip_inflate_codes(ZipInflater& z, const ZipHuffman& lit, const ZipHuffman& dist)
+{
+    for (;;) {
+        int sym = zip_decode(z, lit);
+        if (sym < 0 || z.overrun > 8) return false;
+        if (sym < 256) {
+            if (z.outPos >= z.outLen) return false;
+            z.out[z.outPos++] = (Uint8)sym;
+            continue;
+        }
+        if (sym == 256) return true;
+        sym -= 257;
+        if (sym >= 29) return false;
+        size_t len = ZIP_LEN_BASE[sym] + zip_bits(z, ZIP_LEN_EXTRA[sym]);
+        int ds = zip_decode(z, dist);
+        if (ds < 0 || ds >= 30) return false;
+        size_t d = ZIP_DIST_BASE[ds] + zip_bits(z, ZIP_DIST_EXTRA[ds]);
+        if (d > z.outPos || len > z.outLen - z.outPos) return false;
+        Uint8*       dst = z.out + z.outPos;
+        const Uint8* src = dst - d;
+        if (d >= len) std::memcpy(dst, src, len);
+        else for (size_t i = 0; i < len; i++) dst[i] = src[i];
+        z.outPos += len;
+    }
+}
+
+static bool zip_inflate_stored(ZipInflater& z)
+{
+    // Drop to the byte boundary and return whole buffered bytes to the input.
+    z.bits >>= z.nbits & 7;
+    z.nbits -= z.nbits & 7;
+    Uint32 len  = zip_bits(z, 16);
+    Uint32 nlen = zip_bits(z, 16);
+    if ((len ^ 0xFFFF) != nlen) return false;
+    size_t buffered = (size_t)(z.nbits / 8);
+    if (z.overrun > buffered) return false;
+    z.inPos  -= buffered - z.overrun;
+    z.overrun = 0;
+    z.bits    = 0;
+    z.nbits   = 0;
+    if (len > z.inLen - z.inPos || len > z.outLen - z.outPos) return false;
+    std::memcpy(z.out + z.outPos, z.in + z.inPos, len);
+    z.inPos  += len;
+    z.outPos += len;
+    return true;
+}
+
+static bool zip_inflate_dynamic(ZipInflater& z, ZipHuffman& lit, ZipHuffman& dist)
+{
+    static const Uint8 order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    int nlen  = (int)zip_bits(z, 5) + 257;
+    int ndist = (int)zip_bits(z, 5) + 1;
+    int ncode = (int)zip_bits(z, 4) + 4;
+    if (nlen > 286 || ndist > 30) return false;
+
+    Uint8 lengths[320] = {};
+    for (int i = 0; i < ncode; i++) lengths[order[i]] = (Uint8)zip_bits(z, 3);
+    ZipHuffman codes;
+    if (!zip_build_huffman(codes, lengths, 19)) return false;
+
+    std::memset(lengths, 0, sizeof(lengths));
+    int i = 0;
+    while (i < nlen + ndist) {
+        int sym = zip_decode(z, codes);
+        if (sym < 0 || z.overrun > 8) return false;
+        if (sym < 16) { lengths[i++] = (Uint8)sym; continue; }
+        Uint8 rep = 0;
+        int   n;
+        if (sym == 16) {
+            if (i == 0) return false;
+            rep = lengths[i - 1];
+            n   = 3 + (int)zip_bits(z, 2);
+        } else if (sym == 17) {
+            n = 3 + (int)zip_bits(z, 3);
+        } else {
+            n = 11 + (int)zip_bits(z, 7);
+        }
+        if (i + n > nlen + ndist) return false;
+        while (n--) lengths[i++] = rep;
+    }
+    if (lengths[256] == 0) return false;
+    return zip_build_huffman(lit, lengths, nlen) &&
+           zip_build_huffman(dist, lengths + nlen, ndist);
+}
+
+// Inflates a raw deflate stream into exactly outLen bytes.
+inline bool zip_inflate(const Uint8* in, size_t inLen, Uint8* out, size_t outLen)
+{
+    ZipInflater z;
+    z.in = in; z.inLen = inLen; z.out = out; z.outLen = outLen;
+    ZipHuffman lit, dist;
+    int last;
+    do {
+        last = (int)zip_bits(z, 1);
+        int type = (int)zip_bits(z, 2);
+        bool ok = false;
+        if (type == 0)      ok = zip_inflate_stored(z);
+        else if (type == 1) ok = zip_inflate_codes(z, g_zipFixedLit, g_zipFixedDist);
+        else if (type == 2) ok = zip_inflate_dynamic(z, lit, dist) &&
+                                 zip_inflate_codes(z, lit, dist);
+        if (!ok || z.overrun > 8) return false;
+    } while (!last);
+    return z.outPos == outLen;
+}
+
+// ── Deflate ──────────────────────────────────────────────────
+
+static const int    ZIP_WINDOW     = 32768;
+static const int    ZIP_HASH_BITS  = 15;
+static const int    ZIP_MAX_MATCH  = 258;
+static const size_t ZIP_BLOCK_SYMS = 16384;
+static const size_t ZIP_SINK_BYTES = 1 << 16;
+
+static Uint8 g_zipLenCode[ZIP_MAX_MATCH + 1];
+static Uint8 g_zipDistCode[512];
+
+static void zip_code_tables()
+{
+    for (int c = 0; c < 29; c++)
+        for (int l = ZIP_LEN_BASE[c]; l < ZIP_LEN_BASE[c] + (1 << ZIP_LEN_EXTRA[c]) && l <= ZIP_MAX_MATCH; l++)
+            g_zipLenCode[l] = (Uint8)c;
+    g_zipLenCode[ZIP_MAX_MATCH] = 28;
+    for (int c = 0; c < 30; c++)
+        for (int d = ZIP_DIST_BASE[c] - 1; d < ZIP_DIST_BASE[c] - 1 + (1 << ZIP_DIST_EXTRA[c]); d++)
+            g_zipDistCode[d < 256 ? d : 256 + (d >> 7)] = (Uint8)c;
+}
+
+static inline int zip_dist_code(int dist)
+{
+    int d = dist - 1;
+    return g_zipDistCode[d < 256 ? d : 256 + (d >> 7)];
+}
+
+// Builds the CRC, fixed Huffman and length/distance code tables. Call once
+// on the main thread before any worker inflates or deflates.
+inline void zip_init()
+{
+    if (g_zipReady) return;
+    zip_crc_tables();
+    zip_code_tables();
+    Uint8 l[288];
+    int i = 0;
+    for (; i < 144; i++) l[i] = 8;
+    for (; i < 256; i++) l[i] = 9;
+    for (; i < 280; i++) l[i] = 7;
+    for (; i < 288; i++) l[i] = 8;
+    zip_build_huffman(g_zipFixedLit, l, 288);
+    for (i = 0; i < 30; i++) l[i] = 5;
+    zip_build_huffman(g_zipFixedDist, l, 30);
+    g_zipReady = true;
+}
+
+// dist == 0 marks a literal byte in `litlen`, otherwise a match length.
+struct ZipToken {
+    Uint16 litlen;
+    Uint16 dist;
+};
+
+struct ZipDeflater {
+    std::function<bool(const Uint8*, size_t)> sink;
+    std::vector<Uint8> buf;
+    Uint64 bits  = 0;
+    int    nbits = 0;
+    Uint64 total = 0;
+    bool   ok    = true;
+};
+
+static void zip_put(ZipDeflater& z, Uint32 v, int n)
+{
+    z.bits  |= (Uint64)v << z.nbits;
+    z.nbits += n;
+    while (z.nbits >= 8) {
+        z.buf.push_back((Uint8)z.bits);
+        z.bits  >>= 8;
+        z.nbits  -= 8;
+    }
+    if (z.buf.size() >= ZIP_SINK_BYTES) {
+        z.ok = z.ok && z.sink(z.buf.data(), z.buf.size());
+        z.total += z.buf.size();
+        z.buf.clear();
+    }
+}
+
+static void zip_put_align(ZipDeflater& z)
+{
+    if (z.nbits & 7) zip_put(z, 0, 8 - (z.nbits & 7));
+}
+
+// Huffman code lengths for `freq`, at most `limit` bits. Over-long trees are
+// flattened by halving the frequencies and rebuilding, which costs a little
+// ratio in rare cases but keeps the builder tiny and deterministic.
+static void zip_code_lengths(const Uint32* freq, int n, int limit, Uint8* lengths)
+{
+    std::vector<Uint32> f(freq, freq + n);
+    int used = 0;
+    for (int i = 0; i < n; i++) used += f[i] != 0;
+    for (int i = 0; used < 2 && i < n; i++)
+        if (!f[i]) { f[i] = 1; used++; }
+
+    std::vector<int>    leaves;
+    std::vector<Uint32> weight(2 * n);
+    std::vector<int>    parent(2 * n), depth(2 * n);
+    for (;;) {
+        leaves.clear();
+        for (int i = 0; i < n; i++) if (f[i]) leaves.push_back(i);
+        std::stable_sort(leaves.begin(), leaves.end(),
+                         [&](int a, int b) { return f[a] < f[b]; });
+        for (int i = 0; i < n; i++) weight[i] = f[i];
+
+        // Two-queue merge: leaves by weight, internal nodes in creation order.
+        size_t li = 0;
+        int    ni = n, next = n;
+        auto pop = [&]() {
+            if (li < leaves.size() && (ni == next || weight[leaves[li]] <= weight[ni]))
+                return leaves[li++];
+            return ni++;
+        };
+        for (size_t k = 1; k < leaves.size(); k++) {
+            int a = pop(), b = pop();
+            weight[next] = weight[a] + weight[b];
+            parent[a] = parent[b] = next;
+            next++;
+        }
+        int root = next - 1, maxLen = 0;
+        depth[root] = 0;
+        for (int i = root - 1; i >= n; i--) depth[i] = depth[parent[i]] + 1;
+        for (int i = 0; i < n; i++) {
+            lengths[i] = f[i] ? (Uint8)(depth[parent[i]] + 1) : 0;
+            maxLen = std::max(maxLen, (int)lengths[i]);
+        }
+        if (maxLen <= limit) return;
+        for (auto& x : f) if (x) x = (x >> 1) | 1;
+    }
+}
+
+static void zip_canonical_codes(const Uint8* lengths, int n, Uint16* codes)
+{
+    Uint16 count[16] = {}, next[16] = {};
+    for (int i = 0; i < n; i++) count[lengths[i]]++;
+    count[0] = 0;
+    for (int len = 1; len < 16; len++) next[len] = (Uint16)((next[len - 1] + count[len - 1]) << 1);
+    for (int i = 0; i < n; i++) {
+        int len = lengths[i];
+        if (!len) continue;
+        Uint16 code = next[len]++, rev = 0;
+        for (int b = 0; b < len; b++) rev |= ((code >> b) & 1) << (len - 1 - b);
+        codes[i] = rev;
+    }
+}
+
+static void zip_emit_stored(ZipDeflater& z, const Uint8* raw, size_t n, bool last)
+{
+    do {
+        size_t chunk = std::min<size_t>(n, 65535);
+        n -= chunk;
+        zip_put(z, last && n == 0, 1);
+        zip_put(z, 0, 2);
+        zip_put_align(z);
+        zip_put(z, (Uint32)chunk, 16);
+        zip_put(z, (Uint32)chunk ^ 0xFFFF, 16);
+        for (size_t i = 0; i < chunk; i++) zip_put(z, raw[i], 8);
+        raw += chunk;
+    } while (n);
+}
+
+// Emits one block, choosing whichever of stored, fixed and dynamic Huffman
+// encodes these tokens in the fewest bits.
+static void zip_emit_block(ZipDeflater& z, const std::vector<ZipToken>& toks,
+                           const Uint8* raw, size_t rawLen, bool last)
+{
+    Uint32 lf[286] = {}, df[30] = {};
+    for (const auto& t : toks) {
+        if (!t.dist) { lf[t.litlen]++; continue; }
+        lf[257 + g_zipLenCode[t.litlen]]++;
+        df[zip_dist_code(t.dist)]++;
+    }
+    lf[256] = 1;
+
+    Uint8 ll[286], dl[30];
+    zip_code_lengths(lf, 286, 15, ll);
+    zip_code_lengths(df, 30, 15, dl);
+    int nlit = 286, ndist = 30;
+    while (nlit > 257 && !ll[nlit - 1]) nlit--;
+    while (ndist > 1 && !dl[ndist - 1]) ndist--;
+
+    // Run-length code the two length tables as one sequence.
+    Uint8 seq[316];
+    std::memcpy(seq, ll, nlit);
+    std::memcpy(seq + nlit, dl, ndist);
+    int nseq = nlit + ndist;
+    std::vector<Uint16> rle;
+    Uint32 cf[19] = {};
+    for (int i = 0; i < nseq; ) {
+        int run = 1;
+        while (i + run < nseq && seq[i + run] == seq[i]) run++;
+        int left = run;
+        if (seq[i] == 0) {
+            while (left >= 11) { int k = std::min(left, 138); rle.push_back((Uint16)(18 | (k - 11) << 5)); cf[18]++; left -= k; }
+            if (left >= 3)     { rle.push_back((Uint16)(17 | (left - 3) << 5)); cf[17]++; left = 0; }
+        } else {
+            rle.push_back(seq[i]); cf[seq[i]]++; left--;
+            while (left >= 3) { int k = std::min(left, 6); rle.push_back((Uint16)(16 | (k - 3) << 5)); cf[16]++; left -= k; }
+        }
+        while (left-- > 0) { rle.push_back(seq[i]); cf[seq[i]]++; }
+        i += run;
+    }
+    static const Uint8 order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    Uint8 cl[19];
+    zip_code_lengths(cf, 19, 7, cl);
+    int ncl = 19;
+    while (ncl > 4 && !cl[order[ncl - 1]]) ncl--;
+
+    Uint64 dynBits = 3 + 14 + 3 * (Uint64)ncl, fixBits = 3;
+    for (int s = 0; s < 19; s++) dynBits += (Uint64)cf[s] * cl[s];
+    dynBits += cf[16] * 2 + cf[17] * 3 + cf[18] * 7;
+    for (int s = 0; s < 286; s++) {
+        Uint64 extra = s > 256 ? ZIP_LEN_EXTRA[s - 257] : 0;
+        dynBits += lf[s] * (ll[s] + extra);
+        fixBits += lf[s] * ((s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8) + extra);
+    }
+    for (int s = 0; s < 30; s++) {
+        dynBits += df[s] * (dl[s] + ZIP_DIST_EXTRA[s]);
+        fixBits += df[s] * (5 + ZIP_DIST_EXTRA[s]);
+    }
+    Uint64 storedBits = ((Uint64)rawLen + 5 * (rawLen / 65535 + 1)) * 8 + 7;
+    if (storedBits <= dynBits && storedBits <= fixBits) {
+        zip_emit_stored(z, raw, rawLen, last);
+        return;
+    }
+
+    // The fixed code spans 288 symbols; 286 and 287 never occur but still
+    // take their place in the canonical ordering.
+    Uint16 lc[288] = {}, dc[30] = {};
+    Uint8  useLl[288] = {}, useDl[30];
+    bool dynamic = dynBits < fixBits;
+    if (dynamic) {
+        std::memcpy(useLl, ll, sizeof(ll));
+        std::memcpy(useDl, dl, sizeof(dl));
+    } else {
+        for (int s = 0; s < 288; s++) useLl[s] = s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8;
+        for (int s = 0; s < 30; s++)  useDl[s] = 5;
+    }
+    zip_canonical_codes(useLl, 288, lc);
+    zip_canonical_codes(useDl, 30, dc);
+
+    zip_put(z, last, 1);
+    zip_put(z, dynamic ? 2 : 1, 2);
+    if (dynamic) {
+        Uint16 cc[19] = {};
+        zip_canonical_codes(cl, 19, cc);
+        zip_put(z, nlit - 257, 5);
+        zip_put(z, ndist - 1, 5);
+        zip_put(z, ncl - 4, 4);
+        for (int i = 0; i < ncl; i++) zip_put(z, cl[order[i]], 3);
+        for (Uint16 r : rle) {
+            int s = r & 31;
+            zip_put(z, cc[s], cl[s]);
+            if (s == 16) zip_put(z, r >> 5, 2);
+            if (s == 17) zip_put(z, r >> 5, 3);
+            if (s == 18) zip_put(z, r >> 5, 7);
+        }
+    }
+    for (const auto& t : toks) {
+        if (!t.dist) { zip_put(z, lc[t.litlen], useLl[t.litlen]); continue; }
+        int c = g_zipLenCode[t.litlen];
+        zip_put(z, lc[257 + c], useLl[257 + c]);
+        zip_put(z, t.litlen - ZIP_LEN_BASE[c], ZIP_LEN_EXTRA[c]);
+        int d = zip_dist_code(t.dist);
+        zip_put(z, dc[d], useDl[d]);
+        zip_put(z, t.dist - ZIP_DIST_BASE[d], ZIP_DIST_EXTRA[d]);
+    }
+    zip_put(z, lc[256], useLl[256]);
+}
+
+static inline Uint32 zip_hash3(const Uint8* p)
+{
+    return ((Uint32)p[0] << 10 ^ (Uint32)p[1] << 5 ^ p[2]) & ((1u << ZIP_HASH_BITS) - 1);
+}
+
+// Raw deflate of `in`, handed to `sink` in chunks as blocks complete, so
+// the compressed form is never held in memory whole. Level 0 stores, 1-9
+// trade hash-chain depth (and lazy matching from 4 up) for ratio. Returns
+// false when the sink fails.
+inline bool zip_deflate(const Uint8* in, size_t n, int level,
+                        const std::function<bool(const Uint8*, size_t)>& sink,
+                        Uint64* outBytes = nullptr)
+{
+    ZipDeflater z;
+    z.sink = sink;
+    z.buf.reserve(ZIP_SINK_BYTES + 1024);
+
+    if (level <= 0) {
+        zip_emit_stored(z, in, n, true);
+    } else {
+        int maxChain = level >= 9 ? 1024 : level >= 6 ? 128 : level >= 4 ? 32 : 8;
+        bool lazy    = level >= 4;
+        std::vector<Sint32> head(1 << ZIP_HASH_BITS, -1), prev(ZIP_WINDOW, -1);
+        std::vector<ZipToken> toks;
+        toks.reserve(ZIP_BLOCK_SYMS + 2);
+
+        auto insert = [&](size_t p) {
+            if (p + 3 > n) return;
+            Uint32 h = zip_hash3(in + p);
+            prev[p & (ZIP_WINDOW - 1)] = head[h];
+            head[h] = (Sint32)p;
+        };
+        auto longest = [&](size_t p, int& dist) {
+            int best = 0;
+            if (p + 3 > n) return 0;
+            int limit = (int)std::min<size_t>(ZIP_MAX_MATCH, n - p);
+            Sint32 cand = head[zip_hash3(in + p)];
+            for (int chain = maxChain; cand >= 0 && chain--; ) {
+                size_t c = (size_t)cand;
+                if (c >= p || p - c > (size_t)ZIP_WINDOW) break;
+                if (in[c + best] == in[p + best]) {
+                    int len = 0;
+                    while (len < limit && in[c + len] == in[p + len]) len++;
+                    if (len > best) {
+                        best = len;
+                        dist = (int)(p - c);
+                        if (len == limit) break;
+                    }
+                }
+                Sint32 nx = prev[c & (ZIP_WINDOW - 1)];
+                if (nx >= cand) break;
+                cand = nx;
+            }
+            return best >= 3 ? best : 0;
+        };
+
+        size_t blockStart = 0, pos = 0;
+        while (pos < n) {
+            int dist = 0;
+            int len  = longest(pos, dist);
+            if (len && lazy && len < 32 && pos + 1 < n) {
+                int d2 = 0;
+                int l2 = longest(pos + 1, d2);
+                if (l2 > len) len = 0;
+            }
+            if (len) {
+                toks.push_back({(Uint16)len, (Uint16)dist});
+                for (int k = 0; k < len; k++) insert(pos + k);
+                pos += len;
+            } else {
+                toks.push_back({in[pos], 0});
+                insert(pos);
+                pos++;
+            }
+            if (toks.size() >= ZIP_BLOCK_SYMS) {
+                zip_emit_block(z, toks, in + blockStart, pos - blockStart, pos == n);
+                toks.clear();
+                blockStart = pos;
+            }
+        }
+        if (!toks.empty() || n == 0)
+            zip_emit_block(z, toks, in + blockStart, pos - blockStart, true);
+    }
+
+    zip_put_align(z);
+    if (!z.buf.empty()) {
+        z.ok = z.ok && z.sink(z.buf.data(), z.buf.size());
+        z.total += z.buf.size();
+    }
+    if (outBytes) *outBytes = z.total;
+    return z.ok;
+}
+
+// ── Archive ─────────────────────────────────────────────────
+
+inline bool zip_open(const Uint8* data, size_t size, ZipArchive& za)
+{
+    zip_init();
+    za.data = data;
+    za.size = size;
+    za.entries.clear();
+    if (size < 22) return false;
+
+    size_t end = size - 22, stop = size > 22 + 65535 ? size - 22 - 65535 : 0;
+    for (;; end--) {
+        if (zip_u32(data + end) == ZIP_SIG_END) break;
+        if (end == stop) return false;
+    }
+    Uint16 count   = zip_u16(data + end + 10);
+    Uint32 cdBytes = zip_u32(data + end + 12);
+    Uint32 cdOff   = zip_u32(data + end + 16);
+    if (cdOff > end || cdBytes > end - cdOff) return false;
+
+    za.entries.reserve(count);
+    const Uint8* p    = data + cdOff;
+    const Uint8* stopP = p + cdBytes;
+    for (Uint16 i = 0; i < count; i++) {
+        if (stopP - p < 46 || zip_u32(p) != ZIP_SIG_CENTRAL) return false;
+        Uint16 nameLen  = zip_u16(p + 28);
+        Uint16 extraLen = zip_u16(p + 30);
+        Uint16 noteLen  = zip_u16(p + 32);
+        if ((size_t)(stopP - p) < 46u + nameLen + extraLen + noteLen) return false;
+        ZipEntry e;
+        e.method      = zip_u16(p + 10);
+        e.crc         = zip_u32(p + 16);
+        e.compSize    = zip_u32(p + 20);
+        e.size        = zip_u32(p + 24);
+        e.localOffset = zip_u32(p + 42);
+        e.name.assign((const char*)p + 46, nameLen);
+        za.entries.push_back(std::move(e));
+        p += 46 + nameLen + extraLen + noteLen;
+    }
+    return true;
+}
+
+inline const ZipEntry* zip_find(const ZipArchive& za, const std::string& name)
+{
+    for (const auto& e : za.entries)
+        if (e.name == name) return &e;
+    return nullptr;
+}
+
+// Safe to call from several threads on the same archive.
+inline bool zip_extract(const ZipArchive& za, const ZipEntry& e, std::vector<Uint8>& out)
+{
+    size_t lo = e.localOffset;
+    if (lo > za.size || za.size - lo < 30 || zip_u32(za.data + lo) != ZIP_SIG_LOCAL)
+        return false;
+    size_t start = lo + 30 + zip_u16(za.data + lo + 26) + zip_u16(za.data + lo + 28);
+    if (start > za.size || e.compSize > za.size - start) return false;
+    const Uint8* src = za.data + start;
+    if (e.size > ZIP_MAX_ENTRY || e.size > (size_t)e.compSize * 1032 + 1024) {
+        std::cerr << "[Zip] '" << e.name << "' claims " << e.size << " bytes from "
+                  << e.compSize << "; not extracting\n";
+        return false;
+    }
+
+    out.resize(e.size);
+    bool ok = false;
+    if (e.method == ZIP_STORED) {
+        ok = e.compSize == e.size;
+        if (ok && e.size) std::memcpy(out.data(), src, e.size);
+    } else if (e.method == ZIP_DEFLATE) {
+        ok = zip_inflate(src, e.compSize, out.data(), e.size);
+    }
+    if (ok && zip_crc32(0, out.data(), out.size()) != e.crc) ok = false;
+    if (!ok) {
+        std::cerr << "[Zip] Cannot extract '" << e.name << "'\n";
+        out.clear();
+    }
+    return ok;
+}
+
+// ── Writer ──────────────────────────────────────────────────
+
+// Entries are written in the order added, with a fixed 1980-01-01 timestamp
+// and no extra fields, so identical input gives a byte-identical archive.
+struct ZipWriter {
+    FILE*  f      = nullptr;
+    Uint32 offset = 0;
+    bool   ok     = true;
+    std::vector<ZipEntry> entries;
+};
+
+static const Uint16 ZIP_DOS_DATE = (1 << 5) | 1;
+
+static void zip_le16(std::vector<Uint8>& v, Uint16 x)
+{
+    v.push_back((Uint8)x);
+    v.push_back((Uint8)(x >> 8));
+}
+
+static void zip_le32(std::vector<Uint8>& v, Uint32 x)
+{
+    zip_le16(v, (Uint16)x);
+    zip_le16(v, (Uint16)(x >> 16));
+}
+
+static bool zip_write(ZipWriter& w, const void* p, size_t n)
+{
+    if (w.ok && n && std::fwrite(p, 1, n, w.f) != n) w.ok = false;
+    w.offset += (Uint32)n;
+    return w.ok;
+}
+
+static void zip_write_local(ZipWriter& w, const ZipEntry& e)
+{
+    std::vector<Uint8> h;
+    zip_le32(h, ZIP_SIG_LOCAL);
+    zip_le16(h, 20);
+    zip_le16(h, 0);
+    zip_le16(h, e.method);
+    zip_le16(h, 0);
+    zip_le16(h, ZIP_DOS_DATE);
+    zip_le32(h, e.crc);
+    zip_le32(h, e.compSize);
+    zip_le32(h, e.size);
+    zip_le16(h, (Uint16)e.name.size());
+    zip_le16(h, 0);
+    h.insert(h.end(), e.name.begin(), e.name.end());
+    zip_write(w, h.data(), h.size());
+}
+
+// Adds an entry compressed elsewhere, e.g. deflated on a worker thread.
+inline bool zip_writer_add_raw(ZipWriter& w, const std::string& name, Uint16 method,
+                               Uint32 crc, Uint32 size, const Uint8* data, size_t compSize)
+{
+    ZipEntry e;
+    e.name        = name;
+    e.method      = method;
+    e.crc         = crc;
+    e.size        = size;
+    e.compSize    = (Uint32)compSize;
+    e.localOffset = w.offset;
+    zip_write_local(w, e);
+    zip_write(w, data, compSize);
+    w.entries.push_back(std::move(e));
+    return w.ok;
+}
+
+// Streams the deflate of `data` straight into the archive, then patches the
+// compressed size into the local header.
+inline bool zip_writer_add(ZipWriter& w, const std::string& name,
+                           const Uint8* data, size_t size, int level)
+{
+    if (level <= 0)
+        return zip_writer_add_raw(w, name, ZIP_STORED, zip_crc32(0, data, size),
+                                  (Uint32)size, data, size);
+    ZipEntry e;
+    e.name        = name;
+    e.method      = ZIP_DEFLATE;
+    e.crc         = zip_crc32(0, data, size);
+    e.size        = (Uint32)size;
+    e.localOffset = w.offset;
+    zip_write_local(w, e);
+
+    Uint64 comp = 0;
+    zip_deflate(data, size, level,
+                [&w](const Uint8* p, size_t n) { return zip_write(w, p, n); }, &comp);
+    e.compSize = (Uint32)comp;
+    if (w.ok) {
+        std::vector<Uint8> v;
+        zip_le32(v, e.compSize);
+        w.ok = std::fseek(w.f, (long)e.localOffset + 18, SEEK_SET) == 0 &&
+               std::fwrite(v.data(), 1, 4, w.f) == 4 &&
+               std::fseek(w.f, 0, SEEK_END) == 0;
+    }
+    w.entries.push_back(std::move(e));
+    return w.ok;
+}
+
+// Writes the central directory; the caller still owns and closes the file.
+inline bool zip_writer_finish(ZipWriter& w)
+{
+    std::vector<Uint8> cd;
+    for (const auto& e : w.entries) {
+        zip_le32(cd, ZIP_SIG_CENTRAL);
+        zip_le16(cd, 20);
+        zip_le16(cd, 20);
+        zip_le16(cd, 0);
+        zip_le16(cd, e.method);
+        zip_le16(cd, 0);
+        zip_le16(cd, ZIP_DOS_DATE);
+        zip_le32(cd, e.crc);
+        zip_le32(cd, e.compSize);
+        zip_le32(cd, e.size);
+        zip_le16(cd, (Uint16)e.name.size());
+        zip_le16(cd, 0);
+        zip_le16(cd, 0);
+        zip_le16(cd, 0);
+        zip_le16(cd, 0);
+        zip_le32(cd, 0);
+        zip_le32(cd, e.localOffset);
+        cd.insert(cd.end(), e.name.begin(), e.name.end());
+    }
+    Uint32 cdOffset = w.offset, cdBytes = (Uint32)cd.size();
+    zip_le32(cd, ZIP_SIG_END);
+    zip_le16(cd, 0);
+    zip_le16(cd, 0);
+    zip_le16(cd, (Uint16)w.entries.size());
+    zip_le16(cd, (Uint16)w.entries.size());
+    zip_le32(cd, cdBytes);
+    zip_le32(cd, cdOffset);
+    zip_le16(cd, 0);
+    return zip_write(w, cd.data(), cd.size());
+}
+
+#endif